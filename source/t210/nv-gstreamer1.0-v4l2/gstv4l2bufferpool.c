@@ -1351,8 +1351,44 @@ select_error:
   }
 }
 
+#ifdef USE_V4L2_TARGET_NV
+/* The encoder applies input metadata to the queued buffer whose index
+ * matches config_store, so it must be set right before VIDIOC_QBUF */
+static gboolean
+gst_v4l2_buffer_pool_set_input_metadata (GstV4l2BufferPool * pool,
+    guint32 index)
+{
+  v4l2_ctrl_videoenc_input_metadata *metadata = pool->obj->enc_input_metadata;
+  struct v4l2_ext_control control;
+  struct v4l2_ext_controls ctrls;
+
+  memset (&control, 0, sizeof (control));
+  memset (&ctrls, 0, sizeof (ctrls));
+
+  ctrls.count = 1;
+  ctrls.controls = &control;
+  ctrls.ctrl_class = V4L2_CTRL_CLASS_MPEG;
+
+  metadata->config_store = index;
+  if (metadata->flag & V4L2_ENC_INPUT_ROI_PARAM_FLAG)
+    metadata->VideoEncROIParams->config_store = index;
+
+  control.id = V4L2_CID_MPEG_VIDEOENC_INPUT_METADATA;
+  control.string = (gchar *) metadata;
+
+  if (pool->obj->ioctl (pool->video_fd, VIDIOC_S_EXT_CTRLS, &ctrls) < 0) {
+    GST_WARNING_OBJECT (pool, "could not set input metadata for buffer %u: %s",
+        index, g_strerror (errno));
+    return FALSE;
+  }
+
+  return TRUE;
+}
+#endif
+
 static GstFlowReturn
-gst_v4l2_buffer_pool_qbuf (GstV4l2BufferPool * pool, GstBuffer * buf)
+gst_v4l2_buffer_pool_qbuf (GstV4l2BufferPool * pool, GstBuffer * buf,
+    guint32 * frame_number)
 {
   GstV4l2MemoryGroup *group = NULL;
   const GstV4l2Object *obj = pool->obj;
@@ -1400,11 +1436,23 @@ gst_v4l2_buffer_pool_qbuf (GstV4l2BufferPool * pool, GstBuffer * buf)
     group->buffer.field = field;
   }
 
-  if (GST_BUFFER_TIMESTAMP_IS_VALID (buf)) {
+  if (frame_number) {
+    /* Drivers copy the timestamp of the output buffer to the capture buffer
+     * produced from it, which gives us the frame back without a search. The
+     * PTS is not queued then, it stays with the frame */
+    group->buffer.timestamp.tv_sec = *frame_number;
+    group->buffer.timestamp.tv_usec = 0;
+  } else if (GST_BUFFER_TIMESTAMP_IS_VALID (buf)) {
     timestamp = GST_BUFFER_TIMESTAMP (buf);
     GST_TIME_TO_TIMEVAL (timestamp, group->buffer.timestamp);
   }
 
+#ifdef USE_V4L2_TARGET_NV
+  /* A frame encoded without its parameters is still better than none */
+  if (obj->enc_input_metadata && V4L2_TYPE_IS_OUTPUT (obj->type))
+    gst_v4l2_buffer_pool_set_input_metadata (pool, index);
+#endif
+
   GST_OBJECT_LOCK (pool);
   g_atomic_int_inc (&pool->num_queued);
   pool->buffers[index] = buf;
@@ -1435,6 +1483,48 @@ queue_failed:
   }
 }
 
+#ifdef USE_V4L2_TARGET_NV
+/* Marks the slice which completes a frame with GST_BUFFER_FLAG_MARKER, the
+ * way RTP payloaders expect the end of an access unit in NAL alignment */
+static void
+gst_v4l2_buffer_pool_mark_slice (GstV4l2BufferPool * pool, GstBuffer * buf,
+    guint32 index)
+{
+  GstV4l2Object *obj = pool->obj;
+  v4l2_ctrl_videoenc_outputbuf_metadata enc_metadata;
+  v4l2_ctrl_video_metadata metadata;
+  struct v4l2_ext_control control;
+  struct v4l2_ext_controls ctrls;
+
+  memset (&enc_metadata, 0, sizeof (enc_metadata));
+  memset (&metadata, 0, sizeof (metadata));
+  memset (&control, 0, sizeof (control));
+  memset (&ctrls, 0, sizeof (ctrls));
+
+  ctrls.count = 1;
+  ctrls.controls = &control;
+  ctrls.ctrl_class = V4L2_CTRL_CLASS_MPEG;
+
+  metadata.buffer_index = index;
+  metadata.VideoEncMetadata = &enc_metadata;
+
+  control.id = V4L2_CID_MPEG_VIDEOENC_METADATA;
+  control.string = (gchar *) &metadata;
+
+  if (!obj->slice_end_unknown
+      && obj->ioctl (pool->video_fd, VIDIOC_G_EXT_CTRLS, &ctrls) < 0) {
+    GST_WARNING_OBJECT (pool, "no end of frame information, every slice "
+        "will be treated as a whole frame: %s", g_strerror (errno));
+    obj->slice_end_unknown = TRUE;
+  }
+
+  if (obj->slice_end_unknown || enc_metadata.EndofFrame)
+    GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_MARKER);
+  else
+    GST_BUFFER_FLAG_UNSET (buf, GST_BUFFER_FLAG_MARKER);
+}
+#endif
+
 static GstFlowReturn
 gst_v4l2_buffer_pool_dqbuf (GstV4l2BufferPool * pool, GstBuffer ** buffer)
 {
@@ -1503,6 +1593,9 @@ gst_v4l2_buffer_pool_dqbuf (GstV4l2BufferPool * pool, GstBuffer ** buffer)
         &dec_metadata);
     report_metadata (obj, group->buffer.index, &dec_metadata);
   }
+
+  if (obj->slice_output && obj->is_encode && !V4L2_TYPE_IS_OUTPUT (obj->type))
+    gst_v4l2_buffer_pool_mark_slice (pool, outbuf, group->buffer.index);
 #endif
   timestamp = GST_TIMEVAL_TO_TIME (group->buffer.timestamp);
 
@@ -1746,7 +1839,7 @@ gst_v4l2_buffer_pool_release_buffer (GstBufferPool * bpool, GstBuffer * buffer)
             /* queue back in the device */
             if (pool->other_pool)
               gst_v4l2_buffer_pool_prepare_buffer (pool, buffer, NULL);
-            if (gst_v4l2_buffer_pool_qbuf (pool, buffer) != GST_FLOW_OK)
+            if (gst_v4l2_buffer_pool_qbuf (pool, buffer, NULL) != GST_FLOW_OK)
               pclass->release_buffer (bpool, buffer);
           } else {
             /* Simply release invalide/modified buffer, the allocator will
@@ -2060,15 +2153,22 @@ cleanup:
  * gst_v4l2_buffer_pool_process:
  * @bpool: a #GstBufferPool
  * @buf: a #GstBuffer, maybe be replaced
+ * @frame_number: (allow-none): the system_frame_number of the codec frame
+ *   @buf belongs to
  *
  * Process @buf in @bpool. For capture devices, this functions fills @buf with
  * data from the device. For output devices, this functions send the contents of
  * @buf to the device for playback.
  *
+ * When @frame_number is given it is queued as the V4L2 timestamp in place of
+ * the PTS of @buf, and shows up as the timestamp of the capture buffer the
+ * device produces from it, in seconds. The device then does not get the PTS.
+ *
  * Returns: %GST_FLOW_OK on success.
  */
 GstFlowReturn
-gst_v4l2_buffer_pool_process (GstV4l2BufferPool * pool, GstBuffer ** buf)
+gst_v4l2_buffer_pool_process (GstV4l2BufferPool * pool, GstBuffer ** buf,
+    guint32 * frame_number)
 {
   GstFlowReturn ret = GST_FLOW_OK;
   GstBufferPool *bpool = GST_BUFFER_POOL_CAST (pool);
@@ -2294,7 +2394,8 @@ gst_v4l2_buffer_pool_process (GstV4l2BufferPool * pool, GstBuffer ** buf)
             }
           }
 
-          if ((ret = gst_v4l2_buffer_pool_qbuf (pool, to_queue)) != GST_FLOW_OK)
+          if ((ret = gst_v4l2_buffer_pool_qbuf (pool, to_queue,
+                      frame_number)) != GST_FLOW_OK)
             goto queue_failed;
 
           /* if we are not streaming yet (this is the first buffer, start
@@ -174,6 +174,7 @@ gst_v4l2_h264_enc_set_property (GObject * object,
         video_enc->slice_output = TRUE;
       else
         video_enc->slice_output = FALSE;
+      video_enc->v4l2capture->slice_output = video_enc->slice_output;
       break;
     case PROP_SLICE_INTRA_REFRESH_INTERVAL:
       self->SliceIntraRefreshInterval = g_value_get_uint (value);
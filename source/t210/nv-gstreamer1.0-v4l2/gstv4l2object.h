@@ -226,6 +226,11 @@ struct _GstV4l2Object {
   gboolean capture_plane_stopped;
   GCond cplane_stopped_cond;
   GMutex cplane_stopped_lock;
+  /* per-frame encoder parameters for the next buffer queued on this plane */
+  v4l2_ctrl_videoenc_input_metadata *enc_input_metadata;
+  /* the encoder outputs one buffer per slice, flag the last one of a frame */
+  gboolean slice_output;
+  gboolean slice_end_unknown;
 #endif
 
   /* funcs */
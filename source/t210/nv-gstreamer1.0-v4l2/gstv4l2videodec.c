@@ -29,6 +29,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <string.h>
+#include <poll.h>
 #include "gstv4l2object.h"
 #include "gstv4l2videodec.h"
 #include "stdlib.h"
@@ -77,12 +78,9 @@ static void buffer_identification_free (BufferIdentification * id)
 }
 
 #ifdef USE_V4L2_TARGET_NV
-GstVideoCodecFrame *
-gst_v4l2_video_dec_find_nearest_frame (GstBuffer * buf, GList * frames);
-
 static void
 gst_v4l2_video_dec_clean_older_frames (GstV4l2VideoDec * self,
-    GstBuffer * buf, GList * frames);
+    GstVideoCodecFrame * frame);
 
 #endif
 
@@ -695,6 +693,7 @@ gst_v4l2_video_dec_start (GstVideoDecoder * decoder)
   gst_v4l2_object_unlock (self->v4l2output);
   g_atomic_int_set (&self->active, TRUE);
   self->output_flow = GST_FLOW_OK;
+  self->first_frame_time = GST_CLOCK_TIME_NONE;
 #if USE_V4L2_TARGET_NV
   self->decoded_picture_cnt = 0;
 #endif
@@ -1050,7 +1049,7 @@ gst_v4l2_video_dec_finish (GstVideoDecoder * decoder)
       buffer = gst_buffer_new ();
       ret =
           gst_v4l2_buffer_pool_process (GST_V4L2_BUFFER_POOL (self->
-              v4l2output->pool), &buffer);
+              v4l2output->pool), &buffer, NULL);
       gst_buffer_unref (buffer);
     }
   }
@@ -1094,88 +1093,55 @@ gst_v4l2_video_dec_drain (GstVideoDecoder * decoder)
 }
 
 #ifdef USE_V4L2_TARGET_NV
-GstVideoCodecFrame *
-gst_v4l2_video_dec_find_nearest_frame (GstBuffer * buf, GList * frames)
-{
-  GstVideoCodecFrame *best = NULL;
-  GstClockTimeDiff best_diff = G_MAXINT64;
-  GstClockTime timestamp;
-  GList *l;
-
-  timestamp = buf->pts;
-
-  for (l = frames; l; l = l->next) {
-    GstVideoCodecFrame *tmp = l->data;
-    GstClockTimeDiff diff = ABS (GST_CLOCK_DIFF (timestamp, tmp->pts));
-
-    if (diff < best_diff) {
-      best = tmp;
-      best_diff = diff;
-
-      if (diff == 0)
-        break;
-    }
-  }
-
-  if (best)
-    gst_video_codec_frame_ref (best);
-
-  g_list_foreach (frames, (GFunc) gst_video_codec_frame_unref, NULL);
-  g_list_free (frames);
-
-  return best;
-}
-
-
 static void
 gst_v4l2_video_dec_clean_older_frames (GstV4l2VideoDec * self,
-    GstBuffer * buf, GList * frames)
+    GstVideoCodecFrame * frame)
 {
-  GList *l;
-  GstClockTime timestamp;
-
-  timestamp = buf->pts;
-
-  if (GST_CLOCK_TIME_IS_VALID (timestamp)) {
-    /* We could release all frames stored with pts < timestamp since the
-     * decoder will likely output frames in display order */
-    for (l = frames; l; l = l->next) {
-      GstVideoCodecFrame *tmp = l->data;
+  GstVideoDecoder *decoder = GST_VIDEO_DECODER (self);
+  GstClockTime timestamp = frame->pts;
+  GstVideoCodecFrame *tmp;
+  gboolean ghost;
+
+  /* Only the head of the pending list is looked at, so that this stays O(1)
+   * per output buffer. The list is in decoding order, a ghost frame queued
+   * behind a frame which is still to be output goes once that frame does. */
+  while ((tmp = gst_video_decoder_get_oldest_frame (decoder))) {
+    if (tmp == frame) {
+      gst_video_codec_frame_unref (tmp);
+      break;
+    }
 
-      if (tmp->pts < timestamp) {
+    if (GST_CLOCK_TIME_IS_VALID (timestamp)) {
+      /* We could release all frames stored with pts < timestamp since the
+       * decoder will likely output frames in display order */
+      ghost = tmp->pts < timestamp;
+      if (ghost)
         GST_LOG_OBJECT (self,
             "discarding ghost frame %p (#%d) PTS:%" GST_TIME_FORMAT " DTS:%"
             GST_TIME_FORMAT, tmp, tmp->system_frame_number,
             GST_TIME_ARGS (tmp->pts), GST_TIME_ARGS (tmp->dts));
-        gst_video_decoder_release_frame (GST_VIDEO_DECODER (self), tmp);
-      } else {
-        gst_video_codec_frame_unref (tmp);
-      }
-    }
-  } else {
-    /* We will release all frames with invalid timestamp because we don't even
-     * know if they will be output some day. */
-    for (l = frames; l; l = l->next) {
-      GstVideoCodecFrame *tmp = l->data;
-
-      if (!GST_CLOCK_TIME_IS_VALID (tmp->pts)) {
+    } else {
+      /* We will release all frames with invalid timestamp because we don't
+       * even know if they will be output some day. */
+      ghost = !GST_CLOCK_TIME_IS_VALID (tmp->pts);
+      if (ghost)
         GST_LOG_OBJECT (self,
             "discarding frame %p (#%d) with invalid PTS:%" GST_TIME_FORMAT
             " DTS:%" GST_TIME_FORMAT, tmp, tmp->system_frame_number,
             GST_TIME_ARGS (tmp->pts), GST_TIME_ARGS (tmp->dts));
-        gst_video_decoder_release_frame (GST_VIDEO_DECODER (self), tmp);
-      } else {
-        gst_video_codec_frame_unref (tmp);
-      }
     }
-  }
 
-  g_list_free (frames);
+    if (!ghost) {
+      gst_video_codec_frame_unref (tmp);
+      break;
+    }
+
+    gst_video_decoder_release_frame (decoder, tmp);
+  }
 }
 
 #endif
 
-#ifndef USE_V4L2_TARGET_NV
 static GstVideoCodecFrame *
 gst_v4l2_video_dec_get_oldest_frame (GstVideoDecoder * decoder)
 {
@@ -1205,7 +1171,39 @@ gst_v4l2_video_dec_get_oldest_frame (GstVideoDecoder * decoder)
 
   return frame;
 }
+
+/* The frames are queued with their system_frame_number as V4L2 timestamp,
+ * which the driver copies to the decoded buffer. The PTS is not queued, so
+ * for drivers which do not preserve the timestamp there is nothing to match
+ * and the oldest pending frame is taken instead. */
+static GstVideoCodecFrame *
+gst_v4l2_video_dec_get_frame (GstV4l2VideoDec * self, GstBuffer * buf)
+{
+  GstVideoDecoder *decoder = GST_VIDEO_DECODER (self);
+  GstClockTime cookie = GST_BUFFER_TIMESTAMP (buf);
+  GstVideoCodecFrame *frame = NULL;
+
+  if (GST_CLOCK_TIME_IS_VALID (cookie) && cookie % GST_SECOND == 0)
+    frame = gst_video_decoder_get_frame (decoder, cookie / GST_SECOND);
+
+  if (frame) {
+#ifdef USE_V4L2_TARGET_NV
+    /* So we have a buffer and its corresponding frame. Assuming decoder
+     * output frames in display order, frames preceding this frame could be
+     * discarded as they seems useless due to e.g interlaced stream,
+     * corrupted input data...
+     * In any cases, not likely to be seen again. so drop it before they pile
+     * up and use all the memory. Only done for matched frames, the oldest
+     * frame fallback says nothing about which frames were skipped. */
+    gst_v4l2_video_dec_clean_older_frames (self, frame);
 #endif
+    return frame;
+  }
+
+  GST_LOG_OBJECT (self, "no frame for timestamp %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (cookie));
+  return gst_v4l2_video_dec_get_oldest_frame (decoder);
+}
 
 static void
 gst_v4l2_video_dec_loop (GstVideoDecoder * decoder)
@@ -1240,27 +1238,20 @@ gst_v4l2_video_dec_loop (GstVideoDecoder * decoder)
       goto beach;
 
     GST_LOG_OBJECT (decoder, "Process output buffer");
-    ret = gst_v4l2_buffer_pool_process (v4l2_pool, &buffer);
+    ret = gst_v4l2_buffer_pool_process (v4l2_pool, &buffer, NULL);
 
   } while (ret == GST_V4L2_FLOW_CORRUPTED_BUFFER);
 
   if (ret != GST_FLOW_OK)
     goto beach;
 
-#ifdef USE_V4L2_TARGET_NV
-  frame = gst_v4l2_video_dec_find_nearest_frame (buffer,
-          gst_video_decoder_get_frames (GST_VIDEO_DECODER (self)));
-  /* So we have a timestamped  buffer and get, or not, corresponding frame.
-   * Assuming decoder output frames in display order, frames preceding this
-   * frame could be discarded as they seems useless due to e.g interlaced
-   * stream, corrupted input data...
-   * In any cases, not likely to be seen again. so drop it before they pile up
-   * and use all the memory. */
-  gst_v4l2_video_dec_clean_older_frames (self, buffer,
-          gst_video_decoder_get_frames (GST_VIDEO_DECODER (self)));
-#else
-  frame = gst_v4l2_video_dec_get_oldest_frame (decoder);
-#endif
+  if (G_UNLIKELY (GST_CLOCK_TIME_IS_VALID (self->first_frame_time))) {
+    GST_INFO_OBJECT (self, "time to first frame %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (gst_util_get_timestamp () - self->first_frame_time));
+    self->first_frame_time = GST_CLOCK_TIME_NONE;
+  }
+
+  frame = gst_v4l2_video_dec_get_frame (self, buffer);
 
 #ifdef USE_V4L2_TARGET_NV
   if (is_cuvid == FALSE) {
@@ -1377,6 +1368,54 @@ gst_v4l2_video_remove_padding (GstCapsFeatures * features,
   return TRUE;
 }
 
+#ifdef USE_V4L2_TARGET_NV
+/* Waits for V4L2_EVENT_RESOLUTION_CHANGE, after which the capture format can
+ * be acquired. The event raises POLLPRI, the poll is done in slices of a few
+ * ms because the fds of some libv4l2 plugins never signal it, these then see
+ * the event within a slice. A @timeout of 0 only checks for a pending event,
+ * GST_CLOCK_TIME_NONE waits until the decoder is stopped. */
+static gboolean
+gst_v4l2_video_dec_wait_resolution_change (GstV4l2VideoDec * self,
+    GstClockTime timeout)
+{
+  GstV4l2Object *obj = self->v4l2output;
+  struct pollfd pfd;
+  struct v4l2_event ev;
+  gint64 now, end = 0;
+  gint slice = 1;
+
+  if (GST_CLOCK_TIME_IS_VALID (timeout))
+    end = g_get_monotonic_time () + timeout / GST_USECOND;
+
+  while (1) {
+    memset (&ev, 0, sizeof (ev));
+    if (obj->ioctl (obj->video_fd, VIDIOC_DQEVENT, &ev) == 0) {
+      if (ev.type == V4L2_EVENT_RESOLUTION_CHANGE)
+        return TRUE;
+      GST_DEBUG_OBJECT (self, "skipping event %u", ev.type);
+      continue;
+    }
+
+    if (G_UNLIKELY (!g_atomic_int_get (&self->active)))
+      return FALSE;
+
+    if (GST_CLOCK_TIME_IS_VALID (timeout)) {
+      now = g_get_monotonic_time ();
+      if (now >= end)
+        return FALSE;
+      slice = MIN (slice, (end - now + 999) / 1000);
+    }
+
+    pfd.fd = obj->video_fd;
+    pfd.events = POLLPRI;
+    pfd.revents = 0;
+    if (poll (&pfd, 1, slice) < 0 || (pfd.revents & (POLLERR | POLLNVAL)))
+      g_usleep (slice * 1000);
+    slice = MIN (slice * 2, 16);
+  }
+}
+#endif
+
 static GstFlowReturn
 gst_v4l2_video_dec_handle_frame (GstVideoDecoder * decoder,
     GstVideoCodecFrame * frame)
@@ -1432,6 +1471,9 @@ gst_v4l2_video_dec_handle_frame (GstVideoDecoder * decoder,
     GstCaps *acquired_caps, *available_caps, *caps, *filter;
     GstStructure *st;
 
+    if (!GST_CLOCK_TIME_IS_VALID (self->first_frame_time))
+      self->first_frame_time = gst_util_get_timestamp ();
+
     GST_DEBUG_OBJECT (self, "Sending header");
 
     codec_data = self->input_state->codec_data;
@@ -1473,7 +1515,7 @@ gst_v4l2_video_dec_handle_frame (GstVideoDecoder * decoder,
     GST_VIDEO_DECODER_STREAM_UNLOCK (decoder);
     ret =
         gst_v4l2_buffer_pool_process (GST_V4L2_BUFFER_POOL (self->
-            v4l2output->pool), &codec_data);
+            v4l2output->pool), &codec_data, NULL);
     GST_VIDEO_DECODER_STREAM_LOCK (decoder);
 
     gst_buffer_unref (codec_data);
@@ -1486,7 +1528,7 @@ gst_v4l2_video_dec_handle_frame (GstVideoDecoder * decoder,
       GST_VIDEO_DECODER_STREAM_UNLOCK (decoder);
       ret =
           gst_v4l2_buffer_pool_process (GST_V4L2_BUFFER_POOL (self->v4l2output->
-              pool), &frame->input_buffer);
+              pool), &frame->input_buffer, &frame->system_frame_number);
       GST_VIDEO_DECODER_STREAM_LOCK (decoder);
 
       if (ret == GST_FLOW_FLUSHING) {
@@ -1500,25 +1542,19 @@ gst_v4l2_video_dec_handle_frame (GstVideoDecoder * decoder,
     }
 
     if (V4L2_TYPE_IS_OUTPUT (obj->type)) {
-      gint retval;
-      struct v4l2_event ev;
-      while (1) {
-        memset (&ev, 0, sizeof (ev));
-        retval = obj->ioctl (obj->video_fd, VIDIOC_DQEVENT, &ev);
-        if (retval != 0)
-        {
 #ifndef USE_V4L2_TARGET_NV_X86
-          if (ev.sequence == 0) {
-            g_print ("Stream format not found, dropping the frame\n");
-            goto drop;
-          }
-#endif
-          usleep(100*1000); //TODO is this needed ?
-          continue;
-        }
-        else
-          break;
+      if (!gst_v4l2_video_dec_wait_resolution_change (self, 0)) {
+        g_print ("Stream format not found, dropping the frame\n");
+        goto drop;
       }
+#else
+      if (!gst_v4l2_video_dec_wait_resolution_change (self,
+              GST_CLOCK_TIME_NONE))
+        goto flushing;
+#endif
+      GST_INFO_OBJECT (self, "stream format known %" GST_TIME_FORMAT
+          " after the first frame", GST_TIME_ARGS (gst_util_get_timestamp () -
+              self->first_frame_time));
     }
 #endif
 
@@ -1657,7 +1693,7 @@ gst_v4l2_video_dec_handle_frame (GstVideoDecoder * decoder,
     GST_VIDEO_DECODER_STREAM_UNLOCK (decoder);
     ret =
         gst_v4l2_buffer_pool_process (GST_V4L2_BUFFER_POOL (self->v4l2output->
-            pool), &frame->input_buffer);
+            pool), &frame->input_buffer, &frame->system_frame_number);
     GST_VIDEO_DECODER_STREAM_LOCK (decoder);
 
     if (ret == GST_FLOW_FLUSHING) {
@@ -70,6 +70,7 @@ struct _GstV4l2VideoDec
   gboolean active;
   GstFlowReturn output_flow;
   guint64 frame_num;
+  GstClockTime first_frame_time; /* until the first frame is decoded */
 #ifdef USE_V4L2_TARGET_NV
   guint64 decoded_picture_cnt;
   guint32 skip_frames;
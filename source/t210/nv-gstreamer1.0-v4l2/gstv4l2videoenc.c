@@ -72,11 +72,6 @@ typedef struct
 static gboolean default_nvbuf_api_version_new;
 #ifdef USE_V4L2_TARGET_NV
 #define DEFAULT_CUDAENC_GPU_ID   0
-#ifdef USE_V4L2_TARGET_NV
-GstVideoCodecFrame *
-gst_v4l2_video_enc_find_nearest_frame (GstV4l2VideoEnc *self,
-    GstBuffer * buf, GList * frames);
-#endif
 gboolean set_v4l2_video_encoder_properties (GstVideoEncoder * encoder);
 gboolean setQpRange (GstV4l2Object * v4l2object, guint label, guint MinQpI,
     guint MaxQpI, guint MinQpP, guint MaxQpP, guint MinQpB, guint MaxQpB);
@@ -91,12 +86,16 @@ gst_v4l2_video_enc_parse_quantization_range (GstV4l2VideoEnc * self,
     const gchar * arr);
 static GType gst_v4l2_videnc_hw_preset_level_get_type (void);
 static void gst_v4l2_video_encoder_forceIDR (GstV4l2VideoEnc * self);
+static gboolean gst_v4l2_video_encoder_set_frame_rc (GstV4l2VideoEnc * self,
+    guint target_bits, guint qp, guint min_qp, guint max_qp,
+    guint max_qp_deviation);
 
 static GType gst_v4l2_videnc_ratecontrol_get_type (void);
 enum
 {
   /* actions */
   SIGNAL_FORCE_IDR,
+  SIGNAL_SET_FRAME_RC,
   LAST_SIGNAL
 };
 
@@ -129,7 +128,10 @@ enum
   PROP_MAX_PERF,
   PROP_IDR_FRAME_INTERVAL,
   PROP_FORCE_INTRA,
-  PROP_FORCE_IDR
+  PROP_FORCE_IDR,
+  PROP_ROI_ENABLE,
+  PROP_ROI_QP_DELTA,
+  PROP_EXT_RC_ENABLE
 #endif
 };
 
@@ -148,6 +150,8 @@ enum
 #define GST_TYPE_V4L2_VID_ENC_HW_PRESET_LEVEL        (gst_v4l2_videnc_hw_preset_level_get_type ())
 #define GST_TYPE_V4L2_VID_ENC_RATECONTROL            (gst_v4l2_videnc_ratecontrol_get_type())
 #define DEFAULT_VBV_SIZE                             4000000
+#define DEFAULT_ROI_QP_DELTA                         (-6)
+#define GST_V4L2_VIDEO_ENC_MAX_QP                    51
 #endif
 
 #define gst_v4l2_video_enc_parent_class parent_class
@@ -277,6 +281,18 @@ gst_v4l2_video_enc_set_property_tegra (GObject * object,
     case PROP_IDR_FRAME_INTERVAL:
       self->idrinterval = g_value_get_uint (value);
       break;
+
+    case PROP_ROI_ENABLE:
+      self->roi_enable = g_value_get_boolean (value);
+      break;
+
+    case PROP_ROI_QP_DELTA:
+      self->roi_qp_delta = g_value_get_int (value);
+      break;
+
+    case PROP_EXT_RC_ENABLE:
+      self->ext_rc_enable = g_value_get_boolean (value);
+      break;
 #endif
 
       /* By default, only set on output */
@@ -419,6 +435,18 @@ gst_v4l2_video_enc_get_property_tegra (GObject * object,
     case PROP_IDR_FRAME_INTERVAL:
       g_value_set_uint (value, self->idrinterval);
       break;
+
+    case PROP_ROI_ENABLE:
+      g_value_set_boolean (value, self->roi_enable);
+      break;
+
+    case PROP_ROI_QP_DELTA:
+      g_value_set_int (value, self->roi_qp_delta);
+      break;
+
+    case PROP_EXT_RC_ENABLE:
+      g_value_set_boolean (value, self->ext_rc_enable);
+      break;
 #endif
 
       /* By default read from output */
@@ -531,6 +559,8 @@ gst_v4l2_video_enc_open (GstVideoEncoder * encoder)
 #ifdef USE_V4L2_TARGET_NV
   s = gst_caps_get_structure (self->probed_srccaps, 0);
   mimetype = gst_structure_get_name (s);
+  /* Only h264enc sets slice_output: H.265 keeps alignment=au, its
+   * slice-header-spacing only sets the slice length */
   if (g_str_equal (mimetype, "video/x-h264") && self->slice_output) {
     gst_structure_remove_field (s, "alignment");
     gst_structure_set (s, "alignment", G_TYPE_STRING, "nal", NULL);
@@ -607,6 +637,21 @@ gst_v4l2_video_enc_close (GstVideoEncoder * encoder)
   return TRUE;
 }
 
+#ifdef USE_V4L2_TARGET_NV
+/* Drop the frame the last slices were pushed with, so that slices after a
+ * flush or a restart never get attached to a frame from before it */
+static void
+gst_v4l2_video_enc_reset_slices (GstV4l2VideoEnc * self)
+{
+  if (self->best_prev) {
+    gst_video_codec_frame_unref (self->best_prev);
+    self->best_prev = NULL;
+  }
+  self->buf_pts_prev = GST_CLOCK_TIME_NONE;
+  self->slice_frame_start = TRUE;
+}
+#endif
+
 static gboolean
 gst_v4l2_video_enc_start (GstVideoEncoder * encoder)
 {
@@ -617,6 +662,10 @@ gst_v4l2_video_enc_start (GstVideoEncoder * encoder)
   gst_v4l2_object_unlock (self->v4l2output);
   g_atomic_int_set (&self->active, TRUE);
   self->output_flow = GST_FLOW_OK;
+#ifdef USE_V4L2_TARGET_NV
+  self->slice_frame_start = TRUE;
+  self->v4l2capture->slice_end_unknown = FALSE;
+#endif
 
   return TRUE;
 }
@@ -650,6 +699,17 @@ gst_v4l2_video_enc_stop (GstVideoEncoder * encoder)
     self->input_state = NULL;
   }
 
+#ifdef USE_V4L2_TARGET_NV
+  gst_v4l2_video_enc_reset_slices (self);
+
+  /* A restarted stream starts from the encoder's own rate control until
+   * the application sets new per-frame parameters */
+  GST_OBJECT_LOCK (self);
+  self->ext_rc_set = FALSE;
+  memset (&self->ext_rc_params, 0, sizeof (self->ext_rc_params));
+  GST_OBJECT_UNLOCK (self);
+#endif
+
   GST_DEBUG_OBJECT (self, "Stopped");
 
   return TRUE;
@@ -841,6 +901,10 @@ gst_v4l2_video_enc_flush (GstVideoEncoder * encoder)
 
   gst_v4l2_object_unlock_stop (self->v4l2output);
   gst_v4l2_object_unlock_stop (self->v4l2capture);
+#ifdef USE_V4L2_TARGET_NV
+  /* The capture task has stopped, nothing else touches the slice state */
+  gst_v4l2_video_enc_reset_slices (self);
+#endif
 
   return TRUE;
 }
@@ -1080,66 +1144,6 @@ not_negotiated:
   return FALSE;
 }
 
-#ifdef USE_V4L2_TARGET_NV
-GstVideoCodecFrame *
-gst_v4l2_video_enc_find_nearest_frame (GstV4l2VideoEnc *self,
-    GstBuffer * buf, GList * frames)
-{
-  GstVideoCodecFrame *best = NULL;
-  GstClockTimeDiff best_diff = G_MAXINT64;
-  GstClockTime timestamp;
-  GList *l;
-
-  timestamp = buf->pts;
-
-  for (l = frames; l; l = l->next) {
-    GstVideoCodecFrame *tmp = l->data;
-    GstClockTimeDiff diff = ABS (GST_CLOCK_DIFF (timestamp, tmp->pts));
-
-    if (diff < best_diff) {
-      best = tmp;
-      best_diff = diff;
-
-      if (diff == 0)
-        break;
-    }
-  }
-
-  /* For slice output mode, video encoder will ouput multi buffer with
-   * one input buffer. Which will cause frames list haven't any entry.
-   * So the best will be NULL. Video bit stream will be discard in
-   * function gst_v4l2_video_enc_loop() when the best is NULL.
-   * Here reuse previous frame when the best is NULL to handle discard
-   * bit stream issue when slice output mode enabled. */
-  /* Video encoder will output the same PTS for slices. Reuse previous
-   * frame for the same PTS slices */
-  if (self->slice_output && self->best_prev
-          && GST_CLOCK_TIME_IS_VALID (buf->pts)
-          && GST_CLOCK_TIME_IS_VALID (self->buf_pts_prev)
-          && buf->pts == self->buf_pts_prev)
-      best = NULL;
-  self->buf_pts_prev = buf->pts;
-
-  if (best) {
-    gst_video_codec_frame_ref (best);
-    if (self->slice_output) {
-      if (self->best_prev)
-        gst_video_codec_frame_unref (self->best_prev);
-      self->best_prev = gst_video_codec_frame_ref (best);
-    }
-  } else if (self->slice_output) {
-    best = gst_video_codec_frame_ref (self->best_prev);
-    /* Presentation_frame_number == 0 means discontinues. Need avoid it */
-    if (best->presentation_frame_number == 0)
-      best->presentation_frame_number = 1;
-  }
-
-  g_list_foreach (frames, (GFunc) gst_video_codec_frame_unref, NULL);
-  g_list_free (frames);
-
-  return best;
-}
-#else
 static GstVideoCodecFrame *
 gst_v4l2_video_enc_get_oldest_frame (GstVideoEncoder * encoder)
 {
@@ -1170,8 +1174,69 @@ gst_v4l2_video_enc_get_oldest_frame (GstVideoEncoder * encoder)
 
   return frame;
 }
+
+#ifdef USE_V4L2_TARGET_NV
+static GstVideoCodecFrame *
+gst_v4l2_video_enc_reuse_prev_frame (GstV4l2VideoEnc * self)
+{
+  GstVideoCodecFrame *frame = gst_video_codec_frame_ref (self->best_prev);
+
+  /* Presentation_frame_number == 0 means discontinues. Need avoid it */
+  if (frame->presentation_frame_number == 0)
+    frame->presentation_frame_number = 1;
+
+  return frame;
+}
+#endif
+
+/* The frames are queued with their system_frame_number as V4L2 timestamp,
+ * which the driver copies to the encoded buffer. The PTS is not queued, so
+ * for drivers which do not preserve the timestamp there is nothing to match
+ * and the oldest pending frame is taken instead. */
+static GstVideoCodecFrame *
+gst_v4l2_video_enc_get_frame (GstV4l2VideoEnc * self, GstBuffer * buf)
+{
+  GstVideoEncoder *encoder = GST_VIDEO_ENCODER (self);
+  GstClockTime cookie = GST_BUFFER_TIMESTAMP (buf);
+  GstVideoCodecFrame *frame = NULL;
+
+#ifdef USE_V4L2_TARGET_NV
+  /* For slice output mode, video encoder will ouput multi buffer with
+   * one input buffer, all with the same timestamp. The frame is gone from
+   * the pending list after the first one, reuse it for the others. */
+  if (self->slice_output && self->best_prev
+      && (!self->slice_frame_start
+          || (GST_CLOCK_TIME_IS_VALID (cookie)
+              && GST_CLOCK_TIME_IS_VALID (self->buf_pts_prev)
+              && cookie == self->buf_pts_prev)))
+    return gst_v4l2_video_enc_reuse_prev_frame (self);
+  self->buf_pts_prev = cookie;
+#endif
+
+  if (GST_CLOCK_TIME_IS_VALID (cookie) && cookie % GST_SECOND == 0)
+    frame = gst_video_encoder_get_frame (encoder, cookie / GST_SECOND);
+
+  if (!frame) {
+    GST_LOG_OBJECT (self, "no frame for timestamp %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (cookie));
+    frame = gst_v4l2_video_enc_get_oldest_frame (encoder);
+  }
+
+#ifdef USE_V4L2_TARGET_NV
+  if (self->slice_output) {
+    if (frame) {
+      if (self->best_prev)
+        gst_video_codec_frame_unref (self->best_prev);
+      self->best_prev = gst_video_codec_frame_ref (frame);
+    } else if (self->best_prev) {
+      frame = gst_v4l2_video_enc_reuse_prev_frame (self);
+    }
+  }
 #endif
 
+  return frame;
+}
+
 static void
 gst_v4l2_video_enc_loop (GstVideoEncoder * encoder)
 {
@@ -1183,6 +1248,7 @@ gst_v4l2_video_enc_loop (GstVideoEncoder * encoder)
   struct timeval ts;
   guint64 done_time;
   guint64 *in_time_pt;
+  gboolean frame_end = TRUE;
 #endif
 
   GST_LOG_OBJECT (encoder, "Allocate output buffer");
@@ -1219,19 +1285,22 @@ gst_v4l2_video_enc_loop (GstVideoEncoder * encoder)
   GST_LOG_OBJECT (encoder, "Process output buffer");
   ret =
       gst_v4l2_buffer_pool_process (GST_V4L2_BUFFER_POOL
-      (self->v4l2capture->pool), &buffer);
+      (self->v4l2capture->pool), &buffer, NULL);
 
   if (ret != GST_FLOW_OK)
     goto beach;
 
-#ifdef USE_V4L2_TARGET_NV
-  frame = gst_v4l2_video_enc_find_nearest_frame (self, buffer,
-          gst_video_encoder_get_frames (GST_VIDEO_ENCODER (self)));
-#else
-  frame = gst_v4l2_video_enc_get_oldest_frame (encoder);
-#endif
+  frame = gst_v4l2_video_enc_get_frame (self, buffer);
 
   if (frame) {
+#ifdef USE_V4L2_TARGET_NV
+    if (self->slice_output)
+      frame_end = GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_MARKER);
+
+    /* A reused frame still holds the previous slice */
+    if (frame->output_buffer)
+      gst_buffer_unref (frame->output_buffer);
+#endif
     frame->output_buffer = buffer;
     buffer = NULL;
 
@@ -1240,17 +1309,30 @@ gst_v4l2_video_enc_loop (GstVideoEncoder * encoder)
       gettimeofday (&ts, NULL);
       done_time = ((gint64) ts.tv_sec * 1000000 + ts.tv_usec) / 1000;
 
-      in_time_pt = g_queue_pop_head (self->got_frame_pt);
-      gst_v4l2_trace_printf (self->tracing_file_enc,
-          "KPI: v4l2: frameNumber= %lld encoder= %lld ms pts= %lld\n",
-          frame->system_frame_number, done_time - *in_time_pt, frame->pts);
+      /* In slice output mode the first slice gives the time to first byte,
+       * the one ending the frame the whole encoding time */
+      if (self->slice_output && self->slice_frame_start
+          && (in_time_pt = g_queue_peek_head (self->got_frame_pt)))
+        gst_v4l2_trace_printf (self->tracing_file_enc,
+            "KPI: v4l2: frameNumber= %lld first slice= %lld ms pts= %lld\n",
+            frame->system_frame_number, done_time - *in_time_pt, frame->pts);
+
+      if (frame_end && (in_time_pt = g_queue_pop_head (self->got_frame_pt))) {
+        gst_v4l2_trace_printf (self->tracing_file_enc,
+            "KPI: v4l2: frameNumber= %lld encoder= %lld ms pts= %lld\n",
+            frame->system_frame_number, done_time - *in_time_pt, frame->pts);
 
-      g_free (in_time_pt);
+        g_free (in_time_pt);
+      }
     }
 #endif
 
     ret = gst_video_encoder_finish_frame (encoder, frame);
 
+#ifdef USE_V4L2_TARGET_NV
+    self->slice_frame_start = frame_end;
+#endif
+
     if (ret != GST_FLOW_OK)
       goto beach;
   } else {
@@ -1284,6 +1366,117 @@ gst_v4l2_video_enc_loop_stopped (GstV4l2VideoEnc * self)
 
 }
 
+#ifdef USE_V4L2_TARGET_NV
+/* GstVideoEncoder flags every buffer of a sync point frame as a key unit,
+ * but decoding can only start at the first slice of the frame */
+static GstFlowReturn
+gst_v4l2_video_enc_pre_push (GstVideoEncoder * encoder,
+    GstVideoCodecFrame * frame)
+{
+  GstV4l2VideoEnc *self = GST_V4L2_VIDEO_ENC (encoder);
+
+  if (self->slice_output && !self->slice_frame_start)
+    GST_BUFFER_FLAG_SET (frame->output_buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+
+  return GST_FLOW_OK;
+}
+
+static gboolean
+gst_v4l2_video_enc_enable_roi (GstV4l2VideoEnc * self)
+{
+  GstV4l2Object *v4l2object = self->v4l2output;
+  v4l2_enc_enable_roi_param param;
+  struct v4l2_ext_control control;
+  struct v4l2_ext_controls ctrls;
+
+  memset (&control, 0, sizeof (control));
+  memset (&ctrls, 0, sizeof (ctrls));
+
+  ctrls.count = 1;
+  ctrls.controls = &control;
+  ctrls.ctrl_class = V4L2_CTRL_CLASS_MPEG;
+
+  param.bEnableROI = 1;
+  control.id = V4L2_CID_MPEG_VIDEOENC_ENABLE_ROI_PARAM;
+  control.string = (gchar *) &param;
+
+  return v4l2object->ioctl (v4l2object->video_fd, VIDIOC_S_EXT_CTRLS,
+      &ctrls) == 0;
+}
+
+static gboolean
+gst_v4l2_video_enc_enable_ext_rc (GstV4l2VideoEnc * self)
+{
+  GstV4l2Object *v4l2object = self->v4l2output;
+  v4l2_enc_enable_ext_rate_ctr param;
+  struct v4l2_ext_control control;
+  struct v4l2_ext_controls ctrls;
+
+  memset (&param, 0, sizeof (param));
+  memset (&control, 0, sizeof (control));
+  memset (&ctrls, 0, sizeof (ctrls));
+
+  ctrls.count = 1;
+  ctrls.controls = &control;
+  ctrls.ctrl_class = V4L2_CTRL_CLASS_MPEG;
+
+  param.bEnableExternalPictureRC = 1;
+  param.nsessionMaxQP = GST_V4L2_VIDEO_ENC_MAX_QP;
+  control.id = V4L2_CID_MPEG_VIDEOENC_ENABLE_EXTERNAL_RATE_CONTROL;
+  control.string = (gchar *) &param;
+
+  return v4l2object->ioctl (v4l2object->video_fd, VIDIOC_S_EXT_CTRLS,
+      &ctrls) == 0;
+}
+
+/* Translates the region of interest metas of @buf into encoder ROI params.
+ * A "delta-qp" integer in any of the meta parameter structures overrides
+ * the roi-qp-delta property for that region. */
+static guint
+gst_v4l2_video_enc_get_roi_params (GstV4l2VideoEnc * self, GstBuffer * buf,
+    v4l2_enc_frame_ROI_params * roi)
+{
+  guint width = GST_VIDEO_INFO_WIDTH (&self->input_state->info);
+  guint height = GST_VIDEO_INFO_HEIGHT (&self->input_state->info);
+  gpointer state = NULL;
+  GstMeta *meta;
+
+  memset (roi, 0, sizeof (*roi));
+
+  while ((meta = gst_buffer_iterate_meta_filtered (buf, &state,
+              GST_VIDEO_REGION_OF_INTEREST_META_API_TYPE))) {
+    GstVideoRegionOfInterestMeta *rmeta =
+        (GstVideoRegionOfInterestMeta *) meta;
+    v4l2_enc_ROI_param *param;
+    gint qp_delta = self->roi_qp_delta;
+    GList *l;
+
+    if (rmeta->x >= width || rmeta->y >= height || !rmeta->w || !rmeta->h)
+      continue;
+
+    if (roi->num_ROI_regions == V4L2_MAX_ROI_REGIONS) {
+      GST_LOG_OBJECT (self, "more than %d regions, ignoring the rest",
+          V4L2_MAX_ROI_REGIONS);
+      break;
+    }
+
+    for (l = rmeta->params; l; l = l->next) {
+      if (gst_structure_get_int (l->data, "delta-qp", &qp_delta))
+        break;
+    }
+
+    param = &roi->ROI_params[roi->num_ROI_regions++];
+    param->ROIRect.left = rmeta->x;
+    param->ROIRect.top = rmeta->y;
+    param->ROIRect.width = MIN (rmeta->w, width - rmeta->x);
+    param->ROIRect.height = MIN (rmeta->h, height - rmeta->y);
+    param->QPdelta = CLAMP (qp_delta, -51, 51);
+  }
+
+  return roi->num_ROI_regions;
+}
+#endif
+
 static GstFlowReturn
 gst_v4l2_video_enc_handle_frame (GstVideoEncoder * encoder,
     GstVideoCodecFrame * frame)
@@ -1342,6 +1535,20 @@ gst_v4l2_video_enc_handle_frame (GstVideoEncoder * encoder,
 #ifdef USE_V4L2_TARGET_NV
     set_v4l2_video_mpeg_class (self->v4l2capture,
               V4L2_CID_MPEG_SET_POLL_INTERRUPT, 1);
+
+    /* ROI must be enabled once buffers exist on both planes, the property
+     * keeps its value if the driver refuses so the next start retries */
+    self->roi_active = self->roi_enable;
+    if (self->roi_active && !gst_v4l2_video_enc_enable_roi (self)) {
+      GST_WARNING_OBJECT (self, "Could not enable ROI encoding");
+      self->roi_active = FALSE;
+    }
+
+    self->ext_rc_active = self->ext_rc_enable;
+    if (self->ext_rc_active && !gst_v4l2_video_enc_enable_ext_rc (self)) {
+      GST_WARNING_OBJECT (self, "Could not enable external rate control");
+      self->ext_rc_active = FALSE;
+    }
 #endif
 
     GST_DEBUG_OBJECT (self, "Starting encoding thread");
@@ -1355,11 +1562,47 @@ gst_v4l2_video_enc_handle_frame (GstVideoEncoder * encoder,
   }
 
   if (frame->input_buffer) {
+#ifdef USE_V4L2_TARGET_NV
+    v4l2_ctrl_videoenc_input_metadata input_metadata;
+    v4l2_enc_frame_ROI_params roi_params;
+    v4l2_enc_frame_ext_rate_ctrl_params ext_rc_params;
+
+    memset (&input_metadata, 0, sizeof (input_metadata));
+
+    /* Frames without metas still send zero regions so that the regions of
+     * an earlier frame do not stick to the V4L2 buffer */
+    if (self->roi_active) {
+      guint num_regions = gst_v4l2_video_enc_get_roi_params (self,
+          frame->input_buffer, &roi_params);
+
+      GST_LOG_OBJECT (self, "frame %u has %u ROI regions",
+          frame->system_frame_number, num_regions);
+      input_metadata.flag |= V4L2_ENC_INPUT_ROI_PARAM_FLAG;
+      input_metadata.VideoEncROIParams = &roi_params;
+    }
+
+    if (self->ext_rc_active) {
+      GST_OBJECT_LOCK (self);
+      if (self->ext_rc_set) {
+        ext_rc_params = self->ext_rc_params;
+        input_metadata.flag |= V4L2_ENC_INPUT_RC_PARAM_FLAG;
+        input_metadata.VideoEncExtRCParams = &ext_rc_params;
+      }
+      GST_OBJECT_UNLOCK (self);
+    }
+
+    if (input_metadata.flag)
+      self->v4l2output->enc_input_metadata = &input_metadata;
+#endif
     GST_VIDEO_ENCODER_STREAM_UNLOCK (encoder);
     ret =
         gst_v4l2_buffer_pool_process (GST_V4L2_BUFFER_POOL
-        (self->v4l2output->pool), &frame->input_buffer);
+        (self->v4l2output->pool), &frame->input_buffer,
+        &frame->system_frame_number);
     GST_VIDEO_ENCODER_STREAM_LOCK (encoder);
+#ifdef USE_V4L2_TARGET_NV
+    self->v4l2output->enc_input_metadata = NULL;
+#endif
 
     if (ret == GST_FLOW_FLUSHING) {
       if (gst_pad_get_task_state (GST_VIDEO_DECODER_SRC_PAD (self)) !=
@@ -1686,6 +1929,13 @@ gst_v4l2_video_enc_init (GstV4l2VideoEnc * self)
   self->slice_output = FALSE;
   self->best_prev = NULL;
   self->buf_pts_prev = GST_CLOCK_STIME_NONE;
+  self->slice_frame_start = TRUE;
+  self->roi_enable = FALSE;
+  self->roi_qp_delta = DEFAULT_ROI_QP_DELTA;
+  self->roi_active = FALSE;
+  self->ext_rc_enable = FALSE;
+  self->ext_rc_active = FALSE;
+  self->ext_rc_set = FALSE;
   if (is_cuvid == TRUE)
     self->cudaenc_gpu_id = DEFAULT_CUDAENC_GPU_ID;
 
@@ -1885,6 +2135,30 @@ gst_v4l2_video_enc_class_init (GstV4l2VideoEncClass * klass)
             FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
             GST_PARAM_MUTABLE_READY));
 
+    g_object_class_install_property (gobject_class, PROP_ROI_ENABLE,
+        g_param_spec_boolean ("roi-enable",
+            "Enable Region Of Interest encoding",
+            "Encode the regions of GstVideoRegionOfInterestMeta attached "
+            "to input buffers with their own QP delta",
+            FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+            GST_PARAM_MUTABLE_READY));
+
+    g_object_class_install_property (gobject_class, PROP_ROI_QP_DELTA,
+        g_param_spec_int ("roi-qp-delta", "ROI QP delta",
+            "QP delta for regions whose meta carries no \"delta-qp\" "
+            "parameter (negative values raise the quality)",
+            -51, 51, DEFAULT_ROI_QP_DELTA,
+            G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+            GST_PARAM_MUTABLE_READY));
+
+    g_object_class_install_property (gobject_class, PROP_EXT_RC_ENABLE,
+        g_param_spec_boolean ("ext-rc-enable",
+            "Enable external rate control",
+            "Let the application drive rate control per frame through the "
+            "set-frame-rc action signal",
+            FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+            GST_PARAM_MUTABLE_READY));
+
     /* Signals */
     gst_v4l2_signals[SIGNAL_FORCE_IDR] =
         g_signal_new ("force-IDR",
@@ -1893,7 +2167,17 @@ gst_v4l2_video_enc_class_init (GstV4l2VideoEncClass * klass)
         G_STRUCT_OFFSET (GstV4l2VideoEncClass, force_IDR),
         NULL, NULL, g_cclosure_marshal_VOID__VOID, G_TYPE_NONE, 0);
 
+    /* target frame bits, frame QP, min QP, max QP, max QP deviation */
+    gst_v4l2_signals[SIGNAL_SET_FRAME_RC] =
+        g_signal_new ("set-frame-rc",
+        G_TYPE_FROM_CLASS (video_encoder_class),
+        (GSignalFlags) (G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION),
+        G_STRUCT_OFFSET (GstV4l2VideoEncClass, set_frame_rc),
+        NULL, NULL, NULL, G_TYPE_BOOLEAN, 5, G_TYPE_UINT, G_TYPE_UINT,
+        G_TYPE_UINT, G_TYPE_UINT, G_TYPE_UINT);
+
     klass->force_IDR = gst_v4l2_video_encoder_forceIDR;
+    klass->set_frame_rc = gst_v4l2_video_encoder_set_frame_rc;
   }
 #endif
 
@@ -1919,6 +2203,10 @@ gst_v4l2_video_enc_class_init (GstV4l2VideoEncClass * klass)
       GST_DEBUG_FUNCPTR (gst_v4l2_video_enc_sink_event);
   video_encoder_class->handle_frame =
       GST_DEBUG_FUNCPTR (gst_v4l2_video_enc_handle_frame);
+#ifdef USE_V4L2_TARGET_NV
+  video_encoder_class->pre_push =
+      GST_DEBUG_FUNCPTR (gst_v4l2_video_enc_pre_push);
+#endif
 
   element_class->change_state =
       GST_DEBUG_FUNCPTR (gst_v4l2_video_enc_change_state);
@@ -2251,6 +2539,37 @@ gst_v4l2_video_encoder_forceIDR (GstV4l2VideoEnc * self)
     g_print ("Error while signalling force IDR\n");
 }
 
+/* The parameters stay in effect for every following frame until the next
+ * call or until the encoder stops, so a bandwidth estimator only has to
+ * signal when its target moves */
+static gboolean
+gst_v4l2_video_encoder_set_frame_rc (GstV4l2VideoEnc * self,
+    guint target_bits, guint qp, guint min_qp, guint max_qp,
+    guint max_qp_deviation)
+{
+  if (min_qp > max_qp || max_qp > GST_V4L2_VIDEO_ENC_MAX_QP) {
+    GST_WARNING_OBJECT (self, "invalid QP range [%u, %u]", min_qp, max_qp);
+    return FALSE;
+  }
+
+  if (!self->ext_rc_enable) {
+    GST_WARNING_OBJECT (self, "ext-rc-enable is not set, ignoring the "
+        "frame rate control parameters");
+    return FALSE;
+  }
+
+  GST_OBJECT_LOCK (self);
+  self->ext_rc_params.nTargetFrameBits = target_bits;
+  self->ext_rc_params.nFrameQP = CLAMP (qp, min_qp, max_qp);
+  self->ext_rc_params.nFrameMinQp = min_qp;
+  self->ext_rc_params.nFrameMaxQp = max_qp;
+  self->ext_rc_params.nMaxQPDeviation = max_qp_deviation;
+  self->ext_rc_set = TRUE;
+  GST_OBJECT_UNLOCK (self);
+
+  return TRUE;
+}
+
 gboolean
 set_v4l2_video_encoder_properties (GstVideoEncoder * encoder)
 {
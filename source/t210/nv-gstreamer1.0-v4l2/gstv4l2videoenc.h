@@ -81,6 +81,14 @@ struct _GstV4l2VideoEnc
   gboolean slice_output;
   GstVideoCodecFrame *best_prev;
   GstClockTime buf_pts_prev;
+  gboolean slice_frame_start;
+  gboolean roi_enable;
+  gint roi_qp_delta;
+  gboolean roi_active;
+  gboolean ext_rc_enable;
+  gboolean ext_rc_active;
+  gboolean ext_rc_set;
+  v4l2_enc_frame_ext_rate_ctrl_params ext_rc_params;
 #endif
 
   /* < private > */
@@ -120,6 +128,8 @@ struct _GstV4l2VideoEncClass
 
 #ifdef USE_V4L2_TARGET_NV
   void (*force_IDR) (GstV4l2VideoEnc *);
+  gboolean (*set_frame_rc) (GstV4l2VideoEnc *, guint target_bits, guint qp,
+      guint min_qp, guint max_qp, guint max_qp_deviation);
 #endif
 };
 
@@ -30,6 +30,7 @@
 
 #include <string.h>
 #include "libv4lconvert-priv.h"
+#include "libv4lsimd-priv.h"
 
 /**************************************************************
  *     Color conversion functions for cameras that can        *
@@ -40,6 +41,552 @@
  * patterns.                                                  *
  **************************************************************/
 
+/* Position of the colors in a 2x2 block of the 4 bayer orders,
+   0: top left, 1: top right, 2: bottom left, 3: bottom right */
+struct bayer_cfa {
+	unsigned char r, g0, g1, b;
+};
+
+static const struct bayer_cfa bayer_cfa_sbggr8 = { 3, 1, 2, 0 };
+static const struct bayer_cfa bayer_cfa_srggb8 = { 0, 1, 2, 3 };
+static const struct bayer_cfa bayer_cfa_sgbrg8 = { 2, 0, 3, 1 };
+static const struct bayer_cfa bayer_cfa_sgrbg8 = { 1, 0, 3, 2 };
+
+/* Y coefficients for the interior of a line, indexed by blue_line. Per line
+   there are 2 kinds of pixels: A, a red or blue pixel, with coefficients for
+   the pixel itself, the sum of its 4 cross neighbours and the sum of its 4
+   diagonal neighbours. And B, a green pixel, with coefficients for the pixel
+   itself, the sum of its horizontal and the sum of its vertical neighbours. */
+static const short bayer_y_coef[2][2][3] = {
+	{ { 3223, 4148, 2113 }, { 16594, 1611, 4226 } },
+	{ { 8453, 4148,  806 }, { 16594, 4226, 1611 } },
+};
+
+/* SIMD kernels, selected once by v4lconvert_bayer_init(). The line kernels
+   render the interior of a line: bayer points to the line above the one
+   being rendered, at a position where bayer[stride + 1] is a red or blue
+   pixel, and they return the number of A B pixel pairs rendered. The scalar
+   code renders the rest and is the reference the kernels must match. */
+static struct {
+	int (*line_to_rgbbgr24)(const unsigned char *bayer, unsigned char *bgr,
+			int pairs, unsigned int stride, int blue_line);
+	int (*line_to_y)(const unsigned char *bayer, unsigned char *y,
+			int pairs, unsigned int stride, const short coef[2][3]);
+	/* With nv12 set u and v get stored interleaved at udst */
+	int (*line_to_uv)(const unsigned char *bayer, unsigned char *udst,
+			unsigned char *vdst, int width, unsigned int stride,
+			const struct bayer_cfa *cfa, int nv12);
+} bayer_simd;
+
+#ifdef V4LCONVERT_HAVE_NEON
+/* (a + b + c + d + 2) >> 2 */
+static V4LCONVERT_ALWAYS_INLINE uint8x16_t bayer_avg4_neon(uint8x16_t a,
+		uint8x16_t b, uint8x16_t c, uint8x16_t d)
+{
+	uint16x8_t lo = vaddq_u16(vaddl_u8(vget_low_u8(a), vget_low_u8(b)),
+				  vaddl_u8(vget_low_u8(c), vget_low_u8(d)));
+	uint16x8_t hi = vaddq_u16(vaddl_u8(vget_high_u8(a), vget_high_u8(b)),
+				  vaddl_u8(vget_high_u8(c), vget_high_u8(d)));
+
+	return vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2));
+}
+
+/* 16 pixel pairs per iteration, vld2 splits the lines in even / odd pixels,
+   the loads at + 2 give us the right hand neighbours */
+static int bayer_line_to_rgbbgr24_neon(const unsigned char *bayer,
+		unsigned char *bgr, int pairs, unsigned int stride, int blue_line)
+{
+	int i, h;
+
+	for (i = 0; i + 16 <= pairs; i += 16) {
+		uint8x16x2_t r0 = vld2q_u8(bayer);
+		uint8x16x2_t r0s = vld2q_u8(bayer + 2);
+		uint8x16x2_t r1 = vld2q_u8(bayer + stride);
+		uint8x16x2_t r1s = vld2q_u8(bayer + stride + 2);
+		uint8x16x2_t r2 = vld2q_u8(bayer + stride * 2);
+		uint8x16x2_t r2s = vld2q_u8(bayer + stride * 2 + 2);
+		uint8x16_t diag = bayer_avg4_neon(r0.val[0], r0s.val[0],
+						  r2.val[0], r2s.val[0]);
+		uint8x16_t cross = bayer_avg4_neon(r0.val[1], r1.val[0],
+						   r1s.val[0], r2.val[1]);
+		uint8x16_t vert = vrhaddq_u8(r0s.val[0], r2s.val[0]);
+		uint8x16_t horiz = vrhaddq_u8(r1.val[1], r1s.val[1]);
+		uint8x16x2_t c0 = vzipq_u8(diag, vert);
+		uint8x16x2_t c1 = vzipq_u8(cross, r1s.val[0]);
+		uint8x16x2_t c2 = vzipq_u8(r1.val[1], horiz);
+		uint8x16x3_t out;
+
+		for (h = 0; h < 2; h++) {
+			out.val[0] = blue_line ? c0.val[h] : c2.val[h];
+			out.val[1] = c1.val[h];
+			out.val[2] = blue_line ? c2.val[h] : c0.val[h];
+			vst3q_u8(bgr + h * 48, out);
+		}
+		bayer += 32;
+		bgr += 96;
+	}
+	return i;
+}
+
+/* (c[0] * p + c[1] * s1 + c[2] * s2 + 524288) >> 15 for 8 pixels */
+static V4LCONVERT_ALWAYS_INLINE uint8x8_t bayer_y_neon(uint16x8_t p,
+		uint16x8_t s1, uint16x8_t s2, const short c[3])
+{
+	uint32x4_t lo = vmull_n_u16(vget_low_u16(p), c[0]);
+	uint32x4_t hi = vmull_n_u16(vget_high_u16(p), c[0]);
+
+	lo = vmlal_n_u16(lo, vget_low_u16(s1), c[1]);
+	hi = vmlal_n_u16(hi, vget_high_u16(s1), c[1]);
+	lo = vmlal_n_u16(lo, vget_low_u16(s2), c[2]);
+	hi = vmlal_n_u16(hi, vget_high_u16(s2), c[2]);
+
+	/* + 524288 before the shift is + 16 after it */
+	return vmovn_u16(vaddq_u16(vcombine_u16(vshrn_n_u32(lo, 15),
+			vshrn_n_u32(hi, 15)), vdupq_n_u16(16)));
+}
+
+static int bayer_line_to_y_neon(const unsigned char *bayer, unsigned char *y,
+		int pairs, unsigned int stride, const short coef[2][3])
+{
+	int i, h;
+
+	for (i = 0; i + 16 <= pairs; i += 16) {
+		uint8x16x2_t r0 = vld2q_u8(bayer);
+		uint8x16x2_t r0s = vld2q_u8(bayer + 2);
+		uint8x16x2_t r1 = vld2q_u8(bayer + stride);
+		uint8x16x2_t r1s = vld2q_u8(bayer + stride + 2);
+		uint8x16x2_t r2 = vld2q_u8(bayer + stride * 2);
+		uint8x16x2_t r2s = vld2q_u8(bayer + stride * 2 + 2);
+		uint8x8_t a[2], b[2];
+
+		for (h = 0; h < 2; h++) {
+#define HALF(x) (h ? vget_high_u8(x) : vget_low_u8(x))
+			uint16x8_t diag = vaddq_u16(
+				vaddl_u8(HALF(r0.val[0]), HALF(r0s.val[0])),
+				vaddl_u8(HALF(r2.val[0]), HALF(r2s.val[0])));
+			uint16x8_t cross = vaddq_u16(
+				vaddl_u8(HALF(r0.val[1]), HALF(r1.val[0])),
+				vaddl_u8(HALF(r1s.val[0]), HALF(r2.val[1])));
+			uint16x8_t vert = vaddl_u8(HALF(r0s.val[0]),
+						   HALF(r2s.val[0]));
+			uint16x8_t horiz = vaddl_u8(HALF(r1.val[1]),
+						    HALF(r1s.val[1]));
+
+			a[h] = bayer_y_neon(vmovl_u8(HALF(r1.val[1])), cross,
+					    diag, coef[0]);
+			b[h] = bayer_y_neon(vmovl_u8(HALF(r1s.val[0])), horiz,
+					    vert, coef[1]);
+#undef HALF
+		}
+		vst2q_u8(y, (uint8x16x2_t){ { vcombine_u8(a[0], a[1]),
+					      vcombine_u8(b[0], b[1]) } });
+		bayer += 32;
+		y += 32;
+	}
+	return i;
+}
+
+/* (c0 * r + c1 * g + c2 * b + 4210688) >> 15 for 4 2x2 blocks */
+static V4LCONVERT_ALWAYS_INLINE int16x4_t bayer_uv_neon(int16x4_t r,
+		int16x4_t g, int16x4_t b, short c0, short c1, short c2)
+{
+	int32x4_t acc = vmull_n_s16(r, c0);
+
+	acc = vmlal_n_s16(acc, g, c1);
+	acc = vmlal_n_s16(acc, b, c2);
+	/* 4210688 is 128 << 15 plus rounding */
+	return vrshrn_n_s32(acc, 15);
+}
+
+static int bayer_line_to_uv_neon(const unsigned char *bayer,
+		unsigned char *udst, unsigned char *vdst, int width,
+		unsigned int stride, const struct bayer_cfa *cfa, int nv12)
+{
+	int x, h;
+
+	for (x = 0; x + 32 <= width; x += 32) {
+		uint8x16x2_t top = vld2q_u8(bayer + x);
+		uint8x16x2_t bot = vld2q_u8(bayer + stride + x);
+		uint8x16_t c[4] = { top.val[0], top.val[1], bot.val[0], bot.val[1] };
+		int16x8_t u[2], v[2];
+		uint8x16x2_t uv;
+
+		for (h = 0; h < 2; h++) {
+#define HALF(x) (h ? vget_high_u8(x) : vget_low_u8(x))
+			int16x8_t r = vreinterpretq_s16_u16(vmovl_u8(HALF(c[cfa->r])));
+			int16x8_t b = vreinterpretq_s16_u16(vmovl_u8(HALF(c[cfa->b])));
+			int16x8_t g = vreinterpretq_s16_u16(vaddl_u8(HALF(c[cfa->g0]),
+								   HALF(c[cfa->g1])));
+#undef HALF
+			u[h] = vcombine_s16(
+				bayer_uv_neon(vget_low_s16(r), vget_low_s16(g),
+					vget_low_s16(b), -4878, -4789, 14456),
+				bayer_uv_neon(vget_high_s16(r), vget_high_s16(g),
+					vget_high_s16(b), -4878, -4789, 14456));
+			v[h] = vcombine_s16(
+				bayer_uv_neon(vget_low_s16(r), vget_low_s16(g),
+					vget_low_s16(b), 14456, -6052, -2351),
+				bayer_uv_neon(vget_high_s16(r), vget_high_s16(g),
+					vget_high_s16(b), 14456, -6052, -2351));
+			u[h] = vaddq_s16(u[h], vdupq_n_s16(128));
+			v[h] = vaddq_s16(v[h], vdupq_n_s16(128));
+		}
+		uv.val[0] = vcombine_u8(vqmovun_s16(u[0]), vqmovun_s16(u[1]));
+		uv.val[1] = vcombine_u8(vqmovun_s16(v[0]), vqmovun_s16(v[1]));
+		if (nv12) {
+			vst2q_u8(udst, uv);
+			udst += 32;
+		} else {
+			vst1q_u8(udst, uv.val[0]);
+			vst1q_u8(vdst, uv.val[1]);
+			udst += 16;
+			vdst += 16;
+		}
+	}
+	return x;
+}
+#endif
+
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+/* The SSE2 and AVX2 kernels split the lines into 16 bit even / odd pixels,
+   which makes interleaving the A and B results back a shift and an or */
+#define BAYER_LOAD_LINES(vec, load, and, srli, mask) \
+	vec x, xs, e0, o0, es0, e1, o1, es1, os1, e2, o2, es2; \
+	x = load(bayer); xs = load(bayer + 2); \
+	e0 = and(x, mask); o0 = srli(x, 8); es0 = and(xs, mask); \
+	x = load(bayer + stride); xs = load(bayer + stride + 2); \
+	e1 = and(x, mask); o1 = srli(x, 8); \
+	es1 = and(xs, mask); os1 = srli(xs, 8); \
+	x = load(bayer + stride * 2); xs = load(bayer + stride * 2 + 2); \
+	e2 = and(x, mask); o2 = srli(x, 8); es2 = and(xs, mask);
+
+#define BAYER_LOADU_SSE2(p) _mm_loadu_si128((const __m128i *)(p))
+#define BAYER_LOADU_AVX2(p) _mm256_loadu_si256((const __m256i *)(p))
+
+static V4LCONVERT_SSE2 int bayer_line_to_rgbbgr24_sse2(
+		const unsigned char *bayer, unsigned char *bgr, int pairs,
+		unsigned int stride, int blue_line)
+{
+	const __m128i mask = _mm_set1_epi16(0xff);
+	const __m128i one = _mm_set1_epi16(1);
+	const __m128i two = _mm_set1_epi16(2);
+	int i;
+
+	for (i = 0; i + 8 <= pairs; i += 8) {
+		BAYER_LOAD_LINES(__m128i, BAYER_LOADU_SSE2, _mm_and_si128,
+				 _mm_srli_epi16, mask)
+		__m128i diag = _mm_srli_epi16(_mm_add_epi16(
+				_mm_add_epi16(e0, es0),
+				_mm_add_epi16(_mm_add_epi16(e2, es2), two)), 2);
+		__m128i cross = _mm_srli_epi16(_mm_add_epi16(
+				_mm_add_epi16(o0, e1),
+				_mm_add_epi16(_mm_add_epi16(es1, o2), two)), 2);
+		__m128i vert = _mm_srli_epi16(_mm_add_epi16(
+				_mm_add_epi16(es0, es2), one), 1);
+		__m128i horiz = _mm_srli_epi16(_mm_add_epi16(
+				_mm_add_epi16(o1, os1), one), 1);
+		__m128i c0 = _mm_or_si128(diag, _mm_slli_epi16(vert, 8));
+		__m128i c1 = _mm_or_si128(cross, _mm_slli_epi16(es1, 8));
+		__m128i c2 = _mm_or_si128(o1, _mm_slli_epi16(horiz, 8));
+
+		if (blue_line)
+			v4lconvert_store_rgb24_sse2(bgr, c0, c1, c2);
+		else
+			v4lconvert_store_rgb24_sse2(bgr, c2, c1, c0);
+		bayer += 16;
+		bgr += 48;
+	}
+	return i;
+}
+
+/* (c[0] * p + c[1] * s1 + c[2] * s2 + 524288) >> 15 for 8 pixels */
+static V4LCONVERT_ALWAYS_INLINE V4LCONVERT_SSE2 __m128i bayer_y_sse2(
+		__m128i p, __m128i s1, __m128i s2, const short c[3])
+{
+	const __m128i c01 = _mm_unpacklo_epi16(_mm_set1_epi16(c[0]),
+						_mm_set1_epi16(c[1]));
+	const __m128i c2 = _mm_set1_epi32(c[2]);
+	__m128i zero = _mm_setzero_si128();
+	__m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(p, s1), c01),
+				   _mm_madd_epi16(_mm_unpacklo_epi16(s2, zero), c2));
+	__m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(p, s1), c01),
+				   _mm_madd_epi16(_mm_unpackhi_epi16(s2, zero), c2));
+
+	/* + 524288 before the shift is + 16 after it */
+	return _mm_add_epi16(_mm_packs_epi32(_mm_srli_epi32(lo, 15),
+			_mm_srli_epi32(hi, 15)), _mm_set1_epi16(16));
+}
+
+static V4LCONVERT_SSE2 int bayer_line_to_y_sse2(const unsigned char *bayer,
+		unsigned char *y, int pairs, unsigned int stride,
+		const short coef[2][3])
+{
+	const __m128i mask = _mm_set1_epi16(0xff);
+	int i;
+
+	for (i = 0; i + 8 <= pairs; i += 8) {
+		BAYER_LOAD_LINES(__m128i, BAYER_LOADU_SSE2, _mm_and_si128,
+				 _mm_srli_epi16, mask)
+		__m128i diag = _mm_add_epi16(_mm_add_epi16(e0, es0),
+					     _mm_add_epi16(e2, es2));
+		__m128i cross = _mm_add_epi16(_mm_add_epi16(o0, e1),
+					      _mm_add_epi16(es1, o2));
+		__m128i a = bayer_y_sse2(o1, cross, diag, coef[0]);
+		__m128i b = bayer_y_sse2(es1, _mm_add_epi16(o1, os1),
+					 _mm_add_epi16(es0, es2), coef[1]);
+
+		_mm_storeu_si128((__m128i *)y,
+				 _mm_or_si128(a, _mm_slli_epi16(b, 8)));
+		bayer += 16;
+		y += 16;
+	}
+	return i;
+}
+
+/* (c0 * r + c1 * g + c2 * b + 4210688) >> 15 for 8 2x2 blocks, the
+   rounding part of the constant gets multiplied in with b, the 128 << 15
+   part gets added after the shift */
+static V4LCONVERT_ALWAYS_INLINE V4LCONVERT_SSE2 __m128i bayer_uv_sse2(
+		__m128i r, __m128i g, __m128i b, short c0, short c1, short c2)
+{
+	const __m128i crg = _mm_unpacklo_epi16(_mm_set1_epi16(c0),
+						_mm_set1_epi16(c1));
+	const __m128i cb = _mm_unpacklo_epi16(_mm_set1_epi16(c2),
+					       _mm_set1_epi16(16384));
+	const __m128i one = _mm_set1_epi16(1);
+	__m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(r, g), crg),
+				   _mm_madd_epi16(_mm_unpacklo_epi16(b, one), cb));
+	__m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(r, g), crg),
+				   _mm_madd_epi16(_mm_unpackhi_epi16(b, one), cb));
+
+	return _mm_add_epi16(_mm_packs_epi32(_mm_srai_epi32(lo, 15),
+			_mm_srai_epi32(hi, 15)), _mm_set1_epi16(128));
+}
+
+static V4LCONVERT_SSE2 int bayer_line_to_uv_sse2(const unsigned char *bayer,
+		unsigned char *udst, unsigned char *vdst, int width,
+		unsigned int stride, const struct bayer_cfa *cfa, int nv12)
+{
+	const __m128i mask = _mm_set1_epi16(0xff);
+	__m128i c[4], r, g, b, u, v;
+	int x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		__m128i top = _mm_loadu_si128((const __m128i *)(bayer + x));
+		__m128i bot = _mm_loadu_si128((const __m128i *)(bayer + stride + x));
+
+		c[0] = _mm_and_si128(top, mask);
+		c[1] = _mm_srli_epi16(top, 8);
+		c[2] = _mm_and_si128(bot, mask);
+		c[3] = _mm_srli_epi16(bot, 8);
+		r = c[cfa->r];
+		g = _mm_add_epi16(c[cfa->g0], c[cfa->g1]);
+		b = c[cfa->b];
+		u = bayer_uv_sse2(r, g, b, -4878, -4789, 14456);
+		v = bayer_uv_sse2(r, g, b, 14456, -6052, -2351);
+		u = _mm_packus_epi16(u, u);
+		v = _mm_packus_epi16(v, v);
+		if (nv12) {
+			_mm_storeu_si128((__m128i *)udst, _mm_unpacklo_epi8(u, v));
+			udst += 16;
+		} else {
+			_mm_storel_epi64((__m128i *)udst, u);
+			_mm_storel_epi64((__m128i *)vdst, v);
+			udst += 8;
+			vdst += 8;
+		}
+	}
+	return x;
+}
+
+/* The AVX2 kernels are the SSE2 ones on 2 lanes, the unpack / pack pairs
+   and the rgb24 store all work per lane, so the pixel order is preserved */
+static V4LCONVERT_AVX2 int bayer_line_to_rgbbgr24_avx2(
+		const unsigned char *bayer, unsigned char *bgr, int pairs,
+		unsigned int stride, int blue_line)
+{
+	const __m256i mask = _mm256_set1_epi16(0xff);
+	const __m256i one = _mm256_set1_epi16(1);
+	const __m256i two = _mm256_set1_epi16(2);
+	int i;
+
+	for (i = 0; i + 16 <= pairs; i += 16) {
+		BAYER_LOAD_LINES(__m256i, BAYER_LOADU_AVX2, _mm256_and_si256,
+				 _mm256_srli_epi16, mask)
+		__m256i diag = _mm256_srli_epi16(_mm256_add_epi16(
+				_mm256_add_epi16(e0, es0),
+				_mm256_add_epi16(_mm256_add_epi16(e2, es2), two)), 2);
+		__m256i cross = _mm256_srli_epi16(_mm256_add_epi16(
+				_mm256_add_epi16(o0, e1),
+				_mm256_add_epi16(_mm256_add_epi16(es1, o2), two)), 2);
+		__m256i vert = _mm256_srli_epi16(_mm256_add_epi16(
+				_mm256_add_epi16(es0, es2), one), 1);
+		__m256i horiz = _mm256_srli_epi16(_mm256_add_epi16(
+				_mm256_add_epi16(o1, os1), one), 1);
+		__m256i c0 = _mm256_or_si256(diag, _mm256_slli_epi16(vert, 8));
+		__m256i c1 = _mm256_or_si256(cross, _mm256_slli_epi16(es1, 8));
+		__m256i c2 = _mm256_or_si256(o1, _mm256_slli_epi16(horiz, 8));
+
+		if (blue_line)
+			v4lconvert_store_rgb24_avx2(bgr, c0, c1, c2);
+		else
+			v4lconvert_store_rgb24_avx2(bgr, c2, c1, c0);
+		bayer += 32;
+		bgr += 96;
+	}
+	return i;
+}
+
+static V4LCONVERT_ALWAYS_INLINE V4LCONVERT_AVX2 __m256i bayer_y_avx2(
+		__m256i p, __m256i s1, __m256i s2, const short c[3])
+{
+	const __m256i c01 = _mm256_unpacklo_epi16(_mm256_set1_epi16(c[0]),
+						   _mm256_set1_epi16(c[1]));
+	const __m256i c2 = _mm256_set1_epi32(c[2]);
+	__m256i zero = _mm256_setzero_si256();
+	__m256i lo = _mm256_add_epi32(
+			_mm256_madd_epi16(_mm256_unpacklo_epi16(p, s1), c01),
+			_mm256_madd_epi16(_mm256_unpacklo_epi16(s2, zero), c2));
+	__m256i hi = _mm256_add_epi32(
+			_mm256_madd_epi16(_mm256_unpackhi_epi16(p, s1), c01),
+			_mm256_madd_epi16(_mm256_unpackhi_epi16(s2, zero), c2));
+
+	return _mm256_add_epi16(_mm256_packs_epi32(_mm256_srli_epi32(lo, 15),
+			_mm256_srli_epi32(hi, 15)), _mm256_set1_epi16(16));
+}
+
+static V4LCONVERT_AVX2 int bayer_line_to_y_avx2(const unsigned char *bayer,
+		unsigned char *y, int pairs, unsigned int stride,
+		const short coef[2][3])
+{
+	const __m256i mask = _mm256_set1_epi16(0xff);
+	int i;
+
+	for (i = 0; i + 16 <= pairs; i += 16) {
+		BAYER_LOAD_LINES(__m256i, BAYER_LOADU_AVX2, _mm256_and_si256,
+				 _mm256_srli_epi16, mask)
+		__m256i diag = _mm256_add_epi16(_mm256_add_epi16(e0, es0),
+						_mm256_add_epi16(e2, es2));
+		__m256i cross = _mm256_add_epi16(_mm256_add_epi16(o0, e1),
+						 _mm256_add_epi16(es1, o2));
+		__m256i a = bayer_y_avx2(o1, cross, diag, coef[0]);
+		__m256i b = bayer_y_avx2(es1, _mm256_add_epi16(o1, os1),
+					 _mm256_add_epi16(es0, es2), coef[1]);
+
+		_mm256_storeu_si256((__m256i *)y,
+				    _mm256_or_si256(a, _mm256_slli_epi16(b, 8)));
+		bayer += 32;
+		y += 32;
+	}
+	return i;
+}
+
+static V4LCONVERT_ALWAYS_INLINE V4LCONVERT_AVX2 __m256i bayer_uv_avx2(
+		__m256i r, __m256i g, __m256i b, short c0, short c1, short c2)
+{
+	const __m256i crg = _mm256_unpacklo_epi16(_mm256_set1_epi16(c0),
+						   _mm256_set1_epi16(c1));
+	const __m256i cb = _mm256_unpacklo_epi16(_mm256_set1_epi16(c2),
+						  _mm256_set1_epi16(16384));
+	const __m256i one = _mm256_set1_epi16(1);
+	__m256i lo = _mm256_add_epi32(
+			_mm256_madd_epi16(_mm256_unpacklo_epi16(r, g), crg),
+			_mm256_madd_epi16(_mm256_unpacklo_epi16(b, one), cb));
+	__m256i hi = _mm256_add_epi32(
+			_mm256_madd_epi16(_mm256_unpackhi_epi16(r, g), crg),
+			_mm256_madd_epi16(_mm256_unpackhi_epi16(b, one), cb));
+
+	return _mm256_add_epi16(_mm256_packs_epi32(_mm256_srai_epi32(lo, 15),
+			_mm256_srai_epi32(hi, 15)), _mm256_set1_epi16(128));
+}
+
+static V4LCONVERT_AVX2 int bayer_line_to_uv_avx2(const unsigned char *bayer,
+		unsigned char *udst, unsigned char *vdst, int width,
+		unsigned int stride, const struct bayer_cfa *cfa, int nv12)
+{
+	const __m256i mask = _mm256_set1_epi16(0xff);
+	__m256i c[4], r, g, b, u, v;
+	__m128i u8, v8;
+	int x;
+
+	for (x = 0; x + 32 <= width; x += 32) {
+		__m256i top = _mm256_loadu_si256((const __m256i *)(bayer + x));
+		__m256i bot = _mm256_loadu_si256(
+				(const __m256i *)(bayer + stride + x));
+
+		c[0] = _mm256_and_si256(top, mask);
+		c[1] = _mm256_srli_epi16(top, 8);
+		c[2] = _mm256_and_si256(bot, mask);
+		c[3] = _mm256_srli_epi16(bot, 8);
+		r = c[cfa->r];
+		g = _mm256_add_epi16(c[cfa->g0], c[cfa->g1]);
+		b = c[cfa->b];
+		u = bayer_uv_avx2(r, g, b, -4878, -4789, 14456);
+		v = bayer_uv_avx2(r, g, b, 14456, -6052, -2351);
+		u8 = _mm_packus_epi16(_mm256_castsi256_si128(u),
+				      _mm256_extracti128_si256(u, 1));
+		v8 = _mm_packus_epi16(_mm256_castsi256_si128(v),
+				      _mm256_extracti128_si256(v, 1));
+		if (nv12) {
+			_mm_storeu_si128((__m128i *)udst, _mm_unpacklo_epi8(u8, v8));
+			_mm_storeu_si128((__m128i *)(udst + 16),
+					 _mm_unpackhi_epi8(u8, v8));
+			udst += 32;
+		} else {
+			_mm_storeu_si128((__m128i *)udst, u8);
+			_mm_storeu_si128((__m128i *)vdst, v8);
+			udst += 16;
+			vdst += 16;
+		}
+	}
+	return x;
+}
+#endif
+
+void v4lconvert_bayer_init(int cpu_flags)
+{
+#ifdef V4LCONVERT_HAVE_NEON
+	if (cpu_flags & V4LCONVERT_CPU_NEON) {
+		bayer_simd.line_to_rgbbgr24 = bayer_line_to_rgbbgr24_neon;
+		bayer_simd.line_to_y = bayer_line_to_y_neon;
+		bayer_simd.line_to_uv = bayer_line_to_uv_neon;
+		return;
+	}
+#endif
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+	if (cpu_flags & V4LCONVERT_CPU_AVX2) {
+		bayer_simd.line_to_rgbbgr24 = bayer_line_to_rgbbgr24_avx2;
+		bayer_simd.line_to_y = bayer_line_to_y_avx2;
+		bayer_simd.line_to_uv = bayer_line_to_uv_avx2;
+		return;
+	}
+	if (cpu_flags & V4LCONVERT_CPU_SSE2) {
+		bayer_simd.line_to_rgbbgr24 = bayer_line_to_rgbbgr24_sse2;
+		bayer_simd.line_to_y = bayer_line_to_y_sse2;
+		bayer_simd.line_to_uv = bayer_line_to_uv_sse2;
+		return;
+	}
+#endif
+}
+
+/* step is the distance between 2 u (or v) samples in the dest, 2 for nv12 */
+static inline int bayer_line_to_uv_simd(const unsigned char *bayer,
+		unsigned char **udst, unsigned char **vdst, int width,
+		unsigned int stride, const struct bayer_cfa *cfa, int step)
+{
+	int x;
+
+	if (!bayer_simd.line_to_uv)
+		return 0;
+
+	x = bayer_simd.line_to_uv(bayer, *udst, *vdst, width, stride, cfa,
+				  step == 2);
+	*udst += x / 2 * step;
+	*vdst += x / 2 * step;
+
+	return x;
+}
+
 /* inspired by OpenCV's Bayer decoding */
 static void v4lconvert_border_bayer_line_to_bgr24(
 		const unsigned char *bayer, const unsigned char *adjacent_bayer,
@@ -164,15 +711,30 @@ static void v4lconvert_border_bayer_line_to_bgr24(
 /* From libdc1394, which on turn was based on OpenCV's Bayer decoding */
 static void bayer_to_rgbbgr24(const unsigned char *bayer,
 		unsigned char *bgr, int width, int height, const unsigned int stride, unsigned int pixfmt,
-		int start_with_green, int blue_line)
+		int start_with_green, int blue_line, int first_line, int lines)
 {
+	int last_line = first_line + lines;
+
+	bgr += first_line * width * 3;
+
 	/* render the first line */
-	v4lconvert_border_bayer_line_to_bgr24(bayer, bayer + stride, bgr, width,
-			start_with_green, blue_line);
-	bgr += width * 3;
+	if (first_line == 0) {
+		v4lconvert_border_bayer_line_to_bgr24(bayer, bayer + stride, bgr, width,
+				start_with_green, blue_line);
+		bgr += width * 3;
+		first_line = 1;
+	}
 
-	/* reduce height by 2 because of the special case top/bottom line */
-	for (height -= 2; height; height--) {
+	/* line y gets rendered from lines y - 1 till y + 1 */
+	bayer += (first_line - 1) * stride;
+	if ((first_line - 1) & 1) {
+		blue_line = !blue_line;
+		start_with_green = !start_with_green;
+	}
+
+	/* stop 1 line early because of the special case bottom line */
+	for (lines = (last_line < height ? last_line : height - 1) - first_line;
+			lines > 0; lines--) {
 		int t0, t1;
 		/* (width - 2) because of the border */
 		const unsigned char *bayer_end = bayer + (width - 2);
@@ -218,6 +780,13 @@ static void bayer_to_rgbbgr24(const unsigned char *bayer,
 			}
 		}
 
+		if (bayer_simd.line_to_rgbbgr24 && bayer_end - bayer >= 2) {
+			t0 = bayer_simd.line_to_rgbbgr24(bayer, bgr,
+					(bayer_end - bayer) / 2, stride, blue_line);
+			bayer += 2 * t0;
+			bgr += 6 * t0;
+		}
+
 		if (blue_line) {
 			for (; bayer <= bayer_end - 2; bayer += 2) {
 				t0 = (bayer[0] + bayer[2] + bayer[stride * 2] +
@@ -305,28 +874,39 @@ static void bayer_to_rgbbgr24(const unsigned char *bayer,
 	}
 
 	/* render the last line */
-	v4lconvert_border_bayer_line_to_bgr24(bayer + stride, bayer, bgr, width,
-			!start_with_green, !blue_line);
+	if (last_line == height)
+		v4lconvert_border_bayer_line_to_bgr24(bayer + stride, bayer, bgr, width,
+				!start_with_green, !blue_line);
 }
 
 void v4lconvert_bayer_to_rgb24(const unsigned char *bayer,
 		unsigned char *bgr, int width, int height, const unsigned int stride, unsigned int pixfmt)
 {
-	bayer_to_rgbbgr24(bayer, bgr, width, height, stride, pixfmt,
-			pixfmt == V4L2_PIX_FMT_SGBRG8		/* start with green */
-			|| pixfmt == V4L2_PIX_FMT_SGRBG8,
-			pixfmt != V4L2_PIX_FMT_SBGGR8		/* blue line */
-			&& pixfmt != V4L2_PIX_FMT_SGBRG8);
+	v4lconvert_bayer_lines_to_rgbbgr24(bayer, bgr, width, height, stride,
+			pixfmt, 0, 0, height);
 }
 
 void v4lconvert_bayer_to_bgr24(const unsigned char *bayer,
 		unsigned char *bgr, int width, int height, const unsigned int stride, unsigned int pixfmt)
 {
+	v4lconvert_bayer_lines_to_rgbbgr24(bayer, bgr, width, height, stride,
+			pixfmt, 1, 0, height);
+}
+
+/* Render lines first_line till first_line + lines of the frame, bayer and
+   bgr point to the start of the frame */
+void v4lconvert_bayer_lines_to_rgbbgr24(const unsigned char *bayer,
+		unsigned char *bgr, int width, int height, const unsigned int stride,
+		unsigned int pixfmt, int bgr_order, int first_line, int lines)
+{
+	int blue_line = pixfmt == V4L2_PIX_FMT_SBGGR8
+		|| pixfmt == V4L2_PIX_FMT_SGBRG8;
+
 	bayer_to_rgbbgr24(bayer, bgr, width, height, stride, pixfmt,
 			pixfmt == V4L2_PIX_FMT_SGBRG8		/* start with green */
 			|| pixfmt == V4L2_PIX_FMT_SGRBG8,
-			pixfmt == V4L2_PIX_FMT_SBGGR8		/* blue line */
-			|| pixfmt == V4L2_PIX_FMT_SGBRG8);
+			bgr_order ? blue_line : !blue_line,	/* blue line */
+			first_line, lines);
 }
 
 static void v4lconvert_border_bayer_line_to_y(
@@ -428,34 +1008,65 @@ static void v4lconvert_border_bayer_line_to_y(
 	}
 }
 
+/* dest_pixfmt is yuv420, yvu420 or nv12 */
 void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
-		int width, int height, const unsigned int stride, unsigned int src_pixfmt, int yvu)
+		int width, int height, const unsigned int stride, unsigned int src_pixfmt,
+		unsigned int dest_pixfmt)
+{
+	v4lconvert_bayer_lines_to_yuv420(bayer, yuv, width, height, stride,
+			src_pixfmt, dest_pixfmt, 0, height);
+}
+
+/* Render lines first_line till first_line + lines of the frame, first_line
+   must be even, bayer and yuv point to the start of the frame */
+void v4lconvert_bayer_lines_to_yuv420(const unsigned char *bayer,
+		unsigned char *yuv, int width, int height, const unsigned int stride,
+		unsigned int src_pixfmt, unsigned int dest_pixfmt, int first_line,
+		int lines)
 {
 	int blue_line = 0, start_with_green = 0, x, y;
-	unsigned char *ydst = yuv;
+	int last_line = first_line + lines;
+	const unsigned char *frame = bayer;
+	unsigned char *ydst = yuv + first_line * width;
 	unsigned char *udst, *vdst;
+	/* Distance between 2 u (or v) samples */
+	int step = 1;
 
-	if (yvu) {
+	switch (dest_pixfmt) {
+	case V4L2_PIX_FMT_YVU420:
 		vdst = yuv + width * height;
 		udst = vdst + width * height / 4;
-	} else {
+		break;
+	case V4L2_PIX_FMT_NV12:
+		udst = yuv + width * height;
+		vdst = udst + 1;
+		step = 2;
+		break;
+	default:
 		udst = yuv + width * height;
 		vdst = udst + width * height / 4;
 	}
+	udst += first_line * width / 4 * step;
+	vdst += first_line * width / 4 * step;
+	bayer += first_line * stride;
 
 	/* First calculate the u and v planes 2x2 pixels at a time */
 	switch (src_pixfmt) {
 	case V4L2_PIX_FMT_SBGGR8:
-		for (y = 0; y < height; y += 2) {
-			for (x = 0; x < width; x += 2) {
+		for (y = first_line; y < last_line; y += 2) {
+			x = bayer_line_to_uv_simd(bayer, &udst, &vdst, width,
+					stride, &bayer_cfa_sbggr8, step);
+			for (; x < width; x += 2) {
 				int b, g, r;
 
 				b  = bayer[x];
 				g  = bayer[x + 1];
 				g += bayer[x + stride];
 				r  = bayer[x + stride + 1];
-				*udst++ = (-4878 * r - 4789 * g + 14456 * b + 4210688) >> 15;
-				*vdst++ = (14456 * r - 6052 * g -  2351 * b + 4210688) >> 15;
+				*udst = (-4878 * r - 4789 * g + 14456 * b + 4210688) >> 15;
+				*vdst = (14456 * r - 6052 * g -  2351 * b + 4210688) >> 15;
+				udst += step;
+				vdst += step;
 			}
 			bayer += 2 * stride;
 		}
@@ -463,32 +1074,40 @@ void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
 		break;
 
 	case V4L2_PIX_FMT_SRGGB8:
-		for (y = 0; y < height; y += 2) {
-			for (x = 0; x < width; x += 2) {
+		for (y = first_line; y < last_line; y += 2) {
+			x = bayer_line_to_uv_simd(bayer, &udst, &vdst, width,
+					stride, &bayer_cfa_srggb8, step);
+			for (; x < width; x += 2) {
 				int b, g, r;
 
 				r  = bayer[x];
 				g  = bayer[x + 1];
 				g += bayer[x + stride];
 				b  = bayer[x + stride + 1];
-				*udst++ = (-4878 * r - 4789 * g + 14456 * b + 4210688) >> 15;
-				*vdst++ = (14456 * r - 6052 * g -  2351 * b + 4210688) >> 15;
+				*udst = (-4878 * r - 4789 * g + 14456 * b + 4210688) >> 15;
+				*vdst = (14456 * r - 6052 * g -  2351 * b + 4210688) >> 15;
+				udst += step;
+				vdst += step;
 			}
 			bayer += 2 * stride;
 		}
 		break;
 
 	case V4L2_PIX_FMT_SGBRG8:
-		for (y = 0; y < height; y += 2) {
-			for (x = 0; x < width; x += 2) {
+		for (y = first_line; y < last_line; y += 2) {
+			x = bayer_line_to_uv_simd(bayer, &udst, &vdst, width,
+					stride, &bayer_cfa_sgbrg8, step);
+			for (; x < width; x += 2) {
 				int b, g, r;
 
 				g  = bayer[x];
 				b  = bayer[x + 1];
 				r  = bayer[x + stride];
 				g += bayer[x + stride + 1];
-				*udst++ = (-4878 * r - 4789 * g + 14456 * b + 4210688) >> 15;
-				*vdst++ = (14456 * r - 6052 * g -  2351 * b + 4210688) >> 15;
+				*udst = (-4878 * r - 4789 * g + 14456 * b + 4210688) >> 15;
+				*vdst = (14456 * r - 6052 * g -  2351 * b + 4210688) >> 15;
+				udst += step;
+				vdst += step;
 			}
 			bayer += 2 * stride;
 		}
@@ -497,16 +1116,20 @@ void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
 		break;
 
 	case V4L2_PIX_FMT_SGRBG8:
-		for (y = 0; y < height; y += 2) {
-			for (x = 0; x < width; x += 2) {
+		for (y = first_line; y < last_line; y += 2) {
+			x = bayer_line_to_uv_simd(bayer, &udst, &vdst, width,
+					stride, &bayer_cfa_sgrbg8, step);
+			for (; x < width; x += 2) {
 				int b, g, r;
 
 				g  = bayer[x];
 				r  = bayer[x + 1];
 				b  = bayer[x + stride];
 				g += bayer[x + stride + 1];
-				*udst++ = (-4878 * r - 4789 * g + 14456 * b + 4210688) >> 15;
-				*vdst++ = (14456 * r - 6052 * g -  2351 * b + 4210688) >> 15;
+				*udst = (-4878 * r - 4789 * g + 14456 * b + 4210688) >> 15;
+				*vdst = (14456 * r - 6052 * g -  2351 * b + 4210688) >> 15;
+				udst += step;
+				vdst += step;
 			}
 			bayer += 2 * stride;
 		}
@@ -515,15 +1138,26 @@ void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
 	}
 
 	/* Point bayer back to start of frame */
-	bayer -= stride * height;
+	bayer = frame;
 
 	/* render the first line */
-	v4lconvert_border_bayer_line_to_y(bayer, bayer + stride, ydst, width,
-			start_with_green, blue_line);
-	ydst += width;
+	if (first_line == 0) {
+		v4lconvert_border_bayer_line_to_y(bayer, bayer + stride, ydst, width,
+				start_with_green, blue_line);
+		ydst += width;
+		first_line = 1;
+	}
 
-	/* reduce height by 2 because of the border */
-	for (height -= 2; height; height--) {
+	/* line y gets rendered from lines y - 1 till y + 1 */
+	bayer += (first_line - 1) * stride;
+	if ((first_line - 1) & 1) {
+		blue_line = !blue_line;
+		start_with_green = !start_with_green;
+	}
+
+	/* stop 1 line early because of the border */
+	for (lines = (last_line < height ? last_line : height - 1) - first_line;
+			lines > 0; lines--) {
 		int t0, t1;
 		/* (width - 2) because of the border */
 		const unsigned char *bayer_end = bayer + (width - 2);
@@ -560,6 +1194,13 @@ void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
 			}
 		}
 
+		if (bayer_simd.line_to_y && bayer_end - bayer >= 2) {
+			t0 = bayer_simd.line_to_y(bayer, ydst, (bayer_end - bayer) / 2,
+					stride, bayer_y_coef[blue_line]);
+			bayer += 2 * t0;
+			ydst += 2 * t0;
+		}
+
 		if (blue_line) {
 			for (; bayer <= bayer_end - 2; bayer += 2) {
 				t0 = bayer[0] + bayer[2] + bayer[stride * 2] + bayer[stride * 2 + 2];
@@ -627,6 +1268,7 @@ void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
 	}
 
 	/* render the last line */
-	v4lconvert_border_bayer_line_to_y(bayer + stride, bayer, ydst, width,
-			!start_with_green, !blue_line);
+	if (last_line == height)
+		v4lconvert_border_bayer_line_to_y(bayer + stride, bayer, ydst, width,
+				!start_with_green, !blue_line);
 }
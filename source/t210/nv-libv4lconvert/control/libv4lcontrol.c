@@ -632,7 +632,10 @@ struct v4lcontrol_data *v4lcontrol_create(int fd, void *dev_ops_priv,
 	/* If the device always needs conversion, we can add fake controls at no cost
 	   (no cost when not activated by the user that is) */
 	if (always_needs_conversion || v4lcontrol_needs_conversion(data)) {
-		for (i = 0; i < V4LCONTROL_AUTO_ENABLE_COUNT; i++) {
+		for (i = 0; i < V4LCONTROL_COUNT; i++) {
+			if (i >= V4LCONTROL_AUTO_ENABLE_COUNT &&
+					i != V4LCONTROL_ROTATE)
+				continue;
 			ctrl.id = fake_controls[i].id;
 			rc = data->dev_ops->ioctl(data->dev_ops_priv, data->fd,
 					VIDIOC_QUERYCTRL, &ctrl);
@@ -834,9 +837,27 @@ static const struct v4l2_queryctrl fake_controls[V4LCONTROL_COUNT] = {
 		.step = 1,
 		.default_value = 100,
 		.flags = V4L2_CTRL_FLAG_SLIDER
+	}, {
+		.id = V4L2_CID_ROTATE,
+		.type = V4L2_CTRL_TYPE_INTEGER,
+		.name =  "Rotate",
+		.minimum = 0,
+		.maximum = 270,
+		.step = 90,
+		.default_value = 0,
+		.flags = 0
 	},
 };
 
+/* Like the kernel does, round values to the nearest step */
+static int v4lcontrol_round_to_step(int i, int value)
+{
+	int step = fake_controls[i].step;
+
+	return fake_controls[i].minimum +
+		(value - fake_controls[i].minimum + step / 2) / step * step;
+}
+
 static void v4lcontrol_copy_queryctrl(struct v4lcontrol_data *data,
 		struct v4l2_queryctrl *ctrl, int i)
 {
@@ -999,6 +1020,7 @@ int v4lcontrol_vidioc_s_ctrl(struct v4lcontrol_data *data, void *arg)
 				return -1;
 			}
 
+			ctrl->value = v4lcontrol_round_to_step(i, ctrl->value);
 			data->shm_values[i] = ctrl->value;
 			return 0;
 		}
@@ -1066,6 +1088,8 @@ int v4lcontrol_vidioc_s_ext_ctrls(struct v4lcontrol_data *data, void *arg)
 		for (j = 0; j < V4LCONTROL_COUNT; j++)
 			if ((data->controls & (1 << j)) &&
 			    ctrls->controls[i].id == fake_controls[j].id) {
+				ctrls->controls[i].value = v4lcontrol_round_to_step(j,
+						ctrls->controls[i].value);
 				data->shm_values[j] = ctrls->controls[i].value;
 				break;
 			}
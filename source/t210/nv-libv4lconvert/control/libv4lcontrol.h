@@ -44,6 +44,8 @@ enum {
 	V4LCONTROL_AUTO_ENABLE_COUNT,
 	V4LCONTROL_AUTOGAIN,
 	V4LCONTROL_AUTOGAIN_TARGET,
+	/* Auto enabled too, but kept last to not renumber the controls above */
+	V4LCONTROL_ROTATE,
 	V4LCONTROL_COUNT
 };
 
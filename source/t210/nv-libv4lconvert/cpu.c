@@ -0,0 +1,72 @@
+/*
+
+# CPU feature detection and SIMD kernel selection
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License, version 2.1,
+# as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "libv4lconvert-priv.h"
+
+static pthread_once_t v4lconvert_cpu_once = PTHREAD_ONCE_INIT;
+static int v4lconvert_cpu_flags;
+
+static int v4lconvert_detect_cpu_flags(void)
+{
+	int flags = 0;
+
+#if defined(__aarch64__) || defined(__ARM_NEON)
+	/* NEON is part of the aarch64 base ISA, and on 32 bit arm we only
+	   build the NEON kernels when the compiler was told NEON is there */
+	flags |= V4LCONVERT_CPU_NEON;
+#endif
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+		flags |= V4LCONVERT_CPU_SSE2;
+	if (__builtin_cpu_supports("avx2"))
+		flags |= V4LCONVERT_CPU_AVX2;
+#endif
+
+	return flags;
+}
+
+static void v4lconvert_cpu_init_once(void)
+{
+	char *s;
+
+	v4lconvert_cpu_flags = v4lconvert_detect_cpu_flags();
+
+	/* Allow masking off SIMD kernels through environment, f.e. setting this
+	   to 0 forces the scalar reference code */
+	s = getenv("LIBV4LCONVERT_CPU_FLAGS");
+	if (s)
+		v4lconvert_cpu_flags &= strtol(s, NULL, 0);
+
+	v4lconvert_rgbyuv_init(v4lconvert_cpu_flags);
+	v4lconvert_bayer_init(v4lconvert_cpu_flags);
+	tinyjpeg_idct_init(v4lconvert_cpu_flags);
+	v4lconvert_rotate_init(v4lconvert_cpu_flags);
+	v4lconvert_scale_init(v4lconvert_cpu_flags);
+	v4lprocessing_stats_init(v4lconvert_cpu_flags);
+}
+
+int v4lconvert_cpu_init(void)
+{
+	pthread_once(&v4lconvert_cpu_once, v4lconvert_cpu_init_once);
+
+	return v4lconvert_cpu_flags;
+}
@@ -21,7 +21,32 @@
 
 #include <string.h>
 #include "libv4lconvert-priv.h"
+#include "libv4lsimd-priv.h"
+
+/* List of well known resolutions which we can get by cropping somewhat larger
+   resolutions */
+static const unsigned int v4lconvert_crop_res[][2] = {
+	/* low res VGA resolutions, can be made by software cropping SIF resolutions
+	   for cam/drivers which do not support this in hardware */
+	{ 320, 240 },
+	{ 160, 120 },
+	/* Some CIF cams (with vv6410 sensor) have slightly larger then usual CIF
+	   resolutions, make regular CIF resolutions available on these by sw crop */
+	{ 352, 288 },
+	{ 176, 144 },
+};
+
+int v4lconvert_is_crop_res(unsigned int width, unsigned int height)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(v4lconvert_crop_res); i++)
+		if (v4lconvert_crop_res[i][0] == width &&
+				v4lconvert_crop_res[i][1] == height)
+			return 1;
 
+	return 0;
+}
 
 static void v4lconvert_reduceandcrop_rgbbgr24(
 		unsigned char *src, unsigned char *dest,
@@ -285,3 +310,326 @@ void v4lconvert_crop(unsigned char *src, unsigned char *dest,
 		break;
 	}
 }
+
+/* Does v4lconvert_crop() give the dest size by cropping, reducing and cropping
+   or adding a border, which keeps the aspect ratio, or is the frame scaled
+   with v4lconvert_scale(). This must match what v4lconvert_try_format() has
+   chosen the src resolution for. */
+int v4lconvert_crop_scales(const struct v4l2_format *src_fmt,
+		const struct v4l2_format *dest_fmt)
+{
+	unsigned int src_width = src_fmt->fmt.pix.width;
+	unsigned int src_height = src_fmt->fmt.pix.height;
+	unsigned int width = dest_fmt->fmt.pix.width;
+	unsigned int height = dest_fmt->fmt.pix.height;
+
+	/* Adding a border */
+	if (src_width <= width && src_height <= height)
+		return 0;
+
+	/* Cropping off the extra (border) pixels some sensors have */
+	if (src_width >= width && src_width <= width + 7 &&
+			src_height >= height && src_height <= height + 1)
+		return 0;
+
+	/* Well known resolutions made from a slightly larger one */
+	if (v4lconvert_is_crop_res(width, height) &&
+			((src_width >= width && src_width <= width * 5 / 4 &&
+			  src_height >= height && src_height <= height * 5 / 4) ||
+			 (src_width >= width * 2 && src_width <= width * 5 / 2 &&
+			  src_height >= height * 2 && src_height <= height * 5 / 2)))
+		return 0;
+
+	/* Too small to filter */
+	if (src_width < 4 || src_height < 4)
+		return 0;
+
+	return 1;
+}
+
+/* Bilinear scaling, done separably in 8 bit fixed point. When scaling down
+   the 2 source lines for a dest line are blended vertically first, so that
+   only one line per dest line needs to be scaled horizontally. When scaling
+   up source lines are scaled horizontally into a cache of 2 lines, which
+   then get blended into the dest lines, so that every source line gets
+   scaled horizontally only once. The horizontal pass uses per dest pixel
+   offset / weight tables, the vertical blend, which is a straight
+   multiply-add over whole lines, has SIMD kernels. */
+#define SCALE_FRAC_BITS		8
+#define SCALE_ONE		(1 << SCALE_FRAC_BITS)
+
+/* dest[i] = (row0[i] * (256 - f) + row1[i] * f + 128) >> 8, for 0 < f < 256 */
+static struct {
+	void (*blend_line)(const unsigned char *row0, const unsigned char *row1,
+			unsigned char *dest, int n, int f);
+} scale_simd;
+
+static void blend_line_c(const unsigned char *row0, const unsigned char *row1,
+		unsigned char *dest, int n, int f)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		dest[i] = (row0[i] * (SCALE_ONE - f) + row1[i] * f +
+				SCALE_ONE / 2) >> SCALE_FRAC_BITS;
+}
+
+#ifdef V4LCONVERT_HAVE_NEON
+static void blend_line_neon(const unsigned char *row0,
+		const unsigned char *row1, unsigned char *dest, int n, int f)
+{
+	uint8x8_t w0 = vdup_n_u8(SCALE_ONE - f), w1 = vdup_n_u8(f);
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		uint8x16_t a = vld1q_u8(row0 + i), b = vld1q_u8(row1 + i);
+		uint16x8_t lo, hi;
+
+		lo = vmlal_u8(vmull_u8(vget_low_u8(a), w0), vget_low_u8(b), w1);
+		hi = vmlal_u8(vmull_u8(vget_high_u8(a), w0), vget_high_u8(b), w1);
+		vst1q_u8(dest + i, vcombine_u8(vrshrn_n_u16(lo, SCALE_FRAC_BITS),
+					vrshrn_n_u16(hi, SCALE_FRAC_BITS)));
+	}
+
+	blend_line_c(row0 + i, row1 + i, dest + i, n - i, f);
+}
+#endif
+
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+/* The sum of both products is at most 255 * 256 + 128, so all math can be
+   done in unsigned 16 bit lanes */
+static V4LCONVERT_SSE2 void blend_line_sse2(const unsigned char *row0,
+		const unsigned char *row1, unsigned char *dest, int n, int f)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i w0 = _mm_set1_epi16(SCALE_ONE - f), w1 = _mm_set1_epi16(f);
+	__m128i round = _mm_set1_epi16(SCALE_ONE / 2);
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(row0 + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(row1 + i));
+		__m128i lo, hi;
+
+		lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), w0),
+				_mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), w1));
+		hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), w0),
+				_mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), w1));
+		lo = _mm_srli_epi16(_mm_add_epi16(lo, round), SCALE_FRAC_BITS);
+		hi = _mm_srli_epi16(_mm_add_epi16(hi, round), SCALE_FRAC_BITS);
+		_mm_storeu_si128((__m128i *)(dest + i), _mm_packus_epi16(lo, hi));
+	}
+
+	blend_line_c(row0 + i, row1 + i, dest + i, n - i, f);
+}
+#endif
+
+void v4lconvert_scale_init(int cpu_flags)
+{
+	scale_simd.blend_line = blend_line_c;
+#ifdef V4LCONVERT_HAVE_NEON
+	if (cpu_flags & V4LCONVERT_CPU_NEON)
+		scale_simd.blend_line = blend_line_neon;
+#endif
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+	if (cpu_flags & V4LCONVERT_CPU_SSE2)
+		scale_simd.blend_line = blend_line_sse2;
+#endif
+}
+
+/* Source position of the first dest pixel and the step between dest pixels
+   in 16.16 fixed point, with pixel centers mapped onto pixel centers */
+static void scale_steps(int src_size, int size, int *pos, int *step)
+{
+	*step = ((long long)src_size << 16) / size;
+	*pos = *step / 2 - (1 << 15);
+}
+
+/* Split a 16.16 source position into the first of the 2 pixels to blend
+   and the weight of the second one, clamped to the src */
+static void scale_tap(int pos, int src_size, int *index, int *frac)
+{
+	if (pos < 0) {
+		*index = 0;
+		*frac = 0;
+	} else {
+		*index = pos >> 16;
+		*frac = (pos >> (16 - SCALE_FRAC_BITS)) & (SCALE_ONE - 1);
+	}
+
+	/* Keep the second pixel inside the src, blending fully to it */
+	if (*index >= src_size - 1) {
+		*index = src_size - 2;
+		*frac = SCALE_ONE;
+	}
+}
+
+static V4LCONVERT_ALWAYS_INLINE void scale_line(const unsigned char *src,
+		unsigned char *dest, const int *xofs, const unsigned short *xfrac,
+		int width, int bpp)
+{
+	int x;
+
+	for (x = 0; x < width; x++) {
+		const unsigned char *s = src + xofs[x];
+		int f1 = xfrac[x], f0 = SCALE_ONE - f1;
+
+		dest[0] = (s[0] * f0 + s[bpp] * f1 + SCALE_ONE / 2) >>
+			SCALE_FRAC_BITS;
+		if (bpp == 3) {
+			dest[1] = (s[1] * f0 + s[4] * f1 + SCALE_ONE / 2) >>
+				SCALE_FRAC_BITS;
+			dest[2] = (s[2] * f0 + s[5] * f1 + SCALE_ONE / 2) >>
+				SCALE_FRAC_BITS;
+		}
+		dest += bpp;
+	}
+}
+
+static void scale_line_bpp(const unsigned char *src, unsigned char *dest,
+		const int *xofs, const unsigned short *xfrac, int width, int bpp)
+{
+	switch (bpp) {
+	case 1:
+		scale_line(src, dest, xofs, xfrac, width, 1);
+		break;
+	case 3:
+		scale_line(src, dest, xofs, xfrac, width, 3);
+		break;
+	}
+}
+
+/* Get source line y scaled horizontally into line[j], taking it from the
+   other cache line if that has it */
+static void scale_cache_line(const unsigned char *src, int src_stride,
+		unsigned char *line[2], int line_y[2], int j, int y,
+		const int *xofs, const unsigned short *xfrac, int width, int bpp)
+{
+	unsigned char *tmp;
+
+	if (line_y[j] == y)
+		return;
+
+	if (line_y[!j] == y) {
+		tmp = line[j];
+		line[j] = line[!j];
+		line[!j] = tmp;
+		line_y[!j] = line_y[j];
+	} else
+		scale_line_bpp(src + y * src_stride, line[j], xofs, xfrac,
+				width, bpp);
+	line_y[j] = y;
+}
+
+/* tables must have room for width ints + width shorts + 2 dest lines or
+   1 src line, whichever is larger */
+static void scale_plane(const unsigned char *src, int src_stride,
+		int src_width, int src_height, unsigned char *dest,
+		int dest_stride, int width, int height, int bpp,
+		unsigned char *tables)
+{
+	int *xofs = (int *)tables;
+	unsigned short *xfrac = (unsigned short *)(xofs + width);
+	unsigned char *line[2];
+	int line_y[2] = { -1, -1 };
+	int x, y, i, f, pos, step, line_size = width * bpp;
+
+	line[0] = (unsigned char *)(xfrac + width);
+	line[1] = line[0] + line_size;
+
+	scale_steps(src_width, width, &pos, &step);
+	for (x = 0; x < width; x++, pos += step) {
+		scale_tap(pos, src_width, &i, &f);
+		xofs[x] = i * bpp;
+		xfrac[x] = f;
+	}
+
+	scale_steps(src_height, height, &pos, &step);
+	for (y = 0; y < height; y++, pos += step) {
+		scale_tap(pos, src_height, &i, &f);
+		/* Use line i + 1 alone when it gets the full weight */
+		if (f == SCALE_ONE) {
+			i++;
+			f = 0;
+		}
+
+		if (height < src_height) {
+			const unsigned char *s = src + i * src_stride;
+
+			if (f) {
+				scale_simd.blend_line(s, s + src_stride, line[0],
+						src_width * bpp, f);
+				s = line[0];
+			}
+			scale_line_bpp(s, dest, xofs, xfrac, width, bpp);
+		} else {
+			scale_cache_line(src, src_stride, line, line_y, 0, i,
+					xofs, xfrac, width, bpp);
+			if (f) {
+				scale_cache_line(src, src_stride, line, line_y,
+						1, i + 1, xofs, xfrac, width, bpp);
+				scale_simd.blend_line(line[0], line[1], dest,
+						line_size, f);
+			} else
+				memcpy(dest, line[0], line_size);
+		}
+		dest += dest_stride;
+	}
+}
+
+int v4lconvert_scale(struct v4lconvert_data *data, unsigned char *src,
+		unsigned char *dest, const struct v4l2_format *src_fmt,
+		const struct v4l2_format *dest_fmt)
+{
+	int src_width = src_fmt->fmt.pix.width;
+	int src_height = src_fmt->fmt.pix.height;
+	int src_stride = src_fmt->fmt.pix.bytesperline;
+	int width = dest_fmt->fmt.pix.width;
+	int height = dest_fmt->fmt.pix.height;
+	int stride = dest_fmt->fmt.pix.bytesperline;
+	int bpp = 1, tables_size;
+	unsigned char *tables;
+
+	switch (dest_fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+		bpp = 3;
+		break;
+	}
+
+	tables_size = width * (sizeof(int) + sizeof(short)) +
+		(2 * width > src_width ? 2 * width : src_width) * bpp;
+	tables = v4lconvert_alloc_buffer(tables_size, &data->scale_buf,
+			&data->scale_buf_size);
+	if (!tables)
+		return v4lconvert_oom_error(data);
+
+	switch (dest_fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+		scale_plane(src, src_stride, src_width, src_height, dest,
+				stride, width, height, 3, tables);
+		break;
+
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+		/* Y */
+		scale_plane(src, src_stride, src_width, src_height, dest,
+				stride, width, height, 1, tables);
+		src += src_height * src_stride;
+		dest += height * stride;
+
+		/* U */
+		scale_plane(src, src_stride / 2, src_width / 2, src_height / 2,
+				dest, stride / 2, width / 2, height / 2, 1, tables);
+		src += src_height * src_stride / 4;
+		dest += height * stride / 4;
+
+		/* V */
+		scale_plane(src, src_stride / 2, src_width / 2, src_height / 2,
+				dest, stride / 2, width / 2, height / 2, 1, tables);
+		break;
+	}
+
+	return 0;
+}
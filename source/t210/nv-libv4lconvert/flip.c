@@ -21,246 +21,432 @@
 
 #include <string.h>
 #include "libv4lconvert-priv.h"
+#include "libv4lsimd-priv.h"
+
+/* All rotations and flips are done by one engine, which walks the dest in
+   order and picks the source pixels with a per dest pixel x and y step. When
+   the orientation transposes the frame, going right in dest means going down
+   in the source. So the frame is done in tiles of 16 dest lines, which read
+   16 pixels of every source line they cover, with their width limited so
+   that those source lines stay in the (L2) cache while the tile gets written.
+   Within a tile 8x8 blocks are transposed in registers when we have SIMD
+   kernels for that. */
+#define ROTATE_TILE_WIDTH	1024
+#define ROTATE_TILE_HEIGHT	16
+
+/* Transpose an 8x8 block of bpp 1 or 2 pixels. Row i of the block is read
+   from src + i * src_stride, column i gets written to dest + i * dest_stride,
+   the strides may be negative. */
+static struct {
+	void (*transpose8x8_8)(const unsigned char *src, int src_stride,
+			unsigned char *dest, int dest_stride);
+	void (*transpose8x8_16)(const unsigned char *src, int src_stride,
+			unsigned char *dest, int dest_stride);
+} rotate_simd;
+
+#ifdef V4LCONVERT_HAVE_NEON
+static void transpose8x8_8_neon(const unsigned char *src, int src_stride,
+		unsigned char *dest, int dest_stride)
+{
+	uint8x8x2_t t01, t23, t45, t67;
+	uint16x4x2_t u02, u13, u46, u57;
+	uint32x2x2_t v04, v15, v26, v37;
+
+	t01 = vtrn_u8(vld1_u8(src), vld1_u8(src + src_stride));
+	t23 = vtrn_u8(vld1_u8(src + 2 * src_stride),
+			vld1_u8(src + 3 * src_stride));
+	t45 = vtrn_u8(vld1_u8(src + 4 * src_stride),
+			vld1_u8(src + 5 * src_stride));
+	t67 = vtrn_u8(vld1_u8(src + 6 * src_stride),
+			vld1_u8(src + 7 * src_stride));
+
+	u02 = vtrn_u16(vreinterpret_u16_u8(t01.val[0]),
+			vreinterpret_u16_u8(t23.val[0]));
+	u13 = vtrn_u16(vreinterpret_u16_u8(t01.val[1]),
+			vreinterpret_u16_u8(t23.val[1]));
+	u46 = vtrn_u16(vreinterpret_u16_u8(t45.val[0]),
+			vreinterpret_u16_u8(t67.val[0]));
+	u57 = vtrn_u16(vreinterpret_u16_u8(t45.val[1]),
+			vreinterpret_u16_u8(t67.val[1]));
+
+	v04 = vtrn_u32(vreinterpret_u32_u16(u02.val[0]),
+			vreinterpret_u32_u16(u46.val[0]));
+	v26 = vtrn_u32(vreinterpret_u32_u16(u02.val[1]),
+			vreinterpret_u32_u16(u46.val[1]));
+	v15 = vtrn_u32(vreinterpret_u32_u16(u13.val[0]),
+			vreinterpret_u32_u16(u57.val[0]));
+	v37 = vtrn_u32(vreinterpret_u32_u16(u13.val[1]),
+			vreinterpret_u32_u16(u57.val[1]));
+
+	vst1_u8(dest, vreinterpret_u8_u32(v04.val[0]));
+	vst1_u8(dest + dest_stride, vreinterpret_u8_u32(v15.val[0]));
+	vst1_u8(dest + 2 * dest_stride, vreinterpret_u8_u32(v26.val[0]));
+	vst1_u8(dest + 3 * dest_stride, vreinterpret_u8_u32(v37.val[0]));
+	vst1_u8(dest + 4 * dest_stride, vreinterpret_u8_u32(v04.val[1]));
+	vst1_u8(dest + 5 * dest_stride, vreinterpret_u8_u32(v15.val[1]));
+	vst1_u8(dest + 6 * dest_stride, vreinterpret_u8_u32(v26.val[1]));
+	vst1_u8(dest + 7 * dest_stride, vreinterpret_u8_u32(v37.val[1]));
+}
 
-static void v4lconvert_vflip_rgbbgr24(unsigned char *src, unsigned char *dest,
-		struct v4l2_format *fmt)
+static void transpose8x8_16_neon(const unsigned char *src, int src_stride,
+		unsigned char *dest, int dest_stride)
 {
-	unsigned int y;
+	uint16x8x2_t t01, t23, t45, t67;
+	uint32x4x2_t u02, u13, u46, u57;
+	uint16x4_t lo, hi;
+	int i;
 
-	src += fmt->fmt.pix.height * fmt->fmt.pix.bytesperline;
-	for (y = 0; y < fmt->fmt.pix.height; y++) {
-		src -= fmt->fmt.pix.bytesperline;
-		memcpy(dest, src, fmt->fmt.pix.width * 3);
-		dest += fmt->fmt.pix.width * 3;
+	t01 = vtrnq_u16(vreinterpretq_u16_u8(vld1q_u8(src)),
+			vreinterpretq_u16_u8(vld1q_u8(src + src_stride)));
+	t23 = vtrnq_u16(vreinterpretq_u16_u8(vld1q_u8(src + 2 * src_stride)),
+			vreinterpretq_u16_u8(vld1q_u8(src + 3 * src_stride)));
+	t45 = vtrnq_u16(vreinterpretq_u16_u8(vld1q_u8(src + 4 * src_stride)),
+			vreinterpretq_u16_u8(vld1q_u8(src + 5 * src_stride)));
+	t67 = vtrnq_u16(vreinterpretq_u16_u8(vld1q_u8(src + 6 * src_stride)),
+			vreinterpretq_u16_u8(vld1q_u8(src + 7 * src_stride)));
+
+	/* u02 holds columns 0 | 4 and 2 | 6 of rows 0-3, u13 1 | 5 and 3 | 7 */
+	u02 = vtrnq_u32(vreinterpretq_u32_u16(t01.val[0]),
+			vreinterpretq_u32_u16(t23.val[0]));
+	u13 = vtrnq_u32(vreinterpretq_u32_u16(t01.val[1]),
+			vreinterpretq_u32_u16(t23.val[1]));
+	u46 = vtrnq_u32(vreinterpretq_u32_u16(t45.val[0]),
+			vreinterpretq_u32_u16(t67.val[0]));
+	u57 = vtrnq_u32(vreinterpretq_u32_u16(t45.val[1]),
+			vreinterpretq_u32_u16(t67.val[1]));
+
+	for (i = 0; i < 4; i++) {
+		uint32x4_t top, bottom;
+
+		/* column i and i + 4 */
+		top = (i & 1) ? u13.val[i >> 1] : u02.val[i >> 1];
+		bottom = (i & 1) ? u57.val[i >> 1] : u46.val[i >> 1];
+		lo = vget_low_u16(vreinterpretq_u16_u32(top));
+		hi = vget_low_u16(vreinterpretq_u16_u32(bottom));
+		vst1q_u8(dest + i * dest_stride,
+				vreinterpretq_u8_u16(vcombine_u16(lo, hi)));
+		lo = vget_high_u16(vreinterpretq_u16_u32(top));
+		hi = vget_high_u16(vreinterpretq_u16_u32(bottom));
+		vst1q_u8(dest + (i + 4) * dest_stride,
+				vreinterpretq_u8_u16(vcombine_u16(lo, hi)));
 	}
 }
+#endif
 
-static void v4lconvert_vflip_yuv420(unsigned char *src, unsigned char *dest,
-		struct v4l2_format *fmt)
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+static V4LCONVERT_SSE2 void transpose8x8_8_sse2(const unsigned char *src,
+		int src_stride, unsigned char *dest, int dest_stride)
 {
-	unsigned int y;
-
-	/* First flip the Y plane */
-	src += fmt->fmt.pix.height * fmt->fmt.pix.bytesperline;
-	for (y = 0; y < fmt->fmt.pix.height; y++) {
-		src -= fmt->fmt.pix.bytesperline;
-		memcpy(dest, src, fmt->fmt.pix.width);
-		dest += fmt->fmt.pix.width;
-	}
+	__m128i r[8], t[4], u[4], v[4];
+	int i;
 
-	/* Now flip the U plane */
-	src += fmt->fmt.pix.height * fmt->fmt.pix.bytesperline * 5 / 4;
-	for (y = 0; y < fmt->fmt.pix.height / 2; y++) {
-		src -= fmt->fmt.pix.bytesperline / 2;
-		memcpy(dest, src, fmt->fmt.pix.width / 2);
-		dest += fmt->fmt.pix.width / 2;
-	}
+	for (i = 0; i < 8; i++)
+		r[i] = _mm_loadl_epi64((const __m128i *)(src + i * src_stride));
 
-	/* Last flip the V plane */
-	src += fmt->fmt.pix.height * fmt->fmt.pix.bytesperline / 2;
-	for (y = 0; y < fmt->fmt.pix.height / 2; y++) {
-		src -= fmt->fmt.pix.bytesperline / 2;
-		memcpy(dest, src, fmt->fmt.pix.width / 2);
-		dest += fmt->fmt.pix.width / 2;
-	}
-}
+	for (i = 0; i < 4; i++)
+		t[i] = _mm_unpacklo_epi8(r[2 * i], r[2 * i + 1]);
 
-static void v4lconvert_hflip_rgbbgr24(unsigned char *src, unsigned char *dest,
-		struct v4l2_format *fmt)
-{
-	unsigned int x, y;
-
-	for (y = 0; y < fmt->fmt.pix.height; y++) {
-		src += fmt->fmt.pix.width * 3;
-		for (x = 0; x < fmt->fmt.pix.width; x++) {
-			src -= 3;
-			dest[0] = src[0];
-			dest[1] = src[1];
-			dest[2] = src[2];
-			dest += 3;
-		}
-		src += fmt->fmt.pix.bytesperline;
+	/* u[0] / u[1] columns 0-3 / 4-7 of rows 0-3, u[2] / u[3] of rows 4-7 */
+	u[0] = _mm_unpacklo_epi16(t[0], t[1]);
+	u[1] = _mm_unpackhi_epi16(t[0], t[1]);
+	u[2] = _mm_unpacklo_epi16(t[2], t[3]);
+	u[3] = _mm_unpackhi_epi16(t[2], t[3]);
+
+	/* v[i] holds columns 2 * i and 2 * i + 1 */
+	v[0] = _mm_unpacklo_epi32(u[0], u[2]);
+	v[1] = _mm_unpackhi_epi32(u[0], u[2]);
+	v[2] = _mm_unpacklo_epi32(u[1], u[3]);
+	v[3] = _mm_unpackhi_epi32(u[1], u[3]);
+
+	for (i = 0; i < 4; i++) {
+		_mm_storel_epi64((__m128i *)(dest + 2 * i * dest_stride), v[i]);
+		_mm_storel_epi64((__m128i *)(dest + (2 * i + 1) * dest_stride),
+				_mm_unpackhi_epi64(v[i], v[i]));
 	}
 }
 
-static void v4lconvert_hflip_yuv420(unsigned char *src, unsigned char *dest,
-		struct v4l2_format *fmt)
+static V4LCONVERT_SSE2 void transpose8x8_16_sse2(const unsigned char *src,
+		int src_stride, unsigned char *dest, int dest_stride)
 {
-	unsigned int x, y;
-
-	/* First flip the Y plane */
-	for (y = 0; y < fmt->fmt.pix.height; y++) {
-		src += fmt->fmt.pix.width;
-		for (x = 0; x < fmt->fmt.pix.width; x++)
-			*dest++ = *--src;
-		src += fmt->fmt.pix.bytesperline;
+	__m128i r[8], t[8], u[8];
+	int i;
+
+	for (i = 0; i < 8; i++)
+		r[i] = _mm_loadu_si128((const __m128i *)(src + i * src_stride));
+
+	/* t[2 * i] columns 0-3, t[2 * i + 1] columns 4-7 of rows 2 * i, + 1 */
+	for (i = 0; i < 4; i++) {
+		t[2 * i] = _mm_unpacklo_epi16(r[2 * i], r[2 * i + 1]);
+		t[2 * i + 1] = _mm_unpackhi_epi16(r[2 * i], r[2 * i + 1]);
 	}
 
-	/* Now flip the U plane */
-	for (y = 0; y < fmt->fmt.pix.height / 2; y++) {
-		src += fmt->fmt.pix.width / 2;
-		for (x = 0; x < fmt->fmt.pix.width / 2; x++)
-			*dest++ = *--src;
-		src += fmt->fmt.pix.bytesperline / 2;
+	/* u[j] / u[j + 4] columns 2 * j and 2 * j + 1 of rows 0-3 / 4-7 */
+	for (i = 0; i < 2; i++) {
+		u[4 * i] = _mm_unpacklo_epi32(t[4 * i], t[4 * i + 2]);
+		u[4 * i + 1] = _mm_unpackhi_epi32(t[4 * i], t[4 * i + 2]);
+		u[4 * i + 2] = _mm_unpacklo_epi32(t[4 * i + 1], t[4 * i + 3]);
+		u[4 * i + 3] = _mm_unpackhi_epi32(t[4 * i + 1], t[4 * i + 3]);
 	}
 
-	/* Last flip the V plane */
-	for (y = 0; y < fmt->fmt.pix.height / 2; y++) {
-		src += fmt->fmt.pix.width / 2;
-		for (x = 0; x < fmt->fmt.pix.width / 2; x++)
-			*dest++ = *--src;
-		src += fmt->fmt.pix.bytesperline / 2;
+	for (i = 0; i < 4; i++) {
+		_mm_storeu_si128((__m128i *)(dest + 2 * i * dest_stride),
+				_mm_unpacklo_epi64(u[i], u[i + 4]));
+		_mm_storeu_si128((__m128i *)(dest + (2 * i + 1) * dest_stride),
+				_mm_unpackhi_epi64(u[i], u[i + 4]));
 	}
 }
+#endif
 
-static void v4lconvert_rotate180_rgbbgr24(const unsigned char *src,
-		unsigned char *dst, int width, int height)
+void v4lconvert_rotate_init(int cpu_flags)
 {
-	int i;
-
-	src += 3 * width * height - 3;
-
-	for (i = 0; i < width * height; i++) {
-		dst[0] = src[0];
-		dst[1] = src[1];
-		dst[2] = src[2];
-		dst += 3;
-		src -= 3;
+#ifdef V4LCONVERT_HAVE_NEON
+	if (cpu_flags & V4LCONVERT_CPU_NEON) {
+		rotate_simd.transpose8x8_8 = transpose8x8_8_neon;
+		rotate_simd.transpose8x8_16 = transpose8x8_16_neon;
+		return;
+	}
+#endif
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+	/* An 8x8 transpose does not get faster with 256 bit vectors */
+	if (cpu_flags & V4LCONVERT_CPU_SSE2) {
+		rotate_simd.transpose8x8_8 = transpose8x8_8_sse2;
+		rotate_simd.transpose8x8_16 = transpose8x8_16_sse2;
+		return;
 	}
+#endif
 }
 
-static void v4lconvert_rotate180_yuv420(const unsigned char *src,
-		unsigned char *dst, int width, int height)
+static V4LCONVERT_ALWAYS_INLINE void rotate_copy_pixel(unsigned char *dest,
+		const unsigned char *src, int bpp)
 {
-	int i;
+	dest[0] = src[0];
+	if (bpp > 1)
+		dest[1] = src[1];
+	if (bpp > 2)
+		dest[2] = src[2];
+}
 
-	/* First flip x and y of the Y plane */
-	src += width * height - 1;
-	for (i = 0; i < width * height; i++)
-		*dst++ = *src--;
+/* Do a block of the dest, src points to the source pixel of the top left
+   dest pixel, x_step / y_step are the source offsets of the next dest pixel
+   to the right / below */
+static V4LCONVERT_ALWAYS_INLINE void rotate_block(const unsigned char *src,
+		int x_step, int y_step, unsigned char *dest, int dest_stride,
+		int width, int height, int bpp)
+{
+	int x, y;
 
-	/* Now flip the U plane */
-	src += width * height * 5 / 4;
-	for (i = 0; i < width * height / 4; i++)
-		*dst++ = *src--;
+	for (y = 0; y < height; y++) {
+		const unsigned char *s = src + y * y_step;
+		unsigned char *d = dest + y * dest_stride;
 
-	/* Last flip the V plane */
-	src += width * height / 2;
-	for (i = 0; i < width * height / 4; i++)
-		*dst++ = *src--;
+		for (x = 0; x < width; x++) {
+			rotate_copy_pixel(d, s, bpp);
+			s += x_step;
+			d += bpp;
+		}
+	}
 }
 
-static void v4lconvert_rotate90_rgbbgr24(const unsigned char *src,
-		unsigned char *dst, int destwidth, int destheight)
+static V4LCONVERT_ALWAYS_INLINE void rotate_transposed(
+		const unsigned char *src, int x_step, int y_step,
+		unsigned char *dest, int dest_stride, int width, int height,
+		int bpp)
 {
-	int x, y;
-#define srcwidth destheight
-#define srcheight destwidth
-
-	for (y = 0; y < destheight; y++)
-		for (x = 0; x < destwidth; x++) {
-			int offset = ((srcheight - x - 1) * srcwidth + y) * 3;
-			*dst++ = src[offset++];
-			*dst++ = src[offset++];
-			*dst++ = src[offset];
+	void (*transpose)(const unsigned char *src, int src_stride,
+			unsigned char *dest, int dest_stride) = NULL;
+	int tx, ty, bx, by, tw, th;
+
+	if (bpp == 1)
+		transpose = rotate_simd.transpose8x8_8;
+	else if (bpp == 2)
+		transpose = rotate_simd.transpose8x8_16;
+
+	for (ty = 0; ty < height; ty += ROTATE_TILE_HEIGHT) {
+		th = height - ty;
+		if (th > ROTATE_TILE_HEIGHT)
+			th = ROTATE_TILE_HEIGHT;
+		for (tx = 0; tx < width; tx += ROTATE_TILE_WIDTH) {
+			const unsigned char *s = src + tx * x_step + ty * y_step;
+			unsigned char *d = dest + ty * dest_stride + tx * bpp;
+
+			tw = width - tx;
+			if (tw > ROTATE_TILE_WIDTH)
+				tw = ROTATE_TILE_WIDTH;
+			if (!transpose) {
+				rotate_block(s, x_step, y_step, d, dest_stride,
+						tw, th, bpp);
+				continue;
+			}
+
+			/* The 8x8 blocks read the source lines of a block from
+			   their lowest address on, when the source is read
+			   backwards the block gets written bottom up instead */
+			for (by = 0; by + 8 <= th; by += 8) {
+				const unsigned char *bs = s + by * y_step;
+				unsigned char *bd = d + by * dest_stride;
+
+				if (y_step < 0) {
+					bs += 7 * y_step;
+					bd += 7 * dest_stride;
+				}
+				for (bx = 0; bx + 8 <= tw; bx += 8)
+					transpose(bs + bx * x_step, x_step,
+						  bd + bx * bpp,
+						  y_step < 0 ? -dest_stride :
+							       dest_stride);
+				rotate_block(s + by * y_step + bx * x_step,
+						x_step, y_step,
+						d + by * dest_stride + bx * bpp,
+						dest_stride, tw - bx, 8, bpp);
+			}
+			rotate_block(s + by * y_step, x_step, y_step,
+					d + by * dest_stride, dest_stride,
+					tw, th - by, bpp);
 		}
+	}
 }
 
-static void v4lconvert_rotate90_yuv420(const unsigned char *src,
-		unsigned char *dst, int destwidth, int destheight)
+/* Rotate / flip one plane of width x height pixels of bpp bytes as
+   described by orient (V4LCONVERT_ORIENT_*), the transposed case swaps
+   the width and height of the dest. src and dest may not overlap. */
+void v4lconvert_rotate_plane(const unsigned char *src, int src_stride,
+		unsigned char *dest, int dest_stride, int width, int height,
+		int bpp, int orient)
 {
-	int x, y;
+	int x, y, x_step, y_step;
+
+	if (orient & V4LCONVERT_ORIENT_TRANSPOSE) {
+		x_step = src_stride;
+		y_step = bpp;
+		x = width;
+		width = height;
+		height = x;
+	} else {
+		x_step = bpp;
+		y_step = src_stride;
+	}
 
-	/* Y-plane */
-	for (y = 0; y < destheight; y++)
-		for (x = 0; x < destwidth; x++) {
-			int offset = (srcheight - x - 1) * srcwidth + y;
-			*dst++ = src[offset];
-		}
+	if (orient & V4LCONVERT_ORIENT_HFLIP) {
+		src += (width - 1) * x_step;
+		x_step = -x_step;
+	}
+	if (orient & V4LCONVERT_ORIENT_VFLIP) {
+		src += (height - 1) * y_step;
+		y_step = -y_step;
+	}
 
-	/* U-plane */
-	src += srcwidth * srcheight;
-	destwidth /= 2;
-	destheight /= 2;
-	for (y = 0; y < destheight; y++)
-		for (x = 0; x < destwidth; x++) {
-			int offset = (srcheight - x - 1) * srcwidth + y;
-			*dst++ = src[offset];
+	if (orient & V4LCONVERT_ORIENT_TRANSPOSE) {
+		/* Give the compiler a constant bpp to work with */
+		switch (bpp) {
+		case 1:
+			rotate_transposed(src, x_step, y_step, dest, dest_stride,
+					width, height, 1);
+			break;
+		case 2:
+			rotate_transposed(src, x_step, y_step, dest, dest_stride,
+					width, height, 2);
+			break;
+		case 3:
+			rotate_transposed(src, x_step, y_step, dest, dest_stride,
+					width, height, 3);
+			break;
 		}
+		return;
+	}
 
-	/* V-plane */
-	src += srcwidth * srcheight;
-	for (y = 0; y < destheight; y++)
-		for (x = 0; x < destwidth; x++) {
-			int offset = (srcheight - x - 1) * srcwidth + y;
-			*dst++ = src[offset];
+	/* Without transposing the source is read line by line already */
+	for (y = 0; y < height; y++) {
+		if (x_step > 0) {
+			memcpy(dest, src, width * bpp);
+		} else {
+			switch (bpp) {
+			case 1:
+				rotate_block(src, -1, 0, dest, 0, width, 1, 1);
+				break;
+			case 2:
+				rotate_block(src, -2, 0, dest, 0, width, 1, 2);
+				break;
+			case 3:
+				rotate_block(src, -3, 0, dest, 0, width, 1, 3);
+				break;
+			}
 		}
+		src += y_step;
+		dest += dest_stride;
+	}
 }
 
-void v4lconvert_rotate90(unsigned char *src, unsigned char *dest,
-		struct v4l2_format *fmt)
+/* Rotation by the given number of degrees clockwise followed by flipping
+   as an orientation for v4lconvert_rotate_plane() */
+int v4lconvert_orientation(int rotate, int hflip, int vflip)
 {
-	int tmp;
+	int orient;
+
+	switch (rotate) {
+	case 90:
+		orient = V4LCONVERT_ORIENT_TRANSPOSE | V4LCONVERT_ORIENT_HFLIP;
+		break;
+	case 180:
+		orient = V4LCONVERT_ORIENT_HFLIP | V4LCONVERT_ORIENT_VFLIP;
+		break;
+	case 270:
+		orient = V4LCONVERT_ORIENT_TRANSPOSE | V4LCONVERT_ORIENT_VFLIP;
+		break;
+	default:
+		orient = 0;
+	}
+
+	if (hflip)
+		orient ^= V4LCONVERT_ORIENT_HFLIP;
+	if (vflip)
+		orient ^= V4LCONVERT_ORIENT_VFLIP;
+
+	return orient;
+}
 
-	tmp = fmt->fmt.pix.width;
-	fmt->fmt.pix.width = fmt->fmt.pix.height;
-	fmt->fmt.pix.height = tmp;
+/* Rotate / flip a frame, for yuv420 width and height must be even. fmt gets
+   updated to describe the unpadded dest frame. */
+void v4lconvert_rotate(unsigned char *src, unsigned char *dest,
+		struct v4l2_format *fmt, int orient)
+{
+	int width = fmt->fmt.pix.width;
+	int height = fmt->fmt.pix.height;
+	int stride = fmt->fmt.pix.bytesperline;
+	int dest_width = (orient & V4LCONVERT_ORIENT_TRANSPOSE) ? height : width;
 
 	switch (fmt->fmt.pix.pixelformat) {
 	case V4L2_PIX_FMT_RGB24:
 	case V4L2_PIX_FMT_BGR24:
-		v4lconvert_rotate90_rgbbgr24(src, dest, fmt->fmt.pix.width,
-				fmt->fmt.pix.height);
+		v4lconvert_rotate_plane(src, stride, dest, dest_width * 3,
+				width, height, 3, orient);
 		break;
 	case V4L2_PIX_FMT_YUV420:
 	case V4L2_PIX_FMT_YVU420:
-		v4lconvert_rotate90_yuv420(src, dest, fmt->fmt.pix.width,
-				fmt->fmt.pix.height);
+		v4lconvert_rotate_plane(src, stride, dest, dest_width,
+				width, height, 1, orient);
+		src += height * stride;
+		dest += width * height;
+		v4lconvert_rotate_plane(src, stride / 2, dest, dest_width / 2,
+				width / 2, height / 2, 1, orient);
+		src += height / 2 * stride / 2;
+		dest += width * height / 4;
+		v4lconvert_rotate_plane(src, stride / 2, dest, dest_width / 2,
+				width / 2, height / 2, 1, orient);
+		break;
+	case V4L2_PIX_FMT_NV12:
+		/* The interleaved u / v plane is rotated as 2 bpp pixels */
+		v4lconvert_rotate_plane(src, stride, dest, dest_width,
+				width, height, 1, orient);
+		src += height * stride;
+		dest += width * height;
+		v4lconvert_rotate_plane(src, stride, dest, dest_width,
+				width / 2, height / 2, 2, orient);
 		break;
 	}
-	v4lconvert_fixup_fmt(fmt);
-}
 
-void v4lconvert_flip(unsigned char *src, unsigned char *dest,
-		struct v4l2_format *fmt, int hflip, int vflip)
-{
-	if (vflip && hflip) {
-		switch (fmt->fmt.pix.pixelformat) {
-		case V4L2_PIX_FMT_RGB24:
-		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_rotate180_rgbbgr24(src, dest, fmt->fmt.pix.width,
-					fmt->fmt.pix.height);
-			break;
-		case V4L2_PIX_FMT_YUV420:
-		case V4L2_PIX_FMT_YVU420:
-			v4lconvert_rotate180_yuv420(src, dest, fmt->fmt.pix.width,
-					fmt->fmt.pix.height);
-			break;
-		}
-	} else if (hflip) {
-		switch (fmt->fmt.pix.pixelformat) {
-		case V4L2_PIX_FMT_RGB24:
-		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_hflip_rgbbgr24(src, dest, fmt);
-			break;
-		case V4L2_PIX_FMT_YUV420:
-		case V4L2_PIX_FMT_YVU420:
-			v4lconvert_hflip_yuv420(src, dest, fmt);
-			break;
-		}
-	} else if (vflip) {
-		switch (fmt->fmt.pix.pixelformat) {
-		case V4L2_PIX_FMT_RGB24:
-		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_vflip_rgbbgr24(src, dest, fmt);
-			break;
-		case V4L2_PIX_FMT_YUV420:
-		case V4L2_PIX_FMT_YVU420:
-			v4lconvert_vflip_yuv420(src, dest, fmt);
-			break;
-		}
+	if (orient & V4LCONVERT_ORIENT_TRANSPOSE) {
+		fmt->fmt.pix.width = height;
+		fmt->fmt.pix.height = width;
 	}
-
-	/* Our newly written data has no padding */
 	v4lconvert_fixup_fmt(fmt);
 }
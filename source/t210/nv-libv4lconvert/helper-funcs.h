@@ -29,6 +29,11 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include "libv4lhelper-priv.h"
 
 static int v4lconvert_helper_write(int fd, const void *b, size_t count,
   char *progname)
@@ -77,3 +82,198 @@ static int v4lconvert_helper_read(int fd, void *b, size_t count,
 
   return 0;
 }
+
+/* Frame transport for the helper main loops, which is either the pipe
+   protocol on stdin / stdout, or the shared memory ring once libv4lconvert
+   has handed us one */
+struct v4lconvert_helper {
+  char *progname;
+  unsigned char *src_buf;  /* Buffers for the pipe protocol */
+  int src_buf_size;
+  unsigned char *dest_buf;
+  int dest_buf_size;
+  struct v4lconvert_helper_shm *shm; /* NULL when using the pipes */
+  unsigned int shm_size;
+  int shm_fd;
+  unsigned int slot;
+};
+
+static int v4lconvert_helper_shm_remap(struct v4lconvert_helper *h)
+{
+  struct stat st;
+  void *shm;
+
+  if (fstat(h->shm_fd, &st)) {
+    fprintf(stderr, "%s: error with shm: %s\n", h->progname, strerror(errno));
+    return -1;
+  }
+
+  shm = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, h->shm_fd,
+    0);
+  if (shm == MAP_FAILED) {
+    fprintf(stderr, "%s: error mapping shm: %s\n", h->progname,
+      strerror(errno));
+    return -1;
+  }
+
+  if (h->shm)
+    munmap(h->shm, h->shm_size);
+  h->shm = shm;
+  h->shm_size = st.st_size;
+
+  return 0;
+}
+
+static int v4lconvert_helper_shm_next(struct v4lconvert_helper *h,
+  int *width, int *height, int *flags, unsigned char **src, int *src_size,
+  unsigned char **dest, int *dest_max)
+{
+  struct v4lconvert_helper_shm_slot *slot;
+  struct pollfd fds[2];
+  eventfd_t kick;
+  char c;
+
+  /* Wait for a frame, or for libv4l to close our stdin */
+  fds[0].fd = h->shm->kick_fd;
+  fds[0].events = POLLIN;
+  fds[1].fd = STDIN_FILENO;
+  fds[1].events = POLLIN;
+  while (__atomic_load_n(&h->shm->head, __ATOMIC_ACQUIRE) == h->slot) {
+    if (poll(fds, 2, -1) == -1) {
+      if (errno == EINTR)
+	continue;
+
+      fprintf(stderr, "%s: error waiting: %s\n", h->progname, strerror(errno));
+      return -1;
+    }
+    if (fds[1].revents)
+      v4lconvert_helper_read(STDIN_FILENO, &c, 1, h->progname);
+    if (fds[0].revents & POLLIN)
+      eventfd_read(h->shm->kick_fd, &kick);
+  }
+
+  /* libv4l only grows the shm while nothing is in flight */
+  if (h->shm->size != h->shm_size && v4lconvert_helper_shm_remap(h))
+    return -1;
+
+  slot = &h->shm->slot[h->slot % V4LCONVERT_HELPER_SHM_SLOTS];
+  *width = slot->width;
+  *height = slot->height;
+  *flags = slot->flags;
+  *src_size = slot->src_size;
+  if (*src_size < 0 || (unsigned)*src_size > h->shm->src_max) {
+    fprintf(stderr, "%s: error: src_size out of bounds\n", h->progname);
+    return -1;
+  }
+  *src = v4lconvert_helper_shm_src(h->shm, h->slot);
+  *dest = v4lconvert_helper_shm_dest(h->shm, h->slot);
+  *dest_max = h->shm->dest_max;
+
+  return 0;
+}
+
+/* Get the next frame to decompress into *dest, returns 0 on success, or the
+   exit status for the helper. */
+static int v4lconvert_helper_get_frame(struct v4lconvert_helper *h,
+  int *width, int *height, int *flags, unsigned char **src, int *src_size,
+  unsigned char **dest, int *dest_max)
+{
+  int magic = V4LCONVERT_HELPER_SHM_MAGIC;
+
+  if (h->shm)
+    return v4lconvert_helper_shm_next(h, width, height, flags, src,
+      src_size, dest, dest_max) ? 1 : 0;
+
+  while (1) {
+    if (v4lconvert_helper_read(STDIN_FILENO, width, sizeof(int), h->progname))
+      return 1; /* Erm, no way to recover without loosing sync with libv4l */
+
+    if (v4lconvert_helper_read(STDIN_FILENO, height, sizeof(int), h->progname))
+      return 1; /* Erm, no way to recover without loosing sync with libv4l */
+
+    if (v4lconvert_helper_read(STDIN_FILENO, flags, sizeof(int), h->progname))
+      return 1; /* Erm, no way to recover without loosing sync with libv4l */
+
+    if (v4lconvert_helper_read(STDIN_FILENO, src_size, sizeof(int),
+	  h->progname))
+      return 1; /* Erm, no way to recover without loosing sync with libv4l */
+
+    if (*flags != V4LCONVERT_HELPER_SHM_MAGIC)
+      break;
+
+    /* libv4l offers us shared memory, the memfd is in the probe data */
+    if (*src_size != V4LCONVERT_HELPER_SHM_PROBE_SIZE) {
+      fprintf(stderr, "%s: error: invalid shm probe size: %d\n",
+	h->progname, *src_size);
+      return 2;
+    }
+    if (v4lconvert_helper_read(STDIN_FILENO, h->src_buf, *src_size,
+	  h->progname))
+      return 1; /* Erm, no way to recover without loosing sync with libv4l */
+    memcpy(&h->shm_fd, h->src_buf + sizeof(int), sizeof(int));
+    if (v4lconvert_helper_shm_remap(h) ||
+	h->shm->magic != V4LCONVERT_HELPER_SHM_MAGIC) {
+      magic = -1;
+      if (h->shm) {
+	munmap(h->shm, h->shm_size);
+	h->shm = NULL;
+      }
+    } else
+      h->slot = h->shm->tail;
+
+    if (v4lconvert_helper_write(STDOUT_FILENO, &magic, sizeof(int),
+	  h->progname))
+      return 1;
+
+    if (h->shm)
+      return v4lconvert_helper_shm_next(h, width, height, flags, src,
+	src_size, dest, dest_max) ? 1 : 0;
+  }
+
+  if (*src_size > h->src_buf_size) {
+    fprintf(stderr, "%s: error: src_buf too small, need: %d\n",
+      h->progname, *src_size);
+    return 2;
+  }
+
+  if (v4lconvert_helper_read(STDIN_FILENO, h->src_buf, *src_size, h->progname))
+    return 1; /* Erm, no way to recover without loosing sync with libv4l */
+
+  *src = h->src_buf;
+  *dest = h->dest_buf;
+  *dest_max = h->dest_buf_size;
+
+  return 0;
+}
+
+/* Hand back the frame got from v4lconvert_helper_get_frame(), dest_size is
+   -1 in case of a decompression error. Returns 0 on success, or the exit
+   status for the helper. */
+static int v4lconvert_helper_put_frame(struct v4lconvert_helper *h,
+  int dest_size)
+{
+  if (h->shm) {
+    h->shm->slot[h->slot % V4LCONVERT_HELPER_SHM_SLOTS].dest_size = dest_size;
+    h->slot++;
+    __atomic_store_n(&h->shm->tail, h->slot, __ATOMIC_RELEASE);
+    if (eventfd_write(h->shm->done_fd, 1)) {
+      fprintf(stderr, "%s: error signalling: %s\n", h->progname,
+	strerror(errno));
+      return 1;
+    }
+    return 0;
+  }
+
+  if (v4lconvert_helper_write(STDOUT_FILENO, &dest_size, sizeof(int),
+	h->progname))
+    return 1; /* Erm, no way to recover without loosing sync with libv4l */
+
+  if (dest_size == -1)
+    return 0;
+
+  if (v4lconvert_helper_write(STDOUT_FILENO, h->dest_buf, dest_size,
+	h->progname))
+    return 1; /* Erm, no way to recover without loosing sync with libv4l */
+
+  return 0;
+}
@@ -21,11 +21,19 @@
 #include <errno.h>
 #include <string.h>
 #include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
 #include "libv4lconvert-priv.h"
+#include "libv4lhelper-priv.h"
 
-#define READ_END  0
-#define WRITE_END 1
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
 
 /* <sigh> Unfortunately I've failed in contact some Authors of decompression
    code of out of tree drivers. So I've no permission to relicense their code
@@ -45,87 +53,140 @@
    From the helper to libv4l the following is send:
    int			data length (-1 in case of a decompression error)
    unsigned char[]	data (not present when a decompression error happened)
+
+   This copies every frame through the kernel twice, so when possible the
+   pipes are only used once, to hand the helper a memfd holding a ring of
+   frame slots (see libv4lhelper-priv.h), after which frames are passed
+   through that and signalled with eventfds. Helpers which do not know about
+   this keep getting their frames through the pipes.
+
+   The "pipes" are a unix socketpair connected to the helper's stdin and
+   stdout, so that we get EPIPE rather than SIGPIPE when a helper crashed,
+   and can simply start a new one.
+
+   With LIBV4LCONVERT_HELPERS set to N > 1, frames are handed round robin to
+   N helpers and handed back in order N - 1 frames later, so that N frames
+   get decompressed in parallel. Until the pipeline is filled, and for
+   frames lost to a crashing helper, v4lconvert_helper_decompress() fails
+   and the caller reports EAGAIN, which makes libv4l2 get another frame.
  */
 
-static int v4lconvert_helper_start(struct v4lconvert_data *data,
-		const char *helper)
+struct v4lconvert_helper_proc {
+	pid_t pid;    /* -1 when not running */
+	int sock;     /* connected to stdin / stdout of the helper */
+	struct v4lconvert_helper_shm *shm; /* NULL when using the pipes */
+	int shm_fd;
+	int kick_fd;  /* eventfd, frame(s) ready for the helper */
+	int done_fd;  /* eventfd, frame(s) done by the helper */
+	int busy;     /* a frame is in flight */
+	unsigned int slot; /* shm slot of the frame in flight */
+	int width;    /* of the frame in flight */
+	int height;
+	int flags;
+};
+
+struct v4lconvert_helper_pool {
+	const char *helper;
+	int count;
+	unsigned int submitted; /* Frames handed to the helpers */
+	unsigned int delivered; /* Frames handed back to the caller (or lost) */
+	struct v4lconvert_helper_proc proc[V4LCONVERT_MAX_HELPERS];
+};
+
+static void v4lconvert_helper_shm_destroy(struct v4lconvert_helper_proc *proc)
 {
-	if (pipe(data->decompress_in_pipe)) {
-		V4LCONVERT_ERR("with helper pipe: %s\n", strerror(errno));
-		goto error;
-	}
+	if (!proc->shm)
+		return;
+
+	munmap(proc->shm, proc->shm->size);
+	close(proc->shm_fd);
+	close(proc->kick_fd);
+	close(proc->done_fd);
+	proc->shm = NULL;
+}
 
-	if (pipe(data->decompress_out_pipe)) {
-		V4LCONVERT_ERR("with helper pipe: %s\n", strerror(errno));
-		goto error_close_in_pipe;
+static int v4lconvert_helper_shm_map(struct v4lconvert_data *data,
+		struct v4lconvert_helper_proc *proc,
+		unsigned int src_max, unsigned int dest_max)
+{
+	struct v4lconvert_helper_shm *shm;
+	unsigned int size;
+
+	src_max = (src_max + V4LCONVERT_HELPER_SHM_ALIGN - 1) &
+		~(V4LCONVERT_HELPER_SHM_ALIGN - 1);
+	dest_max = (dest_max + V4LCONVERT_HELPER_SHM_ALIGN - 1) &
+		~(V4LCONVERT_HELPER_SHM_ALIGN - 1);
+	size = V4LCONVERT_HELPER_SHM_HDR_SIZE +
+		V4LCONVERT_HELPER_SHM_SLOTS * (src_max + dest_max);
+
+	if (ftruncate(proc->shm_fd, size)) {
+		V4LCONVERT_ERR("resizing helper shm: %s\n", strerror(errno));
+		return -1;
 	}
 
-	data->decompress_pid = fork();
-	if (data->decompress_pid == -1) {
-		V4LCONVERT_ERR("with helper fork: %s\n", strerror(errno));
-		goto error_close_out_pipe;
+	shm = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			proc->shm_fd, 0);
+	if (shm == MAP_FAILED) {
+		V4LCONVERT_ERR("mapping helper shm: %s\n", strerror(errno));
+		return -1;
 	}
 
-	if (data->decompress_pid == 0) {
-		/* We are the child */
+	if (proc->shm)
+		munmap(proc->shm, proc->shm->size);
+	proc->shm = shm;
 
-		/* Closed unused read / write end of the pipes */
-		close(data->decompress_out_pipe[WRITE_END]);
-		close(data->decompress_in_pipe[READ_END]);
-
-		/* Connect stdin / out to the pipes */
-		if (dup2(data->decompress_out_pipe[READ_END], STDIN_FILENO) == -1) {
-			perror("libv4lconvert: error with helper dup2");
-			exit(1);
-		}
-		if (dup2(data->decompress_in_pipe[WRITE_END], STDOUT_FILENO) == -1) {
-			perror("libv4lconvert: error with helper dup2");
-			exit(1);
-		}
-
-		/* And execute the helper */
-		execl(helper, helper, NULL);
-
-		/* We should never get here */
-		perror("libv4lconvert: error starting helper");
-		exit(1);
-	} else {
-		/* Closed unused read / write end of the pipes */
-		close(data->decompress_out_pipe[READ_END]);
-		close(data->decompress_in_pipe[WRITE_END]);
-	}
+	shm->magic = V4LCONVERT_HELPER_SHM_MAGIC;
+	shm->size = size;
+	shm->src_max = src_max;
+	shm->dest_max = dest_max;
+	shm->kick_fd = proc->kick_fd;
+	shm->done_fd = proc->done_fd;
 
 	return 0;
-
-error_close_out_pipe:
-	close(data->decompress_out_pipe[READ_END]);
-	close(data->decompress_out_pipe[WRITE_END]);
-error_close_in_pipe:
-	close(data->decompress_in_pipe[READ_END]);
-	close(data->decompress_in_pipe[WRITE_END]);
-error:
-	return -1;
 }
 
-/* IMPROVE ME: we could block SIGPIPE here using pthread_sigmask()
-   and then in case of EPIPE consume the signal using
-   sigtimedwait (we need to check if a blocked signal wasn't present
-   before the write, otherwise we will consume that) and
-   after consuming the signal try to restart the helper.
+/* Failing to set up the shared memory is not fatal, we then simply use the
+   pipes */
+static void v4lconvert_helper_shm_create(struct v4lconvert_data *data,
+		struct v4lconvert_helper_proc *proc)
+{
+#ifdef SYS_memfd_create
+	proc->shm_fd = syscall(SYS_memfd_create, "libv4lconvert-helper",
+			MFD_CLOEXEC);
+	if (proc->shm_fd == -1)
+		return;
+
+	proc->kick_fd = eventfd(0, EFD_CLOEXEC);
+	if (proc->kick_fd == -1)
+		goto error_close_shm;
+
+	proc->done_fd = eventfd(0, EFD_CLOEXEC);
+	if (proc->done_fd == -1)
+		goto error_close_kick;
+
+	if (v4lconvert_helper_shm_map(data, proc, 0, 0))
+		goto error_close_done;
+
+	return;
+
+error_close_done:
+	close(proc->done_fd);
+error_close_kick:
+	close(proc->kick_fd);
+error_close_shm:
+	close(proc->shm_fd);
+#endif
+}
 
-   Note we currently do not do this, as SIGPIPE only happens if the
-   decompressor crashes, which in case of an embedded decompressor
-   would mean end of program, so by not handling SIGPIPE we treat
-   external decompressors identical. */
 static int v4lconvert_helper_write(struct v4lconvert_data *data,
-		const void *b, size_t count)
+		struct v4lconvert_helper_proc *proc, const void *b, size_t count)
 {
 	const unsigned char *buf = b;
 	size_t ret, written = 0;
 
 	while (written < count) {
-		ret = write(data->decompress_out_pipe[WRITE_END], buf + written,
-				count - written);
+		ret = send(proc->sock, buf + written, count - written,
+				MSG_NOSIGNAL);
 		if ((int)ret == -1) {
 			if (errno == EINTR)
 				continue;
@@ -139,14 +200,14 @@ static int v4lconvert_helper_write(struct v4lconvert_data *data,
 	return 0;
 }
 
-static int v4lconvert_helper_read(struct v4lconvert_data *data, void *b,
-		size_t count)
+static int v4lconvert_helper_read(struct v4lconvert_data *data,
+		struct v4lconvert_helper_proc *proc, void *b, size_t count)
 {
 	unsigned char *buf = b;
 	size_t ret, r = 0;
 
 	while (r < count) {
-		ret = read(data->decompress_in_pipe[READ_END], buf + r, count - r);
+		ret = read(proc->sock, buf + r, count - r);
 		if ((int)ret == -1) {
 			if (errno == EINTR)
 				continue;
@@ -164,56 +225,324 @@ static int v4lconvert_helper_read(struct v4lconvert_data *data, void *b,
 	return 0;
 }
 
-int v4lconvert_helper_decompress(struct v4lconvert_data *data,
-		const char *helper, const unsigned char *src, int src_size,
-		unsigned char *dest, int dest_size, int width, int height, int flags)
+/* Offer the helper the shared memory, if it declines we stay on the pipes */
+static int v4lconvert_helper_shm_probe(struct v4lconvert_data *data,
+		struct v4lconvert_helper_proc *proc)
 {
+	int header[4] = {
+		V4LCONVERT_HELPER_SHM_PROBE_WIDTH,
+		V4LCONVERT_HELPER_SHM_PROBE_HEIGHT,
+		V4LCONVERT_HELPER_SHM_MAGIC,
+		V4LCONVERT_HELPER_SHM_PROBE_SIZE
+	};
+	int probe[V4LCONVERT_HELPER_SHM_PROBE_SIZE / sizeof(int)] = {
+		V4LCONVERT_HELPER_SHM_MAGIC, proc->shm_fd
+	};
+	unsigned char frame[V4LCONVERT_HELPER_SHM_PROBE_WIDTH *
+			    V4LCONVERT_HELPER_SHM_PROBE_HEIGHT * 3];
 	int r;
 
-	if (data->decompress_pid == -1) {
-		if (v4lconvert_helper_start(data, helper))
-			return -1;
-	}
+	if (v4lconvert_helper_write(data, proc, header, sizeof(header)) ||
+	    v4lconvert_helper_write(data, proc, probe, sizeof(probe)))
+		return -1;
 
-	if (v4lconvert_helper_write(data, &width, sizeof(int)))
+	if (v4lconvert_helper_read(data, proc, &r, sizeof(int)))
 		return -1;
 
-	if (v4lconvert_helper_write(data, &height, sizeof(int)))
+	if (r == V4LCONVERT_HELPER_SHM_MAGIC)
+		return 0;
+
+	/* An older helper, which decompressed the probe as a normal frame */
+	if (r > (int)sizeof(frame)) {
+		V4LCONVERT_ERR("invalid helper answer to shm probe: %d\n", r);
+		return -1;
+	}
+	if (r > 0 && v4lconvert_helper_read(data, proc, frame, r))
 		return -1;
 
-	if (v4lconvert_helper_write(data, &flags, sizeof(int)))
+	v4lconvert_helper_shm_destroy(proc);
+	return 0;
+}
+
+static void v4lconvert_helper_stop(struct v4lconvert_helper_proc *proc)
+{
+	int status;
+
+	if (proc->pid == -1)
+		return;
+
+	/* Closing the socket makes the helper exit */
+	close(proc->sock);
+	waitpid(proc->pid, &status, 0);
+	proc->pid = -1;
+	proc->busy = 0;
+	v4lconvert_helper_shm_destroy(proc);
+}
+
+static int v4lconvert_helper_start(struct v4lconvert_data *data,
+		struct v4lconvert_helper_proc *proc, const char *helper)
+{
+	int sv[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv)) {
+		V4LCONVERT_ERR("with helper socketpair: %s\n", strerror(errno));
 		return -1;
+	}
+
+	v4lconvert_helper_shm_create(data, proc);
 
-	if (v4lconvert_helper_write(data, &src_size, sizeof(int)))
+	proc->pid = fork();
+	if (proc->pid == -1) {
+		V4LCONVERT_ERR("with helper fork: %s\n", strerror(errno));
+		v4lconvert_helper_shm_destroy(proc);
+		close(sv[0]);
+		close(sv[1]);
 		return -1;
+	}
+
+	if (proc->pid == 0) {
+		/* We are the child */
 
-	if (v4lconvert_helper_write(data, src, src_size))
+		/* Connect stdin / out to the socket, dup2 clears CLOEXEC */
+		if (dup2(sv[1], STDIN_FILENO) == -1 ||
+				dup2(sv[1], STDOUT_FILENO) == -1) {
+			perror("libv4lconvert: error with helper dup2");
+			exit(1);
+		}
+
+		/* Let the helper inherit the shm and eventfds */
+		if (proc->shm) {
+			fcntl(proc->shm_fd, F_SETFD, 0);
+			fcntl(proc->kick_fd, F_SETFD, 0);
+			fcntl(proc->done_fd, F_SETFD, 0);
+		}
+
+		/* And execute the helper */
+		execl(helper, helper, NULL);
+
+		/* We should never get here */
+		perror("libv4lconvert: error starting helper");
+		exit(1);
+	}
+
+	/* Close the child's end of the socket */
+	close(sv[1]);
+	proc->sock = sv[0];
+
+	if (proc->shm && v4lconvert_helper_shm_probe(data, proc)) {
+		v4lconvert_helper_stop(proc);
 		return -1;
+	}
+
+	return 0;
+}
+
+static int v4lconvert_helper_submit(struct v4lconvert_data *data,
+		struct v4lconvert_helper_proc *proc,
+		const unsigned char *src, int src_size, int dest_size,
+		int width, int height, int flags)
+{
+	struct v4lconvert_helper_shm *shm = proc->shm;
+	struct v4lconvert_helper_shm_slot *slot;
+	int header[4] = { width, height, flags, src_size };
+
+	proc->width = width;
+	proc->height = height;
+	proc->flags = flags;
+
+	if (!shm) {
+		if (v4lconvert_helper_write(data, proc, header, sizeof(header)))
+			return -1;
+
+		return v4lconvert_helper_write(data, proc, src, src_size);
+	}
 
-	if (v4lconvert_helper_read(data, &r, sizeof(int)))
+	/* Only grow while the helper is idle */
+	if ((unsigned)src_size > shm->src_max ||
+			(unsigned)dest_size > shm->dest_max) {
+		if (v4lconvert_helper_shm_map(data, proc, src_size, dest_size))
+			return -1;
+		shm = proc->shm;
+	}
+
+	proc->slot = shm->head;
+	slot = &shm->slot[proc->slot % V4LCONVERT_HELPER_SHM_SLOTS];
+	slot->width = width;
+	slot->height = height;
+	slot->flags = flags;
+	slot->src_size = src_size;
+	memcpy(v4lconvert_helper_shm_src(shm, proc->slot), src, src_size);
+	__atomic_store_n(&shm->head, proc->slot + 1, __ATOMIC_RELEASE);
+
+	if (eventfd_write(proc->kick_fd, 1)) {
+		V4LCONVERT_ERR("signalling helper: %s\n", strerror(errno));
 		return -1;
+	}
+
+	return 0;
+}
+
+/* Returns -1 on a decompression error, -2 when the helper is gone */
+static int v4lconvert_helper_receive(struct v4lconvert_data *data,
+		struct v4lconvert_helper_proc *proc,
+		unsigned char *dest, int dest_size)
+{
+	struct v4lconvert_helper_shm *shm = proc->shm;
+	struct pollfd fds[2];
+	eventfd_t done;
+	int r;
+
+	if (!shm) {
+		if (v4lconvert_helper_read(data, proc, &r, sizeof(int)))
+			return -2;
 
+		if (r < 0) {
+			V4LCONVERT_ERR("decompressing frame data\n");
+			return -1;
+		}
+
+		/* Too late to skip the data, we would lose sync */
+		if (dest_size < r) {
+			V4LCONVERT_ERR("destination buffer to small\n");
+			return -2;
+		}
+
+		return v4lconvert_helper_read(data, proc, dest, r) ? -2 : 0;
+	}
+
+	/* The helper never writes to its stdout after the probe, so it
+	   becoming readable means the helper has exited */
+	fds[0].fd = proc->done_fd;
+	fds[0].events = POLLIN;
+	fds[1].fd = proc->sock;
+	fds[1].events = POLLIN;
+	while (__atomic_load_n(&shm->tail, __ATOMIC_ACQUIRE) == proc->slot) {
+		r = poll(fds, 2, -1);
+		if (r == -1) {
+			if (errno == EINTR)
+				continue;
+
+			V4LCONVERT_ERR("waiting for helper: %s\n", strerror(errno));
+			return -2;
+		}
+		if (fds[0].revents & POLLIN) {
+			eventfd_read(proc->done_fd, &done);
+			continue;
+		}
+		V4LCONVERT_ERR("waiting for helper: unexpected EOF\n");
+		return -2;
+	}
+
+	r = shm->slot[proc->slot % V4LCONVERT_HELPER_SHM_SLOTS].dest_size;
 	if (r < 0) {
 		V4LCONVERT_ERR("decompressing frame data\n");
 		return -1;
 	}
 
-	if (dest_size < r) {
+	if (dest_size < r || (unsigned)r > shm->dest_max) {
 		V4LCONVERT_ERR("destination buffer to small\n");
 		return -1;
 	}
 
-	return v4lconvert_helper_read(data, dest, r);
+	memcpy(dest, v4lconvert_helper_shm_dest(shm, proc->slot), r);
+	return 0;
 }
 
-void v4lconvert_helper_cleanup(struct v4lconvert_data *data)
+static int v4lconvert_helper_pool_create(struct v4lconvert_data *data,
+		const char *helper)
 {
-	int status;
+	struct v4lconvert_helper_pool *pool;
+	int i;
 
-	if (data->decompress_pid != -1) {
-		close(data->decompress_out_pipe[WRITE_END]);
-		close(data->decompress_in_pipe[READ_END]);
-		waitpid(data->decompress_pid, &status, 0);
-		data->decompress_pid = -1;
+	pool = calloc(1, sizeof(*pool));
+	if (!pool) {
+		V4LCONVERT_ERR("out of memory\n");
+		return -1;
+	}
+
+	pool->helper = helper;
+	pool->count = data->decompress_helpers;
+	for (i = 0; i < pool->count; i++)
+		pool->proc[i].pid = -1;
+
+	data->helpers = pool;
+	return 0;
+}
+
+int v4lconvert_helper_decompress(struct v4lconvert_data *data,
+		const char *helper, const unsigned char *src, int src_size,
+		unsigned char *dest, int dest_size, int width, int height, int flags)
+{
+	struct v4lconvert_helper_pool *pool = data->helpers;
+	struct v4lconvert_helper_proc *proc;
+	int r;
+
+	if (pool && strcmp(pool->helper, helper)) {
+		v4lconvert_helper_cleanup(data);
+		pool = NULL;
+	}
+
+	if (!pool) {
+		if (v4lconvert_helper_pool_create(data, helper))
+			return -1;
+		pool = data->helpers;
+	}
+
+	/* Hand the frame to the next helper in line, which is idle as it has
+	   handed back its previous frame pool->count frames ago */
+	proc = &pool->proc[pool->submitted % pool->count];
+	pool->submitted++;
+	if (proc->pid == -1 && v4lconvert_helper_start(data, proc, helper))
+		return -1;
+
+	if (v4lconvert_helper_submit(data, proc, src, src_size, dest_size,
+				width, height, flags))
+		v4lconvert_helper_stop(proc); /* Restarted for the next frame */
+	else
+		proc->busy = 1;
+
+	/* Then hand back the oldest frame, once the pipeline is full */
+	if (pool->submitted - pool->delivered < (unsigned)pool->count) {
+		V4LCONVERT_ERR("filling helper pipeline\n");
+		return -1;
+	}
+
+	/* Frames decoded with another size or other flags (yvu) are of no use
+	   to the caller. After a change these are all frames in flight but the
+	   one just submitted, so drop them and wait for that one instead */
+	for (;;) {
+		proc = &pool->proc[pool->delivered % pool->count];
+		pool->delivered++;
+		if (!proc->busy) {
+			r = -1; /* Lost to a crashed helper */
+		} else {
+			proc->busy = 0;
+			r = v4lconvert_helper_receive(data, proc, dest, dest_size);
+			if (r == -2)
+				v4lconvert_helper_stop(proc);
+		}
+
+		if (proc->width == width && proc->height == height &&
+				proc->flags == flags)
+			return r ? -1 : 0;
+
+		if (pool->delivered == pool->submitted) {
+			V4LCONVERT_ERR("helper frame of a previous format\n");
+			return -1;
+		}
 	}
 }
+
+void v4lconvert_helper_cleanup(struct v4lconvert_data *data)
+{
+	int i;
+
+	if (!data->helpers)
+		return;
+
+	for (i = 0; i < data->helpers->count; i++)
+		v4lconvert_helper_stop(&data->helpers->proc[i]);
+
+	free(data->helpers);
+	data->helpers = NULL;
+}
@@ -0,0 +1,753 @@
+/*
+ * jidctint.c
+ *
+ * Copyright (C) 1991-1998, Thomas G. Lane.
+ * This file is part of the Independent JPEG Group's software.
+ *
+ * The authors make NO WARRANTY or representation, either express or implied,
+ * with respect to this software, its quality, accuracy, merchantability, or
+ * fitness for a particular purpose.  This software is provided "AS IS", and you,
+ * its user, assume the entire risk as to its quality and accuracy.
+ *
+ * This software is copyright (C) 1991-1998, Thomas G. Lane.
+ * All Rights Reserved except as specified below.
+ *
+ * Permission is hereby granted to use, copy, modify, and distribute this
+ * software (or portions thereof) for any purpose, without fee, subject to these
+ * conditions:
+ * (1) If any part of the source code for this software is distributed, then this
+ * README file must be included, with this copyright and no-warranty notice
+ * unaltered; and any additions, deletions, or changes to the original files
+ * must be clearly indicated in accompanying documentation.
+ * (2) If only executable code is distributed, then the accompanying
+ * documentation must state that "this software is based in part on the work of
+ * the Independent JPEG Group".
+ * (3) Permission for use of this software is granted only if the user accepts
+ * full responsibility for any undesirable consequences; the authors accept
+ * NO LIABILITY for damages of any kind.
+ *
+ * These conditions apply to any software derived from or based on the IJG code,
+ * not just to the unmodified library.  If you use our work, you ought to
+ * acknowledge us.
+ *
+ * Permission is NOT granted for the use of any IJG author's name or company name
+ * in advertising or publicity relating to this software or products derived from
+ * it.  This software may be referred to only as "the Independent JPEG Group's
+ * software".
+ *
+ * We specifically permit and encourage the use of this software as the basis of
+ * commercial products, provided that all warranty or liability claims are
+ * assumed by the product vendor.
+ *
+ *
+ * This file contains the integer implementations of the inverse DCT for
+ * tinyjpeg, based on the IJG jidctint.c ("islow") and jidctfst.c ("ifast").
+ * Changes from the IJG code: the islow version uses 32 bit arithmetic only,
+ * so that it can be vectorized; the ifast version always rounds when
+ * descaling the final output; both have AVX2 and NEON versions which give
+ * results identical to the C version, and clamp the output instead of using a
+ * range limit table.
+ *
+ * islow is a fixed point version of the Loeffler, Ligtenberg and Moschytz
+ * algorithm, its accuracy is about that of the floating-point version in
+ * jidctflt.c. ifast is the Arai, Agui and Nakajima algorithm also used in
+ * jidctflt.c with 8 bit fixed point multipliers, which is faster but less
+ * accurate.
+ */
+
+#include <stdint.h>
+#include "tinyjpeg-internal.h"
+#include "libv4lconvert-priv.h"
+#include "libv4lsimd-priv.h"
+
+/* Also defined by jpeglib.h when building with libjpeg */
+#ifndef DCTSIZE
+#define DCTSIZE	   8
+#define DCTSIZE2   (DCTSIZE * DCTSIZE)
+#endif
+
+/* Descale and correctly round an int32_t value that's scaled by n bits */
+#define DESCALE(x, n)  (((x) + (1 << ((n) - 1))) >> (n))
+
+static inline uint8_t clamp_sample(int32_t x)
+{
+	x += 128;
+	if (x < 0)
+		return 0;
+	if (x > 255)
+		return 255;
+	return x;
+}
+
+/*
+ * islow
+ */
+
+#define CONST_BITS  13
+#define PASS1_BITS  2
+
+#define FIX_0_298631336  2446
+#define FIX_0_390180644  3196
+#define FIX_0_541196100  4433
+#define FIX_0_765366865  6270
+#define FIX_0_899976223  7373
+#define FIX_1_175875602  9633
+#define FIX_1_501321110  12299
+#define FIX_1_847759065  15137
+#define FIX_1_961570560  16069
+#define FIX_2_053119869  16819
+#define FIX_2_562915447  20995
+#define FIX_3_072711026  25172
+
+/* 1-D islow IDCT of in0 ... in7, the outputs are tmp1x +/- tmpx, still
+   scaled up by CONST_BITS */
+#define IDCT_ISLOW_1D(in0, in1, in2, in3, in4, in5, in6, in7) do { \
+	/* Even part */ \
+	z1 = ((in2) + (in6)) * FIX_0_541196100; \
+	tmp2 = z1 + (in6) * -FIX_1_847759065; \
+	tmp3 = z1 + (in2) * FIX_0_765366865; \
+	tmp0 = ((in0) + (in4)) * (1 << CONST_BITS); \
+	tmp1 = ((in0) - (in4)) * (1 << CONST_BITS); \
+	tmp10 = tmp0 + tmp3; \
+	tmp13 = tmp0 - tmp3; \
+	tmp11 = tmp1 + tmp2; \
+	tmp12 = tmp1 - tmp2; \
+	/* Odd part */ \
+	tmp0 = (in7); \
+	tmp1 = (in5); \
+	tmp2 = (in3); \
+	tmp3 = (in1); \
+	z1 = tmp0 + tmp3; \
+	z2 = tmp1 + tmp2; \
+	z3 = tmp0 + tmp2; \
+	z4 = tmp1 + tmp3; \
+	z5 = (z3 + z4) * FIX_1_175875602; \
+	tmp0 *= FIX_0_298631336; \
+	tmp1 *= FIX_2_053119869; \
+	tmp2 *= FIX_3_072711026; \
+	tmp3 *= FIX_1_501321110; \
+	z1 *= -FIX_0_899976223; \
+	z2 *= -FIX_2_562915447; \
+	z3 *= -FIX_1_961570560; \
+	z4 *= -FIX_0_390180644; \
+	z3 += z5; \
+	z4 += z5; \
+	tmp0 += z1 + z3; \
+	tmp1 += z2 + z4; \
+	tmp2 += z2 + z3; \
+	tmp3 += z1 + z4; \
+} while (0)
+
+static void idct_islow_c(struct component *compptr, uint8_t *output_buf, int stride)
+{
+	int32_t tmp0, tmp1, tmp2, tmp3, tmp10, tmp11, tmp12, tmp13;
+	int32_t z1, z2, z3, z4, z5;
+	const int16_t *inptr = compptr->DCT;
+	const int16_t *quantptr = compptr->islow_Q_table;
+	int32_t workspace[DCTSIZE2], *wsptr = workspace;
+	int32_t in[DCTSIZE];
+	uint8_t *outptr;
+	int i, ctr;
+
+	/* Pass 1: process columns from input, store into work array.
+	 * Note results are scaled up by sqrt(8) compared to a true IDCT;
+	 * furthermore, we scale the results by 2**PASS1_BITS. */
+	for (ctr = 0; ctr < DCTSIZE; ctr++, inptr++, quantptr++, wsptr++) {
+		/* Columns without AC terms are common, each output is the
+		 * DC coefficient then (this gives the same result as the full
+		 * calculation) */
+		if ((inptr[DCTSIZE*1] | inptr[DCTSIZE*2] | inptr[DCTSIZE*3] |
+				inptr[DCTSIZE*4] | inptr[DCTSIZE*5] |
+				inptr[DCTSIZE*6] | inptr[DCTSIZE*7]) == 0) {
+			int32_t dcval = (inptr[0] * quantptr[0]) * (1 << PASS1_BITS);
+
+			for (i = 0; i < DCTSIZE; i++)
+				wsptr[DCTSIZE*i] = dcval;
+			continue;
+		}
+
+		for (i = 0; i < DCTSIZE; i++)
+			in[i] = inptr[DCTSIZE*i] * quantptr[DCTSIZE*i];
+
+		IDCT_ISLOW_1D(in[0], in[1], in[2], in[3], in[4], in[5], in[6],
+				in[7]);
+
+		wsptr[DCTSIZE*0] = DESCALE(tmp10 + tmp3, CONST_BITS-PASS1_BITS);
+		wsptr[DCTSIZE*7] = DESCALE(tmp10 - tmp3, CONST_BITS-PASS1_BITS);
+		wsptr[DCTSIZE*1] = DESCALE(tmp11 + tmp2, CONST_BITS-PASS1_BITS);
+		wsptr[DCTSIZE*6] = DESCALE(tmp11 - tmp2, CONST_BITS-PASS1_BITS);
+		wsptr[DCTSIZE*2] = DESCALE(tmp12 + tmp1, CONST_BITS-PASS1_BITS);
+		wsptr[DCTSIZE*5] = DESCALE(tmp12 - tmp1, CONST_BITS-PASS1_BITS);
+		wsptr[DCTSIZE*3] = DESCALE(tmp13 + tmp0, CONST_BITS-PASS1_BITS);
+		wsptr[DCTSIZE*4] = DESCALE(tmp13 - tmp0, CONST_BITS-PASS1_BITS);
+	}
+
+	/* Pass 2: process rows from work array, store into output array.
+	 * Note that we must descale the results by a factor of 8 == 2**3,
+	 * and also undo the PASS1_BITS scaling. */
+	wsptr = workspace;
+	outptr = output_buf;
+	for (ctr = 0; ctr < DCTSIZE; ctr++, wsptr += DCTSIZE, outptr += stride) {
+		IDCT_ISLOW_1D(wsptr[0], wsptr[1], wsptr[2], wsptr[3], wsptr[4],
+				wsptr[5], wsptr[6], wsptr[7]);
+
+		outptr[0] = clamp_sample(DESCALE(tmp10 + tmp3, CONST_BITS+PASS1_BITS+3));
+		outptr[7] = clamp_sample(DESCALE(tmp10 - tmp3, CONST_BITS+PASS1_BITS+3));
+		outptr[1] = clamp_sample(DESCALE(tmp11 + tmp2, CONST_BITS+PASS1_BITS+3));
+		outptr[6] = clamp_sample(DESCALE(tmp11 - tmp2, CONST_BITS+PASS1_BITS+3));
+		outptr[2] = clamp_sample(DESCALE(tmp12 + tmp1, CONST_BITS+PASS1_BITS+3));
+		outptr[5] = clamp_sample(DESCALE(tmp12 - tmp1, CONST_BITS+PASS1_BITS+3));
+		outptr[3] = clamp_sample(DESCALE(tmp13 + tmp0, CONST_BITS+PASS1_BITS+3));
+		outptr[4] = clamp_sample(DESCALE(tmp13 - tmp0, CONST_BITS+PASS1_BITS+3));
+	}
+}
+
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+/* One vector holds a row of 8 coefficients, so the 1-D IDCT of the columns
+   is done for all 8 columns at once. v[] is replaced by the unscaled
+   outputs. */
+static inline V4LCONVERT_AVX2 void idct_islow_1d_avx2(__m256i *v)
+{
+	__m256i tmp0, tmp1, tmp2, tmp3, tmp10, tmp11, tmp12, tmp13;
+	__m256i z1, z2, z3, z4, z5;
+
+#define MUL(a, c) _mm256_mullo_epi32(a, _mm256_set1_epi32(c))
+	/* Even part */
+	z1 = MUL(_mm256_add_epi32(v[2], v[6]), FIX_0_541196100);
+	tmp2 = _mm256_add_epi32(z1, MUL(v[6], -FIX_1_847759065));
+	tmp3 = _mm256_add_epi32(z1, MUL(v[2], FIX_0_765366865));
+	tmp0 = _mm256_slli_epi32(_mm256_add_epi32(v[0], v[4]), CONST_BITS);
+	tmp1 = _mm256_slli_epi32(_mm256_sub_epi32(v[0], v[4]), CONST_BITS);
+	tmp10 = _mm256_add_epi32(tmp0, tmp3);
+	tmp13 = _mm256_sub_epi32(tmp0, tmp3);
+	tmp11 = _mm256_add_epi32(tmp1, tmp2);
+	tmp12 = _mm256_sub_epi32(tmp1, tmp2);
+
+	/* Odd part */
+	z1 = _mm256_add_epi32(v[7], v[1]);
+	z2 = _mm256_add_epi32(v[5], v[3]);
+	z3 = _mm256_add_epi32(v[7], v[3]);
+	z4 = _mm256_add_epi32(v[5], v[1]);
+	z5 = MUL(_mm256_add_epi32(z3, z4), FIX_1_175875602);
+	tmp0 = MUL(v[7], FIX_0_298631336);
+	tmp1 = MUL(v[5], FIX_2_053119869);
+	tmp2 = MUL(v[3], FIX_3_072711026);
+	tmp3 = MUL(v[1], FIX_1_501321110);
+	z1 = MUL(z1, -FIX_0_899976223);
+	z2 = MUL(z2, -FIX_2_562915447);
+	z3 = _mm256_add_epi32(MUL(z3, -FIX_1_961570560), z5);
+	z4 = _mm256_add_epi32(MUL(z4, -FIX_0_390180644), z5);
+	tmp0 = _mm256_add_epi32(tmp0, _mm256_add_epi32(z1, z3));
+	tmp1 = _mm256_add_epi32(tmp1, _mm256_add_epi32(z2, z4));
+	tmp2 = _mm256_add_epi32(tmp2, _mm256_add_epi32(z2, z3));
+	tmp3 = _mm256_add_epi32(tmp3, _mm256_add_epi32(z1, z4));
+#undef MUL
+
+	v[0] = _mm256_add_epi32(tmp10, tmp3);
+	v[7] = _mm256_sub_epi32(tmp10, tmp3);
+	v[1] = _mm256_add_epi32(tmp11, tmp2);
+	v[6] = _mm256_sub_epi32(tmp11, tmp2);
+	v[2] = _mm256_add_epi32(tmp12, tmp1);
+	v[5] = _mm256_sub_epi32(tmp12, tmp1);
+	v[3] = _mm256_add_epi32(tmp13, tmp0);
+	v[4] = _mm256_sub_epi32(tmp13, tmp0);
+}
+
+static inline V4LCONVERT_AVX2 void transpose_8x8_epi32_avx2(__m256i *v)
+{
+	__m256i a[8], b[8];
+	int i;
+
+	for (i = 0; i < 8; i += 2) {
+		a[i] = _mm256_unpacklo_epi32(v[i], v[i + 1]);
+		a[i + 1] = _mm256_unpackhi_epi32(v[i], v[i + 1]);
+	}
+	for (i = 0; i < 8; i += 4) {
+		b[i] = _mm256_unpacklo_epi64(a[i], a[i + 2]);
+		b[i + 1] = _mm256_unpackhi_epi64(a[i], a[i + 2]);
+		b[i + 2] = _mm256_unpacklo_epi64(a[i + 1], a[i + 3]);
+		b[i + 3] = _mm256_unpackhi_epi64(a[i + 1], a[i + 3]);
+	}
+	for (i = 0; i < 4; i++) {
+		v[i] = _mm256_permute2x128_si256(b[i], b[i + 4], 0x20);
+		v[i + 4] = _mm256_permute2x128_si256(b[i], b[i + 4], 0x31);
+	}
+}
+
+/* Saturating store of the samples of v, packs work per 128 bit lane so put
+   the 4 byte halves of each row back together with a permute */
+static inline V4LCONVERT_AVX2 void store_8x8_epi32_avx2(const __m256i *v,
+		uint8_t *output_buf, int stride)
+{
+	__m256i p01, p23, p45, p67, out0123, out4567;
+	__m128i rows[4];
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	int i;
+
+	p01 = _mm256_packs_epi32(v[0], v[1]);
+	p23 = _mm256_packs_epi32(v[2], v[3]);
+	p45 = _mm256_packs_epi32(v[4], v[5]);
+	p67 = _mm256_packs_epi32(v[6], v[7]);
+	out0123 = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(p01, p23), order);
+	out4567 = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(p45, p67), order);
+
+	rows[0] = _mm256_castsi256_si128(out0123);
+	rows[1] = _mm256_extracti128_si256(out0123, 1);
+	rows[2] = _mm256_castsi256_si128(out4567);
+	rows[3] = _mm256_extracti128_si256(out4567, 1);
+	for (i = 0; i < 4; i++) {
+		_mm_storel_epi64((__m128i *)output_buf, rows[i]);
+		_mm_storel_epi64((__m128i *)(output_buf + stride),
+				_mm_unpackhi_epi64(rows[i], rows[i]));
+		output_buf += 2 * stride;
+	}
+}
+
+static inline V4LCONVERT_AVX2 void dequantize_avx2(const int16_t *coef,
+		const int16_t *quant, __m256i *v)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		v[i] = _mm256_mullo_epi32(
+			_mm256_cvtepi16_epi32(_mm_loadu_si128(
+				(const __m128i *)(coef + i * 8))),
+			_mm256_cvtepi16_epi32(_mm_loadu_si128(
+				(const __m128i *)(quant + i * 8))));
+}
+
+static V4LCONVERT_AVX2 void idct_islow_avx2(struct component *compptr,
+		uint8_t *output_buf, int stride)
+{
+	__m256i v[8];
+	int i;
+
+	/* Dequantize, pass 1 on the columns */
+	dequantize_avx2(compptr->DCT, compptr->islow_Q_table, v);
+	idct_islow_1d_avx2(v);
+	for (i = 0; i < 8; i++)
+		v[i] = _mm256_srai_epi32(_mm256_add_epi32(v[i],
+				_mm256_set1_epi32(1 << (CONST_BITS - PASS1_BITS - 1))),
+				CONST_BITS - PASS1_BITS);
+
+	/* Pass 2 on the rows */
+	transpose_8x8_epi32_avx2(v);
+	idct_islow_1d_avx2(v);
+	transpose_8x8_epi32_avx2(v);
+	for (i = 0; i < 8; i++)
+		v[i] = _mm256_srai_epi32(_mm256_add_epi32(v[i],
+				_mm256_set1_epi32((1 << (CONST_BITS + PASS1_BITS + 2)) +
+					(128 << (CONST_BITS + PASS1_BITS + 3)))),
+				CONST_BITS + PASS1_BITS + 3);
+
+	store_8x8_epi32_avx2(v, output_buf, stride);
+}
+#endif
+
+#ifdef V4LCONVERT_HAVE_NEON
+/* NEON vectors hold 4 int32, so the 8x8 block is kept as v[row][half] and
+   the 1-D IDCT is done for 4 columns at a time */
+static inline void idct_islow_1d_neon(int32x4_t *v)
+{
+	int32x4_t tmp0, tmp1, tmp2, tmp3, tmp10, tmp11, tmp12, tmp13;
+	int32x4_t z1, z2, z3, z4, z5;
+
+	/* Even part */
+	z1 = vmulq_n_s32(vaddq_s32(v[2], v[6]), FIX_0_541196100);
+	tmp2 = vmlaq_n_s32(z1, v[6], -FIX_1_847759065);
+	tmp3 = vmlaq_n_s32(z1, v[2], FIX_0_765366865);
+	tmp0 = vshlq_n_s32(vaddq_s32(v[0], v[4]), CONST_BITS);
+	tmp1 = vshlq_n_s32(vsubq_s32(v[0], v[4]), CONST_BITS);
+	tmp10 = vaddq_s32(tmp0, tmp3);
+	tmp13 = vsubq_s32(tmp0, tmp3);
+	tmp11 = vaddq_s32(tmp1, tmp2);
+	tmp12 = vsubq_s32(tmp1, tmp2);
+
+	/* Odd part */
+	z1 = vaddq_s32(v[7], v[1]);
+	z2 = vaddq_s32(v[5], v[3]);
+	z3 = vaddq_s32(v[7], v[3]);
+	z4 = vaddq_s32(v[5], v[1]);
+	z5 = vmulq_n_s32(vaddq_s32(z3, z4), FIX_1_175875602);
+	z3 = vmlaq_n_s32(z5, z3, -FIX_1_961570560);
+	z4 = vmlaq_n_s32(z5, z4, -FIX_0_390180644);
+	z1 = vmulq_n_s32(z1, -FIX_0_899976223);
+	z2 = vmulq_n_s32(z2, -FIX_2_562915447);
+	tmp0 = vmlaq_n_s32(vaddq_s32(z1, z3), v[7], FIX_0_298631336);
+	tmp1 = vmlaq_n_s32(vaddq_s32(z2, z4), v[5], FIX_2_053119869);
+	tmp2 = vmlaq_n_s32(vaddq_s32(z2, z3), v[3], FIX_3_072711026);
+	tmp3 = vmlaq_n_s32(vaddq_s32(z1, z4), v[1], FIX_1_501321110);
+
+	v[0] = vaddq_s32(tmp10, tmp3);
+	v[7] = vsubq_s32(tmp10, tmp3);
+	v[1] = vaddq_s32(tmp11, tmp2);
+	v[6] = vsubq_s32(tmp11, tmp2);
+	v[2] = vaddq_s32(tmp12, tmp1);
+	v[5] = vsubq_s32(tmp12, tmp1);
+	v[3] = vaddq_s32(tmp13, tmp0);
+	v[4] = vsubq_s32(tmp13, tmp0);
+}
+
+/* Transpose the 8x8 block in v[row][half] into t[row][half] */
+static inline void transpose_8x8_s32_neon(int32x4_t v[8][2], int32x4_t t[8][2])
+{
+	int32x4x2_t a, b;
+	int r, h;
+
+	for (r = 0; r < 8; r += 4) {
+		for (h = 0; h < 2; h++) {
+			a = vtrnq_s32(v[r][h], v[r + 1][h]);
+			b = vtrnq_s32(v[r + 2][h], v[r + 3][h]);
+			t[h * 4 + 0][r / 4] = vcombine_s32(vget_low_s32(a.val[0]),
+					vget_low_s32(b.val[0]));
+			t[h * 4 + 1][r / 4] = vcombine_s32(vget_low_s32(a.val[1]),
+					vget_low_s32(b.val[1]));
+			t[h * 4 + 2][r / 4] = vcombine_s32(vget_high_s32(a.val[0]),
+					vget_high_s32(b.val[0]));
+			t[h * 4 + 3][r / 4] = vcombine_s32(vget_high_s32(a.val[1]),
+					vget_high_s32(b.val[1]));
+		}
+	}
+}
+
+static inline void dequantize_neon(const int16_t *coef_buf,
+		const int16_t *quant_buf, int32x4_t v[8][2])
+{
+	int16x8_t coef, quant;
+	int r;
+
+	for (r = 0; r < 8; r++) {
+		coef = vld1q_s16(coef_buf + r * 8);
+		quant = vld1q_s16(quant_buf + r * 8);
+		v[r][0] = vmull_s16(vget_low_s16(coef), vget_low_s16(quant));
+		v[r][1] = vmull_s16(vget_high_s16(coef), vget_high_s16(quant));
+	}
+}
+
+/* Saturating store of the samples of v */
+static inline void store_8x8_s32_neon(int32x4_t v[8][2], uint8_t *output_buf,
+		int stride)
+{
+	int r;
+
+	for (r = 0; r < 8; r++) {
+		int16x8_t row = vcombine_s16(
+				vqmovn_s32(vaddq_s32(v[r][0], vdupq_n_s32(128))),
+				vqmovn_s32(vaddq_s32(v[r][1], vdupq_n_s32(128))));
+
+		vst1_u8(output_buf + r * stride, vqmovun_s16(row));
+	}
+}
+
+static void idct_islow_neon(struct component *compptr, uint8_t *output_buf,
+		int stride)
+{
+	int32x4_t v[8][2], t[8][2], col[8];
+	int r, h;
+
+	dequantize_neon(compptr->DCT, compptr->islow_Q_table, v);
+
+	/* Pass 1 on the columns */
+	for (h = 0; h < 2; h++) {
+		for (r = 0; r < 8; r++)
+			col[r] = v[r][h];
+		idct_islow_1d_neon(col);
+		for (r = 0; r < 8; r++)
+			v[r][h] = vrshrq_n_s32(col[r], CONST_BITS - PASS1_BITS);
+	}
+
+	/* Pass 2 on the rows */
+	transpose_8x8_s32_neon(v, t);
+	for (h = 0; h < 2; h++) {
+		for (r = 0; r < 8; r++)
+			col[r] = t[r][h];
+		idct_islow_1d_neon(col);
+		for (r = 0; r < 8; r++)
+			t[r][h] = vrshrq_n_s32(col[r], CONST_BITS + PASS1_BITS + 3);
+	}
+	transpose_8x8_s32_neon(t, v);
+
+	store_8x8_s32_neon(v, output_buf, stride);
+}
+#endif
+
+/*
+ * ifast
+ */
+
+#undef CONST_BITS
+#define CONST_BITS  8
+
+#undef FIX_1_847759065
+#define FIX_1_082392200  277
+#define FIX_1_414213562  362
+#define FIX_1_847759065  473
+#define FIX_2_613125930  669
+
+#define MULTIPLY(var, const)  (((var) * (const)) >> CONST_BITS)
+
+#define IDCT_IFAST_1D(in0, in1, in2, in3, in4, in5, in6, in7) do { \
+	/* Even part */ \
+	tmp10 = (in0) + (in4); \
+	tmp11 = (in0) - (in4); \
+	tmp13 = (in2) + (in6); \
+	tmp12 = MULTIPLY((in2) - (in6), FIX_1_414213562) - tmp13; \
+	tmp0 = tmp10 + tmp13; \
+	tmp3 = tmp10 - tmp13; \
+	tmp1 = tmp11 + tmp12; \
+	tmp2 = tmp11 - tmp12; \
+	/* Odd part */ \
+	z13 = (in5) + (in3); \
+	z10 = (in5) - (in3); \
+	z11 = (in1) + (in7); \
+	z12 = (in1) - (in7); \
+	tmp7 = z11 + z13; \
+	tmp11 = MULTIPLY(z11 - z13, FIX_1_414213562); \
+	z5 = MULTIPLY(z10 + z12, FIX_1_847759065); \
+	tmp10 = MULTIPLY(z12, FIX_1_082392200) - z5; \
+	tmp12 = MULTIPLY(z10, -FIX_2_613125930) + z5; \
+	tmp6 = tmp12 - tmp7; \
+	tmp5 = tmp11 - tmp6; \
+	tmp4 = tmp10 + tmp5; \
+} while (0)
+
+static void idct_ifast_c(struct component *compptr, uint8_t *output_buf, int stride)
+{
+	int32_t tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+	int32_t tmp10, tmp11, tmp12, tmp13;
+	int32_t z5, z10, z11, z12, z13;
+	const int16_t *inptr = compptr->DCT;
+	const int16_t *quantptr = compptr->ifast_Q_table;
+	int32_t workspace[DCTSIZE2], *wsptr = workspace;
+	int32_t in[DCTSIZE];
+	uint8_t *outptr;
+	int i, ctr;
+
+	/* Pass 1: process columns from input, store into work array.
+	 * The quantization table is prescaled by 2**PASS1_BITS. */
+	for (ctr = 0; ctr < DCTSIZE; ctr++, inptr++, quantptr++, wsptr++) {
+		if ((inptr[DCTSIZE*1] | inptr[DCTSIZE*2] | inptr[DCTSIZE*3] |
+				inptr[DCTSIZE*4] | inptr[DCTSIZE*5] |
+				inptr[DCTSIZE*6] | inptr[DCTSIZE*7]) == 0) {
+			int32_t dcval = inptr[0] * quantptr[0];
+
+			for (i = 0; i < DCTSIZE; i++)
+				wsptr[DCTSIZE*i] = dcval;
+			continue;
+		}
+
+		for (i = 0; i < DCTSIZE; i++)
+			in[i] = inptr[DCTSIZE*i] * quantptr[DCTSIZE*i];
+
+		IDCT_IFAST_1D(in[0], in[1], in[2], in[3], in[4], in[5], in[6],
+				in[7]);
+
+		wsptr[DCTSIZE*0] = tmp0 + tmp7;
+		wsptr[DCTSIZE*7] = tmp0 - tmp7;
+		wsptr[DCTSIZE*1] = tmp1 + tmp6;
+		wsptr[DCTSIZE*6] = tmp1 - tmp6;
+		wsptr[DCTSIZE*2] = tmp2 + tmp5;
+		wsptr[DCTSIZE*5] = tmp2 - tmp5;
+		wsptr[DCTSIZE*4] = tmp3 + tmp4;
+		wsptr[DCTSIZE*3] = tmp3 - tmp4;
+	}
+
+	/* Pass 2: process rows from work array, store into output array.
+	 * Note that we must descale the results by a factor of 8 == 2**3,
+	 * and also undo the PASS1_BITS scaling. */
+	wsptr = workspace;
+	outptr = output_buf;
+	for (ctr = 0; ctr < DCTSIZE; ctr++, wsptr += DCTSIZE, outptr += stride) {
+		IDCT_IFAST_1D(wsptr[0], wsptr[1], wsptr[2], wsptr[3], wsptr[4],
+				wsptr[5], wsptr[6], wsptr[7]);
+
+		outptr[0] = clamp_sample(DESCALE(tmp0 + tmp7, PASS1_BITS+3));
+		outptr[7] = clamp_sample(DESCALE(tmp0 - tmp7, PASS1_BITS+3));
+		outptr[1] = clamp_sample(DESCALE(tmp1 + tmp6, PASS1_BITS+3));
+		outptr[6] = clamp_sample(DESCALE(tmp1 - tmp6, PASS1_BITS+3));
+		outptr[2] = clamp_sample(DESCALE(tmp2 + tmp5, PASS1_BITS+3));
+		outptr[5] = clamp_sample(DESCALE(tmp2 - tmp5, PASS1_BITS+3));
+		outptr[4] = clamp_sample(DESCALE(tmp3 + tmp4, PASS1_BITS+3));
+		outptr[3] = clamp_sample(DESCALE(tmp3 - tmp4, PASS1_BITS+3));
+	}
+}
+
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+/* Like idct_islow_1d_avx2(), all 8 columns at once. MULTIPLY() shifts the
+   same way in 32 bit lanes, so this gives the results of the C version. */
+static inline V4LCONVERT_AVX2 void idct_ifast_1d_avx2(__m256i *v)
+{
+	__m256i tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+	__m256i tmp10, tmp11, tmp12, tmp13;
+	__m256i z5, z10, z11, z12, z13;
+
+#define MUL(a, c) _mm256_srai_epi32(_mm256_mullo_epi32(a, \
+		_mm256_set1_epi32(c)), CONST_BITS)
+	/* Even part */
+	tmp10 = _mm256_add_epi32(v[0], v[4]);
+	tmp11 = _mm256_sub_epi32(v[0], v[4]);
+	tmp13 = _mm256_add_epi32(v[2], v[6]);
+	tmp12 = _mm256_sub_epi32(MUL(_mm256_sub_epi32(v[2], v[6]),
+			FIX_1_414213562), tmp13);
+	tmp0 = _mm256_add_epi32(tmp10, tmp13);
+	tmp3 = _mm256_sub_epi32(tmp10, tmp13);
+	tmp1 = _mm256_add_epi32(tmp11, tmp12);
+	tmp2 = _mm256_sub_epi32(tmp11, tmp12);
+
+	/* Odd part */
+	z13 = _mm256_add_epi32(v[5], v[3]);
+	z10 = _mm256_sub_epi32(v[5], v[3]);
+	z11 = _mm256_add_epi32(v[1], v[7]);
+	z12 = _mm256_sub_epi32(v[1], v[7]);
+	tmp7 = _mm256_add_epi32(z11, z13);
+	tmp11 = MUL(_mm256_sub_epi32(z11, z13), FIX_1_414213562);
+	z5 = MUL(_mm256_add_epi32(z10, z12), FIX_1_847759065);
+	tmp10 = _mm256_sub_epi32(MUL(z12, FIX_1_082392200), z5);
+	tmp12 = _mm256_add_epi32(MUL(z10, -FIX_2_613125930), z5);
+	tmp6 = _mm256_sub_epi32(tmp12, tmp7);
+	tmp5 = _mm256_sub_epi32(tmp11, tmp6);
+	tmp4 = _mm256_add_epi32(tmp10, tmp5);
+#undef MUL
+
+	v[0] = _mm256_add_epi32(tmp0, tmp7);
+	v[7] = _mm256_sub_epi32(tmp0, tmp7);
+	v[1] = _mm256_add_epi32(tmp1, tmp6);
+	v[6] = _mm256_sub_epi32(tmp1, tmp6);
+	v[2] = _mm256_add_epi32(tmp2, tmp5);
+	v[5] = _mm256_sub_epi32(tmp2, tmp5);
+	v[4] = _mm256_add_epi32(tmp3, tmp4);
+	v[3] = _mm256_sub_epi32(tmp3, tmp4);
+}
+
+static V4LCONVERT_AVX2 void idct_ifast_avx2(struct component *compptr,
+		uint8_t *output_buf, int stride)
+{
+	__m256i v[8];
+	int i;
+
+	/* The quantization table is prescaled by 2**PASS1_BITS, so pass 1
+	   needs no descaling */
+	dequantize_avx2(compptr->DCT, compptr->ifast_Q_table, v);
+	idct_ifast_1d_avx2(v);
+
+	transpose_8x8_epi32_avx2(v);
+	idct_ifast_1d_avx2(v);
+	transpose_8x8_epi32_avx2(v);
+	for (i = 0; i < 8; i++)
+		v[i] = _mm256_srai_epi32(_mm256_add_epi32(v[i],
+				_mm256_set1_epi32((1 << (PASS1_BITS + 2)) +
+					(128 << (PASS1_BITS + 3)))),
+				PASS1_BITS + 3);
+
+	store_8x8_epi32_avx2(v, output_buf, stride);
+}
+#endif
+
+#ifdef V4LCONVERT_HAVE_NEON
+static inline void idct_ifast_1d_neon(int32x4_t *v)
+{
+	int32x4_t tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+	int32x4_t tmp10, tmp11, tmp12, tmp13;
+	int32x4_t z5, z10, z11, z12, z13;
+
+#define MUL(a, c) vshrq_n_s32(vmulq_n_s32(a, c), CONST_BITS)
+	/* Even part */
+	tmp10 = vaddq_s32(v[0], v[4]);
+	tmp11 = vsubq_s32(v[0], v[4]);
+	tmp13 = vaddq_s32(v[2], v[6]);
+	tmp12 = vsubq_s32(MUL(vsubq_s32(v[2], v[6]), FIX_1_414213562), tmp13);
+	tmp0 = vaddq_s32(tmp10, tmp13);
+	tmp3 = vsubq_s32(tmp10, tmp13);
+	tmp1 = vaddq_s32(tmp11, tmp12);
+	tmp2 = vsubq_s32(tmp11, tmp12);
+
+	/* Odd part */
+	z13 = vaddq_s32(v[5], v[3]);
+	z10 = vsubq_s32(v[5], v[3]);
+	z11 = vaddq_s32(v[1], v[7]);
+	z12 = vsubq_s32(v[1], v[7]);
+	tmp7 = vaddq_s32(z11, z13);
+	tmp11 = MUL(vsubq_s32(z11, z13), FIX_1_414213562);
+	z5 = MUL(vaddq_s32(z10, z12), FIX_1_847759065);
+	tmp10 = vsubq_s32(MUL(z12, FIX_1_082392200), z5);
+	tmp12 = vaddq_s32(MUL(z10, -FIX_2_613125930), z5);
+	tmp6 = vsubq_s32(tmp12, tmp7);
+	tmp5 = vsubq_s32(tmp11, tmp6);
+	tmp4 = vaddq_s32(tmp10, tmp5);
+#undef MUL
+
+	v[0] = vaddq_s32(tmp0, tmp7);
+	v[7] = vsubq_s32(tmp0, tmp7);
+	v[1] = vaddq_s32(tmp1, tmp6);
+	v[6] = vsubq_s32(tmp1, tmp6);
+	v[2] = vaddq_s32(tmp2, tmp5);
+	v[5] = vsubq_s32(tmp2, tmp5);
+	v[4] = vaddq_s32(tmp3, tmp4);
+	v[3] = vsubq_s32(tmp3, tmp4);
+}
+
+static void idct_ifast_neon(struct component *compptr, uint8_t *output_buf,
+		int stride)
+{
+	int32x4_t v[8][2], t[8][2], col[8];
+	int r, h;
+
+	dequantize_neon(compptr->DCT, compptr->ifast_Q_table, v);
+
+	/* Pass 1 on the columns */
+	for (h = 0; h < 2; h++) {
+		for (r = 0; r < 8; r++)
+			col[r] = v[r][h];
+		idct_ifast_1d_neon(col);
+		for (r = 0; r < 8; r++)
+			v[r][h] = col[r];
+	}
+
+	/* Pass 2 on the rows */
+	transpose_8x8_s32_neon(v, t);
+	for (h = 0; h < 2; h++) {
+		for (r = 0; r < 8; r++)
+			col[r] = t[r][h];
+		idct_ifast_1d_neon(col);
+		for (r = 0; r < 8; r++)
+			t[r][h] = vrshrq_n_s32(col[r], PASS1_BITS + 3);
+	}
+	transpose_8x8_s32_neon(t, v);
+
+	store_8x8_s32_neon(v, output_buf, stride);
+}
+#endif
+
+static struct {
+	void (*islow)(struct component *compptr, uint8_t *output_buf, int stride);
+	void (*ifast)(struct component *compptr, uint8_t *output_buf, int stride);
+} idct_simd = {
+	idct_islow_c,
+	idct_ifast_c,
+};
+
+void tinyjpeg_idct_init(int cpu_flags)
+{
+#ifdef V4LCONVERT_HAVE_NEON
+	if (cpu_flags & V4LCONVERT_CPU_NEON) {
+		idct_simd.islow = idct_islow_neon;
+		idct_simd.ifast = idct_ifast_neon;
+	}
+#endif
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+	if (cpu_flags & V4LCONVERT_CPU_AVX2) {
+		idct_simd.islow = idct_islow_avx2;
+		idct_simd.ifast = idct_ifast_avx2;
+	}
+#endif
+}
+
+void tinyjpeg_idct_islow(struct component *compptr, uint8_t *output_buf, int stride)
+{
+	idct_simd.islow(compptr, output_buf, stride);
+}
+
+void tinyjpeg_idct_ifast(struct component *compptr, uint8_t *output_buf, int stride)
+{
+	idct_simd.ifast(compptr, output_buf, stride);
+}
@@ -0,0 +1,288 @@
+/*
+ * jidctred.c
+ *
+ * Copyright (C) 1991-1998, Thomas G. Lane.
+ * This file is part of the Independent JPEG Group's software.
+ *
+ * The authors make NO WARRANTY or representation, either express or implied,
+ * with respect to this software, its quality, accuracy, merchantability, or
+ * fitness for a particular purpose.  This software is provided "AS IS", and you,
+ * its user, assume the entire risk as to its quality and accuracy.
+ *
+ * This software is copyright (C) 1991-1998, Thomas G. Lane.
+ * All Rights Reserved except as specified below.
+ *
+ * Permission is hereby granted to use, copy, modify, and distribute this
+ * software (or portions thereof) for any purpose, without fee, subject to these
+ * conditions:
+ * (1) If any part of the source code for this software is distributed, then this
+ * README file must be included, with this copyright and no-warranty notice
+ * unaltered; and any additions, deletions, or changes to the original files
+ * must be clearly indicated in accompanying documentation.
+ * (2) If only executable code is distributed, then the accompanying
+ * documentation must state that "this software is based in part on the work of
+ * the Independent JPEG Group".
+ * (3) Permission for use of this software is granted only if the user accepts
+ * full responsibility for any undesirable consequences; the authors accept
+ * NO LIABILITY for damages of any kind.
+ *
+ * These conditions apply to any software derived from or based on the IJG code,
+ * not just to the unmodified library.  If you use our work, you ought to
+ * acknowledge us.
+ *
+ * Permission is NOT granted for the use of any IJG author's name or company name
+ * in advertising or publicity relating to this software or products derived from
+ * it.  This software may be referred to only as "the Independent JPEG Group's
+ * software".
+ *
+ * We specifically permit and encourage the use of this software as the basis of
+ * commercial products, provided that all warranty or liability claims are
+ * assumed by the product vendor.
+ *
+ *
+ * This file contains inverse-DCT routines that produce reduced-size output:
+ * either 4x4, 2x2, or 1x1 pixels from an 8x8 DCT block, for decoding at 1/2,
+ * 1/4 or 1/8 scale. Based on the IJG jidctred.c, changes from the IJG code:
+ * the output is clamped instead of using a range limit table.
+ *
+ * The implementation is based on the Loeffler, Ligtenberg and Moschytz (LL&M)
+ * algorithm used in jidctint.c. We simply replace each 8-to-8 1-D IDCT step
+ * with an 8-to-4 step that produces the four averages of two adjacent outputs
+ * (or an 8-to-2 step producing two averages of four outputs, for 2x2 output).
+ * These steps were derived by computing the corresponding values at the end
+ * of the normal LL&M code, then simplifying as much as possible.
+ *
+ * 1x1 is trivial: just take the DC coefficient divided by 8.
+ */
+
+#include <stdint.h>
+#include "tinyjpeg-internal.h"
+
+/* Also defined by jpeglib.h when building with libjpeg */
+#ifndef DCTSIZE
+#define DCTSIZE	   8
+#define DCTSIZE2   (DCTSIZE * DCTSIZE)
+#endif
+
+#define CONST_BITS  13
+#define PASS1_BITS  2
+
+#define FIX_0_211164243  1730
+#define FIX_0_509795579  4176
+#define FIX_0_601344887  4926
+#define FIX_0_720959822  5906
+#define FIX_0_765366865  6270
+#define FIX_0_850430095  6967
+#define FIX_0_899976223  7373
+#define FIX_1_061594337  8697
+#define FIX_1_272758580  10426
+#define FIX_1_451774981  11893
+#define FIX_1_847759065  15137
+#define FIX_2_172734803  17799
+#define FIX_2_562915447  20995
+#define FIX_3_624509785  29692
+
+/* Descale and correctly round an int32_t value that's scaled by n bits */
+#define DESCALE(x, n)  (((x) + (1 << ((n) - 1))) >> (n))
+
+#define DEQUANTIZE(coef, quantval)  (((int32_t) (coef)) * (quantval))
+
+static inline uint8_t clamp_sample(int32_t x)
+{
+	x += 128;
+	if (x < 0)
+		return 0;
+	if (x > 255)
+		return 255;
+	return x;
+}
+
+/*
+ * Perform dequantization and inverse DCT on one block of coefficients,
+ * producing a reduced-size 4x4 output block.
+ */
+void tinyjpeg_idct_4x4(struct component *compptr, uint8_t *output_buf, int stride)
+{
+	int32_t tmp0, tmp2, tmp10, tmp12;
+	int32_t z1, z2, z3, z4;
+	const int16_t *inptr = compptr->DCT;
+	const int16_t *quantptr = compptr->islow_Q_table;
+	int32_t workspace[DCTSIZE * 4], *wsptr = workspace;
+	uint8_t *outptr;
+	int ctr;
+
+	/* Pass 1: process columns from input, store into work array. */
+	for (ctr = DCTSIZE; ctr > 0; inptr++, quantptr++, wsptr++, ctr--) {
+		/* Don't bother to process column 4, because second pass won't use it */
+		if (ctr == DCTSIZE - 4)
+			continue;
+		if ((inptr[DCTSIZE*1] | inptr[DCTSIZE*2] | inptr[DCTSIZE*3] |
+				inptr[DCTSIZE*5] | inptr[DCTSIZE*6] |
+				inptr[DCTSIZE*7]) == 0) {
+			/* AC terms all zero; we need not examine term 4 for 4x4 output */
+			int32_t dcval = DEQUANTIZE(inptr[0], quantptr[0]) *
+				(1 << PASS1_BITS);
+
+			wsptr[DCTSIZE*0] = dcval;
+			wsptr[DCTSIZE*1] = dcval;
+			wsptr[DCTSIZE*2] = dcval;
+			wsptr[DCTSIZE*3] = dcval;
+			continue;
+		}
+
+		/* Even part */
+		tmp0 = DEQUANTIZE(inptr[0], quantptr[0]) * (1 << (CONST_BITS+1));
+
+		z2 = DEQUANTIZE(inptr[DCTSIZE*2], quantptr[DCTSIZE*2]);
+		z3 = DEQUANTIZE(inptr[DCTSIZE*6], quantptr[DCTSIZE*6]);
+
+		tmp2 = z2 * FIX_1_847759065 + z3 * -FIX_0_765366865;
+
+		tmp10 = tmp0 + tmp2;
+		tmp12 = tmp0 - tmp2;
+
+		/* Odd part */
+		z1 = DEQUANTIZE(inptr[DCTSIZE*7], quantptr[DCTSIZE*7]);
+		z2 = DEQUANTIZE(inptr[DCTSIZE*5], quantptr[DCTSIZE*5]);
+		z3 = DEQUANTIZE(inptr[DCTSIZE*3], quantptr[DCTSIZE*3]);
+		z4 = DEQUANTIZE(inptr[DCTSIZE*1], quantptr[DCTSIZE*1]);
+
+		tmp0 = z1 * -FIX_0_211164243 + z2 * FIX_1_451774981 +
+			z3 * -FIX_2_172734803 + z4 * FIX_1_061594337;
+
+		tmp2 = z1 * -FIX_0_509795579 + z2 * -FIX_0_601344887 +
+			z3 * FIX_0_899976223 + z4 * FIX_2_562915447;
+
+		/* Final output stage */
+		wsptr[DCTSIZE*0] = DESCALE(tmp10 + tmp2, CONST_BITS-PASS1_BITS+1);
+		wsptr[DCTSIZE*3] = DESCALE(tmp10 - tmp2, CONST_BITS-PASS1_BITS+1);
+		wsptr[DCTSIZE*1] = DESCALE(tmp12 + tmp0, CONST_BITS-PASS1_BITS+1);
+		wsptr[DCTSIZE*2] = DESCALE(tmp12 - tmp0, CONST_BITS-PASS1_BITS+1);
+	}
+
+	/* Pass 2: process 4 rows from work array, store into output array. */
+	wsptr = workspace;
+	outptr = output_buf;
+	for (ctr = 0; ctr < 4; ctr++, wsptr += DCTSIZE, outptr += stride) {
+		if ((wsptr[1] | wsptr[2] | wsptr[3] | wsptr[5] | wsptr[6] |
+				wsptr[7]) == 0) {
+			/* AC terms all zero */
+			uint8_t outval = clamp_sample(DESCALE(wsptr[0], PASS1_BITS+3));
+
+			outptr[0] = outval;
+			outptr[1] = outval;
+			outptr[2] = outval;
+			outptr[3] = outval;
+			continue;
+		}
+
+		/* Even part */
+		tmp0 = wsptr[0] * (1 << (CONST_BITS+1));
+
+		tmp2 = wsptr[2] * FIX_1_847759065 + wsptr[6] * -FIX_0_765366865;
+
+		tmp10 = tmp0 + tmp2;
+		tmp12 = tmp0 - tmp2;
+
+		/* Odd part */
+		z1 = wsptr[7];
+		z2 = wsptr[5];
+		z3 = wsptr[3];
+		z4 = wsptr[1];
+
+		tmp0 = z1 * -FIX_0_211164243 + z2 * FIX_1_451774981 +
+			z3 * -FIX_2_172734803 + z4 * FIX_1_061594337;
+
+		tmp2 = z1 * -FIX_0_509795579 + z2 * -FIX_0_601344887 +
+			z3 * FIX_0_899976223 + z4 * FIX_2_562915447;
+
+		/* Final output stage */
+		outptr[0] = clamp_sample(DESCALE(tmp10 + tmp2, CONST_BITS+PASS1_BITS+3+1));
+		outptr[3] = clamp_sample(DESCALE(tmp10 - tmp2, CONST_BITS+PASS1_BITS+3+1));
+		outptr[1] = clamp_sample(DESCALE(tmp12 + tmp0, CONST_BITS+PASS1_BITS+3+1));
+		outptr[2] = clamp_sample(DESCALE(tmp12 - tmp0, CONST_BITS+PASS1_BITS+3+1));
+	}
+}
+
+/*
+ * Perform dequantization and inverse DCT on one block of coefficients,
+ * producing a reduced-size 2x2 output block.
+ */
+void tinyjpeg_idct_2x2(struct component *compptr, uint8_t *output_buf, int stride)
+{
+	int32_t tmp0, tmp10;
+	const int16_t *inptr = compptr->DCT;
+	const int16_t *quantptr = compptr->islow_Q_table;
+	int32_t workspace[DCTSIZE * 2], *wsptr = workspace;
+	uint8_t *outptr;
+	int ctr;
+
+	/* Pass 1: process columns from input, store into work array. */
+	for (ctr = DCTSIZE; ctr > 0; inptr++, quantptr++, wsptr++, ctr--) {
+		/* Don't bother to process columns 2,4,6 */
+		if (ctr == DCTSIZE - 2 || ctr == DCTSIZE - 4 || ctr == DCTSIZE - 6)
+			continue;
+		if ((inptr[DCTSIZE*1] | inptr[DCTSIZE*3] | inptr[DCTSIZE*5] |
+				inptr[DCTSIZE*7]) == 0) {
+			/* AC terms all zero; we need not examine terms 2,4,6 for 2x2 output */
+			int32_t dcval = DEQUANTIZE(inptr[0], quantptr[0]) *
+				(1 << PASS1_BITS);
+
+			wsptr[DCTSIZE*0] = dcval;
+			wsptr[DCTSIZE*1] = dcval;
+			continue;
+		}
+
+		/* Even part */
+		tmp10 = DEQUANTIZE(inptr[0], quantptr[0]) * (1 << (CONST_BITS+2));
+
+		/* Odd part */
+		tmp0 = DEQUANTIZE(inptr[DCTSIZE*7], quantptr[DCTSIZE*7]) * -FIX_0_720959822 +
+			DEQUANTIZE(inptr[DCTSIZE*5], quantptr[DCTSIZE*5]) * FIX_0_850430095 +
+			DEQUANTIZE(inptr[DCTSIZE*3], quantptr[DCTSIZE*3]) * -FIX_1_272758580 +
+			DEQUANTIZE(inptr[DCTSIZE*1], quantptr[DCTSIZE*1]) * FIX_3_624509785;
+
+		/* Final output stage */
+		wsptr[DCTSIZE*0] = DESCALE(tmp10 + tmp0, CONST_BITS-PASS1_BITS+2);
+		wsptr[DCTSIZE*1] = DESCALE(tmp10 - tmp0, CONST_BITS-PASS1_BITS+2);
+	}
+
+	/* Pass 2: process 2 rows from work array, store into output array. */
+	wsptr = workspace;
+	outptr = output_buf;
+	for (ctr = 0; ctr < 2; ctr++, wsptr += DCTSIZE, outptr += stride) {
+		if ((wsptr[1] | wsptr[3] | wsptr[5] | wsptr[7]) == 0) {
+			/* AC terms all zero */
+			uint8_t outval = clamp_sample(DESCALE(wsptr[0], PASS1_BITS+3));
+
+			outptr[0] = outval;
+			outptr[1] = outval;
+			continue;
+		}
+
+		/* Even part */
+		tmp10 = wsptr[0] * (1 << (CONST_BITS+2));
+
+		/* Odd part */
+		tmp0 = wsptr[7] * -FIX_0_720959822 + wsptr[5] * FIX_0_850430095 +
+			wsptr[3] * -FIX_1_272758580 + wsptr[1] * FIX_3_624509785;
+
+		/* Final output stage */
+		outptr[0] = clamp_sample(DESCALE(tmp10 + tmp0, CONST_BITS+PASS1_BITS+3+2));
+		outptr[1] = clamp_sample(DESCALE(tmp10 - tmp0, CONST_BITS+PASS1_BITS+3+2));
+	}
+}
+
+/*
+ * Perform dequantization and inverse DCT on one block of coefficients,
+ * producing a reduced-size 1x1 output block.
+ */
+void tinyjpeg_idct_1x1(struct component *compptr, uint8_t *output_buf, int stride)
+{
+	int32_t dcval = DEQUANTIZE(compptr->DCT[0], compptr->islow_Q_table[0]);
+
+	/* A single line, stride is only there to match idct_fct */
+	(void)stride;
+
+	output_buf[0] = clamp_sample(DESCALE(dcval, 3));
+}
@@ -27,23 +27,25 @@
 #include "jpeg_memsrcdest.h"
 #endif
 
-int v4lconvert_decode_jpeg_tinyjpeg(struct v4lconvert_data *data,
-	unsigned char *src, int src_size, unsigned char *dest,
-	struct v4l2_format *fmt, unsigned int dest_pix_fmt, int flags)
+/* fmt has the size of the decoded frame, which is 1 / data->jpeg_scale of
+   the size of the jpeg */
+static int v4lconvert_tinyjpeg_parse_header(struct v4lconvert_data *data,
+	unsigned char *src, int src_size, struct v4l2_format *fmt, int flags)
 {
-	int result = 0;
-	unsigned char *components[3];
 	unsigned int header_width, header_height;
-	unsigned int width  = fmt->fmt.pix.width;
-	unsigned int height = fmt->fmt.pix.height;
+	unsigned int width  = fmt->fmt.pix.width * data->jpeg_scale;
+	unsigned int height = fmt->fmt.pix.height * data->jpeg_scale;
 
 	if (!data->tinyjpeg) {
 		data->tinyjpeg = tinyjpeg_init();
 		if (!data->tinyjpeg)
 			return v4lconvert_oom_error(data);
+		tinyjpeg_set_idct(data->tinyjpeg, data->tinyjpeg_idct);
+		tinyjpeg_set_pool(data->tinyjpeg, data->pool);
 	}
 	flags |= TINYJPEG_FLAGS_MJPEG_TABLE;
 	tinyjpeg_set_flags(data->tinyjpeg, flags);
+	tinyjpeg_set_scale(data->tinyjpeg, data->jpeg_scale);
 	if (tinyjpeg_parse_header(data->tinyjpeg, src, src_size)) {
 		V4LCONVERT_ERR("parsing JPEG header: %s",
 				tinyjpeg_get_errorstring(data->tinyjpeg));
@@ -65,52 +67,167 @@ int v4lconvert_decode_jpeg_tinyjpeg(struct v4lconvert_data *data,
 		errno = EIO;
 		return -1;
 	}
-	fmt->fmt.pix.width = header_width;
-	fmt->fmt.pix.height = header_height;
+	fmt->fmt.pix.width = header_width / data->jpeg_scale;
+	fmt->fmt.pix.height = header_height / data->jpeg_scale;
+
+	return 0;
+}
+
+static int v4lconvert_tinyjpeg_decode(struct v4lconvert_data *data,
+	int pixfmt)
+{
+	if (tinyjpeg_decode(data->tinyjpeg, pixfmt)) {
+		/* The JPEG header checked out ok but we got an error
+		   during decompression. Some webcams, esp pixart and
+		   sn9c20x based ones regulary generate corrupt frames,
+		   which are best thrown away to avoid flashes in the
+		   video stream. We use EPIPE to signal the upper layer
+		   we have some video data, but it is incomplete.
+
+		   The upper layer (usually libv4l2) should respond to
+		   this by trying a number of times to get a new frame
+		   and if that fails just passing up whatever we did
+		   manage to decompress. */
+		V4LCONVERT_ERR("decompressing JPEG: %s",
+				tinyjpeg_get_errorstring(data->tinyjpeg));
+		errno = EPIPE;
+		return -1;
+	}
+	return 0;
+}
+
+struct v4lconvert_jpeg_nv12 {
+	unsigned char *uv;
+	unsigned int width;
+};
 
+/* Interleave the u and v planes of each row of MCUs into the nv12 dest
+   as soon as it is decoded, while they are still in the cache */
+static void v4lconvert_jpeg_nv12_band(void *opaque, unsigned char **planes,
+		unsigned int first_line, unsigned int lines)
+{
+	struct v4lconvert_jpeg_nv12 *nv12 = opaque;
+
+	v4lconvert_merge_uv(planes[1], planes[2],
+			nv12->uv + first_line / 2 * nv12->width,
+			lines / 2 * nv12->width / 2);
+}
+
+int v4lconvert_decode_jpeg_tinyjpeg(struct v4lconvert_data *data,
+	unsigned char *src, int src_size, unsigned char *dest,
+	struct v4l2_format *fmt, unsigned int dest_pix_fmt, int flags)
+{
+	int result = 0;
+	unsigned char *components[3];
+	unsigned int width, height;
+	struct v4lconvert_jpeg_nv12 nv12;
+
+	if (v4lconvert_tinyjpeg_parse_header(data, src, src_size, fmt, flags))
+		return -1;
+
+	width = fmt->fmt.pix.width;
+	height = fmt->fmt.pix.height;
 	components[0] = dest;
 
 	switch (dest_pix_fmt) {
 	case V4L2_PIX_FMT_RGB24:
 		tinyjpeg_set_components(data->tinyjpeg, components, 1);
-		result = tinyjpeg_decode(data->tinyjpeg, TINYJPEG_FMT_RGB24);
+		result = v4lconvert_tinyjpeg_decode(data, TINYJPEG_FMT_RGB24);
 		break;
 	case V4L2_PIX_FMT_BGR24:
 		tinyjpeg_set_components(data->tinyjpeg, components, 1);
-		result = tinyjpeg_decode(data->tinyjpeg, TINYJPEG_FMT_BGR24);
+		result = v4lconvert_tinyjpeg_decode(data, TINYJPEG_FMT_BGR24);
 		break;
 	case V4L2_PIX_FMT_YUV420:
 		components[1] = components[0] + width * height;
 		components[2] = components[1] + width * height / 4;
 		tinyjpeg_set_components(data->tinyjpeg, components, 3);
-		result = tinyjpeg_decode(data->tinyjpeg, TINYJPEG_FMT_YUV420P);
+		result = v4lconvert_tinyjpeg_decode(data, TINYJPEG_FMT_YUV420P);
 		break;
 	case V4L2_PIX_FMT_YVU420:
 		components[2] = components[0] + width * height;
 		components[1] = components[2] + width * height / 4;
 		tinyjpeg_set_components(data->tinyjpeg, components, 3);
-		result = tinyjpeg_decode(data->tinyjpeg, TINYJPEG_FMT_YUV420P);
+		result = v4lconvert_tinyjpeg_decode(data, TINYJPEG_FMT_YUV420P);
+		break;
+	case V4L2_PIX_FMT_NV12:
+		/* y goes straight to dest, u and v to scratch planes */
+		components[1] = v4lconvert_alloc_buffer(width * height / 2,
+				&data->convert_pixfmt_buf,
+				&data->convert_pixfmt_buf_size);
+		if (!components[1])
+			return v4lconvert_oom_error(data);
+		components[2] = components[1] + width * height / 4;
+		nv12.uv = dest + width * height;
+		nv12.width = width;
+		tinyjpeg_set_components(data->tinyjpeg, components, 3);
+		tinyjpeg_set_band_callback(data->tinyjpeg,
+				v4lconvert_jpeg_nv12_band, &nv12);
+		result = v4lconvert_tinyjpeg_decode(data, TINYJPEG_FMT_YUV420P);
+		tinyjpeg_set_band_callback(data->tinyjpeg, NULL, NULL);
 		break;
 	}
 
-	if (result) {
-		/* The JPEG header checked out ok but we got an error
-		   during decompression. Some webcams, esp pixart and
-		   sn9c20x based ones regulary generate corrupt frames,
-		   which are best thrown away to avoid flashes in the
-		   video stream. We use EPIPE to signal the upper layer
-		   we have some video data, but it is incomplete.
+	return result;
+}
 
-		   The upper layer (usually libv4l2) should respond to
-		   this by trying a number of times to get a new frame
-		   and if that fails just passing up whatever we did
-		   manage to decompress. */
-		V4LCONVERT_ERR("decompressing JPEG: %s",
-				tinyjpeg_get_errorstring(data->tinyjpeg));
-		errno = EPIPE;
+struct v4lconvert_jpeg_band {
+	struct v4lconvert_pipeline *pipeline;
+	int swap_uv;
+};
+
+static void v4lconvert_jpeg_band(void *opaque, unsigned char **planes,
+		unsigned int first_line, unsigned int lines)
+{
+	struct v4lconvert_jpeg_band *band = opaque;
+
+	v4lconvert_pipeline_planes(band->pipeline, planes[0],
+			planes[band->swap_uv ? 2 : 1],
+			planes[band->swap_uv ? 1 : 2], first_line, lines);
+}
+
+/* Feed each row of MCUs to the pipeline as soon as it is decoded, rather
+   than decoding the entire frame first */
+int v4lconvert_decode_jpeg_tinyjpeg_pipeline(struct v4lconvert_data *data,
+	unsigned char *src, int src_size, struct v4l2_format *fmt,
+	unsigned int dest_pix_fmt, int flags,
+	struct v4lconvert_pipeline *pipeline)
+{
+	struct v4lconvert_jpeg_band band;
+	unsigned char *components[3] = { NULL, NULL, NULL };
+	int result, pixfmt;
+
+	switch (dest_pix_fmt) {
+	case V4L2_PIX_FMT_RGB24:
+		pixfmt = TINYJPEG_FMT_RGB24;
+		break;
+	case V4L2_PIX_FMT_BGR24:
+		pixfmt = TINYJPEG_FMT_BGR24;
+		break;
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+		pixfmt = TINYJPEG_FMT_YUV420P;
+		break;
+	default:
+		V4LCONVERT_ERR("Unknown dest format in conversion\n");
+		errno = EINVAL;
 		return -1;
 	}
-	return 0;
+
+	if (v4lconvert_tinyjpeg_parse_header(data, src, src_size, fmt, flags))
+		return -1;
+
+	band.pipeline = pipeline;
+	band.swap_uv = dest_pix_fmt == V4L2_PIX_FMT_YVU420;
+
+	/* Without components tinyjpeg decodes into a buffer of a single row
+	   of MCUs */
+	tinyjpeg_set_components(data->tinyjpeg, components, 3);
+	tinyjpeg_set_band_callback(data->tinyjpeg, v4lconvert_jpeg_band, &band);
+	result = v4lconvert_tinyjpeg_decode(data, pixfmt);
+	tinyjpeg_set_band_callback(data->tinyjpeg, NULL, NULL);
+
+	return result;
 }
 
 #ifdef HAVE_JPEG
@@ -178,7 +295,7 @@ static void init_libjpeg_cinfo(struct v4lconvert_data *data)
 
 static int decode_libjpeg_h_samp1(struct v4lconvert_data *data,
 	unsigned char *ydest, unsigned char *udest, unsigned char *vdest,
-	int v_samp)
+	int step, int v_samp)
 {
 	struct jpeg_decompress_struct *cinfo = &data->cinfo;
 	int x, y;
@@ -217,11 +334,13 @@ static int decode_libjpeg_h_samp1(struct v4lconvert_data *data,
 		/* Copy over every other u + v pixel for 8 lines */
 		for (y = 0; y < 8; y++) {
 			for (x = 0; x < width; x += 2) {
-				*udest++ = *uv_buf++;
+				*udest = *uv_buf++;
+				udest += step;
 				uv_buf++;
 			}
 			for (x = 0; x < width; x += 2) {
-				*vdest++ = *uv_buf++;
+				*vdest = *uv_buf++;
+				vdest += step;
 				uv_buf++;
 			}
 		}
@@ -232,19 +351,34 @@ static int decode_libjpeg_h_samp1(struct v4lconvert_data *data,
 
 static int decode_libjpeg_h_samp2(struct v4lconvert_data *data,
 	unsigned char *ydest, unsigned char *udest, unsigned char *vdest,
-	int v_samp)
+	int step, int v_samp)
 {
 	struct jpeg_decompress_struct *cinfo = &data->cinfo;
 	int y;
 	unsigned int width = cinfo->image_width;
+	unsigned char *uv_buf = NULL, *uvdest = udest;
 	JSAMPROW y_rows[16], u_rows[8], v_rows[8];
 	JSAMPARRAY rows[3] = { y_rows, u_rows, v_rows };
 
+	/* For nv12 read the u and v lines of each row of MCUs into a buffer,
+	   and interleave them into dest from there */
+	if (step == 2) {
+		uv_buf = v4lconvert_alloc_buffer(width * 8,
+						 &data->convert_pixfmt_buf,
+						 &data->convert_pixfmt_buf_size);
+		if (!uv_buf)
+			return v4lconvert_oom_error(data);
+	}
+
 	while (cinfo->output_scanline < cinfo->image_height) {
 		for (y = 0; y < 8 * v_samp; y++) {
 			y_rows[y] = ydest;
 			ydest += width;
 		}
+		if (uv_buf) {
+			udest = uv_buf;
+			vdest = uv_buf + width * 4;
+		}
 		/*
 		 * For v_samp == 1 were going to get 1 set of uv values per
 		 * line, but we need only 1 set per 2 lines since our output
@@ -273,6 +407,78 @@ static int decode_libjpeg_h_samp2(struct v4lconvert_data *data,
 		y = jpeg_read_raw_data(cinfo, rows, 8 * v_samp);
 		if (y != 8 * v_samp)
 			return -1;
+
+		/* 4 * v_samp lines of u and v */
+		if (uv_buf) {
+			v4lconvert_merge_uv(uv_buf, uv_buf + width * 4, uvdest,
+					    2 * v_samp * width);
+			uvdest += 4 * v_samp * width;
+		}
+	}
+	return 0;
+}
+
+#if JPEG_LIB_VERSION >= 70
+#define DCT_H_SCALED_SIZE(compptr) ((compptr)->DCT_h_scaled_size)
+#define DCT_V_SCALED_SIZE(compptr) ((compptr)->DCT_v_scaled_size)
+#else
+#define DCT_H_SCALED_SIZE(compptr) ((compptr)->DCT_scaled_size)
+#define DCT_V_SCALED_SIZE(compptr) ((compptr)->DCT_scaled_size)
+#endif
+
+/* When scaling libjpeg may use a larger IDCT for the chroma than for the
+   luma, rather than upsampling the chroma later on. So get the chroma at
+   whatever size libjpeg gives it, and take the samples we need from that */
+static int decode_libjpeg_scaled(struct v4lconvert_data *data,
+	unsigned char *ydest, unsigned char *udest, unsigned char *vdest,
+	int step)
+{
+	struct jpeg_decompress_struct *cinfo = &data->cinfo;
+	jpeg_component_info *luma = &cinfo->comp_info[0];
+	jpeg_component_info *chroma = &cinfo->comp_info[1];
+	unsigned int width = cinfo->output_width;
+	int lines = luma->v_samp_factor * DCT_V_SCALED_SIZE(luma);
+	int chroma_lines = chroma->v_samp_factor * DCT_V_SCALED_SIZE(chroma);
+	int chroma_width = chroma->width_in_blocks * DCT_H_SCALED_SIZE(chroma);
+	/* Chroma samples per 2 luma pixels is chroma_num / chroma_den */
+	int chroma_num = 2 * chroma->h_samp_factor * DCT_H_SCALED_SIZE(chroma);
+	int chroma_den = cinfo->max_h_samp_factor * DCT_H_SCALED_SIZE(luma);
+	int x, y;
+	unsigned char *uv_buf;
+	const unsigned char *u, *v;
+	JSAMPROW y_rows[16], u_rows[8], v_rows[8];
+	JSAMPARRAY rows[3] = { y_rows, u_rows, v_rows };
+
+	uv_buf = v4lconvert_alloc_buffer(2 * chroma_width * chroma_lines,
+					 &data->convert_pixfmt_buf,
+					 &data->convert_pixfmt_buf_size);
+	if (!uv_buf)
+		return v4lconvert_oom_error(data);
+
+	for (y = 0; y < chroma_lines; y++) {
+		u_rows[y] = uv_buf + y * chroma_width;
+		v_rows[y] = uv_buf + (chroma_lines + y) * chroma_width;
+	}
+
+	while (cinfo->output_scanline < cinfo->output_height) {
+		for (y = 0; y < lines; y++) {
+			y_rows[y] = ydest;
+			ydest += width;
+		}
+		y = jpeg_read_raw_data(cinfo, rows, lines);
+		if (y != lines)
+			return -1;
+
+		for (y = 0; y < lines / 2; y++) {
+			u = u_rows[2 * y * chroma_lines / lines];
+			v = v_rows[2 * y * chroma_lines / lines];
+			for (x = 0; x < (int)width / 2; x++) {
+				*udest = u[x * chroma_num / chroma_den];
+				*vdest = v[x * chroma_num / chroma_den];
+				udest += step;
+				vdest += step;
+			}
+		}
 	}
 	return 0;
 }
@@ -300,15 +506,21 @@ int v4lconvert_decode_jpeg_libjpeg(struct v4lconvert_data *data,
 	jpeg_mem_src(&data->cinfo, src, src_size);
 	jpeg_read_header(&data->cinfo, TRUE);
 
-	if (data->cinfo.image_width  != width ||
-	    data->cinfo.image_height != height) {
+	/* width and height are the size of the decoded frame, for which libjpeg
+	   only uses the low frequency coefficients when scaling */
+	if (data->cinfo.image_width  != width * data->jpeg_scale ||
+	    data->cinfo.image_height != height * data->jpeg_scale) {
 		V4LCONVERT_ERR("unexpected width / height in JPEG header: "
-			       "expected: %ux%u, header: %ux%u\n", width,
-			       height, data->cinfo.image_width,
+			       "expected: %ux%u, header: %ux%u\n",
+			       width * data->jpeg_scale,
+			       height * data->jpeg_scale,
+			       data->cinfo.image_width,
 			       data->cinfo.image_height);
 		errno = EIO;
 		return -1;
 	}
+	data->cinfo.scale_num = 1;
+	data->cinfo.scale_denom = data->jpeg_scale;
 
 	if (data->cinfo.num_components != 3) {
 		V4LCONVERT_ERR("unexpected no components in JPEG: %d\n",
@@ -339,7 +551,7 @@ int v4lconvert_decode_jpeg_libjpeg(struct v4lconvert_data *data,
 			v4lconvert_swap_rgb(dest, dest, width, height);
 #endif
 	} else {
-		int h_samp, v_samp;
+		int h_samp, v_samp, step = 1;
 		unsigned char *udest, *vdest;
 
 		if (data->cinfo.max_h_samp_factor == 2 &&
@@ -389,17 +601,25 @@ int v4lconvert_decode_jpeg_libjpeg(struct v4lconvert_data *data,
 		}
 
 		/* We don't want any padding as that may overflow our dest */
-		if (width % (8 * h_samp) || height % (8 * v_samp)) {
+		if (width % (8 / data->jpeg_scale * h_samp) ||
+		    height % (8 / data->jpeg_scale * v_samp)) {
 			V4LCONVERT_ERR(
 				"resolution is not a multiple of dctsize");
 			errno = EIO;
 			return -1;
 		}
 
-		if (dest_pix_fmt == V4L2_PIX_FMT_YVU420) {
+		switch (dest_pix_fmt) {
+		case V4L2_PIX_FMT_YVU420:
 			vdest = dest + width * height;
 			udest = vdest + (width * height) / 4;
-		} else {
+			break;
+		case V4L2_PIX_FMT_NV12:
+			udest = dest + width * height;
+			vdest = udest + 1;
+			step = 2;
+			break;
+		default:
 			udest = dest + width * height;
 			vdest = udest + (width * height) / 4;
 		}
@@ -409,12 +629,15 @@ int v4lconvert_decode_jpeg_libjpeg(struct v4lconvert_data *data,
 		jpeg_start_decompress(&data->cinfo);
 		/* Make libjpeg errors report that we've got some data */
 		data->jerr_errno = EPIPE;
-		if (h_samp == 1) {
+		if (data->jpeg_scale > 1) {
+			result = decode_libjpeg_scaled(data, dest, udest,
+						       vdest, step);
+		} else if (h_samp == 1) {
 			result = decode_libjpeg_h_samp1(data, dest, udest,
-							vdest, v_samp);
+							vdest, step, v_samp);
 		} else {
 			result = decode_libjpeg_h_samp2(data, dest, udest,
-							vdest, v_samp);
+							vdest, step, v_samp);
 		}
 		if (result)
 			jpeg_abort_decompress(&data->cinfo);
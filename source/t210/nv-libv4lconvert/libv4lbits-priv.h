@@ -0,0 +1,144 @@
+/*
+# Bitstream reader and multi symbol vlc tables for the webcam decoders
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License, version 2.1,
+# as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+ */
+
+#ifndef __LIBV4LBITS_PRIV_H
+#define __LIBV4LBITS_PRIV_H
+
+#include <string.h>
+#include <stdint.h>
+
+/* msb first bit reader with a 64 bit reservoir. After a refill there are at
+   least 56 bits available, reading past the end of the data returns zeros. */
+struct v4lconvert_bits {
+	uint64_t buf;		/* next bit in the msb */
+	int count;		/* valid bits in buf */
+	const unsigned char *p;
+	const unsigned char *end;
+	const unsigned char *start;
+};
+
+static inline void v4lconvert_bits_refill(struct v4lconvert_bits *b)
+{
+	uint64_t v;
+
+	if (b->end - b->p >= 8) {
+		/* The bits below count may already hold the start of the
+		   next byte, or-ing it in again does not change them */
+		memcpy(&v, b->p, 8);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		v = __builtin_bswap64(v);
+#endif
+		b->buf |= v >> b->count;
+		b->p += (63 - b->count) >> 3;
+		b->count |= 56;
+		return;
+	}
+
+	while (b->count <= 56) {
+		if (b->p < b->end)
+			b->buf |= (uint64_t)*b->p << (56 - b->count);
+		b->p++;
+		b->count += 8;
+	}
+}
+
+static inline void v4lconvert_bits_init(struct v4lconvert_bits *b,
+		const unsigned char *p, const unsigned char *end)
+{
+	b->buf = 0;
+	b->count = 0;
+	b->p = b->start = p;
+	b->end = end;
+	v4lconvert_bits_refill(b);
+}
+
+/* n must be 1 - 32 and not exceed count */
+static inline unsigned int v4lconvert_bits_peek(struct v4lconvert_bits *b,
+		int n)
+{
+	return b->buf >> (64 - n);
+}
+
+static inline void v4lconvert_bits_skip(struct v4lconvert_bits *b, int n)
+{
+	b->buf <<= n;
+	b->count -= n;
+}
+
+static inline unsigned int v4lconvert_bits_get(struct v4lconvert_bits *b,
+		int n)
+{
+	unsigned int v = v4lconvert_bits_peek(b, n);
+
+	v4lconvert_bits_skip(b, n);
+	return v;
+}
+
+/* Number of bits consumed since v4lconvert_bits_init() */
+static inline int v4lconvert_bits_pos(const struct v4lconvert_bits *b)
+{
+	return (b->p - b->start) * 8 - b->count;
+}
+
+/* The pac207, mr97310a and sn9c10x codes are at most 8 bits long, each
+   decoder has a table indexed by the next 8 bits of the stream. Codes which
+   are followed by extra bits or which do not produce a pixel are marked as
+   escapes and handled by the decoder. */
+struct v4lconvert_vlc {
+	unsigned char len;
+	unsigned char escape;
+	signed char val;
+};
+
+/* Indexed by the next V4LCONVERT_VLC_MULTI_BITS bits of the stream, holds
+   the first n (up to V4LCONVERT_VLC_MULTI_SYMS) codes which are fully
+   contained in them. end[i] is the number of bits used up to and including
+   code i. n is 0 if the first code is an escape. */
+#define V4LCONVERT_VLC_MULTI_BITS	10
+#define V4LCONVERT_VLC_MULTI_SYMS	4
+
+struct v4lconvert_vlc_multi {
+	unsigned char n;
+	unsigned char end[V4LCONVERT_VLC_MULTI_SYMS];
+	signed char val[V4LCONVERT_VLC_MULTI_SYMS];
+};
+
+static inline void v4lconvert_vlc_multi_init(
+		struct v4lconvert_vlc_multi *multi,
+		const struct v4lconvert_vlc *vlc)
+{
+	const int bits = V4LCONVERT_VLC_MULTI_BITS;
+	const struct v4lconvert_vlc *code;
+	int i, n, pos;
+
+	for (i = 0; i < (1 << bits); i++) {
+		pos = 0;
+		for (n = 0; n < V4LCONVERT_VLC_MULTI_SYMS; n++) {
+			/* The bits past the index are 0, which does not
+			   matter for codes which end before them */
+			code = &vlc[((i << pos) >> (bits - 8)) & 0xff];
+			if (code->escape || pos + code->len > bits)
+				break;
+			pos += code->len;
+			multi[i].end[n] = pos;
+			multi[i].val[n] = code->val;
+		}
+		multi[i].n = n;
+	}
+}
+
+#endif
@@ -0,0 +1,54 @@
+/*
+# Conversion into separate, padded destination planes
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License, version 2.1,
+# as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+ */
+
+#ifndef __LIBV4LCONVERT_PLANES_H
+#define __LIBV4LCONVERT_PLANES_H
+
+#include "libv4lconvert.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Like v4lconvert_convert(), but writes the frame to separate planes, each
+   with their own bytesperline, so that it can be converted straight into
+   pitched (hardware / encoder) buffers instead of being copied there.
+
+   dest_fmt must be one of:
+   - V4L2_PIX_FMT_RGB24 / V4L2_PIX_FMT_BGR24: dest[0] only
+   - V4L2_PIX_FMT_YUV420 / V4L2_PIX_FMT_YVU420: dest[0 - 2], in the plane
+     order of the fourcc, with an even width and height
+   - V4L2_PIX_FMT_NV12: dest[0] the y plane and dest[1] the interleaved uv
+     plane, with an even width and height
+   bytesperline[i] is the pitch of dest[i], it must be at least the width of
+   a line of that plane. The bytesperline and sizeimage of dest_fmt are not
+   used.
+
+   Returns the size of the image data written, excluding the padding of the
+   lines, or -1 on error, in which case errno is set and
+   v4lconvert_get_error_message() describes the error. */
+LIBV4L_PUBLIC int v4lconvert_convert_planes(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt,  /* in */
+		const struct v4l2_format *dest_fmt, /* in */
+		unsigned char *src, int src_size,
+		unsigned char *dest[], const unsigned int bytesperline[]);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
@@ -32,6 +32,7 @@
 #include <setjmp.h>
 #include "libv4l-plugin.h"
 #include "libv4lconvert.h"
+#include "libv4lconvert-planes.h"
 #include "control/libv4lcontrol.h"
 #include "processing/libv4lprocessing.h"
 #include "tinyjpeg.h"
@@ -40,6 +41,14 @@
 
 #define V4LCONVERT_ERROR_MSG_SIZE 256
 #define V4LCONVERT_MAX_FRAMESIZES 256
+#define V4LCONVERT_MAX_THREADS 16
+/* libv4l2 only retries 3 times on EAGAIN, which is what a helper pipeline
+   returns until it is filled */
+#define V4LCONVERT_MAX_HELPERS 4
+
+/* More bands then threads, so that a thread which gets descheduled does not
+   hold up the entire frame */
+#define V4LCONVERT_POOL_BANDS_PER_THREAD 4
 
 #define V4LCONVERT_ERR(...) \
 	snprintf(data->error_msg, V4LCONVERT_ERROR_MSG_SIZE, \
@@ -49,10 +58,16 @@
 #define V4LCONVERT_IS_UVC                0x01
 #define V4LCONVERT_USE_TINYJPEG          0x02
 
+/* CPU features, as returned by v4lconvert_cpu_init() */
+#define V4LCONVERT_CPU_NEON              0x01
+#define V4LCONVERT_CPU_SSE2              0x02
+#define V4LCONVERT_CPU_AVX2              0x04
+
 struct v4lconvert_data {
 	int fd;
 	int flags; /* bitfield */
 	int control_flags; /* bitfield */
+	int cpu_flags; /* bitfield */
 	unsigned int no_formats;
 	int64_t supported_src_formats; /* bitfield */
 	char error_msg[V4LCONVERT_ERROR_MSG_SIZE];
@@ -70,23 +85,29 @@ struct v4lconvert_data {
 	int fps;
 	int convert1_buf_size;
 	int convert2_buf_size;
-	int rotate90_buf_size;
-	int flip_buf_size;
+	int rotate_buf_size;
+	int scale_buf_size;
 	int convert_pixfmt_buf_size;
+	int pipeline_buf_size;
+	int planes_buf_size;
 	unsigned char *convert1_buf;
 	unsigned char *convert2_buf;
-	unsigned char *rotate90_buf;
-	unsigned char *flip_buf;
+	unsigned char *rotate_buf;
+	unsigned char *scale_buf;
 	unsigned char *convert_pixfmt_buf;
+	unsigned char *pipeline_buf;
+	unsigned char *planes_buf;
 	struct v4lcontrol_data *control;
 	struct v4lprocessing_data *processing;
+	struct v4lconvert_pool *pool; /* NULL when not using worker threads */
+	int tinyjpeg_idct; /* enum tinyjpeg_idct */
+	int jpeg_scale; /* jpegs are decoded at 1 / jpeg_scale of their size */
 	void *dev_ops_priv;
 	const struct libv4l_dev_ops *dev_ops;
 
 	/* Data for external decompression helpers code */
-	pid_t decompress_pid;
-	int decompress_in_pipe[2];  /* Data from helper to us */
-	int decompress_out_pipe[2]; /* Data from us to helper */
+	struct v4lconvert_helper_pool *helpers; /* NULL until first used */
+	int decompress_helpers; /* Number of helpers to pipeline frames over */
 
 	/* For mr97310a decoder */
 	int frames_dropped;
@@ -108,6 +129,15 @@ unsigned char *v4lconvert_alloc_buffer(int needed,
 
 int v4lconvert_oom_error(struct v4lconvert_data *data);
 
+int v4lconvert_cpu_init(void);
+
+void v4lconvert_rgbyuv_init(int cpu_flags);
+void v4lconvert_bayer_init(int cpu_flags);
+void tinyjpeg_idct_init(int cpu_flags);
+void v4lconvert_rotate_init(int cpu_flags);
+void v4lconvert_scale_init(int cpu_flags);
+void v4lprocessing_stats_init(int cpu_flags);
+
 void v4lconvert_rgb24_to_yuv420(const unsigned char *src, unsigned char *dest,
 		const struct v4l2_format *src_fmt, int bgr, int yvu, int bpp);
 
@@ -141,6 +171,27 @@ void v4lconvert_uyvy_to_bgr24(const unsigned char *src, unsigned char *dst,
 void v4lconvert_uyvy_to_yuv420(const unsigned char *src, unsigned char *dst,
 		int width, int height, int stride, int yvu);
 
+void v4lconvert_yuyv_to_nv12(const unsigned char *src, unsigned char *dst,
+		int width, int height, int stride);
+
+void v4lconvert_yvyu_to_nv12(const unsigned char *src, unsigned char *dst,
+		int width, int height, int stride);
+
+void v4lconvert_uyvy_to_nv12(const unsigned char *src, unsigned char *dst,
+		int width, int height, int stride);
+
+void v4lconvert_merge_uv(const unsigned char *u, const unsigned char *v,
+		unsigned char *uv, int n);
+
+void v4lconvert_yuv420_to_nv12(const unsigned char *src, unsigned char *dst,
+		int width, int height, int yvu);
+
+void v4lconvert_nv12_to_yuv420(const unsigned char *src, unsigned char *dst,
+		int width, int height, int stride, int yvu);
+
+void v4lconvert_nv12_to_rgb24(const unsigned char *src, unsigned char *dst,
+		int width, int height, int stride, int bgr);
+
 void v4lconvert_swap_rgb(const unsigned char *src, unsigned char *dst,
 		int width, int height);
 
@@ -162,11 +213,11 @@ void v4lconvert_y16_to_yuv420(const unsigned char *src, unsigned char *dest,
 void v4lconvert_rgb32_to_rgb24(const unsigned char *src, unsigned char *dest,
 		int width, int height, int bgr);
 
-int v4lconvert_y10b_to_rgb24(struct v4lconvert_data *data,
-	const unsigned char *src, unsigned char *dest, int width, int height);
+void v4lconvert_y10b_to_rgb24(const unsigned char *src, unsigned char *dest,
+		int width, int height);
 
-int v4lconvert_y10b_to_yuv420(struct v4lconvert_data *data,
-	const unsigned char *src, unsigned char *dest, int width, int height);
+void v4lconvert_y10b_to_yuv420(const unsigned char *src, unsigned char *dest,
+		int width, int height);
 
 void v4lconvert_rgb565_to_rgb24(const unsigned char *src, unsigned char *dest,
 		int width, int height);
@@ -223,8 +274,8 @@ int v4lconvert_decode_jpgl(const unsigned char *src, int src_size,
 void v4lconvert_decode_spca561(const unsigned char *src, unsigned char *dst,
 		int width, int height);
 
-void v4lconvert_decode_sn9c10x(const unsigned char *src, unsigned char *dst,
-		int width, int height);
+void v4lconvert_decode_sn9c10x(const unsigned char *src, int src_size,
+		unsigned char *dst, int width, int height);
 
 int v4lconvert_decode_pac207(struct v4lconvert_data *data,
 		const unsigned char *inp, int src_size, unsigned char *outp,
@@ -254,7 +305,17 @@ void v4lconvert_bayer_to_bgr24(const unsigned char *bayer,
 		unsigned char *rgb, int width, int height, const unsigned int stride, unsigned int pixfmt);
 
 void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
-		int width, int height, const unsigned int stride, unsigned int src_pixfmt, int yvu);
+		int width, int height, const unsigned int stride, unsigned int src_pixfmt,
+		unsigned int dest_pixfmt);
+
+void v4lconvert_bayer_lines_to_rgbbgr24(const unsigned char *bayer,
+		unsigned char *bgr, int width, int height, const unsigned int stride,
+		unsigned int pixfmt, int bgr_order, int first_line, int lines);
+
+void v4lconvert_bayer_lines_to_yuv420(const unsigned char *bayer,
+		unsigned char *yuv, int width, int height, const unsigned int stride,
+		unsigned int src_pixfmt, unsigned int dest_pixfmt, int first_line,
+		int lines);
 
 void v4lconvert_hm12_to_rgb24(const unsigned char *src,
 		unsigned char *dst, int width, int height);
@@ -265,15 +326,101 @@ void v4lconvert_hm12_to_bgr24(const unsigned char *src,
 void v4lconvert_hm12_to_yuv420(const unsigned char *src,
 		unsigned char *dst, int width, int height, int yvu);
 
-void v4lconvert_rotate90(unsigned char *src, unsigned char *dest,
-		struct v4l2_format *fmt);
+/* Orientations for v4lconvert_rotate(), a transpose (mirroring along the
+   top left to bottom right diagonal) followed by flipping */
+#define V4LCONVERT_ORIENT_TRANSPOSE	0x01
+#define V4LCONVERT_ORIENT_HFLIP		0x02
+#define V4LCONVERT_ORIENT_VFLIP		0x04
 
-void v4lconvert_flip(unsigned char *src, unsigned char *dest,
-		struct v4l2_format *fmt, int hflip, int vflip);
+int v4lconvert_orientation(int rotate, int hflip, int vflip);
+
+void v4lconvert_rotate_plane(const unsigned char *src, int src_stride,
+		unsigned char *dest, int dest_stride, int width, int height,
+		int bpp, int orient);
+
+void v4lconvert_rotate(unsigned char *src, unsigned char *dest,
+		struct v4l2_format *fmt, int orient);
 
 void v4lconvert_crop(unsigned char *src, unsigned char *dest,
 		const struct v4l2_format *src_fmt, const struct v4l2_format *dest_fmt);
 
+int v4lconvert_is_crop_res(unsigned int width, unsigned int height);
+
+int v4lconvert_crop_scales(const struct v4l2_format *src_fmt,
+		const struct v4l2_format *dest_fmt);
+
+int v4lconvert_scale(struct v4lconvert_data *data, unsigned char *src,
+		unsigned char *dest, const struct v4l2_format *src_fmt,
+		const struct v4l2_format *dest_fmt);
+
+/* Destination of v4lconvert_convert_planes() */
+struct v4lconvert_planes {
+	unsigned char **dest;
+	const unsigned int *bytesperline;
+	int nv12;
+};
+
+/* State for doing processing lookup, flip and crop in a single pass */
+struct v4lconvert_pipeline {
+	int src_width, src_height;	/* frame size before flip / crop */
+	int width, height;		/* frame size after crop */
+	int startx, starty;		/* crop window in the flipped frame */
+	int bpp;			/* bytes per pixel of the (y) plane */
+	int planar;			/* yuv420 / yvu420 */
+	int hflip, vflip;
+	int nv12;			/* u and v interleaved in dest[1] */
+	const unsigned char *lut[3];	/* rgb component / yuv plane lookups */
+	unsigned char *dest[3];		/* y / u / v, or just rgb */
+	int dest_stride[3];
+};
+
+int v4lconvert_pipeline_init(struct v4lconvert_pipeline *p,
+		const struct v4l2_format *src_fmt, const struct v4l2_format *dest_fmt,
+		unsigned char *dest, int hflip, int vflip);
+
+void v4lconvert_pipeline_set_planes(struct v4lconvert_pipeline *p,
+		unsigned char *dest[], const unsigned int bytesperline[], int nv12);
+
+void v4lconvert_pipeline_set_lut(struct v4lconvert_pipeline *p,
+		const unsigned char *comp1, const unsigned char *green,
+		const unsigned char *comp2);
+
+void v4lconvert_pipeline_lines(struct v4lconvert_pipeline *p,
+		const unsigned char *src, int first_line, int lines);
+
+void v4lconvert_pipeline_frame(struct v4lconvert_pipeline *p,
+		const unsigned char *src, int first_line, int lines);
+
+/* For sources with separate planes, y, u and v point to first_line in their
+   plane, for yuv420 first_line and lines must be even */
+void v4lconvert_pipeline_planes(struct v4lconvert_pipeline *p,
+		const unsigned char *y, const unsigned char *u,
+		const unsigned char *v, int first_line, int lines);
+
+int v4lconvert_decode_jpeg_tinyjpeg_pipeline(struct v4lconvert_data *data,
+	unsigned char *src, int src_size, struct v4l2_format *fmt,
+	unsigned int dest_pix_fmt, int flags,
+	struct v4lconvert_pipeline *pipeline);
+
+struct v4lconvert_pool *v4lconvert_pool_create(int threads);
+
+void v4lconvert_pool_destroy(struct v4lconvert_pool *pool);
+
+int v4lconvert_pool_threads(struct v4lconvert_pool *pool);
+
+/* Calls func(arg, thread, band) for band 0 till bands - 1 from the worker
+   threads and the calling thread, returns when all bands are done. thread
+   is the index of the calling thread, for v4lconvert_pool_scratch() */
+void v4lconvert_pool_run(struct v4lconvert_pool *pool,
+		void (*func)(void *arg, int thread, int band), void *arg, int bands);
+
+unsigned char *v4lconvert_pool_scratch(struct v4lconvert_pool *pool,
+		int thread, int needed);
+
+/* Splits height lines in bands starting at even lines */
+void v4lconvert_pool_band(int band, int bands, int height, int *first_line,
+		int *lines);
+
 int v4lconvert_helper_decompress(struct v4lconvert_data *data,
 		const char *helper, const unsigned char *src, int src_size,
 		unsigned char *dest, int dest_size, int width, int height, int command);
@@ -31,6 +31,7 @@
 #include "libv4lsyscall-priv.h"
 
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
 
 static void *dev_init(int fd)
 {
@@ -81,7 +82,8 @@ static void v4lconvert_get_framesizes(struct v4lconvert_data *data,
 	{ V4L2_PIX_FMT_RGB24,		24,	 1,	 5,	0 }, \
 	{ V4L2_PIX_FMT_BGR24,		24,	 1,	 5,	0 }, \
 	{ V4L2_PIX_FMT_YUV420,		12,	 6,	 1,	0 }, \
-	{ V4L2_PIX_FMT_YVU420,		12,	 6,	 1,	0 }
+	{ V4L2_PIX_FMT_YVU420,		12,	 6,	 1,	0 }, \
+	{ V4L2_PIX_FMT_NV12,		12,	 6,	 1,	0 }
 
 static const struct v4lconvert_pixfmt supported_src_pixfmts[] = {
 	SUPPORTED_DST_PIXFMTS,
@@ -145,19 +147,6 @@ static const struct v4lconvert_pixfmt supported_dst_pixfmts[] = {
 	SUPPORTED_DST_PIXFMTS
 };
 
-/* List of well known resolutions which we can get by cropping somewhat larger
-   resolutions */
-static const unsigned int v4lconvert_crop_res[][2] = {
-	/* low res VGA resolutions, can be made by software cropping SIF resolutions
-	   for cam/drivers which do not support this in hardware */
-	{ 320, 240 },
-	{ 160, 120 },
-	/* Some CIF cams (with vv6410 sensor) have slightly larger then usual CIF
-	   resolutions, make regular CIF resolutions available on these by sw crop */
-	{ 352, 288 },
-	{ 176, 144 },
-};
-
 struct v4lconvert_data *v4lconvert_create(int fd)
 {
 	return v4lconvert_create_with_dev_ops(fd, NULL, &default_dev_ops); 
@@ -169,6 +158,7 @@ struct v4lconvert_data *v4lconvert_create_with_dev_ops(int fd, void *dev_ops_pri
 	int i, j;
 	struct v4lconvert_data *data = calloc(1, sizeof(struct v4lconvert_data));
 	struct v4l2_capability cap;
+	char *s;
 	/* This keeps tracks of devices which have only formats for which apps
 	   most likely will need conversion and we can thus safely add software
 	   processing controls without a performance impact. */
@@ -182,8 +172,9 @@ struct v4lconvert_data *v4lconvert_create_with_dev_ops(int fd, void *dev_ops_pri
 	data->fd = fd;
 	data->dev_ops = dev_ops;
 	data->dev_ops_priv = dev_ops_priv;
-	data->decompress_pid = -1;
+	data->decompress_helpers = 1;
 	data->fps = 30;
+	data->cpu_flags = v4lconvert_cpu_init();
 
 	/* Check supported formats */
 	for (i = 0; ; i++) {
@@ -240,6 +231,37 @@ struct v4lconvert_data *v4lconvert_create_with_dev_ops(int fd, void *dev_ops_pri
 		return NULL;
 	}
 
+	/* Band parallel conversion is opt in, LIBV4LCONVERT_THREADS sets the
+	   number of threads (including the calling one) to use */
+	s = getenv("LIBV4LCONVERT_THREADS");
+	if (s) {
+		i = MIN(atoi(s), V4LCONVERT_MAX_THREADS);
+		if (i > 1) {
+			data->pool = v4lconvert_pool_create(i);
+			if (!data->pool)
+				fprintf(stderr, "libv4lconvert: warning: could not "
+						"create worker threads\n");
+		}
+	}
+
+	/* Pipelining frames over multiple decompression helpers is opt in too,
+	   as it delays the frames by LIBV4LCONVERT_HELPERS - 1 */
+	s = getenv("LIBV4LCONVERT_HELPERS");
+	if (s) {
+		i = atoi(s);
+		data->decompress_helpers = MAX(1, MIN(i, V4LCONVERT_MAX_HELPERS));
+	}
+
+	/* Trade jpeg decoding accuracy for speed, or get the old float idct */
+	s = getenv("LIBV4LCONVERT_IDCT");
+	if (s) {
+		if (!strcmp(s, "ifast"))
+			data->tinyjpeg_idct = TINYJPEG_IDCT_IFAST;
+		else if (!strcmp(s, "float"))
+			data->tinyjpeg_idct = TINYJPEG_IDCT_FLOAT;
+	}
+	data->jpeg_scale = 1;
+
 	return data;
 }
 
@@ -248,6 +270,7 @@ void v4lconvert_destroy(struct v4lconvert_data *data)
 	if (!data)
 		return;
 
+	v4lconvert_pool_destroy(data->pool);
 	v4lprocessing_destroy(data->processing);
 	v4lcontrol_destroy(data->control);
 	if (data->tinyjpeg) {
@@ -263,9 +286,11 @@ void v4lconvert_destroy(struct v4lconvert_data *data)
 	v4lconvert_helper_cleanup(data);
 	free(data->convert1_buf);
 	free(data->convert2_buf);
-	free(data->rotate90_buf);
-	free(data->flip_buf);
+	free(data->rotate_buf);
+	free(data->scale_buf);
 	free(data->convert_pixfmt_buf);
+	free(data->pipeline_buf);
+	free(data->planes_buf);
 	free(data->previous_frame);
 	free(data);
 }
@@ -355,6 +380,7 @@ static int v4lconvert_get_rank(struct v4lconvert_data *data,
 		break;
 	case V4L2_PIX_FMT_YUV420:
 	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_NV12:
 		rank = supported_src_pixfmts[src_index].yuv_rank;
 		break;
 	}
@@ -500,6 +526,68 @@ static int v4lconvert_do_try_format(struct v4lconvert_data *data,
 	return 0;
 }
 
+/* Can we scale from a src resolution to the desired resolution? We only scale
+   down, and by no more than V4LCONVERT_MAX_SCALE, as the bilinear filter
+   only looks at 2x2 src pixels for each dest pixel */
+#define V4LCONVERT_MAX_SCALE 8
+
+static int v4lconvert_can_scale(unsigned int src_width, unsigned int src_height,
+		unsigned int desired_width, unsigned int desired_height)
+{
+	return src_width >= desired_width && src_height >= desired_height &&
+		src_width <= V4LCONVERT_MAX_SCALE * desired_width &&
+		src_height <= V4LCONVERT_MAX_SCALE * desired_height;
+}
+
+/* Find the smallest src resolution which can be scaled down to the desired
+   resolution. dest_fmt / src_fmt must hold the closest match found by
+   v4lconvert_do_try_format(), which is used if nothing better is found in
+   the (discrete) framesizes the cam has. */
+static int v4lconvert_try_format_scaled(struct v4lconvert_data *data,
+		struct v4l2_format *dest_fmt, struct v4l2_format *src_fmt,
+		unsigned int desired_width, unsigned int desired_height)
+{
+	unsigned int i, width, height, size, best_size = -1;
+	struct v4l2_format try_dest, try_src;
+	int best_framesize = -1, found;
+
+	found = v4lconvert_can_scale(dest_fmt->fmt.pix.width,
+			dest_fmt->fmt.pix.height, desired_width, desired_height);
+	if (found)
+		best_size = dest_fmt->fmt.pix.width * dest_fmt->fmt.pix.height;
+
+	for (i = 0; i < data->no_framesizes; i++) {
+		if (data->framesizes[i].type != V4L2_FRMSIZE_TYPE_DISCRETE)
+			continue;
+
+		width = data->framesizes[i].discrete.width;
+		height = data->framesizes[i].discrete.height;
+		size = width * height;
+		if (size < best_size && v4lconvert_can_scale(width, height,
+					desired_width, desired_height)) {
+			best_size = size;
+			best_framesize = i;
+		}
+	}
+
+	if (best_framesize != -1) {
+		width = data->framesizes[best_framesize].discrete.width;
+		height = data->framesizes[best_framesize].discrete.height;
+		try_dest = *dest_fmt;
+		try_dest.fmt.pix.width = width;
+		try_dest.fmt.pix.height = height;
+		if (v4lconvert_do_try_format(data, &try_dest, &try_src) == 0 &&
+				try_dest.fmt.pix.width == width &&
+				try_dest.fmt.pix.height == height) {
+			*dest_fmt = try_dest;
+			*src_fmt = try_src;
+			return 0;
+		}
+	}
+
+	return found ? 0 : -1;
+}
+
 void v4lconvert_fixup_fmt(struct v4l2_format *fmt)
 {
 	switch (fmt->fmt.pix.pixelformat) {
@@ -510,6 +598,7 @@ void v4lconvert_fixup_fmt(struct v4l2_format *fmt)
 		break;
 	case V4L2_PIX_FMT_YUV420:
 	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_NV12:
 		fmt->fmt.pix.bytesperline = fmt->fmt.pix.width;
 		fmt->fmt.pix.sizeimage = fmt->fmt.pix.width * fmt->fmt.pix.height * 3 / 2;
 		break;
@@ -520,9 +609,8 @@ void v4lconvert_fixup_fmt(struct v4l2_format *fmt)
 int v4lconvert_try_format(struct v4lconvert_data *data,
 		struct v4l2_format *dest_fmt, struct v4l2_format *src_fmt)
 {
-	int i, result;
-	unsigned int desired_width = dest_fmt->fmt.pix.width;
-	unsigned int desired_height = dest_fmt->fmt.pix.height;
+	int result, swap;
+	unsigned int desired_width, desired_height;
 	struct v4l2_format try_src, try_dest, try2_src, try2_dest;
 
 	if (dest_fmt->type == V4L2_BUF_TYPE_VIDEO_CAPTURE &&
@@ -530,7 +618,18 @@ int v4lconvert_try_format(struct v4lconvert_data *data,
 			!v4lconvert_supported_dst_format(dest_fmt->fmt.pix.pixelformat))
 		dest_fmt->fmt.pix.pixelformat = V4L2_PIX_FMT_RGB24;
 
+	/* When rotating by 90 or 270 degrees look for a cam resolution
+	   matching the rotated resolution asked for */
+	swap = v4lconvert_orientation(v4lcontrol_get_ctrl(data->control,
+				V4LCONTROL_ROTATE), 0, 0) &
+		V4LCONVERT_ORIENT_TRANSPOSE;
 	try_dest = *dest_fmt;
+	if (swap) {
+		try_dest.fmt.pix.width = dest_fmt->fmt.pix.height;
+		try_dest.fmt.pix.height = dest_fmt->fmt.pix.width;
+	}
+	desired_width = try_dest.fmt.pix.width;
+	desired_height = try_dest.fmt.pix.height;
 
 	/* Can we do conversion to the requested format & type? */
 	if (!v4lconvert_supported_dst_format(dest_fmt->fmt.pix.pixelformat) ||
@@ -570,45 +669,62 @@ int v4lconvert_try_format(struct v4lconvert_data *data,
 	   resolution some apps are hardcoded too and try to give the app what it
 	   asked for by cropping a slightly larger resolution or adding a small
 	   black border to a slightly smaller resolution */
+	if ((try_dest.fmt.pix.width != desired_width ||
+	     try_dest.fmt.pix.height != desired_height) &&
+			v4lconvert_is_crop_res(desired_width, desired_height)) {
+		try2_dest = *dest_fmt;
+
+		/* Note these are chosen so that cropping to vga res just works for
+		   vv6410 sensor cams, which have 356x292 and 180x148 */
+		try2_dest.fmt.pix.width = desired_width * 113 / 100;
+		try2_dest.fmt.pix.height = desired_height * 124 / 100;
+		result = v4lconvert_do_try_format(data, &try2_dest, &try2_src);
+		if (result == 0 &&
+				(/* Add a small black border of max 16 pixels */
+				 (try2_dest.fmt.pix.width >= desired_width - 16 &&
+				  try2_dest.fmt.pix.width <= desired_width &&
+				  try2_dest.fmt.pix.height >= desired_height - 16 &&
+				  try2_dest.fmt.pix.height <= desired_height) ||
+				 /* Standard cropping to max 80% of actual width / height */
+				 (try2_dest.fmt.pix.width >= desired_width &&
+				  try2_dest.fmt.pix.width <= desired_width * 5 / 4 &&
+				  try2_dest.fmt.pix.height >= desired_height &&
+				  try2_dest.fmt.pix.height <= desired_height * 5 / 4) ||
+				 /* Downscale 2x + cropping to max 80% of actual width / height */
+				 (try2_dest.fmt.pix.width >= desired_width * 2 &&
+				  try2_dest.fmt.pix.width <= desired_width * 5 / 2 &&
+				  try2_dest.fmt.pix.height >= desired_height * 2 &&
+				  try2_dest.fmt.pix.height <= desired_height * 5 / 2))) {
+			/* Success! */
+			try2_dest.fmt.pix.width = desired_width;
+			try2_dest.fmt.pix.height = desired_height;
+			try_dest = try2_dest;
+			try_src = try2_src;
+		}
+	}
+
+	/* If all of the above failed, give the app the resolution it asked for
+	   anyways by scaling down a larger resolution */
 	if (try_dest.fmt.pix.width != desired_width ||
 			try_dest.fmt.pix.height != desired_height) {
-		for (i = 0; i < ARRAY_SIZE(v4lconvert_crop_res); i++) {
-			if (v4lconvert_crop_res[i][0] == desired_width &&
-					v4lconvert_crop_res[i][1] == desired_height) {
-				try2_dest = *dest_fmt;
-
-				/* Note these are chosen so that cropping to vga res just works for
-				   vv6410 sensor cams, which have 356x292 and 180x148 */
-				try2_dest.fmt.pix.width = desired_width * 113 / 100;
-				try2_dest.fmt.pix.height = desired_height * 124 / 100;
-				result = v4lconvert_do_try_format(data, &try2_dest, &try2_src);
-				if (result == 0 &&
-						(/* Add a small black border of max 16 pixels */
-						 (try2_dest.fmt.pix.width >= desired_width - 16 &&
-						  try2_dest.fmt.pix.width <= desired_width &&
-						  try2_dest.fmt.pix.height >= desired_height - 16 &&
-						  try2_dest.fmt.pix.height <= desired_height) ||
-						 /* Standard cropping to max 80% of actual width / height */
-						 (try2_dest.fmt.pix.width >= desired_width &&
-						  try2_dest.fmt.pix.width <= desired_width * 5 / 4 &&
-						  try2_dest.fmt.pix.height >= desired_height &&
-						  try2_dest.fmt.pix.height <= desired_height * 5 / 4) ||
-						 /* Downscale 2x + cropping to max 80% of actual width / height */
-						 (try2_dest.fmt.pix.width >= desired_width * 2 &&
-						  try2_dest.fmt.pix.width <= desired_width * 5 / 2 &&
-						  try2_dest.fmt.pix.height >= desired_height * 2 &&
-						  try2_dest.fmt.pix.height <= desired_height * 5 / 2))) {
-					/* Success! */
-					try2_dest.fmt.pix.width = desired_width;
-					try2_dest.fmt.pix.height = desired_height;
-					try_dest = try2_dest;
-					try_src = try2_src;
-				}
-				break;
-			}
+		try2_dest = try_dest;
+		try2_src = try_src;
+		if (v4lconvert_try_format_scaled(data, &try2_dest, &try2_src,
+					desired_width, desired_height) == 0) {
+			try2_dest.fmt.pix.width = desired_width;
+			try2_dest.fmt.pix.height = desired_height;
+			try_dest = try2_dest;
+			try_src = try2_src;
 		}
 	}
 
+	if (swap) {
+		unsigned int tmp = try_dest.fmt.pix.width;
+
+		try_dest.fmt.pix.width = try_dest.fmt.pix.height;
+		try_dest.fmt.pix.height = tmp;
+	}
+
 	/* Some applications / libs (*cough* gstreamer *cough*) will not work
 	   correctly with planar YUV formats when the width is not a multiple of 8
 	   or the height is not a multiple of 2. With RGB formats these apps require
@@ -645,9 +761,41 @@ int v4lconvert_needs_conversion(struct v4lconvert_data *data,
 	return 0;
 }
 
+static int v4lconvert_fmt_is_packed_or_planar_yuv(unsigned int pix_fmt)
+{
+	switch (pix_fmt) {
+	case V4L2_PIX_FMT_YUYV:
+	case V4L2_PIX_FMT_YVYU:
+	case V4L2_PIX_FMT_UYVY:
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_NV12:
+		return 1;
+	}
+	return 0;
+}
+
+static int v4lconvert_fmt_is_rgb(unsigned int pix_fmt)
+{
+	return pix_fmt == V4L2_PIX_FMT_RGB24 || pix_fmt == V4L2_PIX_FMT_BGR24;
+}
+
+/* Decoding jpeg straight to yuv needs whole MCUs, which with 4:2:0 sampling
+   are 16x16 pixels of the jpeg */
+static int v4lconvert_jpeg_size_is_mcu_aligned(struct v4lconvert_data *data,
+		const struct v4l2_format *fmt)
+{
+	unsigned int mcu = 16 / data->jpeg_scale;
+
+	return fmt->fmt.pix.width % mcu == 0 && fmt->fmt.pix.height % mcu == 0;
+}
+
 static int v4lconvert_processing_needs_double_conversion(
-		unsigned int src_pix_fmt, unsigned int dest_pix_fmt)
+		struct v4lconvert_data *data, const struct v4l2_format *src_fmt,
+		unsigned int dest_pix_fmt)
 {
+	unsigned int src_pix_fmt = src_fmt->fmt.pix.pixelformat;
+
 	switch (src_pix_fmt) {
 	case V4L2_PIX_FMT_RGB24:
 	case V4L2_PIX_FMT_BGR24:
@@ -667,15 +815,32 @@ static int v4lconvert_processing_needs_double_conversion(
 	case V4L2_PIX_FMT_STV0680:
 		return 0;
 	}
-	switch (dest_pix_fmt) {
-	case V4L2_PIX_FMT_RGB24:
-	case V4L2_PIX_FMT_BGR24:
+	if (v4lconvert_fmt_is_rgb(dest_pix_fmt))
+		return 0;
+
+	/* yuv to yuv gets processed in the yuv domain instead, as does jpeg
+	   to yuv when the direct decoding handles the size. Jpegs of other
+	   sizes, and the other sources, keep going through rgb24 */
+	if (v4lconvert_fmt_is_packed_or_planar_yuv(src_pix_fmt))
+		return 0;
+
+	if ((src_pix_fmt == V4L2_PIX_FMT_MJPEG ||
+			src_pix_fmt == V4L2_PIX_FMT_JPEG) &&
+			v4lconvert_jpeg_size_is_mcu_aligned(data, src_fmt))
 		return 0;
-	}
 
 	return 1;
 }
 
+/* yuv to rgb gets processed on the rgb dest, as it always was, rather than
+   with the less exact yuv domain filters on the source */
+static int v4lconvert_processing_on_dest(unsigned int src_pix_fmt,
+		unsigned int dest_pix_fmt)
+{
+	return v4lconvert_fmt_is_packed_or_planar_yuv(src_pix_fmt) &&
+		v4lconvert_fmt_is_rgb(dest_pix_fmt);
+}
+
 unsigned char *v4lconvert_alloc_buffer(int needed,
 		unsigned char **buf, int *buf_size)
 {
@@ -698,6 +863,47 @@ int v4lconvert_oom_error(struct v4lconvert_data *data)
 	return -1;
 }
 
+/* Whether v4lconvert_convert_pixfmt() can write nv12 straight from src_pix_fmt,
+   the other formats get converted to yuv420 and have their chroma interleaved
+   afterwards */
+static int v4lconvert_direct_nv12(unsigned int src_pix_fmt)
+{
+	switch (src_pix_fmt) {
+	case V4L2_PIX_FMT_MJPEG:
+	case V4L2_PIX_FMT_JPEG:
+	case V4L2_PIX_FMT_PJPG:
+	case V4L2_PIX_FMT_YUYV:
+	case V4L2_PIX_FMT_YVYU:
+	case V4L2_PIX_FMT_UYVY:
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_SPCA561:
+	case V4L2_PIX_FMT_SN9C10X:
+	case V4L2_PIX_FMT_PAC207:
+	case V4L2_PIX_FMT_MR97310A:
+#ifdef HAVE_JPEG
+	case V4L2_PIX_FMT_JL2005BCD:
+#endif
+	case V4L2_PIX_FMT_SN9C2028:
+	case V4L2_PIX_FMT_SQ905C:
+	case V4L2_PIX_FMT_STV0680:
+	case V4L2_PIX_FMT_SBGGR8:
+	case V4L2_PIX_FMT_SGBRG8:
+	case V4L2_PIX_FMT_SGRBG8:
+	case V4L2_PIX_FMT_SRGGB8:
+	/* Grey has no chroma, yuv420 and nv12 only differ in name */
+	case V4L2_PIX_FMT_GREY:
+	case V4L2_PIX_FMT_Y4:
+	case V4L2_PIX_FMT_Y6:
+	case V4L2_PIX_FMT_Y16:
+	case V4L2_PIX_FMT_Y16_BE:
+	case V4L2_PIX_FMT_Y10BPACK:
+		return 1;
+	}
+	return 0;
+}
+
 static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 	unsigned char *src, unsigned int src_size, unsigned char *dest, int dest_size,
 	struct v4l2_format *fmt, unsigned int dest_pix_fmt)
@@ -707,6 +913,13 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 	unsigned int width  = fmt->fmt.pix.width;
 	unsigned int height = fmt->fmt.pix.height;
 	unsigned int bytesperline = fmt->fmt.pix.bytesperline;
+	int nv12 = 0;
+
+	if (dest_pix_fmt == V4L2_PIX_FMT_NV12 &&
+			!v4lconvert_direct_nv12(src_pix_fmt)) {
+		dest_pix_fmt = V4L2_PIX_FMT_YUV420;
+		nv12 = 1;
+	}
 
 	switch (src_pix_fmt) {
 	/* JPG and variants */
@@ -879,7 +1092,8 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 			tmpfmt.fmt.pix.pixelformat = V4L2_PIX_FMT_SGBRG8;
 			break;
 		case V4L2_PIX_FMT_SN9C10X:
-			v4lconvert_decode_sn9c10x(src, tmpbuf, width, height);
+			v4lconvert_decode_sn9c10x(src, src_size, tmpbuf, width,
+					height);
 			tmpfmt.fmt.pix.pixelformat = V4L2_PIX_FMT_SBGGR8;
 			break;
 		case V4L2_PIX_FMT_PAC207:
@@ -934,6 +1148,7 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		src_pix_fmt = tmpfmt.fmt.pix.pixelformat;
 		src = tmpbuf;
 		src_size = width * height;
+		bytesperline = width;
 		/* fall through */
 	}
 
@@ -955,10 +1170,9 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 			v4lconvert_bayer_to_bgr24(src, dest, width, height, bytesperline, src_pix_fmt);
 			break;
 		case V4L2_PIX_FMT_YUV420:
-			v4lconvert_bayer_to_yuv420(src, dest, width, height, bytesperline, src_pix_fmt, 0);
-			break;
 		case V4L2_PIX_FMT_YVU420:
-			v4lconvert_bayer_to_yuv420(src, dest, width, height, bytesperline, src_pix_fmt, 1);
+		case V4L2_PIX_FMT_NV12:
+			v4lconvert_bayer_to_yuv420(src, dest, width, height, bytesperline, src_pix_fmt, dest_pix_fmt);
 			break;
 		}
 		break;
@@ -1019,6 +1233,7 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 			break;
 		case V4L2_PIX_FMT_YUV420:
 		case V4L2_PIX_FMT_YVU420:
+		case V4L2_PIX_FMT_NV12:
 			v4lconvert_y16_to_yuv420(src, dest, fmt,
 					 src_pix_fmt == V4L2_PIX_FMT_Y16);
 			break;
@@ -1040,6 +1255,7 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 			break;
 		case V4L2_PIX_FMT_YUV420:
 		case V4L2_PIX_FMT_YVU420:
+		case V4L2_PIX_FMT_NV12:
 			v4lconvert_grey_to_yuv420(src, dest, fmt);
 			break;
 		}
@@ -1054,13 +1270,12 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
 	        case V4L2_PIX_FMT_BGR24:
-			result = v4lconvert_y10b_to_rgb24(data, src, dest,
-							  width, height);
+			v4lconvert_y10b_to_rgb24(src, dest, width, height);
 			break;
 		case V4L2_PIX_FMT_YUV420:
 		case V4L2_PIX_FMT_YVU420:
-			result = v4lconvert_y10b_to_yuv420(data, src, dest,
-							   width, height);
+		case V4L2_PIX_FMT_NV12:
+			v4lconvert_y10b_to_yuv420(src, dest, width, height);
 			break;
 		}
 		break;
@@ -1201,6 +1416,9 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		case V4L2_PIX_FMT_YVU420:
 			v4lconvert_swap_uv(src, dest, fmt);
 			break;
+		case V4L2_PIX_FMT_NV12:
+			v4lconvert_yuv420_to_nv12(src, dest, width, height, 0);
+			break;
 		}
 		break;
 
@@ -1225,6 +1443,46 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		case V4L2_PIX_FMT_YVU420:
 			memcpy(dest, src, width * height * 3 / 2);
 			break;
+		case V4L2_PIX_FMT_NV12:
+			v4lconvert_yuv420_to_nv12(src, dest, width, height, 1);
+			break;
+		}
+		break;
+
+	case V4L2_PIX_FMT_NV12:
+		if (src_size < (bytesperline * height * 3 / 2)) {
+			V4LCONVERT_ERR("short nv12 data frame\n");
+			errno = EPIPE;
+			result = -1;
+		}
+		switch (dest_pix_fmt) {
+		case V4L2_PIX_FMT_RGB24:
+			v4lconvert_nv12_to_rgb24(src, dest, width, height,
+					bytesperline, 0);
+			break;
+		case V4L2_PIX_FMT_BGR24:
+			v4lconvert_nv12_to_rgb24(src, dest, width, height,
+					bytesperline, 1);
+			break;
+		case V4L2_PIX_FMT_YUV420:
+			v4lconvert_nv12_to_yuv420(src, dest, width, height,
+					bytesperline, 0);
+			break;
+		case V4L2_PIX_FMT_YVU420:
+			v4lconvert_nv12_to_yuv420(src, dest, width, height,
+					bytesperline, 1);
+			break;
+		case V4L2_PIX_FMT_NV12: {
+			unsigned int y;
+
+			/* The uv plane has the same bytesperline as the y plane */
+			for (y = 0; y < height * 3 / 2; y++) {
+				memcpy(dest, src, width);
+				dest += width;
+				src += bytesperline;
+			}
+			break;
+		}
 		}
 		break;
 
@@ -1247,6 +1505,9 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		case V4L2_PIX_FMT_YVU420:
 			v4lconvert_yuyv_to_yuv420(src, dest, width, height, bytesperline, 1);
 			break;
+		case V4L2_PIX_FMT_NV12:
+			v4lconvert_yuyv_to_nv12(src, dest, width, height, bytesperline);
+			break;
 		}
 		break;
 
@@ -1271,6 +1532,9 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		case V4L2_PIX_FMT_YVU420:
 			v4lconvert_yuyv_to_yuv420(src, dest, width, height, bytesperline, 0);
 			break;
+		case V4L2_PIX_FMT_NV12:
+			v4lconvert_yvyu_to_nv12(src, dest, width, height, bytesperline);
+			break;
 		}
 		break;
 
@@ -1293,6 +1557,9 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		case V4L2_PIX_FMT_YVU420:
 			v4lconvert_uyvy_to_yuv420(src, dest, width, height, bytesperline, 1);
 			break;
+		case V4L2_PIX_FMT_NV12:
+			v4lconvert_uyvy_to_nv12(src, dest, width, height, bytesperline);
+			break;
 		}
 		break;
 
@@ -1302,47 +1569,606 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		return -1;
 	}
 
+	/* Interleave the u and v planes of the yuv420 frame in dest */
+	if (nv12) {
+		unsigned char *uv = dest + width * height;
+		unsigned char *buf = v4lconvert_alloc_buffer(width * height / 2,
+				&data->convert_pixfmt_buf,
+				&data->convert_pixfmt_buf_size);
+
+		if (!buf)
+			return v4lconvert_oom_error(data);
+
+		memcpy(buf, uv, width * height / 2);
+		v4lconvert_merge_uv(buf, buf + width * height / 4, uv,
+				width * height / 4);
+		dest_pix_fmt = V4L2_PIX_FMT_NV12;
+	}
+
 	fmt->fmt.pix.pixelformat = dest_pix_fmt;
 	v4lconvert_fixup_fmt(fmt);
 
 	return result;
 }
 
-int v4lconvert_convert(struct v4lconvert_data *data,
-		const struct v4l2_format *src_fmt,  /* in */
-		const struct v4l2_format *dest_fmt, /* in */
-		unsigned char *src, int src_size, unsigned char *dest, int dest_size)
+/* Lines per band when converting in bands, small enough for the band to
+   stay in the cache while it gets flipped / cropped into dest */
+#define V4LCONVERT_PIPELINE_BAND_LINES 16
+
+/* A frame conversion split in bands for the worker pool */
+struct v4lconvert_band_job {
+	struct v4lconvert_data *data;
+	struct v4l2_format fmt;		/* of src */
+	unsigned char *src;
+	int src_size;
+	unsigned char *dest;
+	unsigned int dest_pix_fmt;
+	struct v4lconvert_pipeline *pipeline;
+	int bands;
+	int result;
+	int oom;
+};
+
+static int v4lconvert_band_job_bands(struct v4lconvert_data *data,
+		int height)
+{
+	int bands = v4lconvert_pool_threads(data->pool) *
+		V4LCONVERT_POOL_BANDS_PER_THREAD;
+
+	/* Keep bands at least V4LCONVERT_PIPELINE_BAND_LINES high */
+	return MAX(1, MIN(bands, height / V4LCONVERT_PIPELINE_BAND_LINES));
+}
+
+/* Convert a band of packed yuv 4:2:2 as if it were a frame of its own */
+static int v4lconvert_convert_band_pixfmt(struct v4lconvert_band_job *job,
+		int first_line, int lines, unsigned char *dest, int dest_size)
+{
+	struct v4l2_format band_fmt = job->fmt;
+	unsigned int bytesperline = job->fmt.fmt.pix.bytesperline;
+
+	band_fmt.fmt.pix.height = lines;
+	band_fmt.fmt.pix.sizeimage = lines * bytesperline;
+
+	return v4lconvert_convert_pixfmt(job->data,
+			job->src + first_line * bytesperline,
+			job->src_size - first_line * bytesperline, dest, dest_size,
+			&band_fmt, job->dest_pix_fmt);
+}
+
+static void v4lconvert_convert_band(void *arg, int thread, int band)
+{
+	struct v4lconvert_band_job *job = arg;
+	unsigned int src_pix_fmt = job->fmt.fmt.pix.pixelformat;
+	unsigned int width = job->fmt.fmt.pix.width;
+	unsigned int height = job->fmt.fmt.pix.height;
+	unsigned int bytesperline = job->fmt.fmt.pix.bytesperline;
+	unsigned char *buf;
+	int y, lines, res;
+
+	v4lconvert_pool_band(band, job->bands, height, &y, &lines);
+	if (!lines)
+		return;
+
+	switch (src_pix_fmt) {
+	case V4L2_PIX_FMT_SBGGR8:
+	case V4L2_PIX_FMT_SGBRG8:
+	case V4L2_PIX_FMT_SGRBG8:
+	case V4L2_PIX_FMT_SRGGB8:
+		switch (job->dest_pix_fmt) {
+		case V4L2_PIX_FMT_RGB24:
+		case V4L2_PIX_FMT_BGR24:
+			v4lconvert_bayer_lines_to_rgbbgr24(job->src, job->dest,
+					width, height, bytesperline, src_pix_fmt,
+					job->dest_pix_fmt == V4L2_PIX_FMT_BGR24,
+					y, lines);
+			break;
+		case V4L2_PIX_FMT_YUV420:
+		case V4L2_PIX_FMT_YVU420:
+		case V4L2_PIX_FMT_NV12:
+			v4lconvert_bayer_lines_to_yuv420(job->src, job->dest,
+					width, height, bytesperline, src_pix_fmt,
+					job->dest_pix_fmt, y, lines);
+			break;
+		}
+		return;
+	}
+
+	switch (job->dest_pix_fmt) {
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+		res = v4lconvert_convert_band_pixfmt(job, y, lines,
+				job->dest + y * width * 3, lines * width * 3);
+		break;
+	case V4L2_PIX_FMT_NV12:
+		buf = v4lconvert_pool_scratch(job->data->pool, thread,
+				width * lines * 3 / 2);
+		if (!buf) {
+			job->oom = 1;
+			return;
+		}
+		res = v4lconvert_convert_band_pixfmt(job, y, lines, buf,
+				width * lines * 3 / 2);
+		if (res)
+			break;
+
+		memcpy(job->dest + y * width, buf, width * lines);
+		memcpy(job->dest + width * height + y * width / 2,
+				buf + width * lines, width * lines / 2);
+		break;
+	default:
+		/* The planes of the band are not contiguous in dest, so convert
+		   to scratch memory and copy the planes in place from there */
+		buf = v4lconvert_pool_scratch(job->data->pool, thread,
+				width * lines * 3 / 2);
+		if (!buf) {
+			job->oom = 1;
+			return;
+		}
+		res = v4lconvert_convert_band_pixfmt(job, y, lines, buf,
+				width * lines * 3 / 2);
+		if (res)
+			break;
+
+		memcpy(job->dest + y * width, buf, width * lines);
+		buf += width * lines;
+		memcpy(job->dest + width * height + y * width / 4, buf,
+				width * lines / 4);
+		buf += width * lines / 4;
+		memcpy(job->dest + width * height * 5 / 4 + y * width / 4, buf,
+				width * lines / 4);
+		break;
+	}
+
+	if (res)
+		job->result = res;
+}
+
+/* v4lconvert_convert_pixfmt(), using the worker pool if there is one and
+   the src format can be converted in bands */
+static int v4lconvert_convert_pixfmt_bands(struct v4lconvert_data *data,
+	unsigned char *src, unsigned int src_size, unsigned char *dest, int dest_size,
+	struct v4l2_format *fmt, unsigned int dest_pix_fmt)
+{
+	struct v4lconvert_band_job job;
+	unsigned int width = fmt->fmt.pix.width;
+	unsigned int height = fmt->fmt.pix.height;
+	unsigned int bytesperline = fmt->fmt.pix.bytesperline;
+	int parallel = 0;
+
+	if (data->pool) {
+		switch (fmt->fmt.pix.pixelformat) {
+		case V4L2_PIX_FMT_YUYV:
+		case V4L2_PIX_FMT_YVYU:
+		case V4L2_PIX_FMT_UYVY:
+			/* Leave the short frame error handling to
+			   v4lconvert_convert_pixfmt() */
+			parallel = !(height & 1) && bytesperline >= width * 2 &&
+				src_size >= width * height * 2 &&
+				src_size >= bytesperline * (height - 1) + width * 2;
+			break;
+		case V4L2_PIX_FMT_SBGGR8:
+		case V4L2_PIX_FMT_SGBRG8:
+		case V4L2_PIX_FMT_SGRBG8:
+		case V4L2_PIX_FMT_SRGGB8:
+			parallel = height >= 2 && src_size >= width * height;
+			break;
+		}
+	}
+
+	if (!parallel)
+		return v4lconvert_convert_pixfmt(data, src, src_size, dest,
+				dest_size, fmt, dest_pix_fmt);
+
+	memset(&job, 0, sizeof(job));
+	job.data = data;
+	job.fmt = *fmt;
+	job.src = src;
+	job.src_size = src_size;
+	job.dest = dest;
+	job.dest_pix_fmt = dest_pix_fmt;
+	job.bands = v4lconvert_band_job_bands(data, height);
+
+	v4lconvert_pool_run(data->pool, v4lconvert_convert_band, &job,
+			job.bands);
+	if (job.oom)
+		return v4lconvert_oom_error(data);
+	if (job.result)
+		return job.result;
+
+	fmt->fmt.pix.pixelformat = dest_pix_fmt;
+	v4lconvert_fixup_fmt(fmt);
+
+	return 0;
+}
+
+/* Convert a band of packed yuv 4:2:2 in small chunks, feeding each chunk to
+   the pipeline while it is still in the cache */
+static void v4lconvert_pipeline_convert_band(void *arg, int thread, int band)
+{
+	struct v4lconvert_band_job *job = arg;
+	unsigned int width = job->fmt.fmt.pix.width;
+	int y, first_line, last_line, lines, band_size, res;
+	unsigned char *buf;
+
+	band_size = width * V4LCONVERT_PIPELINE_BAND_LINES * 3;
+	if (job->data->pool)
+		buf = v4lconvert_pool_scratch(job->data->pool, thread,
+				band_size);
+	else
+		buf = v4lconvert_alloc_buffer(band_size,
+				&job->data->pipeline_buf,
+				&job->data->pipeline_buf_size);
+	if (!buf) {
+		job->oom = 1;
+		return;
+	}
+
+	v4lconvert_pool_band(band, job->bands, job->fmt.fmt.pix.height,
+			&first_line, &lines);
+	last_line = first_line + lines;
+
+	for (y = first_line; y < last_line; y += lines) {
+		lines = MIN(V4LCONVERT_PIPELINE_BAND_LINES, last_line - y);
+		res = v4lconvert_convert_band_pixfmt(job, y, lines, buf,
+				band_size);
+		if (res) {
+			job->result = res;
+			return;
+		}
+		v4lconvert_pipeline_lines(job->pipeline, buf, y, lines);
+	}
+}
+
+static void v4lconvert_pipeline_band(void *arg, int thread, int band)
+{
+	struct v4lconvert_band_job *job = arg;
+	int y, lines;
+
+	/* Works in place, so it needs no scratch memory of the thread */
+	(void)thread;
+
+	v4lconvert_pool_band(band, job->bands, job->fmt.fmt.pix.height,
+			&y, &lines);
+	v4lconvert_pipeline_frame(job->pipeline, job->src, y, lines);
+}
+
+/* Run a pipeline over an entire frame, in parallel if we have a pool */
+static void v4lconvert_pipeline_run(struct v4lconvert_data *data,
+		struct v4lconvert_pipeline *pipeline, unsigned char *src,
+		const struct v4l2_format *fmt)
+{
+	struct v4lconvert_band_job job;
+
+	memset(&job, 0, sizeof(job));
+	job.fmt = *fmt;
+	job.src = src;
+	job.pipeline = pipeline;
+	job.bands = data->pool ?
+		v4lconvert_band_job_bands(data, fmt->fmt.pix.height) : 1;
+
+	v4lconvert_pool_run(data->pool, v4lconvert_pipeline_band, &job,
+			job.bands);
+}
+
+/* Have the pipeline apply the lookup tables of the processing, with the
+   statistics taken from buf in format fmt. Returns 1 if there are tables to
+   apply. */
+static int v4lconvert_pipeline_processing(struct v4lconvert_data *data,
+		struct v4lconvert_pipeline *pipeline, unsigned char *buf,
+		const struct v4l2_format *fmt, unsigned int dest_pix_fmt)
+{
+	const unsigned char *comp1, *green, *comp2;
+
+	if (!v4lprocessing_lookup_tables(data->processing, buf, fmt,
+				&comp1, &green, &comp2))
+		return 0;
+
+	/* For yuv the tables are for y, u and v, the pipeline applies them to
+	   the planes in memory order */
+	if (dest_pix_fmt == V4L2_PIX_FMT_YVU420)
+		v4lconvert_pipeline_set_lut(pipeline, comp1, comp2, green);
+	else
+		v4lconvert_pipeline_set_lut(pipeline, comp1, green, comp2);
+
+	return 1;
+}
+
+/* v4lprocessing_processing(), applying the lookup tables with the worker
+   pool if there is one */
+static void v4lconvert_processing(struct v4lconvert_data *data,
+		unsigned char *buf, const struct v4l2_format *fmt)
+{
+	struct v4lconvert_pipeline pipeline;
+	int bpp;
+
+	switch (fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+		bpp = 3;
+		break;
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+		bpp = 1;
+		break;
+	default:
+		bpp = 0;
+	}
+
+	if (!data->pool || !bpp ||
+			fmt->fmt.pix.bytesperline != fmt->fmt.pix.width * bpp) {
+		v4lprocessing_processing(data->processing, buf, fmt);
+		return;
+	}
+
+	/* A pipeline without flip and crop applies the lookup in place */
+	v4lconvert_pipeline_init(&pipeline, fmt, fmt, buf, 0, 0);
+	if (v4lconvert_pipeline_processing(data, &pipeline, buf, fmt,
+				fmt->fmt.pix.pixelformat))
+		v4lconvert_pipeline_run(data, &pipeline, buf, fmt);
+}
+
+/* convert_pixfmt -> processing -> flip -> crop in a single pass over dest,
+   without full frame intermediate buffers for flip and crop. Formats which
+   are converted line by line are also converted in bands, when no
+   processing (which needs statistics of the entire frame) is active.
+   Returns -2 if the pipeline cannot handle the combination. */
+static int v4lconvert_convert_pipeline(struct v4lconvert_data *data,
+		struct v4l2_format *src_fmt, const struct v4l2_format *dest_fmt,
+		unsigned char *src, int src_size, unsigned char *dest,
+		const struct v4lconvert_planes *planes,
+		int temp_needed, int processing, int hflip, int vflip)
+{
+	struct v4lconvert_pipeline pipeline;
+	struct v4lconvert_band_job job;
+	unsigned int width = src_fmt->fmt.pix.width;
+	unsigned int height = src_fmt->fmt.pix.height;
+	unsigned int bytesperline = src_fmt->fmt.pix.bytesperline;
+	unsigned char *buf;
+	int res;
+
+	if (v4lconvert_pipeline_init(&pipeline, src_fmt, dest_fmt, dest,
+				hflip, vflip))
+		return -2;
+
+	if (planes)
+		v4lconvert_pipeline_set_planes(&pipeline, planes->dest,
+				planes->bytesperline, planes->nv12);
+
+	switch (src_fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_YUYV:
+	case V4L2_PIX_FMT_YVYU:
+	case V4L2_PIX_FMT_UYVY:
+		if ((height & 1) || bytesperline < width * 2 ||
+				src_size < (int)(bytesperline * (height - 1) + width * 2))
+			break;
+
+		/* The statistics for the processing are taken from the source,
+		   while the lookup tables get applied to the converted bands */
+		if (processing) {
+			if (!pipeline.planar)
+				break;
+			v4lconvert_pipeline_processing(data, &pipeline, src,
+					src_fmt, dest_fmt->fmt.pix.pixelformat);
+		}
+
+		memset(&job, 0, sizeof(job));
+		job.data = data;
+		job.fmt = *src_fmt;
+		job.src = src;
+		job.src_size = src_size;
+		job.dest_pix_fmt = dest_fmt->fmt.pix.pixelformat;
+		job.pipeline = &pipeline;
+		job.bands = data->pool ? v4lconvert_band_job_bands(data, height) : 1;
+
+		v4lconvert_pool_run(data->pool, v4lconvert_pipeline_convert_band,
+				&job, job.bands);
+		if (job.oom)
+			return v4lconvert_oom_error(data);
+		return job.result;
+	case V4L2_PIX_FMT_MJPEG:
+	case V4L2_PIX_FMT_JPEG:
+	case V4L2_PIX_FMT_PJPG:
+		/* Feed the pipeline from tinyjpeg a row of MCUs at a time. With
+		   worker threads decoding into a full frame is better, as that
+		   can be done in parallel */
+		if (processing || data->pool)
+			break;
+		if (src_fmt->fmt.pix.pixelformat == V4L2_PIX_FMT_PJPG)
+			return v4lconvert_decode_jpeg_tinyjpeg_pipeline(data,
+					src, src_size, src_fmt,
+					dest_fmt->fmt.pix.pixelformat,
+					TINYJPEG_FLAGS_PIXART_JPEG, &pipeline);
+#ifdef HAVE_JPEG
+		if (!(data->flags & V4LCONVERT_USE_TINYJPEG))
+			break;
+#endif // HAVE_JPEG
+		return v4lconvert_decode_jpeg_tinyjpeg_pipeline(data, src,
+				src_size, src_fmt, dest_fmt->fmt.pix.pixelformat,
+				0, &pipeline);
+	}
+
+	buf = v4lconvert_alloc_buffer(temp_needed, &data->convert2_buf,
+			&data->convert2_buf_size);
+	if (!buf)
+		return v4lconvert_oom_error(data);
+
+	if (processing && !v4lconvert_processing_on_dest(
+				src_fmt->fmt.pix.pixelformat,
+				dest_fmt->fmt.pix.pixelformat))
+		v4lconvert_processing(data, src, src_fmt);
+
+	res = v4lconvert_convert_pixfmt_bands(data, src, src_size, buf,
+			temp_needed, src_fmt, dest_fmt->fmt.pix.pixelformat);
+	if (res)
+		return res;
+
+	/* Apply the lookup tables while flipping / cropping, rather then in a
+	   separate pass */
+	if (processing)
+		v4lconvert_pipeline_processing(data, &pipeline, buf, src_fmt,
+				dest_fmt->fmt.pix.pixelformat);
+
+	v4lconvert_pipeline_run(data, &pipeline, buf, src_fmt);
+
+	return 0;
+}
+
+/* Copy a converted frame into the destination planes */
+static void v4lconvert_copy_planes(struct v4lconvert_data *data,
+		unsigned char *src, const struct v4l2_format *fmt,
+		const struct v4lconvert_planes *planes)
+{
+	struct v4lconvert_pipeline pipeline;
+
+	v4lconvert_pipeline_init(&pipeline, fmt, fmt, NULL, 0, 0);
+	v4lconvert_pipeline_set_planes(&pipeline, planes->dest,
+			planes->bytesperline, planes->nv12);
+	v4lconvert_pipeline_run(data, &pipeline, src, fmt);
+}
+
+/* The factor by which to scale jpegs down while decoding them, which is much
+   cheaper than decoding the full frame and then reducing it, scaling is set
+   when the frame gets scaled to the dest size rather than cropped */
+static int v4lconvert_jpeg_scale(const struct v4l2_format *src_fmt,
+		const struct v4l2_format *dest_fmt, int scaling)
+{
+	unsigned int width = src_fmt->fmt.pix.width;
+	unsigned int height = src_fmt->fmt.pix.height;
+	int scale, yuv420 = 0;
+
+	switch (src_fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_MJPEG:
+	case V4L2_PIX_FMT_JPEG:
+	case V4L2_PIX_FMT_PJPG:
+		break;
+	default:
+		return 1;
+	}
+
+	switch (dest_fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_NV12:
+		yuv420 = 1;
+		break;
+	}
+
+	/* Decode straight to the dest size if possible. At 1/8 each block
+	   gives a single pixel, which is not enough for yuv420 chroma with
+	   all samplings */
+	for (scale = yuv420 ? 4 : 8; scale > 1; scale /= 2)
+		if (width == scale * dest_fmt->fmt.pix.width &&
+				height == scale * dest_fmt->fmt.pix.height &&
+				width % (2 * scale) == 0 &&
+				height % (2 * scale) == 0)
+			return scale;
+
+	/* Otherwise decode at the smallest size which is still larger than
+	   the dest when scaling, or halve the size when v4lconvert_crop()
+	   would reduce the frame, so that what gets cropped from the result
+	   stays the same */
+	for (scale = scaling ? (yuv420 ? 4 : 8) : 2; scale > 1; scale /= 2)
+		if (width >= scale * dest_fmt->fmt.pix.width &&
+				height >= scale * dest_fmt->fmt.pix.height &&
+				width % (2 * scale) == 0 &&
+				height % (2 * scale) == 0)
+			return scale;
+
+	return 1;
+}
+
+/* When planes is not NULL dest and dest_size are ignored, and the result is
+   written to the planes instead */
+static int v4lconvert_convert_to(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt, const struct v4l2_format *dest_fmt,
+		unsigned char *src, int src_size, unsigned char *dest, int dest_size,
+		const struct v4lconvert_planes *planes)
 {
 	int res, dest_needed, temp_needed, processing, convert = 0;
-	int rotate90, vflip, hflip, crop;
+	int rotate, orient, swap, crop, scale;
 	unsigned char *convert1_dest = dest;
 	int convert1_dest_size = dest_size;
 	unsigned char *convert2_src = src, *convert2_dest = dest;
 	int convert2_dest_size = dest_size;
-	unsigned char *rotate90_src = src, *rotate90_dest = dest;
-	unsigned char *flip_src = src, *flip_dest = dest;
+	unsigned char *rotate_src = src, *rotate_dest = dest;
 	unsigned char *crop_src = src;
 	struct v4l2_format my_src_fmt = *src_fmt;
 	struct v4l2_format my_dest_fmt = *dest_fmt;
+	struct v4l2_format rotated_fmt = *src_fmt;
+	struct v4lconvert_planes nv12_planes;
+	unsigned char *nv12_dest[2];
+	unsigned int nv12_bytesperline[2];
 
 	processing = v4lprocessing_pre_processing(data->processing);
-	rotate90 = data->control_flags & V4LCONTROL_ROTATED_90_JPEG;
-	hflip = v4lcontrol_get_ctrl(data->control, V4LCONTROL_HFLIP);
-	vflip = v4lcontrol_get_ctrl(data->control, V4LCONTROL_VFLIP);
-	crop = my_dest_fmt.fmt.pix.width != my_src_fmt.fmt.pix.width ||
-		my_dest_fmt.fmt.pix.height != my_src_fmt.fmt.pix.height;
-
-	if (/* If no conversion/processing is needed */
+	rotate = v4lcontrol_get_ctrl(data->control, V4LCONTROL_ROTATE);
+	/* Rotating by 90 or 270 degrees swaps the width and height */
+	swap = v4lconvert_orientation(rotate, 0, 0) & V4LCONVERT_ORIENT_TRANSPOSE;
+	if (swap) {
+		rotated_fmt.fmt.pix.width = src_fmt->fmt.pix.height;
+		rotated_fmt.fmt.pix.height = src_fmt->fmt.pix.width;
+	}
+	crop = my_dest_fmt.fmt.pix.width != rotated_fmt.fmt.pix.width ||
+		my_dest_fmt.fmt.pix.height != rotated_fmt.fmt.pix.height;
+	/* When cropping can not give the dest size, scale to it instead */
+	scale = crop && v4lconvert_crop_scales(&rotated_fmt, &my_dest_fmt);
+	/* Turning the sideways jpegs of some cams upright is done together
+	   with the rotating and flipping asked for by the app */
+	orient = v4lconvert_orientation(
+			(data->control_flags & V4LCONTROL_ROTATED_90_JPEG) ?
+				(rotate + 90) % 360 : rotate,
+			v4lcontrol_get_ctrl(data->control, V4LCONTROL_HFLIP),
+			v4lcontrol_get_ctrl(data->control, V4LCONTROL_VFLIP));
+
+	if (!planes && (/* If no conversion/processing is needed */
 			(src_fmt->fmt.pix.pixelformat == dest_fmt->fmt.pix.pixelformat &&
-			 !processing && !rotate90 && !hflip && !vflip && !crop) ||
+			 !processing && !orient && !crop) ||
 			/* or if we should do processing/rotating/flipping but the app tries to
 			   use the native cam format, we just return an unprocessed frame copy */
-			!v4lconvert_supported_dst_format(dest_fmt->fmt.pix.pixelformat)) {
+			!v4lconvert_supported_dst_format(dest_fmt->fmt.pix.pixelformat))) {
 		int to_copy = MIN(dest_size, src_size);
 		memcpy(dest, src, to_copy);
 		return to_copy;
 	}
 
+	/* nv12 gets converted to directly, but flipping, rotating, cropping
+	   and scaling work on yuv420. So for those write to the nv12 frame as
+	   planes, which interleaves u and v on the way into dest */
+	if (!planes && my_dest_fmt.fmt.pix.pixelformat == V4L2_PIX_FMT_NV12 &&
+			(orient || crop)) {
+		unsigned int width = my_dest_fmt.fmt.pix.width;
+		unsigned int height = my_dest_fmt.fmt.pix.height;
+
+		if (dest_size < (int)(width * height * 3 / 2)) {
+			V4LCONVERT_ERR("destination buffer too small (%d < %d)\n",
+					dest_size, width * height * 3 / 2);
+			errno = EFAULT;
+			return -1;
+		}
+		nv12_dest[0] = dest;
+		nv12_dest[1] = dest + width * height;
+		nv12_bytesperline[0] = nv12_bytesperline[1] = width;
+		nv12_planes.dest = nv12_dest;
+		nv12_planes.bytesperline = nv12_bytesperline;
+		nv12_planes.nv12 = 1;
+		planes = &nv12_planes;
+		my_dest_fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUV420;
+	}
+
+	/* Decode jpegs at a reduced size when the dest is smaller, from here
+	   on my_src_fmt has the size of the decoded frame */
+	data->jpeg_scale = 1;
+	if (crop && !swap &&
+			!(data->control_flags & V4LCONTROL_ROTATED_90_JPEG))
+		data->jpeg_scale = v4lconvert_jpeg_scale(&my_src_fmt,
+				&my_dest_fmt, scale);
+	if (data->jpeg_scale > 1) {
+		my_src_fmt.fmt.pix.width /= data->jpeg_scale;
+		my_src_fmt.fmt.pix.height /= data->jpeg_scale;
+		crop = my_dest_fmt.fmt.pix.width != my_src_fmt.fmt.pix.width ||
+			my_dest_fmt.fmt.pix.height != my_src_fmt.fmt.pix.height;
+		scale = scale && crop;
+	}
+
 	/* sanity check, is the dest buffer large enough? */
 	switch (my_dest_fmt.fmt.pix.pixelformat) {
 	case V4L2_PIX_FMT_RGB24:
@@ -1352,6 +2178,7 @@ int v4lconvert_convert(struct v4lconvert_data *data,
 		break;
 	case V4L2_PIX_FMT_YUV420:
 	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_NV12:
 		dest_needed =
 			my_dest_fmt.fmt.pix.width * my_dest_fmt.fmt.pix.height * 3 / 2;
 		temp_needed =
@@ -1363,31 +2190,54 @@ int v4lconvert_convert(struct v4lconvert_data *data,
 		return -1;
 	}
 
-	if (dest_size < dest_needed) {
+	if (!planes && dest_size < dest_needed) {
 		V4LCONVERT_ERR("destination buffer too small (%d < %d)\n",
 				dest_size, dest_needed);
 		errno = EFAULT;
 		return -1;
 	}
 
-
 	/* Sometimes we need foo -> rgb -> bar as video processing (whitebalance,
-	   etc.) can only be done on rgb data */
-	if (processing && v4lconvert_processing_needs_double_conversion(
-				my_src_fmt.fmt.pix.pixelformat,
-				my_dest_fmt.fmt.pix.pixelformat))
+	   etc.) can only be done on rgb, bayer or yuv to yuv data */
+	if (processing && v4lconvert_processing_needs_double_conversion(data,
+				&my_src_fmt, my_dest_fmt.fmt.pix.pixelformat))
 		convert = 2;
 	else if (my_dest_fmt.fmt.pix.pixelformat !=
 			my_src_fmt.fmt.pix.pixelformat ||
 		 /* Special case if we do not need to do conversion, but we
 		    are not doing any other step involving copying either,
 		    force going through convert_pixfmt to copy the data from
-		    source to dest */
-		 (!rotate90 && !hflip && !vflip && !crop))
+		    source to dest, the pipeline needs unpadded source lines
+		    for writing to planes so do the same for that */
+		 (!orient && !crop) || planes)
 		convert = 1;
 
+	/* Try to do the common cases in a single pass first */
+	if (convert == 1 && !(orient & V4LCONVERT_ORIENT_TRANSPOSE) &&
+			!scale && (orient || crop || planes)) {
+		res = v4lconvert_convert_pipeline(data, &my_src_fmt, &my_dest_fmt,
+				src, src_size, dest, planes, temp_needed, processing,
+				orient & V4LCONVERT_ORIENT_HFLIP,
+				orient & V4LCONVERT_ORIENT_VFLIP);
+		if (res != -2)
+			return res ? res : dest_needed;
+	}
+
+	/* Otherwise convert into a contiguous frame first and copy that into
+	   the planes at the end */
+	if (planes) {
+		dest = v4lconvert_alloc_buffer(dest_needed, &data->planes_buf,
+				&data->planes_buf_size);
+		if (!dest)
+			return v4lconvert_oom_error(data);
+
+		dest_size = dest_needed;
+		convert1_dest = convert2_dest = rotate_dest = dest;
+		convert1_dest_size = convert2_dest_size = dest_size;
+	}
+
 	/* convert_pixfmt (only if convert == 2) -> processing -> convert_pixfmt ->
-	   rotate -> flip -> crop, all steps are optional */
+	   rotate / flip -> crop / scale, all steps are optional */
 	if (convert == 2) {
 		convert1_dest = v4lconvert_alloc_buffer(
 				my_src_fmt.fmt.pix.width * my_src_fmt.fmt.pix.height * 3,
@@ -1400,38 +2250,29 @@ int v4lconvert_convert(struct v4lconvert_data *data,
 		convert2_src = convert1_dest;
 	}
 
-	if (convert && (rotate90 || hflip || vflip || crop)) {
+	if (convert && (orient || crop)) {
 		convert2_dest = v4lconvert_alloc_buffer(temp_needed,
 				&data->convert2_buf, &data->convert2_buf_size);
 		if (!convert2_dest)
 			return v4lconvert_oom_error(data);
 
 		convert2_dest_size = temp_needed;
-		rotate90_src = flip_src = crop_src = convert2_dest;
-	}
-
-	if (rotate90 && (hflip || vflip || crop)) {
-		rotate90_dest = v4lconvert_alloc_buffer(temp_needed,
-				&data->rotate90_buf, &data->rotate90_buf_size);
-		if (!rotate90_dest)
-			return v4lconvert_oom_error(data);
-
-		flip_src = crop_src = rotate90_dest;
+		rotate_src = crop_src = convert2_dest;
 	}
 
-	if ((vflip || hflip) && crop) {
-		flip_dest = v4lconvert_alloc_buffer(temp_needed, &data->flip_buf,
-				&data->flip_buf_size);
-		if (!flip_dest)
+	if (orient && crop) {
+		rotate_dest = v4lconvert_alloc_buffer(temp_needed,
+				&data->rotate_buf, &data->rotate_buf_size);
+		if (!rotate_dest)
 			return v4lconvert_oom_error(data);
 
-		crop_src = flip_dest;
+		crop_src = rotate_dest;
 	}
 
 	/* Done setting sources / dest and allocating intermediate buffers,
 	   real conversion / processing / ... starts here. */
 	if (convert == 2) {
-		res = v4lconvert_convert_pixfmt(data, src, src_size,
+		res = v4lconvert_convert_pixfmt_bands(data, src, src_size,
 				convert1_dest, convert1_dest_size,
 				&my_src_fmt,
 				V4L2_PIX_FMT_RGB24);
@@ -1441,11 +2282,13 @@ int v4lconvert_convert(struct v4lconvert_data *data,
 		src_size = my_src_fmt.fmt.pix.sizeimage;
 	}
 
-	if (processing)
-		v4lprocessing_processing(data->processing, convert2_src, &my_src_fmt);
+	if (processing && !v4lconvert_processing_on_dest(
+				my_src_fmt.fmt.pix.pixelformat,
+				my_dest_fmt.fmt.pix.pixelformat))
+		v4lconvert_processing(data, convert2_src, &my_src_fmt);
 
 	if (convert) {
-		res = v4lconvert_convert_pixfmt(data, convert2_src, src_size,
+		res = v4lconvert_convert_pixfmt_bands(data, convert2_src, src_size,
 				convert2_dest, convert2_dest_size,
 				&my_src_fmt,
 				my_dest_fmt.fmt.pix.pixelformat);
@@ -1455,24 +2298,103 @@ int v4lconvert_convert(struct v4lconvert_data *data,
 		src_size = my_src_fmt.fmt.pix.sizeimage;
 
 		/* We call processing here again in case the source format was not
-		   rgb, but the dest is. v4lprocessing checks it self it only actually
-		   does the processing once per frame. */
+		   supported or processed, but the dest is. v4lprocessing checks it
+		   self it only actually does the processing once per frame. */
 		if (processing)
-			v4lprocessing_processing(data->processing, convert2_dest, &my_src_fmt);
+			v4lconvert_processing(data, convert2_dest, &my_src_fmt);
 	}
 
-	if (rotate90)
-		v4lconvert_rotate90(rotate90_src, rotate90_dest, &my_src_fmt);
+	if (orient)
+		v4lconvert_rotate(rotate_src, rotate_dest, &my_src_fmt, orient);
 
-	if (hflip || vflip)
-		v4lconvert_flip(flip_src, flip_dest, &my_src_fmt, hflip, vflip);
-
-	if (crop)
+	if (scale) {
+		res = v4lconvert_scale(data, crop_src, dest, &my_src_fmt,
+				&my_dest_fmt);
+		if (res)
+			return res;
+	} else if (crop)
 		v4lconvert_crop(crop_src, dest, &my_src_fmt, &my_dest_fmt);
 
+	if (planes)
+		v4lconvert_copy_planes(data, dest, &my_dest_fmt, planes);
+
 	return dest_needed;
 }
 
+int v4lconvert_convert(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt,  /* in */
+		const struct v4l2_format *dest_fmt, /* in */
+		unsigned char *src, int src_size, unsigned char *dest, int dest_size)
+{
+	return v4lconvert_convert_to(data, src_fmt, dest_fmt, src, src_size,
+			dest, dest_size, NULL);
+}
+
+/* See libv4lconvert-planes.h for description of in / out parameters */
+int v4lconvert_convert_planes(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt,  /* in */
+		const struct v4l2_format *dest_fmt, /* in */
+		unsigned char *src, int src_size,
+		unsigned char *dest[], const unsigned int bytesperline[])
+{
+	struct v4l2_format my_dest_fmt = *dest_fmt;
+	struct v4lconvert_planes planes;
+	unsigned int width = dest_fmt->fmt.pix.width;
+	unsigned int height = dest_fmt->fmt.pix.height;
+	unsigned int min_bytesperline[3];
+	int i, no_planes;
+
+	planes.dest = dest;
+	planes.bytesperline = bytesperline;
+	planes.nv12 = 0;
+
+	switch (dest_fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+		no_planes = 1;
+		min_bytesperline[0] = width * 3;
+		break;
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+		no_planes = 3;
+		min_bytesperline[0] = width;
+		min_bytesperline[1] = min_bytesperline[2] = width / 2;
+		break;
+	case V4L2_PIX_FMT_NV12:
+		/* Converted as yuv420, the pipeline interleaves u and v */
+		no_planes = 2;
+		min_bytesperline[0] = min_bytesperline[1] = width;
+		my_dest_fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUV420;
+		planes.nv12 = 1;
+		break;
+	default:
+		V4LCONVERT_ERR("Unsupported dest format for planes conversion\n");
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (no_planes > 1 && ((width | height) & 1)) {
+		V4LCONVERT_ERR("odd dest size %ux%u for planar format\n",
+				width, height);
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (i = 0; i < no_planes; i++) {
+		if (!dest[i] || bytesperline[i] < min_bytesperline[i]) {
+			V4LCONVERT_ERR("invalid dest plane %d\n", i);
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	/* Any intermediate frame is unpadded, padding only exists in the planes */
+	v4lconvert_fixup_fmt(&my_dest_fmt);
+
+	return v4lconvert_convert_to(data, src_fmt, &my_dest_fmt, src, src_size,
+			NULL, 0, &planes);
+}
+
 const char *v4lconvert_get_error_message(struct v4lconvert_data *data)
 {
 	return data->error_msg;
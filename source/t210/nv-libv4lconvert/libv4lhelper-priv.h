@@ -0,0 +1,95 @@
+/* Shared memory transport between libv4lconvert and decompression helpers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef __LIBV4LHELPER_PRIV_H
+#define __LIBV4LHELPER_PRIV_H
+
+/* Sent in the flags field of a small probe frame to ask the helper to
+   switch to the shared memory transport, the second int of the frame data
+   holds the memfd. Helpers which know about the shared memory transport
+   answer with this value. Older helpers take the probe for a normal (yvu)
+   frame of PROBE_WIDTH x PROBE_HEIGHT, which they decompress or reject
+   without complaining, answering with -1 or a frame which libv4lconvert
+   throws away, and stay on the pipe protocol. */
+#define V4LCONVERT_HELPER_SHM_MAGIC	(-0x56344c48)
+
+#define V4LCONVERT_HELPER_SHM_PROBE_WIDTH	16
+#define V4LCONVERT_HELPER_SHM_PROBE_HEIGHT	16
+/* One non zero and one zero 32 byte block, so that the ov511 helper, which
+   strips 11 bytes of trailer and all zero blocks, still has its header */
+#define V4LCONVERT_HELPER_SHM_PROBE_SIZE	64
+
+#define V4LCONVERT_HELPER_SHM_SLOTS	2
+#define V4LCONVERT_HELPER_SHM_ALIGN	64
+
+struct v4lconvert_helper_shm_slot {
+	int width;
+	int height;
+	int flags;
+	int src_size;
+	int dest_size; /* Set by the helper, -1 in case of a decompression error */
+};
+
+/* Lives at the start of the memfd, followed by the slots data, each slot
+   holding src_max bytes of compressed data and then dest_max bytes of
+   decompressed data.
+
+   libv4lconvert fills slot[head % SLOTS], increments head and signals
+   kick_fd, the helper decompresses all slots from tail up to head straight
+   into their dest area, incrementing tail and signalling done_fd for each.
+   The mapping only grows while no frames are in flight, the helper re-maps
+   when it sees size change. head and tail are stored with release and
+   loaded with acquire semantics, so that whichever side sees the new count
+   also sees the slot it publishes, without relying on the eventfd syscalls
+   for the ordering. */
+struct v4lconvert_helper_shm {
+	int magic;
+	unsigned int size;
+	unsigned int src_max;
+	unsigned int dest_max;
+	int kick_fd; /* eventfds, inherited by the helper under the same number */
+	int done_fd;
+	unsigned int head;
+	unsigned int tail;
+	struct v4lconvert_helper_shm_slot slot[V4LCONVERT_HELPER_SHM_SLOTS];
+};
+
+#define V4LCONVERT_HELPER_SHM_HDR_SIZE \
+	((sizeof(struct v4lconvert_helper_shm) + V4LCONVERT_HELPER_SHM_ALIGN - 1) & \
+	 ~(V4LCONVERT_HELPER_SHM_ALIGN - 1))
+
+static inline unsigned char *v4lconvert_helper_shm_src(
+		struct v4lconvert_helper_shm *shm, unsigned int i)
+{
+	return (unsigned char *)shm + V4LCONVERT_HELPER_SHM_HDR_SIZE +
+		(i % V4LCONVERT_HELPER_SHM_SLOTS) * (shm->src_max + shm->dest_max);
+}
+
+static inline unsigned char *v4lconvert_helper_shm_dest(
+		struct v4lconvert_helper_shm *shm, unsigned int i)
+{
+	return v4lconvert_helper_shm_src(shm, i) + shm->src_max;
+}
+
+#endif
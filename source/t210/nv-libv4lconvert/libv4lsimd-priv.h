@@ -0,0 +1,149 @@
+/*
+# SIMD helpers shared by the vectorized conversion kernels
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License, version 2.1,
+# as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+ */
+
+#ifndef __LIBV4LSIMD_PRIV_H
+#define __LIBV4LSIMD_PRIV_H
+
+#include <string.h>
+#include <stdint.h>
+
+/* Used for the per format / per layout variants of a kernel loop, so that
+   the compiler can resolve all layout checks at compile time */
+#define V4LCONVERT_ALWAYS_INLINE inline __attribute__((always_inline))
+
+/* The kernels are always built, and only get used when v4lconvert_cpu_init()
+   has found the matching instruction set at runtime. On x86 we use function
+   level target attributes so that no special compiler flags are needed. */
+
+#if defined(__aarch64__) || defined(__ARM_NEON)
+#define V4LCONVERT_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define V4LCONVERT_HAVE_X86_SIMD 1
+#include <immintrin.h>
+
+#define V4LCONVERT_SSE2 __attribute__((target("sse2")))
+#define V4LCONVERT_AVX2 __attribute__((target("avx2")))
+
+/* (a + b) >> 1 per byte, _mm_avg_epu8 rounds up so compensate for that */
+static inline V4LCONVERT_SSE2 __m128i v4lconvert_avg_floor_epu8(__m128i a,
+		__m128i b)
+{
+	return _mm_sub_epi8(_mm_avg_epu8(a, b),
+			_mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+}
+
+static inline V4LCONVERT_AVX2 __m256i v4lconvert_avg_floor_epu8_avx2(__m256i a,
+		__m256i b)
+{
+	return _mm256_sub_epi8(_mm256_avg_epu8(a, b),
+			_mm256_and_si256(_mm256_xor_si256(a, b), _mm256_set1_epi8(1)));
+}
+
+/* Interleave 16 pixels worth of 3 planar components into 48 bytes of
+   packed 24 bpp data. SSE2 has no byte shuffle, so we build 32 bit pixels
+   and store them overlapping, writing the last pixel byte by byte so that
+   we never touch memory past the 48 bytes. */
+static inline V4LCONVERT_SSE2 void v4lconvert_store_rgb24_sse2(
+		unsigned char *dest, __m128i c0, __m128i c1, __m128i c2)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i c01lo = _mm_unpacklo_epi8(c0, c1);
+	__m128i c01hi = _mm_unpackhi_epi8(c0, c1);
+	__m128i c2lo = _mm_unpacklo_epi8(c2, zero);
+	__m128i c2hi = _mm_unpackhi_epi8(c2, zero);
+	__m128i px[4];
+	uint32_t p;
+	int i, j;
+
+	px[0] = _mm_unpacklo_epi16(c01lo, c2lo);
+	px[1] = _mm_unpackhi_epi16(c01lo, c2lo);
+	px[2] = _mm_unpacklo_epi16(c01hi, c2hi);
+	px[3] = _mm_unpackhi_epi16(c01hi, c2hi);
+
+	for (i = 0; i < 4; i++) {
+		for (j = 0; j < 4; j++) {
+			p = _mm_cvtsi128_si32(px[i]);
+			px[i] = _mm_srli_si128(px[i], 4);
+			if (i == 3 && j == 3) {
+				dest[0] = p;
+				dest[1] = p >> 8;
+				dest[2] = p >> 16;
+			} else
+				memcpy(dest, &p, 4);
+			dest += 3;
+		}
+	}
+}
+
+#define V4LCONVERT_RGB24_SHUF(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p) \
+	_mm256_setr_epi8(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p, \
+			 a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p)
+
+/* Interleave 32 pixels worth of 3 planar components into 96 bytes of packed
+   24 bpp data, pixels 0-15 must be in the low lane, 16-31 in the high lane */
+static inline V4LCONVERT_AVX2 void v4lconvert_store_rgb24_avx2(
+		unsigned char *dest, __m256i c0, __m256i c1, __m256i c2)
+{
+	const __m256i m00 = V4LCONVERT_RGB24_SHUF(0, -1, -1, 1, -1, -1, 2, -1,
+			-1, 3, -1, -1, 4, -1, -1, 5);
+	const __m256i m01 = V4LCONVERT_RGB24_SHUF(-1, 0, -1, -1, 1, -1, -1, 2,
+			-1, -1, 3, -1, -1, 4, -1, -1);
+	const __m256i m02 = V4LCONVERT_RGB24_SHUF(-1, -1, 0, -1, -1, 1, -1, -1,
+			2, -1, -1, 3, -1, -1, 4, -1);
+	const __m256i m10 = V4LCONVERT_RGB24_SHUF(-1, -1, 6, -1, -1, 7, -1, -1,
+			8, -1, -1, 9, -1, -1, 10, -1);
+	const __m256i m11 = V4LCONVERT_RGB24_SHUF(5, -1, -1, 6, -1, -1, 7, -1,
+			-1, 8, -1, -1, 9, -1, -1, 10);
+	const __m256i m12 = V4LCONVERT_RGB24_SHUF(-1, 5, -1, -1, 6, -1, -1, 7,
+			-1, -1, 8, -1, -1, 9, -1, -1);
+	const __m256i m20 = V4LCONVERT_RGB24_SHUF(-1, 11, -1, -1, 12, -1, -1, 13,
+			-1, -1, 14, -1, -1, 15, -1, -1);
+	const __m256i m21 = V4LCONVERT_RGB24_SHUF(-1, -1, 11, -1, -1, 12, -1, -1,
+			13, -1, -1, 14, -1, -1, 15, -1);
+	const __m256i m22 = V4LCONVERT_RGB24_SHUF(10, -1, -1, 11, -1, -1, 12, -1,
+			-1, 13, -1, -1, 14, -1, -1, 15);
+	__m256i o0, o1, o2;
+
+	o0 = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(c0, m00),
+			_mm256_shuffle_epi8(c1, m01)), _mm256_shuffle_epi8(c2, m02));
+	o1 = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(c0, m10),
+			_mm256_shuffle_epi8(c1, m11)), _mm256_shuffle_epi8(c2, m12));
+	o2 = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(c0, m20),
+			_mm256_shuffle_epi8(c1, m21)), _mm256_shuffle_epi8(c2, m22));
+
+	_mm_storeu_si128((__m128i *)dest, _mm256_castsi256_si128(o0));
+	_mm_storeu_si128((__m128i *)(dest + 16), _mm256_castsi256_si128(o1));
+	_mm_storeu_si128((__m128i *)(dest + 32), _mm256_castsi256_si128(o2));
+	_mm_storeu_si128((__m128i *)(dest + 48), _mm256_extracti128_si256(o0, 1));
+	_mm_storeu_si128((__m128i *)(dest + 64), _mm256_extracti128_si256(o1, 1));
+	_mm_storeu_si128((__m128i *)(dest + 80), _mm256_extracti128_si256(o2, 1));
+}
+
+/* packus_epi16 on 256 bit vectors packs per 128 bit lane, this puts the
+   result back in source order */
+static inline V4LCONVERT_AVX2 __m256i v4lconvert_packus_epi16_avx2(__m256i a,
+		__m256i b)
+{
+	return _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b),
+			_MM_SHUFFLE(3, 1, 2, 0));
+}
+#endif
+
+#endif
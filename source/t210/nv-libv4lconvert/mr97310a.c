@@ -19,29 +19,26 @@
  */
 
 #include <unistd.h>
+#include <pthread.h>
 #include "libv4lconvert-priv.h"
 #include "libv4lsyscall-priv.h"
+#include "libv4lbits-priv.h"
 
 #define CLIP(x) ((x) < 0 ? 0 : ((x) > 0xff) ? 0xff : (x))
 
 #define MIN_CLOCKDIV_CID V4L2_CID_PRIVATE_BASE
 
-/* FIXME not threadsafe */
-static int decoder_initialized;
-
-static struct {
-	unsigned char is_abs;
-	unsigned char len;
-	signed char val;
-} table[256];
+static struct v4lconvert_vlc table[256];
+static struct v4lconvert_vlc_multi multi_table[1 << V4LCONVERT_VLC_MULTI_BITS];
+static pthread_once_t decoder_once = PTHREAD_ONCE_INIT;
 
 static void init_mr97310a_decoder(void)
 {
 	int i;
-	int is_abs, val, len;
+	int escape, val, len;
 
 	for (i = 0; i < 256; ++i) {
-		is_abs = 0;
+		escape = 0;
 		val = 0;
 		len = 0;
 		if ((i & 0x80) == 0) {
@@ -74,44 +71,66 @@ static void init_mr97310a_decoder(void)
 			len = 5;
 		} else if ((i & 0xf8) == 0xe8) {
 			/* code 11101xxxxx */
-			is_abs = 1;
+			escape = 1;
 			val = 0;  /* value is calculated later */
 			len = 5;
 		}
-		table[i].is_abs = is_abs;
+		table[i].escape = escape;
 		table[i].val = val;
 		table[i].len = len;
 	}
-	decoder_initialized = 1;
+	v4lconvert_vlc_multi_init(multi_table, table);
 }
 
-static inline unsigned char get_byte(const unsigned char *inp,
-		unsigned int bitpos)
+/* value the codes are relative to */
+static inline int mr97310a_predict(const unsigned char *outp, int row,
+		int col, int width)
 {
-	const unsigned char *addr;
+	unsigned char lp, tp, tlp, trp;
 
-	addr = inp + (bitpos >> 3);
-	return (addr[0] << (bitpos & 7)) | (addr[1] >> (8 - (bitpos & 7)));
+	lp = outp[-2];
+	if (row < 2) {
+		/* top row: relative to left pixel */
+		return lp;
+	}
+
+	tlp = outp[-2 * width - 2];
+	tp  = outp[-2 * width];
+	trp = outp[-2 * width + 2];
+	if (col < 2) {
+		/* left column: relative to top pixel */
+		/* initial estimate */
+		return (tp + trp) / 2;
+	} else if (col > width - 3) {
+		/* left column: relative to top pixel */
+		return (tp + lp + tlp + 1) / 3;
+	}
+	/* main area: weighted average of tlp, trp, lp, and tp */
+	tlp >>= 1;
+	trp >>= 1;
+	/* initial estimate for predictor */
+	return (lp + tp + tlp + trp + 1) / 3;
 }
 
 int v4lconvert_decode_mr97310a(struct v4lconvert_data *data,
 		const unsigned char *inp, int src_size,
 		unsigned char *outp, int width, int height)
 {
-	int row, col;
+	struct v4lconvert_bits bits;
+	const struct v4lconvert_vlc_multi *multi;
+	int row, col, i, n;
 	int val;
 	int bitpos;
-	unsigned char code;
-	unsigned char lp, tp, tlp, trp;
+	unsigned int code;
 	struct v4l2_control min_clockdiv = { .id = MIN_CLOCKDIV_CID };
 
-	if (!decoder_initialized)
-		init_mr97310a_decoder();
+	pthread_once(&decoder_once, init_mr97310a_decoder);
 
 	/* remove the header */
 	inp += 12;
 
-	bitpos = 0;
+	v4lconvert_bits_init(&bits, inp,
+			inp + (src_size > 12 ? src_size - 12 : 0));
 
 	/* main decoding loop */
 	for (row = 0; row < height; ++row) {
@@ -119,63 +138,41 @@ int v4lconvert_decode_mr97310a(struct v4lconvert_data *data,
 
 		/* first two pixels in first two rows are stored as raw 8-bit */
 		if (row < 2) {
-			code = get_byte(inp, bitpos);
-			bitpos += 8;
-			*outp++ = code;
-
-			code = get_byte(inp, bitpos);
-			bitpos += 8;
-			*outp++ = code;
-
+			v4lconvert_bits_refill(&bits);
+			*outp++ = v4lconvert_bits_get(&bits, 8);
+			*outp++ = v4lconvert_bits_get(&bits, 8);
 			col += 2;
 		}
 
 		while (col < width) {
-			/* get bitcode */
-			code = get_byte(inp, bitpos);
-			/* update bit position */
-			bitpos += table[code].len;
-
-			/* calculate pixel value */
-			if (table[code].is_abs) {
-				/* get 5 more bits and use them as absolute value */
-				code = get_byte(inp, bitpos);
-				val = (code & 0xf8);
-				bitpos += 5;
-
-			} else {
-				/* value is relative to top or left pixel */
-				val = table[code].val;
-				lp = outp[-2];
-				if (row > 1) {
-					tlp = outp[-2 * width - 2];
-					tp  = outp[-2 * width];
-					trp = outp[-2 * width + 2];
-				}
-				if (row < 2) {
-					/* top row: relative to left pixel */
-					val += lp;
-				} else if (col < 2) {
-					/* left column: relative to top pixel */
-					/* initial estimate */
-					val += (tp + trp) / 2;
-				} else if (col > width - 3) {
-					/* left column: relative to top pixel */
-					val += (tp + lp + tlp + 1) / 3;
-					/* main area: weighted average of tlp, trp,
-					 * lp, and tp */
-				} else {
-					tlp >>= 1;
-					trp >>= 1;
-					/* initial estimate for predictor */
-					val += (lp + tp + tlp + trp + 1) / 3;
+			v4lconvert_bits_refill(&bits);
+
+			/* value is relative to top or left pixel, decode as
+			   many codes as we can in one go */
+			multi = &multi_table[v4lconvert_bits_peek(&bits,
+					V4LCONVERT_VLC_MULTI_BITS)];
+			if (multi->n) {
+				n = multi->n;
+				if (n > width - col)
+					n = width - col;
+				for (i = 0; i < n; i++, col++) {
+					val = multi->val[i] +
+					      mr97310a_predict(outp, row, col,
+							       width);
+					*outp++ = CLIP(val);
 				}
+				v4lconvert_bits_skip(&bits, multi->end[n - 1]);
+				continue;
 			}
-			/* store pixel */
-			*outp++ = CLIP(val);
+
+			/* get 5 more bits and use them as absolute value */
+			code = v4lconvert_bits_peek(&bits, 8);
+			v4lconvert_bits_skip(&bits, table[code].len);
+			*outp++ = v4lconvert_bits_get(&bits, 5) << 3;
 			++col;
 		}
 
+		bitpos = v4lconvert_bits_pos(&bits);
 		/* src_size - 12 because of 12 byte footer */
 		if (((bitpos - 1) / 8) >= (src_size - 12)) {
 			data->frames_dropped++;
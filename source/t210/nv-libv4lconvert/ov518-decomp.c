@@ -1427,54 +1427,39 @@ static int v4lconvert_ov518_to_yuv420(unsigned char *src, unsigned char *dst,
 
 int main(int argc, char *argv[])
 {
-	int width, height, yvu, src_size, dest_size;
+	int width, height, yvu, src_size, dest_size, dest_max, r;
+	unsigned char *src, *dest;
 	unsigned char src_buf[200000];
 	unsigned char dest_buf[500000];
+	struct v4lconvert_helper helper = {
+		.progname = argv[0],
+		.src_buf = src_buf,
+		.src_buf_size = sizeof(src_buf),
+		.dest_buf = dest_buf,
+		.dest_buf_size = sizeof(dest_buf),
+	};
 
 	while (1) {
-		if (v4lconvert_helper_read(STDIN_FILENO, &width, sizeof(int), argv[0]))
-			return 1; /* Erm, no way to recover without loosing sync with libv4l */
-
-		if (v4lconvert_helper_read(STDIN_FILENO, &height, sizeof(int), argv[0]))
-			return 1; /* Erm, no way to recover without loosing sync with libv4l */
-
-		if (v4lconvert_helper_read(STDIN_FILENO, &yvu, sizeof(int), argv[0]))
-			return 1; /* Erm, no way to recover without loosing sync with libv4l */
-
-		if (v4lconvert_helper_read(STDIN_FILENO, &src_size, sizeof(int), argv[0]))
-			return 1; /* Erm, no way to recover without loosing sync with libv4l */
-
-		if (src_size > sizeof(src_buf)) {
-			fprintf(stderr, "%s: error: src_buf too small, need: %d\n",
-					argv[0], src_size);
-			return 2;
-		}
-
-		if (v4lconvert_helper_read(STDIN_FILENO, src_buf, src_size, argv[0]))
-			return 1; /* Erm, no way to recover without loosing sync with libv4l */
-
+		r = v4lconvert_helper_get_frame(&helper, &width, &height, &yvu,
+				&src, &src_size, &dest, &dest_max);
+		if (r)
+			return r;
 
 		dest_size = width * height * 3 / 2;
 		if (width <= 0 || width > SHRT_MAX || height <= 0 || height > SHRT_MAX) {
 			fprintf(stderr, "%s: error: width or height out of bounds\n",
 					argv[0]);
 			dest_size = -1;
-		} else if (dest_size > sizeof(dest_buf)) {
+		} else if (dest_size > dest_max) {
 			fprintf(stderr, "%s: error: dest_buf too small, need: %d\n",
 					argv[0], dest_size);
 			dest_size = -1;
-		} else if (v4lconvert_ov518_to_yuv420(src_buf, dest_buf, width, height,
+		} else if (v4lconvert_ov518_to_yuv420(src, dest, width, height,
 					yvu, src_size))
 			dest_size = -1;
 
-		if (v4lconvert_helper_write(STDOUT_FILENO, &dest_size, sizeof(int),
-					argv[0]))
-			return 1; /* Erm, no way to recover without loosing sync with libv4l */
-
-		if (dest_size == -1)
-			continue;
-
-		if (v4lconvert_helper_write(STDOUT_FILENO, dest_buf, dest_size, argv[0]))
-			return 1; /* Erm, no way to recover without loosing sync with libv4l */
+		r = v4lconvert_helper_put_frame(&helper, dest_size);
+		if (r)
+			return r;
 	}
 }
@@ -24,26 +24,23 @@
  */
 
 #include <string.h>
+#include <pthread.h>
 #include "libv4lconvert-priv.h"
+#include "libv4lbits-priv.h"
 
 #define CLIP(color) (unsigned char)(((color) > 0xFF) ? 0xff : (((color) < 0) ? 0 : (color)))
 
-/* FIXME not threadsafe */
-static int decoder_initialized;
-
-static struct {
-	unsigned char is_abs;
-	unsigned char len;
-	signed char val;
-} table[256];
+static struct v4lconvert_vlc table[256];
+static struct v4lconvert_vlc_multi multi_table[1 << V4LCONVERT_VLC_MULTI_BITS];
+static pthread_once_t decoder_once = PTHREAD_ONCE_INIT;
 
 static void init_pixart_decoder(void)
 {
 	int i;
-	int is_abs, val, len;
+	int escape, val, len;
 
 	for (i = 0; i < 256; i++) {
-		is_abs = 0;
+		escape = 0;
 		val = 0;
 		len = 0;
 		if ((i & 0xC0) == 0) {
@@ -83,25 +80,16 @@ static void init_pixart_decoder(void)
 			val = 4;
 			len = 6;
 		} else if ((i & 0xF8) == 0xF8) {
-			/* code 11111xxxxxx */
-			is_abs = 1;
+			/* code 11111xxxxxx, absolute value */
+			escape = 1;
 			val = 0;
 			len = 5;
 		}
-		table[i].is_abs = is_abs;
+		table[i].escape = escape;
 		table[i].val = val;
 		table[i].len = len;
 	}
-	decoder_initialized = 1;
-}
-
-static inline unsigned char getByte(const unsigned char *inp,
-		unsigned int bitpos)
-{
-	const unsigned char *addr;
-
-	addr = inp + (bitpos >> 3);
-	return (addr[0] << (bitpos & 7)) | (addr[1] >> (8 - (bitpos & 7)));
+	v4lconvert_vlc_multi_init(multi_table, table);
 }
 
 static inline unsigned short getShort(const unsigned char *pt)
@@ -110,44 +98,50 @@ static inline unsigned short getShort(const unsigned char *pt)
 }
 
 static int
-pac_decompress_row(const unsigned char *inp, unsigned char *outp, int width,
-		int step_size, int abs_bits)
+pac_decompress_row(const unsigned char *inp, const unsigned char *end,
+		unsigned char *outp, int width, int step_size, int abs_bits)
 {
-	int col;
+	struct v4lconvert_bits bits;
+	const struct v4lconvert_vlc_multi *multi;
+	int col, i, n;
 	int val;
-	int bitpos;
-	unsigned char code;
-
-	if (!decoder_initialized)
-		init_pixart_decoder();
+	unsigned int code;
 
 	/* first two pixels are stored as raw 8-bit */
 	*outp++ = inp[2];
 	*outp++ = inp[3];
-	bitpos = 32;
+	v4lconvert_bits_init(&bits, inp + 4, end);
 
 	/* main decoding loop */
-	for (col = 2; col < width; col++) {
-		/* get bitcode */
-
-		code = getByte(inp, bitpos);
-		bitpos += table[code].len;
-
-		/* calculate pixel value */
-		if (table[code].is_abs) {
-			/* absolute value: get 6 more bits */
-			code = getByte(inp, bitpos);
-			bitpos += abs_bits;
-			*outp++ = code & ~(0xff >> abs_bits);
-		} else {
-			/* relative to left pixel */
-			val = outp[-2] + table[code].val * step_size;
-			*outp++ = CLIP(val);
+	for (col = 2; col < width; ) {
+		v4lconvert_bits_refill(&bits);
+
+		/* relative to left pixel, decode as many codes as we can */
+		multi = &multi_table[v4lconvert_bits_peek(&bits,
+				V4LCONVERT_VLC_MULTI_BITS)];
+		if (multi->n) {
+			n = multi->n;
+			if (n > width - col)
+				n = width - col;
+			for (i = 0; i < n; i++) {
+				val = outp[-2] + multi->val[i] * step_size;
+				*outp++ = CLIP(val);
+			}
+			col += n;
+			v4lconvert_bits_skip(&bits, multi->end[n - 1]);
+			continue;
 		}
+
+		/* absolute value: get abs_bits more bits */
+		code = v4lconvert_bits_peek(&bits, 8);
+		v4lconvert_bits_skip(&bits, table[code].len);
+		code = v4lconvert_bits_get(&bits, abs_bits);
+		*outp++ = code << (8 - abs_bits);
+		col++;
 	}
 
 	/* return line length, rounded up to next 16-bit word */
-	return 2 * ((bitpos + 15) / 16);
+	return 2 * ((32 + v4lconvert_bits_pos(&bits) + 15) / 16);
 }
 
 int v4lconvert_decode_pac207(struct v4lconvert_data *data,
@@ -162,6 +156,8 @@ int v4lconvert_decode_pac207(struct v4lconvert_data *data,
 	unsigned short word;
 	int row;
 
+	pthread_once(&decoder_once, init_pixart_decoder);
+
 	/* iterate over all rows */
 	for (row = 0; row < height; row++) {
 		if ((inp + 2) > end) {
@@ -175,15 +171,15 @@ int v4lconvert_decode_pac207(struct v4lconvert_data *data,
 			inp += (2 + width);
 			break;
 		case 0x1EE1:
-			inp += pac_decompress_row(inp, outp, width, 5, 6);
+			inp += pac_decompress_row(inp, end, outp, width, 5, 6);
 			break;
 
 		case 0x2DD2:
-			inp += pac_decompress_row(inp, outp, width, 9, 5);
+			inp += pac_decompress_row(inp, end, outp, width, 9, 5);
 			break;
 
 		case 0x3CC3:
-			inp += pac_decompress_row(inp, outp, width, 17, 4);
+			inp += pac_decompress_row(inp, end, outp, width, 17, 4);
 			break;
 
 		case 0x4BB4:
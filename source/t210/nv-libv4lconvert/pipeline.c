@@ -0,0 +1,248 @@
+/*
+
+# Single pass processing lookup / flip / crop of converted frames
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License, version 2.1,
+# as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+#include <string.h>
+#include "libv4lconvert-priv.h"
+
+/* This does in one pass what v4lconvert_processing() -> v4lconvert_rotate() ->
+   v4lconvert_crop() do in 3 passes with a full frame intermediate buffer in
+   between each pass. The source rows can be fed in any order and in bands of
+   any (for yuv420 even) size, so that the conversion step can be done in
+   bands too. The output is identical to that of the 3 pass chain. */
+
+int v4lconvert_pipeline_init(struct v4lconvert_pipeline *p,
+		const struct v4l2_format *src_fmt, const struct v4l2_format *dest_fmt,
+		unsigned char *dest, int hflip, int vflip)
+{
+	int crop = dest_fmt->fmt.pix.width != src_fmt->fmt.pix.width ||
+		dest_fmt->fmt.pix.height != src_fmt->fmt.pix.height;
+
+	memset(p, 0, sizeof(*p));
+	p->src_width = src_fmt->fmt.pix.width;
+	p->src_height = src_fmt->fmt.pix.height;
+	p->width = dest_fmt->fmt.pix.width;
+	p->height = dest_fmt->fmt.pix.height;
+	p->hflip = hflip;
+	p->vflip = vflip;
+
+	/* Only plain cropping, adding a border or reducing is left to
+	   v4lconvert_crop() */
+	if (crop && (p->width > p->src_width || p->height > p->src_height ||
+			(p->src_width >= 2 * p->width &&
+			 p->src_height >= 2 * p->height)))
+		return -1;
+
+	switch (dest_fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+		p->bpp = 3;
+		p->startx = (p->src_width - p->width) / 2;
+		p->starty = (p->src_height - p->height) / 2;
+		break;
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+		p->bpp = 1;
+		p->planar = 1;
+		p->startx = ((p->src_width - p->width) / 2) & ~1;
+		p->starty = ((p->src_height - p->height) / 2) & ~1;
+		break;
+	default:
+		return -1;
+	}
+
+	/* Without cropping v4lconvert_rotate() writes unpadded lines */
+	if (crop)
+		p->dest_stride[0] = dest_fmt->fmt.pix.bytesperline;
+	else
+		p->dest_stride[0] = p->width * p->bpp;
+	p->dest[0] = dest;
+
+	if (p->planar) {
+		p->dest_stride[1] = p->dest_stride[2] = p->dest_stride[0] / 2;
+		p->dest[1] = p->dest[0] + p->height * p->dest_stride[0];
+		p->dest[2] = p->dest[1] + (p->height / 2) * p->dest_stride[1];
+	}
+
+	return 0;
+}
+
+/* Write to separate planes with their own bytesperline rather than to a
+   contiguous frame, for nv12 dest[1] is the interleaved u / v plane */
+void v4lconvert_pipeline_set_planes(struct v4lconvert_pipeline *p,
+		unsigned char *dest[], const unsigned int bytesperline[], int nv12)
+{
+	int i;
+
+	for (i = 0; i < (p->planar ? (nv12 ? 2 : 3) : 1); i++) {
+		p->dest[i] = dest[i];
+		p->dest_stride[i] = bytesperline[i];
+	}
+
+	if (nv12) {
+		p->dest[2] = dest[1] + 1;
+		p->dest_stride[2] = bytesperline[1];
+		p->nv12 = 1;
+	}
+}
+
+void v4lconvert_pipeline_set_lut(struct v4lconvert_pipeline *p,
+		const unsigned char *comp1, const unsigned char *green,
+		const unsigned char *comp2)
+{
+	p->lut[0] = comp1;
+	p->lut[1] = green;
+	p->lut[2] = comp2;
+}
+
+/* Copy one source line to its destination line (if any) */
+static void v4lconvert_pipeline_line(const struct v4lconvert_pipeline *p,
+		const unsigned char *src, int y, unsigned char *dest,
+		int src_width, int src_height, int width, int height,
+		int startx, int starty, int dest_stride, int dest_step, int plane)
+{
+	const unsigned char *lut0 = p->lut[0], *lut1 = p->lut[1],
+		*lut2 = p->lut[2];
+	int x;
+
+	/* y in the flipped frame, relative to the crop window */
+	if (p->vflip)
+		y = src_height - 1 - y;
+	y -= starty;
+	if (y < 0 || y >= height)
+		return;
+
+	dest += y * dest_stride;
+
+	if (p->bpp == 3) {
+		if (p->hflip) {
+			src += (src_width - 1 - startx) * 3;
+			if (lut0) {
+				for (x = 0; x < width; x++) {
+					*dest++ = lut0[src[0]];
+					*dest++ = lut1[src[1]];
+					*dest++ = lut2[src[2]];
+					src -= 3;
+				}
+			} else {
+				for (x = 0; x < width; x++) {
+					*dest++ = src[0];
+					*dest++ = src[1];
+					*dest++ = src[2];
+					src -= 3;
+				}
+			}
+		} else {
+			src += startx * 3;
+			if (lut0) {
+				for (x = 0; x < width; x++) {
+					*dest++ = lut0[*src++];
+					*dest++ = lut1[*src++];
+					*dest++ = lut2[*src++];
+				}
+			} else
+				memcpy(dest, src, width * 3);
+		}
+	} else if (p->lut[plane]) {
+		/* y, u or v line, for yuv the lookup tables are per plane */
+		lut0 = p->lut[plane];
+		if (p->hflip) {
+			src += src_width - 1 - startx;
+			for (x = 0; x < width; x++, dest += dest_step)
+				*dest = lut0[*src--];
+		} else {
+			src += startx;
+			for (x = 0; x < width; x++, dest += dest_step)
+				*dest = lut0[*src++];
+		}
+	} else if (dest_step == 1) {
+		if (p->hflip) {
+			src += src_width - 1 - startx;
+			for (x = 0; x < width; x++)
+				*dest++ = *src--;
+		} else
+			memcpy(dest, src + startx, width);
+	} else {
+		/* u or v line of nv12 */
+		if (p->hflip) {
+			src += src_width - 1 - startx;
+			for (x = 0; x < width; x++, dest += dest_step)
+				*dest = *src--;
+		} else {
+			src += startx;
+			for (x = 0; x < width; x++, dest += dest_step)
+				*dest = *src++;
+		}
+	}
+}
+
+/* y, u and v point to the first line to process in their plane */
+void v4lconvert_pipeline_planes(struct v4lconvert_pipeline *p,
+		const unsigned char *y, const unsigned char *u,
+		const unsigned char *v, int first_line, int lines)
+{
+	int i, src_stride = p->src_width * p->bpp;
+	int step = p->nv12 ? 2 : 1;
+
+	for (i = 0; i < lines; i++)
+		v4lconvert_pipeline_line(p, y + i * src_stride, first_line + i,
+				p->dest[0], p->src_width, p->src_height,
+				p->width, p->height, p->startx, p->starty,
+				p->dest_stride[0], 1, 0);
+
+	if (!p->planar)
+		return;
+
+	src_stride /= 2;
+	first_line /= 2;
+	lines /= 2;
+
+	for (i = 0; i < lines; i++)
+		v4lconvert_pipeline_line(p, u + i * src_stride, first_line + i,
+				p->dest[1], p->src_width / 2, p->src_height / 2,
+				p->width / 2, p->height / 2, p->startx / 2,
+				p->starty / 2, p->dest_stride[1], step, 1);
+
+	for (i = 0; i < lines; i++)
+		v4lconvert_pipeline_line(p, v + i * src_stride, first_line + i,
+				p->dest[2], p->src_width / 2, p->src_height / 2,
+				p->width / 2, p->height / 2, p->startx / 2,
+				p->starty / 2, p->dest_stride[2], step, 2);
+}
+
+/* src holds just the lines to process, with for yuv420 the u and v planes
+   of those lines following its y plane */
+void v4lconvert_pipeline_lines(struct v4lconvert_pipeline *p,
+		const unsigned char *src, int first_line, int lines)
+{
+	int size = p->src_width * lines * p->bpp;
+
+	v4lconvert_pipeline_planes(p, src, src + size, src + size * 5 / 4,
+			first_line, lines);
+}
+
+/* src holds the entire frame, for yuv420 first_line must be even */
+void v4lconvert_pipeline_frame(struct v4lconvert_pipeline *p,
+		const unsigned char *src, int first_line, int lines)
+{
+	int size = p->src_width * p->src_height * p->bpp;
+	int offset = p->src_width * first_line * p->bpp;
+
+	v4lconvert_pipeline_planes(p, src + offset, src + size + offset / 4,
+			src + size * 5 / 4 + offset / 4, first_line, lines);
+}
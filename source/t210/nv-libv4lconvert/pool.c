@@ -0,0 +1,211 @@
+/*
+
+# Worker thread pool for band parallel conversion
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License, version 2.1,
+# as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "libv4lconvert-priv.h"
+
+struct v4lconvert_pool_thread {
+	struct v4lconvert_pool *pool;
+	pthread_t thread;
+	int index;
+	/* Per thread scratch memory, see v4lconvert_pool_scratch() */
+	unsigned char *buf;
+	int buf_size;
+};
+
+struct v4lconvert_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond;	/* signalled when new work is queued */
+	pthread_cond_t done_cond;	/* signalled when a worker is done */
+	int threads;			/* including the calling thread */
+	int started;			/* worker threads successfully started */
+	int generation;			/* incremented for each v4lconvert_pool_run */
+	int busy;			/* workers still working on this generation */
+	int quit;
+	/* The current job */
+	void (*func)(void *arg, int thread, int band);
+	void *arg;
+	int bands;
+	int next_band;
+	struct v4lconvert_pool_thread thread[];
+};
+
+/* Process bands of the current job until there are none left */
+static void v4lconvert_pool_work(struct v4lconvert_pool *pool, int index)
+{
+	int band;
+
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+		band = pool->next_band;
+		if (band < pool->bands)
+			pool->next_band++;
+		pthread_mutex_unlock(&pool->lock);
+
+		if (band >= pool->bands)
+			break;
+
+		pool->func(pool->arg, index, band);
+	}
+}
+
+static void *v4lconvert_pool_main(void *arg)
+{
+	struct v4lconvert_pool_thread *thread = arg;
+	struct v4lconvert_pool *pool = thread->pool;
+	int generation = 0;
+
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+		while (!pool->quit && pool->generation == generation)
+			pthread_cond_wait(&pool->work_cond, &pool->lock);
+		if (pool->quit) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+		generation = pool->generation;
+		pthread_mutex_unlock(&pool->lock);
+
+		v4lconvert_pool_work(pool, thread->index);
+
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->busy == 0)
+			pthread_cond_signal(&pool->done_cond);
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	return NULL;
+}
+
+struct v4lconvert_pool *v4lconvert_pool_create(int threads)
+{
+	struct v4lconvert_pool *pool;
+	int i;
+
+	pool = calloc(1, sizeof(*pool) +
+			threads * sizeof(struct v4lconvert_pool_thread));
+	if (!pool)
+		return NULL;
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+	pool->threads = threads;
+
+	/* Thread 0 is the thread calling v4lconvert_pool_run() */
+	for (i = 0; i < threads; i++) {
+		pool->thread[i].pool = pool;
+		pool->thread[i].index = i;
+	}
+
+	for (i = 1; i < threads; i++) {
+		if (pthread_create(&pool->thread[i].thread, NULL,
+					v4lconvert_pool_main, &pool->thread[i]))
+			break;
+		pool->started++;
+	}
+
+	if (pool->started != threads - 1) {
+		v4lconvert_pool_destroy(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+void v4lconvert_pool_destroy(struct v4lconvert_pool *pool)
+{
+	int i;
+
+	if (!pool)
+		return;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = 1;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 1; i <= pool->started; i++)
+		pthread_join(pool->thread[i].thread, NULL);
+
+	for (i = 0; i < pool->threads; i++)
+		free(pool->thread[i].buf);
+
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_cond_destroy(&pool->work_cond);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool);
+}
+
+int v4lconvert_pool_threads(struct v4lconvert_pool *pool)
+{
+	return pool ? pool->threads : 1;
+}
+
+void v4lconvert_pool_run(struct v4lconvert_pool *pool,
+		void (*func)(void *arg, int thread, int band), void *arg, int bands)
+{
+	int i;
+
+	/* No pool, or not enough work to bother waking up the workers */
+	if (!pool || bands < 2) {
+		for (i = 0; i < bands; i++)
+			func(arg, 0, i);
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->func = func;
+	pool->arg = arg;
+	pool->bands = bands;
+	pool->next_band = 0;
+	pool->busy = pool->threads - 1;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	v4lconvert_pool_work(pool, 0);
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->busy)
+		pthread_cond_wait(&pool->done_cond, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+unsigned char *v4lconvert_pool_scratch(struct v4lconvert_pool *pool,
+		int thread, int needed)
+{
+	return v4lconvert_alloc_buffer(needed, &pool->thread[thread].buf,
+			&pool->thread[thread].buf_size);
+}
+
+void v4lconvert_pool_band(int band, int bands, int height, int *first_line,
+		int *lines)
+{
+	/* Bands start at an even line, for the subsampled planes of yuv420 */
+	int first = (height / 2) * band / bands * 2;
+	int last = (height / 2) * (band + 1) / bands * 2;
+
+	if (band == bands - 1)
+		last = height;
+
+	*first_line = first;
+	*lines = last - first;
+}
@@ -34,6 +34,8 @@ static int autogain_active(struct v4lprocessing_data *data)
 	if (!autogain) {
 		/* Reset last_correction val */
 		data->last_gain_correction = 0;
+		/* And re-query the controls when we get re-enabled */
+		data->autogain_ctrls_valid = 0;
 	}
 
 	return autogain;
@@ -73,16 +75,29 @@ static int autogain_calculate_lookup_tables(
 		struct v4lprocessing_data *data,
 		unsigned char *buf, const struct v4l2_format *fmt)
 {
-	int x, y, target, steps, avg_lum = 0;
+	int target, steps, lines, avg_lum = 0, yuv_avg[3];
 	int gain, exposure, orig_gain, orig_exposure, exposure_low;
+	unsigned long long sum = 0;
 	struct v4l2_control ctrl;
 	struct v4l2_queryctrl gainctrl, expoctrl;
 	const int deadzone = 6;
 
+	/* The ranges of the controls do not change while streaming, so only
+	   the current values get queried for every update */
+	if (!data->autogain_ctrls_valid) {
+		data->expoctrl.id = V4L2_CID_EXPOSURE;
+		data->gainctrl.id = V4L2_CID_GAIN;
+		if (SYS_IOCTL(data->fd, VIDIOC_QUERYCTRL, &data->expoctrl) ||
+				SYS_IOCTL(data->fd, VIDIOC_QUERYCTRL,
+					&data->gainctrl))
+			return 0;
+		data->autogain_ctrls_valid = 1;
+	}
+	expoctrl = data->expoctrl;
+	gainctrl = data->gainctrl;
+
 	ctrl.id = V4L2_CID_EXPOSURE;
-	expoctrl.id = V4L2_CID_EXPOSURE;
-	if (SYS_IOCTL(data->fd, VIDIOC_QUERYCTRL, &expoctrl) ||
-			SYS_IOCTL(data->fd, VIDIOC_G_CTRL, &ctrl))
+	if (SYS_IOCTL(data->fd, VIDIOC_G_CTRL, &ctrl))
 		return 0;
 
 	exposure = orig_exposure = ctrl.value;
@@ -98,12 +113,13 @@ static int autogain_calculate_lookup_tables(
 	exposure_low = steps * expoctrl.step + expoctrl.minimum;
 
 	ctrl.id = V4L2_CID_GAIN;
-	gainctrl.id = V4L2_CID_GAIN;
-	if (SYS_IOCTL(data->fd, VIDIOC_QUERYCTRL, &gainctrl) ||
-			SYS_IOCTL(data->fd, VIDIOC_G_CTRL, &ctrl))
+	if (SYS_IOCTL(data->fd, VIDIOC_G_CTRL, &ctrl))
 		return 0;
 	gain = orig_gain = ctrl.value;
 
+	/* Only every stats_step-th line of the centre window is sampled */
+	lines = v4lprocessing_stats_lines(data, fmt->fmt.pix.height / 2);
+
 	switch (fmt->fmt.pix.pixelformat) {
 	case V4L2_PIX_FMT_SGBRG8:
 	case V4L2_PIX_FMT_SGRBG8:
@@ -112,12 +128,10 @@ static int autogain_calculate_lookup_tables(
 		buf += fmt->fmt.pix.height * fmt->fmt.pix.bytesperline / 4 +
 			fmt->fmt.pix.width / 4;
 
-		for (y = 0; (unsigned)y < fmt->fmt.pix.height / 2; y++) {
-			for (x = 0; (unsigned)x < fmt->fmt.pix.width / 2; x++)
-				avg_lum += *buf++;
-			buf += fmt->fmt.pix.bytesperline - fmt->fmt.pix.width / 2;
-		}
-		avg_lum /= fmt->fmt.pix.height * fmt->fmt.pix.width / 4;
+		v4lprocessing_sum_lines(buf, fmt->fmt.pix.width / 2, lines,
+				data->stats_step * fmt->fmt.pix.bytesperline, 1, &sum);
+		if (lines && fmt->fmt.pix.width >= 2)
+			avg_lum = sum / (lines * (fmt->fmt.pix.width / 2));
 		break;
 
 	case V4L2_PIX_FMT_RGB24:
@@ -125,15 +139,24 @@ static int autogain_calculate_lookup_tables(
 		buf += fmt->fmt.pix.height * fmt->fmt.pix.bytesperline / 4 +
 			fmt->fmt.pix.width * 3 / 4;
 
-		for (y = 0; (unsigned)y < fmt->fmt.pix.height / 2; y++) {
-			for (x = 0; (unsigned)x < fmt->fmt.pix.width / 2; x++) {
-				avg_lum += *buf++;
-				avg_lum += *buf++;
-				avg_lum += *buf++;
-			}
-			buf += fmt->fmt.pix.bytesperline - fmt->fmt.pix.width * 3 / 2;
-		}
-		avg_lum /= fmt->fmt.pix.height * fmt->fmt.pix.width * 3 / 4;
+		v4lprocessing_sum_lines(buf, fmt->fmt.pix.width * 3 / 2, lines,
+				data->stats_step * fmt->fmt.pix.bytesperline, 1, &sum);
+		if (lines && fmt->fmt.pix.width >= 2)
+			avg_lum = sum / (lines * (fmt->fmt.pix.width * 3 / 2));
+		break;
+
+	case V4L2_PIX_FMT_YUYV:
+	case V4L2_PIX_FMT_YVYU:
+	case V4L2_PIX_FMT_UYVY:
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_NV12:
+		v4lprocessing_yuv_averages(data, buf, fmt,
+				(fmt->fmt.pix.width / 4) & ~1,
+				(fmt->fmt.pix.height / 4) & ~1,
+				(fmt->fmt.pix.width / 2) & ~1,
+				(fmt->fmt.pix.height / 2) & ~1, yuv_avg);
+		avg_lum = yuv_avg[0] / 16;
 		break;
 	}
 
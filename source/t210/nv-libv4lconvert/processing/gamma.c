@@ -47,8 +47,11 @@ static int gamma_calculate_lookup_tables(
 		data->last_gamma = gamma;
 	}
 
+	/* Of yuv only the luma gets corrected, comp1 holds the y table */
 	for (i = 0; i < 256; i++) {
 		data->comp1[i] = data->gamma_table[data->comp1[i]];
+		if (data->yuv)
+			continue;
 		data->green[i] = data->gamma_table[data->green[i]];
 		data->comp2[i] = data->gamma_table[data->comp2[i]];
 	}
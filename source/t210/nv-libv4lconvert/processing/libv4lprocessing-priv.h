@@ -20,10 +20,14 @@
 #ifndef __LIBV4LPROCESSING_PRIV_H
 #define __LIBV4LPROCESSING_PRIV_H
 
+#include <linux/videodev2.h>
 #include "../control/libv4lcontrol.h"
 #include "../libv4lsyscall-priv.h"
 
 #define V4L2PROCESSING_UPDATE_RATE 10
+/* The filters gather their statistics from 1 out of every this many lines
+   (or line pairs for bayer / yuv420 chroma) */
+#define V4L2PROCESSING_STATS_STEP 4
 
 struct v4lprocessing_data {
 	struct v4lcontrol_data *control;
@@ -36,7 +40,12 @@ struct v4lprocessing_data {
 	/* Counts the number of processed frames until a
 	   V4L2PROCESSING_UPDATE_RATE overflow happens */
 	int lookup_table_update_counter;
-	/* RGB/BGR lookup tables */
+	/* Line step of the statistics grid */
+	int stats_step;
+	/* True if the lookup tables were calculated for a yuv frame */
+	int yuv;
+	/* RGB/BGR lookup tables, for yuv formats comp1 is the y table, green
+	   the u table and comp2 the v table */
 	unsigned char comp1[256];
 	unsigned char green[256];
 	unsigned char comp2[256];
@@ -50,6 +59,10 @@ struct v4lprocessing_data {
 	unsigned char gamma_table[256];
 	/* autogain.c data */
 	int last_gain_correction;
+	/* The gain and exposure ranges, only queried once */
+	int autogain_ctrls_valid;
+	struct v4l2_queryctrl gainctrl;
+	struct v4l2_queryctrl expoctrl;
 };
 
 struct v4lprocessing_filter {
@@ -60,6 +73,22 @@ struct v4lprocessing_filter {
 			unsigned char *buf, const struct v4l2_format *fmt);
 };
 
+/* Adds the sums of the bytes at offset 0 .. period - 1 of each period (1 - 4)
+   bytes to sums, for lines lines of width bytes, stride apart. width must be
+   a multiple of period */
+void v4lprocessing_sum_lines(const unsigned char *buf, int width, int lines,
+		int stride, int period, unsigned long long *sums);
+
+/* Number of lines of a frame (or plane) of height lines which are sampled
+   for the statistics */
+int v4lprocessing_stats_lines(struct v4lprocessing_data *data, int height);
+
+/* Averages of the y, u and v samples in a window of a yuv frame, normed to
+   ~ 0 - 4095. x, y, width and height must be even */
+void v4lprocessing_yuv_averages(struct v4lprocessing_data *data,
+		const unsigned char *buf, const struct v4l2_format *fmt,
+		int x, int y, int width, int height, int avg[3]);
+
 extern struct v4lprocessing_filter whitebalance_filter;
 extern struct v4lprocessing_filter autogain_filter;
 extern struct v4lprocessing_filter gamma_filter;
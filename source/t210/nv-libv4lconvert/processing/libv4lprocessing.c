@@ -25,6 +25,7 @@
 #include "libv4lprocessing.h"
 #include "libv4lprocessing-priv.h"
 #include "../libv4lconvert-priv.h" /* for PIX_FMT defines */
+#include "../libv4lsimd-priv.h"
 
 static struct v4lprocessing_filter *filters[] = {
 	&whitebalance_filter,
@@ -32,10 +33,200 @@ static struct v4lprocessing_filter *filters[] = {
 	&gamma_filter,
 };
 
+static struct {
+	void (*sum_lines)(const unsigned char *buf, int width, int lines,
+			int stride, int period, unsigned long long *sums);
+} stats_simd;
+
+static void sum_lines_c(const unsigned char *buf, int width, int lines,
+		int stride, int period, unsigned long long *sums)
+{
+	unsigned int line[4];
+	int x, y, i;
+
+	for (y = 0; y < lines; y++) {
+		memset(line, 0, sizeof(line));
+		for (x = 0; x < width; x += period)
+			for (i = 0; i < period; i++)
+				line[i] += buf[x + i];
+		for (i = 0; i < period; i++)
+			sums[i] += line[i];
+		buf += stride;
+	}
+}
+
+#ifdef V4LCONVERT_HAVE_NEON
+/* vld2 / vld3 / vld4 split the components, vpadal adds pairs of them to
+   16 bit lanes, which get widened before they can overflow */
+static V4LCONVERT_ALWAYS_INLINE void sum_lines_neon_period(
+		const unsigned char *buf, int width, int lines, int stride,
+		const int period, unsigned long long *sums)
+{
+	uint32x4_t acc32[4];
+	uint16x8_t acc16[4];
+	uint64x2_t sum;
+	int x, y, i, n;
+
+	for (y = 0; y < lines; y++) {
+		for (i = 0; i < period; i++)
+			acc32[i] = vdupq_n_u32(0);
+
+		x = 0;
+		while (x + 16 * period <= width) {
+			for (i = 0; i < period; i++)
+				acc16[i] = vdupq_n_u16(0);
+
+			/* 128 times 2 * 255 fits in 16 bits */
+			for (n = 0; n < 128 && x + 16 * period <= width;
+					n++, x += 16 * period) {
+				if (period == 1) {
+					acc16[0] = vpadalq_u8(acc16[0], vld1q_u8(buf + x));
+				} else if (period == 2) {
+					uint8x16x2_t v = vld2q_u8(buf + x);
+
+					acc16[0] = vpadalq_u8(acc16[0], v.val[0]);
+					acc16[1] = vpadalq_u8(acc16[1], v.val[1]);
+				} else if (period == 3) {
+					uint8x16x3_t v = vld3q_u8(buf + x);
+
+					acc16[0] = vpadalq_u8(acc16[0], v.val[0]);
+					acc16[1] = vpadalq_u8(acc16[1], v.val[1]);
+					acc16[2] = vpadalq_u8(acc16[2], v.val[2]);
+				} else {
+					uint8x16x4_t v = vld4q_u8(buf + x);
+
+					acc16[0] = vpadalq_u8(acc16[0], v.val[0]);
+					acc16[1] = vpadalq_u8(acc16[1], v.val[1]);
+					acc16[2] = vpadalq_u8(acc16[2], v.val[2]);
+					acc16[3] = vpadalq_u8(acc16[3], v.val[3]);
+				}
+			}
+
+			for (i = 0; i < period; i++)
+				acc32[i] = vpadalq_u16(acc32[i], acc16[i]);
+		}
+
+		for (i = 0; i < period; i++) {
+			sum = vpaddlq_u32(acc32[i]);
+			sums[i] += vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1);
+		}
+		sum_lines_c(buf + x, width - x, 1, stride, period, sums);
+		buf += stride;
+	}
+}
+
+static void sum_lines_neon(const unsigned char *buf, int width, int lines,
+		int stride, int period, unsigned long long *sums)
+{
+	switch (period) {
+	case 1:
+		sum_lines_neon_period(buf, width, lines, stride, 1, sums);
+		break;
+	case 2:
+		sum_lines_neon_period(buf, width, lines, stride, 2, sums);
+		break;
+	case 3:
+		sum_lines_neon_period(buf, width, lines, stride, 3, sums);
+		break;
+	default:
+		sum_lines_neon_period(buf, width, lines, stride, 4, sums);
+	}
+}
+#endif
+
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+/* psadbw against zero sums 8 bytes at a time, masking out the bytes of the
+   other components. A 48 byte block holds a whole number of periods, so the
+   masks for its 3 vectors are the same for every block */
+static V4LCONVERT_ALWAYS_INLINE V4LCONVERT_SSE2 void sum_lines_sse2_period(
+		const unsigned char *buf, int width, int lines, int stride,
+		const int period, unsigned long long *sums)
+{
+	unsigned char m[16];
+	__m128i mask[3][4], acc[4], zero = _mm_setzero_si128();
+	uint64_t sum[2];
+	int x, y, i, j;
+
+	for (j = 0; j < 3; j++)
+		for (i = 0; i < period; i++) {
+			for (x = 0; x < 16; x++)
+				m[x] = (16 * j + x) % period == i ? 0xff : 0x00;
+			mask[j][i] = _mm_loadu_si128((const __m128i *)m);
+		}
+
+	for (y = 0; y < lines; y++) {
+		for (i = 0; i < period; i++)
+			acc[i] = zero;
+
+		for (x = 0; x + 48 <= width; x += 48)
+			for (j = 0; j < 3; j++) {
+				__m128i v = _mm_loadu_si128(
+						(const __m128i *)(buf + x + 16 * j));
+
+				for (i = 0; i < period; i++)
+					acc[i] = _mm_add_epi64(acc[i], _mm_sad_epu8(
+							_mm_and_si128(v, mask[j][i]), zero));
+			}
+
+		for (i = 0; i < period; i++) {
+			_mm_storeu_si128((__m128i *)sum, acc[i]);
+			sums[i] += sum[0] + sum[1];
+		}
+		sum_lines_c(buf + x, width - x, 1, stride, period, sums);
+		buf += stride;
+	}
+}
+
+static V4LCONVERT_SSE2 void sum_lines_sse2(const unsigned char *buf,
+		int width, int lines, int stride, int period,
+		unsigned long long *sums)
+{
+	switch (period) {
+	case 1:
+		sum_lines_sse2_period(buf, width, lines, stride, 1, sums);
+		break;
+	case 2:
+		sum_lines_sse2_period(buf, width, lines, stride, 2, sums);
+		break;
+	case 3:
+		sum_lines_sse2_period(buf, width, lines, stride, 3, sums);
+		break;
+	default:
+		sum_lines_sse2_period(buf, width, lines, stride, 4, sums);
+	}
+}
+#endif
+
+void v4lprocessing_stats_init(int cpu_flags)
+{
+	stats_simd.sum_lines = sum_lines_c;
+#ifdef V4LCONVERT_HAVE_NEON
+	if (cpu_flags & V4LCONVERT_CPU_NEON)
+		stats_simd.sum_lines = sum_lines_neon;
+#endif
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+	/* The statistics are bound by memory bandwidth, SSE2 will do */
+	if (cpu_flags & V4LCONVERT_CPU_SSE2)
+		stats_simd.sum_lines = sum_lines_sse2;
+#endif
+}
+
+void v4lprocessing_sum_lines(const unsigned char *buf, int width, int lines,
+		int stride, int period, unsigned long long *sums)
+{
+	stats_simd.sum_lines(buf, width, lines, stride, period, sums);
+}
+
+int v4lprocessing_stats_lines(struct v4lprocessing_data *data, int height)
+{
+	return (height + data->stats_step - 1) / data->stats_step;
+}
+
 struct v4lprocessing_data *v4lprocessing_create(int fd, struct v4lcontrol_data *control)
 {
 	struct v4lprocessing_data *data =
 		calloc(1, sizeof(struct v4lprocessing_data));
+	char *s;
 
 	if (!data) {
 		fprintf(stderr, "libv4lprocessing: error: out of memory!\n");
@@ -45,6 +236,13 @@ struct v4lprocessing_data *v4lprocessing_create(int fd, struct v4lcontrol_data *
 	data->fd = fd;
 	data->control = control;
 
+	/* Allow overriding the statistics grid through environment, 1 gathers
+	   the statistics from every line */
+	data->stats_step = V4L2PROCESSING_STATS_STEP;
+	s = getenv("LIBV4LPROCESSING_STATS_STEP");
+	if (s && atoi(s) > 0)
+		data->stats_step = atoi(s);
+
 	return data;
 }
 
@@ -88,10 +286,115 @@ static void v4lprocessing_update_lookup_tables(struct v4lprocessing_data *data,
 	}
 }
 
+/* Byte offsets of y, u and v in a 4 byte macropixel of packed yuv 4:2:2 */
+static int v4lprocessing_packed_layout(unsigned int pixelformat,
+		int *yo, int *uo, int *vo)
+{
+	switch (pixelformat) {
+	case V4L2_PIX_FMT_YUYV:
+		*yo = 0; *uo = 1; *vo = 3;
+		return 1;
+	case V4L2_PIX_FMT_YVYU:
+		*yo = 0; *uo = 3; *vo = 1;
+		return 1;
+	case V4L2_PIX_FMT_UYVY:
+		*yo = 1; *uo = 0; *vo = 2;
+		return 1;
+	}
+	return 0;
+}
+
+/* Start of the u and v planes, for nv12 v is u + 1 */
+static void v4lprocessing_chroma_planes(const unsigned char *buf,
+		const struct v4l2_format *fmt, const unsigned char **u,
+		const unsigned char **v, int *stride, int *step)
+{
+	unsigned int bytesperline = fmt->fmt.pix.bytesperline;
+	unsigned int height = fmt->fmt.pix.height;
+
+	*u = buf + bytesperline * height;
+	if (fmt->fmt.pix.pixelformat == V4L2_PIX_FMT_NV12) {
+		*v = *u + 1;
+		*stride = bytesperline;
+		*step = 2;
+		return;
+	}
+
+	*v = *u + (bytesperline / 2) * (height / 2);
+	*stride = bytesperline / 2;
+	*step = 1;
+	if (fmt->fmt.pix.pixelformat == V4L2_PIX_FMT_YVU420) {
+		const unsigned char *tmp = *u;
+
+		*u = *v;
+		*v = tmp;
+	}
+}
+
+void v4lprocessing_yuv_averages(struct v4lprocessing_data *data,
+		const unsigned char *buf, const struct v4l2_format *fmt,
+		int x, int y, int width, int height, int avg[3])
+{
+	const unsigned char *u, *v;
+	int bytesperline = fmt->fmt.pix.bytesperline;
+	int lines = v4lprocessing_stats_lines(data, height);
+	int chroma_lines = v4lprocessing_stats_lines(data, height / 2);
+	int yo, uo, vo, stride, step;
+	unsigned long long sum[4] = { 0, 0, 0, 0 };
+
+	if (width < 2 || height < 2) {
+		avg[0] = avg[1] = avg[2] = 2048;
+		return;
+	}
+
+	if (v4lprocessing_packed_layout(fmt->fmt.pix.pixelformat,
+				&yo, &uo, &vo)) {
+		v4lprocessing_sum_lines(buf + y * bytesperline + x * 2, width * 2,
+				lines, data->stats_step * bytesperline, 4, sum);
+		avg[0] = (sum[yo] + sum[yo + 2]) * 16 / (width * lines);
+		avg[1] = sum[uo] * 32 / (width * lines);
+		avg[2] = sum[vo] * 32 / (width * lines);
+		return;
+	}
+
+	v4lprocessing_chroma_planes(buf, fmt, &u, &v, &stride, &step);
+	v4lprocessing_sum_lines(buf + y * bytesperline + x, width, lines,
+			data->stats_step * bytesperline, 1, &sum[0]);
+	u += (y / 2) * stride + (x / 2) * step;
+	v += (y / 2) * stride + (x / 2) * step;
+	if (step == 2) {
+		/* nv12, u and v come out of a single pass over the uv plane */
+		v4lprocessing_sum_lines(u, width, chroma_lines,
+				data->stats_step * stride, 2, &sum[1]);
+	} else {
+		v4lprocessing_sum_lines(u, width / 2, chroma_lines,
+				data->stats_step * stride, 1, &sum[1]);
+		v4lprocessing_sum_lines(v, width / 2, chroma_lines,
+				data->stats_step * stride, 1, &sum[2]);
+	}
+	avg[0] = sum[0] * 16 / (width * lines);
+	avg[1] = sum[1] * 32 / (width * chroma_lines);
+	avg[2] = sum[2] * 32 / (width * chroma_lines);
+}
+
+static void v4lprocessing_lookup_plane(unsigned char *buf,
+		int width, int height, int stride, int step,
+		const unsigned char *lookup)
+{
+	int x, y;
+
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x++)
+			buf[x * step] = lookup[buf[x * step]];
+		buf += stride;
+	}
+}
+
 static void v4lprocessing_do_processing(struct v4lprocessing_data *data,
 		unsigned char *buf, const struct v4l2_format *fmt)
 {
-	int x, y;
+	const unsigned char *u, *v;
+	int x, y, yo, uo, vo, stride, step;
 
 	switch (fmt->fmt.pix.pixelformat) {
 	case V4L2_PIX_FMT_SGBRG8:
@@ -148,40 +451,113 @@ static void v4lprocessing_do_processing(struct v4lprocessing_data *data,
 			buf += fmt->fmt.pix.bytesperline - 3 * fmt->fmt.pix.width;
 		}
 		break;
+
+	/* For yuv comp1 holds the y, green the u and comp2 the v table */
+	case V4L2_PIX_FMT_YUYV:
+	case V4L2_PIX_FMT_YVYU:
+	case V4L2_PIX_FMT_UYVY:
+		v4lprocessing_packed_layout(fmt->fmt.pix.pixelformat,
+				&yo, &uo, &vo);
+		for (y = 0; (unsigned)y < fmt->fmt.pix.height; y++) {
+			for (x = 0; (unsigned)x < fmt->fmt.pix.width * 2; x += 4) {
+				buf[x + yo] = data->comp1[buf[x + yo]];
+				buf[x + yo + 2] = data->comp1[buf[x + yo + 2]];
+				buf[x + uo] = data->green[buf[x + uo]];
+				buf[x + vo] = data->comp2[buf[x + vo]];
+			}
+			buf += fmt->fmt.pix.bytesperline;
+		}
+		break;
+
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_NV12:
+		v4lprocessing_chroma_planes(buf, fmt, &u, &v, &stride, &step);
+		v4lprocessing_lookup_plane(buf, fmt->fmt.pix.width,
+				fmt->fmt.pix.height, fmt->fmt.pix.bytesperline, 1,
+				data->comp1);
+		v4lprocessing_lookup_plane((unsigned char *)u,
+				fmt->fmt.pix.width / 2, fmt->fmt.pix.height / 2,
+				stride, step, data->green);
+		v4lprocessing_lookup_plane((unsigned char *)v,
+				fmt->fmt.pix.width / 2, fmt->fmt.pix.height / 2,
+				stride, step, data->comp2);
+		break;
 	}
 }
 
-void v4lprocessing_processing(struct v4lprocessing_data *data,
-		unsigned char *buf, const struct v4l2_format *fmt)
+/* Returns 1 for yuv formats, 0 for bayer and rgb and -1 for formats which
+   are not supported */
+static int v4lprocessing_fmt_is_yuv(unsigned int pixelformat)
 {
-	if (!data->do_process)
-		return;
-
-	/* Do we support the current pixformat? */
-	switch (fmt->fmt.pix.pixelformat) {
+	switch (pixelformat) {
 	case V4L2_PIX_FMT_SGBRG8:
 	case V4L2_PIX_FMT_SGRBG8:
 	case V4L2_PIX_FMT_SBGGR8:
 	case V4L2_PIX_FMT_SRGGB8:
 	case V4L2_PIX_FMT_RGB24:
 	case V4L2_PIX_FMT_BGR24:
-		break;
-	default:
-		return; /* Non supported pix format */
+		return 0;
+	case V4L2_PIX_FMT_YUYV:
+	case V4L2_PIX_FMT_YVYU:
+	case V4L2_PIX_FMT_UYVY:
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_NV12:
+		return 1;
 	}
+	return -1;
+}
 
-	if (data->controls_changed ||
+/* Returns 1 if the lookup tables must be applied to this frame */
+static int v4lprocessing_prepare(struct v4lprocessing_data *data,
+		unsigned char *buf, const struct v4l2_format *fmt)
+{
+	int yuv;
+
+	if (!data->do_process)
+		return 0;
+
+	/* Do we support the current pixformat? */
+	yuv = v4lprocessing_fmt_is_yuv(fmt->fmt.pix.pixelformat);
+	if (yuv == -1)
+		return 0; /* Non supported pix format */
+
+	/* Tables calculated for rgb can not be used for yuv, or vice versa */
+	if (data->controls_changed || yuv != data->yuv ||
 			data->lookup_table_update_counter == V4L2PROCESSING_UPDATE_RATE) {
 		data->controls_changed = 0;
 		data->lookup_table_update_counter = 0;
+		data->yuv = yuv;
 		/* Do this after resetting lookup_table_update_counter so that filters can
 		   force the next update to be sooner when they changed camera settings */
 		v4lprocessing_update_lookup_tables(data, buf, fmt);
 	} else
 		data->lookup_table_update_counter++;
 
-	if (data->lookup_table_active)
+	data->do_process = 0;
+
+	return data->lookup_table_active;
+}
+
+void v4lprocessing_processing(struct v4lprocessing_data *data,
+		unsigned char *buf, const struct v4l2_format *fmt)
+{
+	if (v4lprocessing_prepare(data, buf, fmt))
 		v4lprocessing_do_processing(data, buf, fmt);
+}
 
-	data->do_process = 0;
+int v4lprocessing_lookup_tables(struct v4lprocessing_data *data,
+		unsigned char *buf, const struct v4l2_format *fmt,
+		const unsigned char **comp1, const unsigned char **green,
+		const unsigned char **comp2)
+{
+	if (!v4lprocessing_prepare(data, buf, fmt))
+		return 0;
+
+	*comp1 = data->comp1;
+	*green = data->green;
+	*comp2 = data->comp2;
+
+	return 1;
 }
@@ -39,4 +39,14 @@ int v4lprocessing_pre_processing(struct v4lprocessing_data *data);
 void v4lprocessing_processing(struct v4lprocessing_data *data,
   unsigned char *buf, const struct v4l2_format *fmt);
 
+/* Like v4lprocessing_processing(), but instead of applying the lookup tables
+   to buf, return them, so that the caller can apply them while copying the
+   frame elsewhere. For yuv formats comp1 is the table for y, green for u and
+   comp2 for v. Returns 1 if the tables must be applied, 0 if there is
+   nothing to do. */
+int v4lprocessing_lookup_tables(struct v4lprocessing_data *data,
+  unsigned char *buf, const struct v4l2_format *fmt,
+  const unsigned char **comp1, const unsigned char **green,
+  const unsigned char **comp2);
+
 #endif
@@ -42,10 +42,10 @@ static int whitebalance_active(struct v4lprocessing_data *data)
 	return wb;
 }
 
-static int whitebalance_calculate_lookup_tables_generic(
+/* Returns 1 if the (slowly adjusted) averages need correcting */
+static int whitebalance_calculate_averages(
 		struct v4lprocessing_data *data, int green_avg, int comp1_avg, int comp2_avg)
 {
-	int i, avg_avg;
 	const int threshold = 64;
 	const int max_step = 128;
 
@@ -108,6 +108,18 @@ static int whitebalance_calculate_lookup_tables_generic(
 			abs(data->comp1_avg - data->comp2_avg) < threshold)
 		return 0;
 
+	return 1;
+}
+
+static int whitebalance_calculate_lookup_tables_generic(
+		struct v4lprocessing_data *data, int green_avg, int comp1_avg, int comp2_avg)
+{
+	int i, avg_avg;
+
+	if (!whitebalance_calculate_averages(data, green_avg, comp1_avg,
+				comp2_avg))
+		return 0;
+
 	avg_avg = (data->green_avg + data->comp1_avg + data->comp2_avg) / 3;
 
 	for (i = 0; i < 256; i++) {
@@ -123,36 +135,35 @@ static int whitebalance_calculate_lookup_tables_bayer(
 		struct v4lprocessing_data *data, unsigned char *buf,
 		const struct v4l2_format *fmt, int starts_with_green)
 {
-	int x, y, a1 = 0, a2 = 0, b1 = 0, b2 = 0;
-	int green_avg, comp1_avg, comp2_avg;
-
-	for (y = 0; (unsigned)y < fmt->fmt.pix.height; y += 2) {
-		for (x = 0; (unsigned)x < fmt->fmt.pix.width; x += 2) {
-			a1 += *buf++;
-			a2 += *buf++;
-		}
-		buf += fmt->fmt.pix.bytesperline - fmt->fmt.pix.width;
-		for (x = 0; (unsigned)x < fmt->fmt.pix.width; x += 2) {
-			b1 += *buf++;
-			b2 += *buf++;
-		}
-		buf += fmt->fmt.pix.bytesperline - fmt->fmt.pix.width;
-	}
+	unsigned long long a[2] = { 0, 0 }, b[2] = { 0, 0 };
+	int green_avg, comp1_avg, comp2_avg, pairs, norm;
+	int width = fmt->fmt.pix.width & ~1;
+	int stride = fmt->fmt.pix.bytesperline;
+
+	/* Only every stats_step-th line pair is sampled */
+	pairs = v4lprocessing_stats_lines(data, fmt->fmt.pix.height / 2);
+	v4lprocessing_sum_lines(buf, width, pairs,
+			2 * data->stats_step * stride, 2, a);
+	v4lprocessing_sum_lines(buf + stride, width, pairs,
+			2 * data->stats_step * stride, 2, b);
 
 	if (starts_with_green) {
-		green_avg = a1 / 2 + b2 / 2;
-		comp1_avg = a2;
-		comp2_avg = b1;
+		green_avg = a[0] / 2 + b[1] / 2;
+		comp1_avg = a[1];
+		comp2_avg = b[0];
 	} else {
-		green_avg = a2 / 2 + b1 / 2;
-		comp1_avg = a1;
-		comp2_avg = b2;
+		green_avg = a[1] / 2 + b[0] / 2;
+		comp1_avg = a[0];
+		comp2_avg = b[1];
 	}
 
 	/* Norm avg to ~ 0 - 4095 */
-	green_avg /= fmt->fmt.pix.width * fmt->fmt.pix.height / 64;
-	comp1_avg /= fmt->fmt.pix.width * fmt->fmt.pix.height / 64;
-	comp2_avg /= fmt->fmt.pix.width * fmt->fmt.pix.height / 64;
+	norm = width * pairs * 2 / 64;
+	if (norm == 0)
+		return 0;
+	green_avg /= norm;
+	comp1_avg /= norm;
+	comp2_avg /= norm;
 
 	return whitebalance_calculate_lookup_tables_generic(data, green_avg,
 			comp1_avg, comp2_avg);
@@ -162,26 +173,61 @@ static int whitebalance_calculate_lookup_tables_rgb(
 		struct v4lprocessing_data *data, unsigned char *buf,
 		const struct v4l2_format *fmt)
 {
-	int x, y, green_avg = 0, comp1_avg = 0, comp2_avg = 0;
-
-	for (y = 0; (unsigned)y < fmt->fmt.pix.height; y++) {
-		for (x = 0; (unsigned)x < fmt->fmt.pix.width; x++) {
-			comp1_avg += *buf++;
-			green_avg += *buf++;
-			comp2_avg += *buf++;
-		}
-		buf += fmt->fmt.pix.bytesperline - fmt->fmt.pix.width * 3;
-	}
+	unsigned long long sum[3] = { 0, 0, 0 };
+	int green_avg, comp1_avg, comp2_avg, lines, norm;
+
+	lines = v4lprocessing_stats_lines(data, fmt->fmt.pix.height);
+	v4lprocessing_sum_lines(buf, fmt->fmt.pix.width * 3, lines,
+			data->stats_step * fmt->fmt.pix.bytesperline, 3, sum);
 
 	/* Norm avg to ~ 0 - 4095 */
-	green_avg /= fmt->fmt.pix.width * fmt->fmt.pix.height / 16;
-	comp1_avg /= fmt->fmt.pix.width * fmt->fmt.pix.height / 16;
-	comp2_avg /= fmt->fmt.pix.width * fmt->fmt.pix.height / 16;
+	norm = fmt->fmt.pix.width * lines / 16;
+	if (norm == 0)
+		return 0;
+	comp1_avg = sum[0] / norm;
+	green_avg = sum[1] / norm;
+	comp2_avg = sum[2] / norm;
 
 	return whitebalance_calculate_lookup_tables_generic(data, green_avg,
 			comp1_avg, comp2_avg);
 }
 
+/* Gray world in yuv: the averages of the frame are taken as rgb, like for the
+   other formats, but the correction is done by shifting u and v by the
+   chroma of the averages, rather than by scaling r, g and b */
+static int whitebalance_calculate_lookup_tables_yuv(
+		struct v4lprocessing_data *data, unsigned char *buf,
+		const struct v4l2_format *fmt)
+{
+	int i, avg[3], u_cast, v_cast, green_avg, comp1_avg, comp2_avg;
+
+	v4lprocessing_yuv_averages(data, buf, fmt, 0, 0, fmt->fmt.pix.width & ~1,
+			fmt->fmt.pix.height & ~1, avg);
+
+	/* The averages are normed to ~ 0 - 4095, so 2048 is 128 */
+	comp1_avg = avg[0] + (avg[2] - 2048) * 1436 / 1024;
+	green_avg = avg[0] - ((avg[1] - 2048) * 352 +
+			(avg[2] - 2048) * 731) / 1024;
+	comp2_avg = avg[0] + (avg[1] - 2048) * 1814 / 1024;
+
+	if (!whitebalance_calculate_averages(data, green_avg, comp1_avg,
+				comp2_avg))
+		return 0;
+
+	u_cast = (-2765 * data->comp1_avg - 5428 * data->green_avg +
+			8192 * data->comp2_avg) / (16384 * 16);
+	v_cast = (8192 * data->comp1_avg - 6860 * data->green_avg -
+			1332 * data->comp2_avg) / (16384 * 16);
+	if (u_cast == 0 && v_cast == 0)
+		return 0;
+
+	for (i = 0; i < 256; i++) {
+		data->green[i] = CLIP256(data->green[i] - u_cast);
+		data->comp2[i] = CLIP256(data->comp2[i] - v_cast);
+	}
+
+	return 1;
+}
 
 static int whitebalance_calculate_lookup_tables(
 		struct v4lprocessing_data *data,
@@ -199,6 +245,14 @@ static int whitebalance_calculate_lookup_tables(
 	case V4L2_PIX_FMT_RGB24:
 	case V4L2_PIX_FMT_BGR24:
 		return whitebalance_calculate_lookup_tables_rgb(data, buf, fmt);
+
+	case V4L2_PIX_FMT_YUYV:
+	case V4L2_PIX_FMT_YVYU:
+	case V4L2_PIX_FMT_UYVY:
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_NV12:
+		return whitebalance_calculate_lookup_tables_yuv(data, buf, fmt);
 	}
 
 	return 0; /* Should never happen */
@@ -23,6 +23,7 @@
 
 #include <string.h>
 #include "libv4lconvert-priv.h"
+#include "libv4lsimd-priv.h"
 
 #define RGB2Y(r, g, b, y) \
 	(y) = ((8453 * (r) + 16594 * (g) + 3223 * (b) + 524288) >> 15)
@@ -91,6 +92,955 @@ void v4lconvert_rgb24_to_yuv420(const unsigned char *src, unsigned char *dest,
 
 #define CLIP(color) (unsigned char)(((color) > 0xFF) ? 0xff : (((color) < 0) ? 0 : (color)))
 
+/* Byte layouts of the packed yuv 4:2:2 formats */
+#define YUV422_YUYV 0
+#define YUV422_YVYU 1
+#define YUV422_UYVY 2
+
+/* SIMD row kernels, selected once by v4lconvert_rgbyuv_init(). These return
+   the number of pixels of the line they have converted, the scalar code takes
+   care of the remainder. The scalar code is the reference, the kernels must
+   produce bit exact identical results. */
+static struct {
+	int (*yuv422_to_rgb24)(const unsigned char *src, unsigned char *dest,
+			int width, int layout, int bgr);
+	int (*yuv422_to_y)(const unsigned char *src, unsigned char *dest,
+			int width, int layout);
+	int (*yuv422_to_uv)(const unsigned char *src, const unsigned char *src1,
+			unsigned char *udest, unsigned char *vdest, int width,
+			int layout);
+	int (*yuv422_to_nv12_uv)(const unsigned char *src,
+			const unsigned char *src1, unsigned char *uvdest,
+			int width, int layout);
+	/* These return the number of u / v pairs done */
+	int (*merge_uv)(const unsigned char *u, const unsigned char *v,
+			unsigned char *uv, int n);
+	int (*split_uv)(const unsigned char *uv, unsigned char *u,
+			unsigned char *v, int n);
+	/* These return the number of pixels done, writing each pixel's 8 msb
+	   to 1 (grey) or 3 (rgb24) bytes of dest, as given by bpp */
+	int (*y16_to_grey)(const unsigned char *src, unsigned char *dest,
+			int n, int bpp, int little_endian);
+	int (*y10b_to_grey)(const unsigned char *src, unsigned char *dest,
+			int n, int bpp);
+} rgbyuv_simd;
+
+#ifdef V4LCONVERT_HAVE_NEON
+/* Same math as the "fast slightly less accurate" scalar code:
+   r = y + v1, g = y - rg, b = y + u1 */
+static V4LCONVERT_ALWAYS_INLINE void uv_terms_neon(uint8x8_t u, uint8x8_t v,
+		int16x8_t *u1, int16x8_t *rg, int16x8_t *v1)
+{
+	int16x8_t du = vreinterpretq_s16_u16(vsubl_u8(u, vdup_n_u8(128)));
+	int16x8_t dv = vreinterpretq_s16_u16(vsubl_u8(v, vdup_n_u8(128)));
+
+	*u1 = vshrq_n_s16(vmulq_n_s16(du, 129), 6);
+	*rg = vshrq_n_s16(vaddq_s16(vmulq_n_s16(du, 3), vmulq_n_s16(dv, 6)), 3);
+	*v1 = vshrq_n_s16(vmulq_n_s16(dv, 3), 1);
+}
+
+static V4LCONVERT_ALWAYS_INLINE void yuv_to_rgb_neon(uint8x8_t y,
+		int16x8_t u1, int16x8_t rg, int16x8_t v1,
+		uint8x8_t *r, uint8x8_t *g, uint8x8_t *b)
+{
+	int16x8_t yw = vreinterpretq_s16_u16(vmovl_u8(y));
+
+	*r = vqmovun_s16(vaddq_s16(yw, v1));
+	*g = vqmovun_s16(vsubq_s16(yw, rg));
+	*b = vqmovun_s16(vaddq_s16(yw, u1));
+}
+
+/* 32 pixels per iteration, vld4 splits them into even y, u, odd y, v */
+static V4LCONVERT_ALWAYS_INLINE int yuv422_to_rgb24_neon_body(
+		const unsigned char *src, unsigned char *dest, int width,
+		int layout, int bgr)
+{
+	const int y0i = layout == YUV422_UYVY ? 1 : 0;
+	const int y1i = y0i + 2;
+	const int ui = layout == YUV422_YUYV ? 1 :
+		       layout == YUV422_YVYU ? 3 : 0;
+	const int vi = layout == YUV422_YUYV ? 3 :
+		       layout == YUV422_YVYU ? 1 : 2;
+	int j, h;
+
+	for (j = 0; j + 32 <= width; j += 32) {
+		uint8x16x4_t in = vld4q_u8(src);
+		uint8x8_t r0[2], g0[2], b0[2], r1[2], g1[2], b1[2];
+		uint8x16x2_t r, g, b;
+		uint8x16x3_t out;
+		int16x8_t u1, rg, v1;
+
+		for (h = 0; h < 2; h++) {
+			uint8x8_t u = h ? vget_high_u8(in.val[ui]) :
+					  vget_low_u8(in.val[ui]);
+			uint8x8_t v = h ? vget_high_u8(in.val[vi]) :
+					  vget_low_u8(in.val[vi]);
+			uint8x8_t y0 = h ? vget_high_u8(in.val[y0i]) :
+					   vget_low_u8(in.val[y0i]);
+			uint8x8_t y1 = h ? vget_high_u8(in.val[y1i]) :
+					   vget_low_u8(in.val[y1i]);
+
+			uv_terms_neon(u, v, &u1, &rg, &v1);
+			yuv_to_rgb_neon(y0, u1, rg, v1, &r0[h], &g0[h], &b0[h]);
+			yuv_to_rgb_neon(y1, u1, rg, v1, &r1[h], &g1[h], &b1[h]);
+		}
+
+		/* Back from even / odd to pixel order */
+		r = vzipq_u8(vcombine_u8(r0[0], r0[1]), vcombine_u8(r1[0], r1[1]));
+		g = vzipq_u8(vcombine_u8(g0[0], g0[1]), vcombine_u8(g1[0], g1[1]));
+		b = vzipq_u8(vcombine_u8(b0[0], b0[1]), vcombine_u8(b1[0], b1[1]));
+
+		for (h = 0; h < 2; h++) {
+			out.val[0] = bgr ? b.val[h] : r.val[h];
+			out.val[1] = g.val[h];
+			out.val[2] = bgr ? r.val[h] : b.val[h];
+			vst3q_u8(dest + h * 48, out);
+		}
+		src += 64;
+		dest += 96;
+	}
+	return j;
+}
+
+static int yuv422_to_rgb24_neon(const unsigned char *src, unsigned char *dest,
+		int width, int layout, int bgr)
+{
+	switch (layout) {
+	case YUV422_YUYV:
+		return bgr ?
+			yuv422_to_rgb24_neon_body(src, dest, width, YUV422_YUYV, 1) :
+			yuv422_to_rgb24_neon_body(src, dest, width, YUV422_YUYV, 0);
+	case YUV422_YVYU:
+		return bgr ?
+			yuv422_to_rgb24_neon_body(src, dest, width, YUV422_YVYU, 1) :
+			yuv422_to_rgb24_neon_body(src, dest, width, YUV422_YVYU, 0);
+	default:
+		return bgr ?
+			yuv422_to_rgb24_neon_body(src, dest, width, YUV422_UYVY, 1) :
+			yuv422_to_rgb24_neon_body(src, dest, width, YUV422_UYVY, 0);
+	}
+}
+
+static int yuv422_to_y_neon(const unsigned char *src, unsigned char *dest,
+		int width, int layout)
+{
+	const int y0i = layout == YUV422_UYVY ? 1 : 0;
+	int j;
+
+	for (j = 0; j + 32 <= width; j += 32) {
+		uint8x16x4_t in = vld4q_u8(src);
+		uint8x16x2_t out;
+
+		out.val[0] = in.val[y0i];
+		out.val[1] = in.val[y0i + 2];
+		vst2q_u8(dest, out);
+		src += 64;
+		dest += 32;
+	}
+	return j;
+}
+
+static int yuv422_to_uv_neon(const unsigned char *src,
+		const unsigned char *src1, unsigned char *udest,
+		unsigned char *vdest, int width, int layout)
+{
+	const int ui = layout == YUV422_UYVY ? 0 : 1;
+	int j;
+
+	for (j = 0; j + 32 <= width; j += 32) {
+		uint8x16x4_t in = vld4q_u8(src);
+		uint8x16x4_t in1 = vld4q_u8(src1);
+
+		/* vhadd truncates, just like the scalar / 2 */
+		vst1q_u8(udest, vhaddq_u8(in.val[ui], in1.val[ui]));
+		vst1q_u8(vdest, vhaddq_u8(in.val[ui + 2], in1.val[ui + 2]));
+		src += 64;
+		src1 += 64;
+		udest += 16;
+		vdest += 16;
+	}
+	return j;
+}
+
+static int yuv422_to_nv12_uv_neon(const unsigned char *src,
+		const unsigned char *src1, unsigned char *uvdest, int width,
+		int layout)
+{
+	const int ui = layout == YUV422_YUYV ? 1 :
+		       layout == YUV422_YVYU ? 3 : 0;
+	const int vi = layout == YUV422_YUYV ? 3 :
+		       layout == YUV422_YVYU ? 1 : 2;
+	int j;
+
+	for (j = 0; j + 32 <= width; j += 32) {
+		uint8x16x4_t in = vld4q_u8(src);
+		uint8x16x4_t in1 = vld4q_u8(src1);
+		uint8x16x2_t out;
+
+		out.val[0] = vhaddq_u8(in.val[ui], in1.val[ui]);
+		out.val[1] = vhaddq_u8(in.val[vi], in1.val[vi]);
+		vst2q_u8(uvdest, out);
+		src += 64;
+		src1 += 64;
+		uvdest += 32;
+	}
+	return j;
+}
+
+static int merge_uv_neon(const unsigned char *u, const unsigned char *v,
+		unsigned char *uv, int n)
+{
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		uint8x16x2_t out;
+
+		out.val[0] = vld1q_u8(u + i);
+		out.val[1] = vld1q_u8(v + i);
+		vst2q_u8(uv + 2 * i, out);
+	}
+	return i;
+}
+
+static int split_uv_neon(const unsigned char *uv, unsigned char *u,
+		unsigned char *v, int n)
+{
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		uint8x16x2_t in = vld2q_u8(uv + 2 * i);
+
+		vst1q_u8(u + i, in.val[0]);
+		vst1q_u8(v + i, in.val[1]);
+	}
+	return i;
+}
+
+static V4LCONVERT_ALWAYS_INLINE int y16_to_grey_neon_body(
+		const unsigned char *src, unsigned char *dest, int n, int bpp,
+		int little_endian)
+{
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		uint8x16_t msb = vld2q_u8(src).val[little_endian ? 1 : 0];
+
+		if (bpp == 3) {
+			uint8x16x3_t out = {{ msb, msb, msb }};
+
+			vst3q_u8(dest, out);
+		} else
+			vst1q_u8(dest, msb);
+		src += 32;
+		dest += 16 * bpp;
+	}
+	return i;
+}
+
+static int y16_to_grey_neon(const unsigned char *src, unsigned char *dest,
+		int n, int bpp, int little_endian)
+{
+	if (bpp == 3)
+		return little_endian ?
+			y16_to_grey_neon_body(src, dest, n, 3, 1) :
+			y16_to_grey_neon_body(src, dest, n, 3, 0);
+	return little_endian ?
+		y16_to_grey_neon_body(src, dest, n, 1, 1) :
+		y16_to_grey_neon_body(src, dest, n, 1, 0);
+}
+
+/* 8 pixels from 10 bytes of Y10B, see y10b_to_grey() for the bit layout.
+   Builds the big endian words starting at bytes 0-3 and 5-8 and shifts
+   each pixel's 8 msb into the high byte. Loads 16 bytes. */
+static V4LCONVERT_ALWAYS_INLINE uint8x8_t y10b_unpack8_neon(
+		const unsigned char *src)
+{
+	static const uint8_t hi_idx[8] = { 0, 1, 2, 3, 5, 6, 7, 8 };
+	static const uint8_t lo_idx[8] = { 1, 2, 3, 4, 6, 7, 8, 9 };
+	static const uint16_t mul[8] = { 1, 4, 16, 64, 1, 4, 16, 64 };
+	uint8x16_t in = vld1q_u8(src);
+	uint8x8x2_t tbl = {{ vget_low_u8(in), vget_high_u8(in) }};
+	uint16x8_t w;
+
+	w = vorrq_u16(vshlq_n_u16(vmovl_u8(vtbl2_u8(tbl, vld1_u8(hi_idx))), 8),
+		      vmovl_u8(vtbl2_u8(tbl, vld1_u8(lo_idx))));
+	return vshrn_n_u16(vmulq_u16(w, vld1q_u16(mul)), 8);
+}
+
+static V4LCONVERT_ALWAYS_INLINE int y10b_to_grey_neon_body(
+		const unsigned char *src, unsigned char *dest, int n, int bpp)
+{
+	int i;
+
+	/* We read 6 bytes past the 20 bytes of each 16 pixels */
+	for (i = 0; i + 24 <= n; i += 16) {
+		uint8x16_t msb = vcombine_u8(y10b_unpack8_neon(src),
+					     y10b_unpack8_neon(src + 10));
+
+		if (bpp == 3) {
+			uint8x16x3_t out = {{ msb, msb, msb }};
+
+			vst3q_u8(dest, out);
+		} else
+			vst1q_u8(dest, msb);
+		src += 20;
+		dest += 16 * bpp;
+	}
+	return i;
+}
+
+static int y10b_to_grey_neon(const unsigned char *src, unsigned char *dest,
+		int n, int bpp)
+{
+	return bpp == 3 ? y10b_to_grey_neon_body(src, dest, n, 3) :
+			  y10b_to_grey_neon_body(src, dest, n, 1);
+}
+#endif
+
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+/* Split 8 pixels of packed 4:2:2 data into 16 bit y, u and v, with u and v
+   duplicated for both pixels sharing them */
+static V4LCONVERT_ALWAYS_INLINE V4LCONVERT_SSE2 void yuv422_unpack_sse2(
+		__m128i in, int layout, __m128i *y, __m128i *u, __m128i *v)
+{
+	__m128i lo = _mm_and_si128(in, _mm_set1_epi16(0xff));
+	__m128i hi = _mm_srli_epi16(in, 8);
+	__m128i c = layout == YUV422_UYVY ? lo : hi;
+	__m128i c0 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c,
+				_MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 2, 0, 0));
+	__m128i c1 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c,
+				_MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+
+	*y = layout == YUV422_UYVY ? hi : lo;
+	*u = layout == YUV422_YVYU ? c1 : c0;
+	*v = layout == YUV422_YVYU ? c0 : c1;
+}
+
+static V4LCONVERT_ALWAYS_INLINE V4LCONVERT_SSE2 void yuv_to_rgb_sse2(
+		__m128i y, __m128i u, __m128i v,
+		__m128i *r, __m128i *g, __m128i *b)
+{
+	__m128i du = _mm_sub_epi16(u, _mm_set1_epi16(128));
+	__m128i dv = _mm_sub_epi16(v, _mm_set1_epi16(128));
+	__m128i u1 = _mm_srai_epi16(_mm_mullo_epi16(du, _mm_set1_epi16(129)), 6);
+	__m128i rg = _mm_srai_epi16(_mm_add_epi16(
+				_mm_mullo_epi16(du, _mm_set1_epi16(3)),
+				_mm_mullo_epi16(dv, _mm_set1_epi16(6))), 3);
+	__m128i v1 = _mm_srai_epi16(_mm_mullo_epi16(dv, _mm_set1_epi16(3)), 1);
+
+	*r = _mm_add_epi16(y, v1);
+	*g = _mm_sub_epi16(y, rg);
+	*b = _mm_add_epi16(y, u1);
+}
+
+static V4LCONVERT_ALWAYS_INLINE V4LCONVERT_SSE2 int yuv422_to_rgb24_sse2_body(
+		const unsigned char *src, unsigned char *dest, int width,
+		int layout, int bgr)
+{
+	int i, j;
+
+	for (j = 0; j + 16 <= width; j += 16) {
+		__m128i y, u, v, r[2], g[2], b[2], r8, g8, b8;
+
+		for (i = 0; i < 2; i++) {
+			yuv422_unpack_sse2(_mm_loadu_si128(
+					(const __m128i *)(src + 16 * i)),
+					layout, &y, &u, &v);
+			yuv_to_rgb_sse2(y, u, v, &r[i], &g[i], &b[i]);
+		}
+		/* packus does the clamping */
+		r8 = _mm_packus_epi16(r[0], r[1]);
+		g8 = _mm_packus_epi16(g[0], g[1]);
+		b8 = _mm_packus_epi16(b[0], b[1]);
+		if (bgr)
+			v4lconvert_store_rgb24_sse2(dest, b8, g8, r8);
+		else
+			v4lconvert_store_rgb24_sse2(dest, r8, g8, b8);
+		src += 32;
+		dest += 48;
+	}
+	return j;
+}
+
+static V4LCONVERT_SSE2 int yuv422_to_rgb24_sse2(const unsigned char *src,
+		unsigned char *dest, int width, int layout, int bgr)
+{
+	switch (layout) {
+	case YUV422_YUYV:
+		return bgr ?
+			yuv422_to_rgb24_sse2_body(src, dest, width, YUV422_YUYV, 1) :
+			yuv422_to_rgb24_sse2_body(src, dest, width, YUV422_YUYV, 0);
+	case YUV422_YVYU:
+		return bgr ?
+			yuv422_to_rgb24_sse2_body(src, dest, width, YUV422_YVYU, 1) :
+			yuv422_to_rgb24_sse2_body(src, dest, width, YUV422_YVYU, 0);
+	default:
+		return bgr ?
+			yuv422_to_rgb24_sse2_body(src, dest, width, YUV422_UYVY, 1) :
+			yuv422_to_rgb24_sse2_body(src, dest, width, YUV422_UYVY, 0);
+	}
+}
+
+static V4LCONVERT_SSE2 int yuv422_to_y_sse2(const unsigned char *src,
+		unsigned char *dest, int width, int layout)
+{
+	__m128i mask = _mm_set1_epi16(0xff);
+	__m128i lo, hi;
+	int j;
+
+	for (j = 0; j + 16 <= width; j += 16) {
+		lo = _mm_loadu_si128((const __m128i *)src);
+		hi = _mm_loadu_si128((const __m128i *)(src + 16));
+		if (layout == YUV422_UYVY) {
+			lo = _mm_srli_epi16(lo, 8);
+			hi = _mm_srli_epi16(hi, 8);
+		} else {
+			lo = _mm_and_si128(lo, mask);
+			hi = _mm_and_si128(hi, mask);
+		}
+		_mm_storeu_si128((__m128i *)dest, _mm_packus_epi16(lo, hi));
+		src += 32;
+		dest += 16;
+	}
+	return j;
+}
+
+static V4LCONVERT_SSE2 int yuv422_to_uv_sse2(const unsigned char *src,
+		const unsigned char *src1, unsigned char *udest,
+		unsigned char *vdest, int width, int layout)
+{
+	__m128i mask = _mm_set1_epi32(0xffff);
+	__m128i c[2], u, v;
+	int i, j;
+
+	for (j = 0; j + 16 <= width; j += 16) {
+		for (i = 0; i < 2; i++) {
+			c[i] = v4lconvert_avg_floor_epu8(
+				_mm_loadu_si128((const __m128i *)(src + 16 * i)),
+				_mm_loadu_si128((const __m128i *)(src1 + 16 * i)));
+			/* Keep only the chroma bytes: u0 v0 u1 v1 ... */
+			if (layout == YUV422_UYVY)
+				c[i] = _mm_and_si128(c[i], _mm_set1_epi16(0xff));
+			else
+				c[i] = _mm_srli_epi16(c[i], 8);
+		}
+		u = _mm_packs_epi32(_mm_and_si128(c[0], mask),
+				    _mm_and_si128(c[1], mask));
+		v = _mm_packs_epi32(_mm_srli_epi32(c[0], 16),
+				    _mm_srli_epi32(c[1], 16));
+		_mm_storel_epi64((__m128i *)udest, _mm_packus_epi16(u, u));
+		_mm_storel_epi64((__m128i *)vdest, _mm_packus_epi16(v, v));
+		src += 32;
+		src1 += 32;
+		udest += 8;
+		vdest += 8;
+	}
+	return j;
+}
+
+/* The chroma bytes of yuyv already are in nv12 order, for yvyu each u / v
+   word pair gets swapped */
+static V4LCONVERT_SSE2 int yuv422_to_nv12_uv_sse2(const unsigned char *src,
+		const unsigned char *src1, unsigned char *uvdest, int width,
+		int layout)
+{
+	__m128i c[2];
+	int i, j;
+
+	for (j = 0; j + 16 <= width; j += 16) {
+		for (i = 0; i < 2; i++) {
+			c[i] = v4lconvert_avg_floor_epu8(
+				_mm_loadu_si128((const __m128i *)(src + 16 * i)),
+				_mm_loadu_si128((const __m128i *)(src1 + 16 * i)));
+			if (layout == YUV422_UYVY)
+				c[i] = _mm_and_si128(c[i], _mm_set1_epi16(0xff));
+			else
+				c[i] = _mm_srli_epi16(c[i], 8);
+			if (layout == YUV422_YVYU)
+				c[i] = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c[i],
+					_MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+		}
+		_mm_storeu_si128((__m128i *)uvdest, _mm_packus_epi16(c[0], c[1]));
+		src += 32;
+		src1 += 32;
+		uvdest += 16;
+	}
+	return j;
+}
+
+static V4LCONVERT_SSE2 int merge_uv_sse2(const unsigned char *u,
+		const unsigned char *v, unsigned char *uv, int n)
+{
+	__m128i a, b;
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		a = _mm_loadu_si128((const __m128i *)(u + i));
+		b = _mm_loadu_si128((const __m128i *)(v + i));
+		_mm_storeu_si128((__m128i *)(uv + 2 * i), _mm_unpacklo_epi8(a, b));
+		_mm_storeu_si128((__m128i *)(uv + 2 * i + 16),
+				 _mm_unpackhi_epi8(a, b));
+	}
+	return i;
+}
+
+static V4LCONVERT_SSE2 int split_uv_sse2(const unsigned char *uv,
+		unsigned char *u, unsigned char *v, int n)
+{
+	__m128i mask = _mm_set1_epi16(0xff);
+	__m128i lo, hi;
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		lo = _mm_loadu_si128((const __m128i *)(uv + 2 * i));
+		hi = _mm_loadu_si128((const __m128i *)(uv + 2 * i + 16));
+		_mm_storeu_si128((__m128i *)(u + i), _mm_packus_epi16(
+				_mm_and_si128(lo, mask), _mm_and_si128(hi, mask)));
+		_mm_storeu_si128((__m128i *)(v + i), _mm_packus_epi16(
+				_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+	}
+	return i;
+}
+
+static V4LCONVERT_ALWAYS_INLINE V4LCONVERT_SSE2 void store_grey_sse2(
+		unsigned char *dest, __m128i msb, int bpp)
+{
+	unsigned char grey[16];
+	int i;
+
+	if (bpp == 3) {
+		_mm_storeu_si128((__m128i *)grey, msb);
+		for (i = 0; i < 16; i++)
+			dest[3 * i] = dest[3 * i + 1] = dest[3 * i + 2] = grey[i];
+	} else
+		_mm_storeu_si128((__m128i *)dest, msb);
+}
+
+static V4LCONVERT_ALWAYS_INLINE V4LCONVERT_SSE2 int y16_to_grey_sse2_body(
+		const unsigned char *src, unsigned char *dest, int n, int bpp,
+		int little_endian)
+{
+	__m128i lo, hi;
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		lo = _mm_loadu_si128((const __m128i *)src);
+		hi = _mm_loadu_si128((const __m128i *)(src + 16));
+		if (little_endian) {
+			lo = _mm_srli_epi16(lo, 8);
+			hi = _mm_srli_epi16(hi, 8);
+		} else {
+			lo = _mm_and_si128(lo, _mm_set1_epi16(0xff));
+			hi = _mm_and_si128(hi, _mm_set1_epi16(0xff));
+		}
+		store_grey_sse2(dest, _mm_packus_epi16(lo, hi), bpp);
+		src += 32;
+		dest += 16 * bpp;
+	}
+	return i;
+}
+
+static V4LCONVERT_SSE2 int y16_to_grey_sse2(const unsigned char *src,
+		unsigned char *dest, int n, int bpp, int little_endian)
+{
+	if (bpp == 3)
+		return little_endian ?
+			y16_to_grey_sse2_body(src, dest, n, 3, 1) :
+			y16_to_grey_sse2_body(src, dest, n, 3, 0);
+	return little_endian ?
+		y16_to_grey_sse2_body(src, dest, n, 1, 1) :
+		y16_to_grey_sse2_body(src, dest, n, 1, 0);
+}
+
+/* 8 pixels from 10 bytes of Y10B, see y10b_to_grey() for the bit layout.
+   Builds the big endian words starting at bytes 0-3 and 5-8 and shifts
+   each pixel's 8 msb into the high byte, the result is in the low byte of
+   each 16 bit lane. Loads 16 bytes. */
+static V4LCONVERT_ALWAYS_INLINE V4LCONVERT_SSE2 __m128i y10b_unpack8_sse2(
+		const unsigned char *src)
+{
+	__m128i in = _mm_loadu_si128((const __m128i *)src);
+	__m128i w0 = _mm_unpacklo_epi8(_mm_srli_si128(in, 1), in);
+	__m128i w5 = _mm_unpacklo_epi8(_mm_srli_si128(in, 6),
+				       _mm_srli_si128(in, 5));
+	__m128i w = _mm_unpacklo_epi64(w0, w5);
+
+	w = _mm_mullo_epi16(w, _mm_setr_epi16(1, 4, 16, 64, 1, 4, 16, 64));
+	return _mm_srli_epi16(w, 8);
+}
+
+static V4LCONVERT_ALWAYS_INLINE V4LCONVERT_SSE2 int y10b_to_grey_sse2_body(
+		const unsigned char *src, unsigned char *dest, int n, int bpp)
+{
+	int i;
+
+	/* We read 6 bytes past the 20 bytes of each 16 pixels */
+	for (i = 0; i + 24 <= n; i += 16) {
+		store_grey_sse2(dest, _mm_packus_epi16(y10b_unpack8_sse2(src),
+				y10b_unpack8_sse2(src + 10)), bpp);
+		src += 20;
+		dest += 16 * bpp;
+	}
+	return i;
+}
+
+static V4LCONVERT_SSE2 int y10b_to_grey_sse2(const unsigned char *src,
+		unsigned char *dest, int n, int bpp)
+{
+	return bpp == 3 ? y10b_to_grey_sse2_body(src, dest, n, 3) :
+			  y10b_to_grey_sse2_body(src, dest, n, 1);
+}
+
+static V4LCONVERT_ALWAYS_INLINE V4LCONVERT_AVX2 void yuv422_unpack_avx2(
+		__m256i in, int layout, __m256i *y, __m256i *u, __m256i *v)
+{
+	__m256i lo = _mm256_and_si256(in, _mm256_set1_epi16(0xff));
+	__m256i hi = _mm256_srli_epi16(in, 8);
+	__m256i c = layout == YUV422_UYVY ? lo : hi;
+	__m256i c0 = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(c,
+				_MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 2, 0, 0));
+	__m256i c1 = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(c,
+				_MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+
+	*y = layout == YUV422_UYVY ? hi : lo;
+	*u = layout == YUV422_YVYU ? c1 : c0;
+	*v = layout == YUV422_YVYU ? c0 : c1;
+}
+
+static V4LCONVERT_ALWAYS_INLINE V4LCONVERT_AVX2 void yuv_to_rgb_avx2(
+		__m256i y, __m256i u, __m256i v,
+		__m256i *r, __m256i *g, __m256i *b)
+{
+	__m256i du = _mm256_sub_epi16(u, _mm256_set1_epi16(128));
+	__m256i dv = _mm256_sub_epi16(v, _mm256_set1_epi16(128));
+	__m256i u1 = _mm256_srai_epi16(
+			_mm256_mullo_epi16(du, _mm256_set1_epi16(129)), 6);
+	__m256i rg = _mm256_srai_epi16(_mm256_add_epi16(
+			_mm256_mullo_epi16(du, _mm256_set1_epi16(3)),
+			_mm256_mullo_epi16(dv, _mm256_set1_epi16(6))), 3);
+	__m256i v1 = _mm256_srai_epi16(
+			_mm256_mullo_epi16(dv, _mm256_set1_epi16(3)), 1);
+
+	*r = _mm256_add_epi16(y, v1);
+	*g = _mm256_sub_epi16(y, rg);
+	*b = _mm256_add_epi16(y, u1);
+}
+
+static V4LCONVERT_ALWAYS_INLINE V4LCONVERT_AVX2 int yuv422_to_rgb24_avx2_body(
+		const unsigned char *src, unsigned char *dest, int width,
+		int layout, int bgr)
+{
+	int i, j;
+
+	for (j = 0; j + 32 <= width; j += 32) {
+		__m256i y, u, v, r[2], g[2], b[2], r8, g8, b8;
+
+		for (i = 0; i < 2; i++) {
+			yuv422_unpack_avx2(_mm256_loadu_si256(
+					(const __m256i *)(src + 32 * i)),
+					layout, &y, &u, &v);
+			yuv_to_rgb_avx2(y, u, v, &r[i], &g[i], &b[i]);
+		}
+		r8 = v4lconvert_packus_epi16_avx2(r[0], r[1]);
+		g8 = v4lconvert_packus_epi16_avx2(g[0], g[1]);
+		b8 = v4lconvert_packus_epi16_avx2(b[0], b[1]);
+		if (bgr)
+			v4lconvert_store_rgb24_avx2(dest, b8, g8, r8);
+		else
+			v4lconvert_store_rgb24_avx2(dest, r8, g8, b8);
+		src += 64;
+		dest += 96;
+	}
+	return j;
+}
+
+static V4LCONVERT_AVX2 int yuv422_to_rgb24_avx2(const unsigned char *src,
+		unsigned char *dest, int width, int layout, int bgr)
+{
+	switch (layout) {
+	case YUV422_YUYV:
+		return bgr ?
+			yuv422_to_rgb24_avx2_body(src, dest, width, YUV422_YUYV, 1) :
+			yuv422_to_rgb24_avx2_body(src, dest, width, YUV422_YUYV, 0);
+	case YUV422_YVYU:
+		return bgr ?
+			yuv422_to_rgb24_avx2_body(src, dest, width, YUV422_YVYU, 1) :
+			yuv422_to_rgb24_avx2_body(src, dest, width, YUV422_YVYU, 0);
+	default:
+		return bgr ?
+			yuv422_to_rgb24_avx2_body(src, dest, width, YUV422_UYVY, 1) :
+			yuv422_to_rgb24_avx2_body(src, dest, width, YUV422_UYVY, 0);
+	}
+}
+
+static V4LCONVERT_AVX2 int yuv422_to_y_avx2(const unsigned char *src,
+		unsigned char *dest, int width, int layout)
+{
+	__m256i mask = _mm256_set1_epi16(0xff);
+	__m256i lo, hi;
+	int j;
+
+	for (j = 0; j + 32 <= width; j += 32) {
+		lo = _mm256_loadu_si256((const __m256i *)src);
+		hi = _mm256_loadu_si256((const __m256i *)(src + 32));
+		if (layout == YUV422_UYVY) {
+			lo = _mm256_srli_epi16(lo, 8);
+			hi = _mm256_srli_epi16(hi, 8);
+		} else {
+			lo = _mm256_and_si256(lo, mask);
+			hi = _mm256_and_si256(hi, mask);
+		}
+		_mm256_storeu_si256((__m256i *)dest,
+				v4lconvert_packus_epi16_avx2(lo, hi));
+		src += 64;
+		dest += 32;
+	}
+	return j;
+}
+
+static V4LCONVERT_AVX2 int yuv422_to_uv_avx2(const unsigned char *src,
+		const unsigned char *src1, unsigned char *udest,
+		unsigned char *vdest, int width, int layout)
+{
+	__m256i mask = _mm256_set1_epi32(0xffff);
+	__m256i c[2], u, v;
+	int i, j;
+
+	for (j = 0; j + 32 <= width; j += 32) {
+		for (i = 0; i < 2; i++) {
+			c[i] = v4lconvert_avg_floor_epu8_avx2(
+				_mm256_loadu_si256((const __m256i *)(src + 32 * i)),
+				_mm256_loadu_si256((const __m256i *)(src1 + 32 * i)));
+			if (layout == YUV422_UYVY)
+				c[i] = _mm256_and_si256(c[i],
+						_mm256_set1_epi16(0xff));
+			else
+				c[i] = _mm256_srli_epi16(c[i], 8);
+		}
+		u = _mm256_permute4x64_epi64(_mm256_packs_epi32(
+				_mm256_and_si256(c[0], mask),
+				_mm256_and_si256(c[1], mask)),
+				_MM_SHUFFLE(3, 1, 2, 0));
+		v = _mm256_permute4x64_epi64(_mm256_packs_epi32(
+				_mm256_srli_epi32(c[0], 16),
+				_mm256_srli_epi32(c[1], 16)),
+				_MM_SHUFFLE(3, 1, 2, 0));
+		_mm_storeu_si128((__m128i *)udest,
+				_mm_packus_epi16(_mm256_castsi256_si128(u),
+						 _mm256_extracti128_si256(u, 1)));
+		_mm_storeu_si128((__m128i *)vdest,
+				_mm_packus_epi16(_mm256_castsi256_si128(v),
+						 _mm256_extracti128_si256(v, 1)));
+		src += 64;
+		src1 += 64;
+		udest += 16;
+		vdest += 16;
+	}
+	return j;
+}
+
+static V4LCONVERT_AVX2 int yuv422_to_nv12_uv_avx2(const unsigned char *src,
+		const unsigned char *src1, unsigned char *uvdest, int width,
+		int layout)
+{
+	__m256i c[2];
+	int i, j;
+
+	for (j = 0; j + 32 <= width; j += 32) {
+		for (i = 0; i < 2; i++) {
+			c[i] = v4lconvert_avg_floor_epu8_avx2(
+				_mm256_loadu_si256((const __m256i *)(src + 32 * i)),
+				_mm256_loadu_si256((const __m256i *)(src1 + 32 * i)));
+			if (layout == YUV422_UYVY)
+				c[i] = _mm256_and_si256(c[i],
+						_mm256_set1_epi16(0xff));
+			else
+				c[i] = _mm256_srli_epi16(c[i], 8);
+			if (layout == YUV422_YVYU)
+				c[i] = _mm256_shufflehi_epi16(
+					_mm256_shufflelo_epi16(c[i],
+						_MM_SHUFFLE(2, 3, 0, 1)),
+					_MM_SHUFFLE(2, 3, 0, 1));
+		}
+		_mm256_storeu_si256((__m256i *)uvdest,
+				v4lconvert_packus_epi16_avx2(c[0], c[1]));
+		src += 64;
+		src1 += 64;
+		uvdest += 32;
+	}
+	return j;
+}
+
+/* Only rgb24 benefits from AVX2, as it can use the pshufb based rgb24 store */
+static V4LCONVERT_ALWAYS_INLINE V4LCONVERT_AVX2 int y16_to_rgb24_avx2_body(
+		const unsigned char *src, unsigned char *dest, int n,
+		int little_endian)
+{
+	__m256i lo, hi, msb;
+	int i;
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		lo = _mm256_loadu_si256((const __m256i *)src);
+		hi = _mm256_loadu_si256((const __m256i *)(src + 32));
+		if (little_endian) {
+			lo = _mm256_srli_epi16(lo, 8);
+			hi = _mm256_srli_epi16(hi, 8);
+		} else {
+			lo = _mm256_and_si256(lo, _mm256_set1_epi16(0xff));
+			hi = _mm256_and_si256(hi, _mm256_set1_epi16(0xff));
+		}
+		msb = v4lconvert_packus_epi16_avx2(lo, hi);
+		v4lconvert_store_rgb24_avx2(dest, msb, msb, msb);
+		src += 64;
+		dest += 96;
+	}
+	return i;
+}
+
+static V4LCONVERT_AVX2 int y16_to_grey_avx2(const unsigned char *src,
+		unsigned char *dest, int n, int bpp, int little_endian)
+{
+	if (bpp == 1)
+		return y16_to_grey_sse2(src, dest, n, bpp, little_endian);
+	return little_endian ? y16_to_rgb24_avx2_body(src, dest, n, 1) :
+			       y16_to_rgb24_avx2_body(src, dest, n, 0);
+}
+
+static V4LCONVERT_AVX2 int y10b_to_grey_avx2(const unsigned char *src,
+		unsigned char *dest, int n, int bpp)
+{
+	__m128i lo, hi;
+	__m256i msb;
+	int i;
+
+	if (bpp == 1)
+		return y10b_to_grey_sse2(src, dest, n, bpp);
+
+	/* We read 6 bytes past the 40 bytes of each 32 pixels */
+	for (i = 0; i + 40 <= n; i += 32) {
+		lo = _mm_packus_epi16(y10b_unpack8_sse2(src),
+				      y10b_unpack8_sse2(src + 10));
+		hi = _mm_packus_epi16(y10b_unpack8_sse2(src + 20),
+				      y10b_unpack8_sse2(src + 30));
+		msb = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+		v4lconvert_store_rgb24_avx2(dest, msb, msb, msb);
+		src += 40;
+		dest += 96;
+	}
+	return i;
+}
+#endif
+
+void v4lconvert_rgbyuv_init(int cpu_flags)
+{
+#ifdef V4LCONVERT_HAVE_NEON
+	if (cpu_flags & V4LCONVERT_CPU_NEON) {
+		rgbyuv_simd.yuv422_to_rgb24 = yuv422_to_rgb24_neon;
+		rgbyuv_simd.yuv422_to_y = yuv422_to_y_neon;
+		rgbyuv_simd.yuv422_to_uv = yuv422_to_uv_neon;
+		rgbyuv_simd.yuv422_to_nv12_uv = yuv422_to_nv12_uv_neon;
+		rgbyuv_simd.merge_uv = merge_uv_neon;
+		rgbyuv_simd.split_uv = split_uv_neon;
+		rgbyuv_simd.y16_to_grey = y16_to_grey_neon;
+		rgbyuv_simd.y10b_to_grey = y10b_to_grey_neon;
+		return;
+	}
+#endif
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+	if (cpu_flags & V4LCONVERT_CPU_AVX2) {
+		rgbyuv_simd.yuv422_to_rgb24 = yuv422_to_rgb24_avx2;
+		rgbyuv_simd.yuv422_to_y = yuv422_to_y_avx2;
+		rgbyuv_simd.yuv422_to_uv = yuv422_to_uv_avx2;
+		rgbyuv_simd.yuv422_to_nv12_uv = yuv422_to_nv12_uv_avx2;
+		/* Interleaving is bound by memory bandwidth, SSE2 will do */
+		rgbyuv_simd.merge_uv = merge_uv_sse2;
+		rgbyuv_simd.split_uv = split_uv_sse2;
+		rgbyuv_simd.y16_to_grey = y16_to_grey_avx2;
+		rgbyuv_simd.y10b_to_grey = y10b_to_grey_avx2;
+		return;
+	}
+	if (cpu_flags & V4LCONVERT_CPU_SSE2) {
+		rgbyuv_simd.yuv422_to_rgb24 = yuv422_to_rgb24_sse2;
+		rgbyuv_simd.yuv422_to_y = yuv422_to_y_sse2;
+		rgbyuv_simd.yuv422_to_uv = yuv422_to_uv_sse2;
+		rgbyuv_simd.yuv422_to_nv12_uv = yuv422_to_nv12_uv_sse2;
+		rgbyuv_simd.merge_uv = merge_uv_sse2;
+		rgbyuv_simd.split_uv = split_uv_sse2;
+		rgbyuv_simd.y16_to_grey = y16_to_grey_sse2;
+		rgbyuv_simd.y10b_to_grey = y10b_to_grey_sse2;
+		return;
+	}
+#endif
+}
+
+/* Helpers calling the SIMD row kernels if we have them, these return the
+   number of pixels done and advance the passed in pointers accordingly */
+static inline int yuv422_to_rgb24_simd(const unsigned char **src,
+		unsigned char **dest, int width, int layout, int bgr)
+{
+	int done;
+
+	if (!rgbyuv_simd.yuv422_to_rgb24)
+		return 0;
+
+	done = rgbyuv_simd.yuv422_to_rgb24(*src, *dest, width, layout, bgr);
+	*src += done * 2;
+	*dest += done * 3;
+	return done;
+}
+
+static inline int yuv422_to_y_simd(const unsigned char **src,
+		unsigned char **dest, int width, int layout)
+{
+	int done;
+
+	if (!rgbyuv_simd.yuv422_to_y)
+		return 0;
+
+	done = rgbyuv_simd.yuv422_to_y(*src, *dest, width, layout);
+	*src += done * 2;
+	*dest += done;
+	return done;
+}
+
+/* Note src and src1 point to the first chroma byte of the line, as that is
+   what the scalar code uses */
+static inline int yuv422_to_uv_simd(const unsigned char **src,
+		const unsigned char **src1, unsigned char **udest,
+		unsigned char **vdest, int width, int layout)
+{
+	int done, offset = layout == YUV422_UYVY ? 0 : 1;
+
+	if (!rgbyuv_simd.yuv422_to_uv)
+		return 0;
+
+	done = rgbyuv_simd.yuv422_to_uv(*src - offset, *src1 - offset,
+					*udest, *vdest, width, layout);
+	*src += done * 2;
+	*src1 += done * 2;
+	*udest += done / 2;
+	*vdest += done / 2;
+	return done;
+}
+
+/* Unlike yuv422_to_uv_simd() src and src1 point to the start of the line */
+static inline int yuv422_to_nv12_uv_simd(const unsigned char **src,
+		const unsigned char **src1, unsigned char **uvdest, int width,
+		int layout)
+{
+	int done;
+
+	if (!rgbyuv_simd.yuv422_to_nv12_uv)
+		return 0;
+
+	done = rgbyuv_simd.yuv422_to_nv12_uv(*src, *src1, *uvdest, width,
+					     layout);
+	*src += done * 2;
+	*src1 += done * 2;
+	*uvdest += done;
+	return done;
+}
+
 void v4lconvert_yuv420_to_bgr24(const unsigned char *src, unsigned char *dest,
 		int width, int height, int yvu)
 {
@@ -205,7 +1155,8 @@ void v4lconvert_yuyv_to_bgr24(const unsigned char *src, unsigned char *dest,
 	int j;
 
 	while (--height >= 0) {
-		for (j = 0; j + 1 < width; j += 2) {
+		j = yuv422_to_rgb24_simd(&src, &dest, width, YUV422_YUYV, 1);
+		for (; j + 1 < width; j += 2) {
 			int u = src[1];
 			int v = src[3];
 			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
@@ -232,7 +1183,8 @@ void v4lconvert_yuyv_to_rgb24(const unsigned char *src, unsigned char *dest,
 	int j;
 
 	while (--height >= 0) {
-		for (j = 0; j + 1 < width; j += 2) {
+		j = yuv422_to_rgb24_simd(&src, &dest, width, YUV422_YUYV, 0);
+		for (; j + 1 < width; j += 2) {
 			int u = src[1];
 			int v = src[3];
 			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
@@ -263,7 +1215,8 @@ void v4lconvert_yuyv_to_yuv420(const unsigned char *src, unsigned char *dest,
 	/* copy the Y values */
 	src1 = src;
 	for (i = 0; i < height; i++) {
-		for (j = 0; j + 1 < width; j += 2) {
+		j = yuv422_to_y_simd(&src1, &dest, width, YUV422_YUYV);
+		for (; j + 1 < width; j += 2) {
 			*dest++ = src1[0];
 			*dest++ = src1[2];
 			src1 += 4;
@@ -282,7 +1235,8 @@ void v4lconvert_yuyv_to_yuv420(const unsigned char *src, unsigned char *dest,
 		vdest = dest + width * height / 4;
 	}
 	for (i = 0; i < height; i += 2) {
-		for (j = 0; j + 1 < width; j += 2) {
+		j = yuv422_to_uv_simd(&src, &src1, &udest, &vdest, width, YUV422_YUYV);
+		for (; j + 1 < width; j += 2) {
 			*udest++ = ((int) src[0] + src1[0]) / 2;	/* U */
 			*vdest++ = ((int) src[2] + src1[2]) / 2;	/* V */
 			src += 4;
@@ -300,7 +1254,8 @@ void v4lconvert_yvyu_to_bgr24(const unsigned char *src, unsigned char *dest,
 	int j;
 
 	while (--height >= 0) {
-		for (j = 0; j + 1 < width; j += 2) {
+		j = yuv422_to_rgb24_simd(&src, &dest, width, YUV422_YVYU, 1);
+		for (; j + 1 < width; j += 2) {
 			int u = src[3];
 			int v = src[1];
 			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
@@ -327,7 +1282,8 @@ void v4lconvert_yvyu_to_rgb24(const unsigned char *src, unsigned char *dest,
 	int j;
 
 	while (--height >= 0) {
-		for (j = 0; j + 1 < width; j += 2) {
+		j = yuv422_to_rgb24_simd(&src, &dest, width, YUV422_YVYU, 0);
+		for (; j + 1 < width; j += 2) {
 			int u = src[3];
 			int v = src[1];
 			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
@@ -354,7 +1310,8 @@ void v4lconvert_uyvy_to_bgr24(const unsigned char *src, unsigned char *dest,
 	int j;
 
 	while (--height >= 0) {
-		for (j = 0; j + 1 < width; j += 2) {
+		j = yuv422_to_rgb24_simd(&src, &dest, width, YUV422_UYVY, 1);
+		for (; j + 1 < width; j += 2) {
 			int u = src[0];
 			int v = src[2];
 			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
@@ -381,7 +1338,8 @@ void v4lconvert_uyvy_to_rgb24(const unsigned char *src, unsigned char *dest,
 	int j;
 
 	while (--height >= 0) {
-		for (j = 0; j + 1 < width; j += 2) {
+		j = yuv422_to_rgb24_simd(&src, &dest, width, YUV422_UYVY, 0);
+		for (; j + 1 < width; j += 2) {
 			int u = src[0];
 			int v = src[2];
 			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
@@ -412,7 +1370,8 @@ void v4lconvert_uyvy_to_yuv420(const unsigned char *src, unsigned char *dest,
 	/* copy the Y values */
 	src1 = src;
 	for (i = 0; i < height; i++) {
-		for (j = 0; j + 1 < width; j += 2) {
+		j = yuv422_to_y_simd(&src1, &dest, width, YUV422_UYVY);
+		for (; j + 1 < width; j += 2) {
 			*dest++ = src1[1];
 			*dest++ = src1[3];
 			src1 += 4;
@@ -430,7 +1389,8 @@ void v4lconvert_uyvy_to_yuv420(const unsigned char *src, unsigned char *dest,
 		vdest = dest + width * height / 4;
 	}
 	for (i = 0; i < height; i += 2) {
-		for (j = 0; j + 1 < width; j += 2) {
+		j = yuv422_to_uv_simd(&src, &src1, &udest, &vdest, width, YUV422_UYVY);
+		for (; j + 1 < width; j += 2) {
 			*udest++ = ((int) src[0] + src1[0]) / 2;	/* U */
 			*vdest++ = ((int) src[2] + src1[2]) / 2;	/* V */
 			src += 4;
@@ -442,6 +1402,168 @@ void v4lconvert_uyvy_to_yuv420(const unsigned char *src, unsigned char *dest,
 	}
 }
 
+/* Packed yuv 4:2:2 straight to nv12, with the u and v of each 2 lines
+   averaged like the yuv420 conversions do */
+static void yuv422_to_nv12(const unsigned char *src, unsigned char *dest,
+		int width, int height, int stride, int layout)
+{
+	/* Offsets of the first y, the u and the v in a 4 byte group */
+	const int yi = layout == YUV422_UYVY ? 1 : 0;
+	const int ui = layout == YUV422_YUYV ? 1 :
+		       layout == YUV422_YVYU ? 3 : 0;
+	const int vi = layout == YUV422_YUYV ? 3 :
+		       layout == YUV422_YVYU ? 1 : 2;
+	int i, j;
+	const unsigned char *src1;
+
+	/* copy the Y values */
+	src1 = src;
+	for (i = 0; i < height; i++) {
+		j = yuv422_to_y_simd(&src1, &dest, width, layout);
+		for (; j + 1 < width; j += 2) {
+			*dest++ = src1[yi];
+			*dest++ = src1[yi + 2];
+			src1 += 4;
+		}
+		src1 += stride - width * 2;
+	}
+
+	/* dest now points to the interleaved U and V plane */
+	for (i = 0; i < height; i += 2) {
+		src1 = src + stride;		/* next line */
+		j = yuv422_to_nv12_uv_simd(&src, &src1, &dest, width, layout);
+		for (; j + 1 < width; j += 2) {
+			*dest++ = ((int) src[ui] + src1[ui]) / 2;	/* U */
+			*dest++ = ((int) src[vi] + src1[vi]) / 2;	/* V */
+			src += 4;
+			src1 += 4;
+		}
+		src = src1 + stride - width * 2;
+	}
+}
+
+void v4lconvert_yuyv_to_nv12(const unsigned char *src, unsigned char *dest,
+		int width, int height, int stride)
+{
+	yuv422_to_nv12(src, dest, width, height, stride, YUV422_YUYV);
+}
+
+void v4lconvert_yvyu_to_nv12(const unsigned char *src, unsigned char *dest,
+		int width, int height, int stride)
+{
+	yuv422_to_nv12(src, dest, width, height, stride, YUV422_YVYU);
+}
+
+void v4lconvert_uyvy_to_nv12(const unsigned char *src, unsigned char *dest,
+		int width, int height, int stride)
+{
+	yuv422_to_nv12(src, dest, width, height, stride, YUV422_UYVY);
+}
+
+/* Interleave n u and n v samples into uv */
+void v4lconvert_merge_uv(const unsigned char *u, const unsigned char *v,
+		unsigned char *uv, int n)
+{
+	int i = 0;
+
+	if (rgbyuv_simd.merge_uv)
+		i = rgbyuv_simd.merge_uv(u, v, uv, n);
+
+	for (; i < n; i++) {
+		uv[2 * i] = u[i];
+		uv[2 * i + 1] = v[i];
+	}
+}
+
+static void split_uv(const unsigned char *uv, unsigned char *u,
+		unsigned char *v, int n)
+{
+	int i = 0;
+
+	if (rgbyuv_simd.split_uv)
+		i = rgbyuv_simd.split_uv(uv, u, v, n);
+
+	for (; i < n; i++) {
+		u[i] = uv[2 * i];
+		v[i] = uv[2 * i + 1];
+	}
+}
+
+void v4lconvert_yuv420_to_nv12(const unsigned char *src, unsigned char *dest,
+		int width, int height, int yvu)
+{
+	const unsigned char *usrc, *vsrc;
+
+	if (yvu) {
+		vsrc = src + width * height;
+		usrc = vsrc + width * height / 4;
+	} else {
+		usrc = src + width * height;
+		vsrc = usrc + width * height / 4;
+	}
+
+	memcpy(dest, src, width * height);
+	v4lconvert_merge_uv(usrc, vsrc, dest + width * height,
+			    width * height / 4);
+}
+
+void v4lconvert_nv12_to_yuv420(const unsigned char *src, unsigned char *dest,
+		int width, int height, int stride, int yvu)
+{
+	unsigned char *udest, *vdest;
+	int i;
+
+	for (i = 0; i < height; i++) {
+		memcpy(dest, src, width);
+		dest += width;
+		src += stride;
+	}
+
+	if (yvu) {
+		vdest = dest;
+		udest = dest + width * height / 4;
+	} else {
+		udest = dest;
+		vdest = dest + width * height / 4;
+	}
+
+	for (i = 0; i < height / 2; i++) {
+		split_uv(src, udest, vdest, width / 2);
+		src += stride;
+		udest += width / 2;
+		vdest += width / 2;
+	}
+}
+
+void v4lconvert_nv12_to_rgb24(const unsigned char *src, unsigned char *dest,
+		int width, int height, int stride, int bgr)
+{
+	const unsigned char *ysrc = src;
+	const unsigned char *uvsrc = src + stride * height;
+	int i, j;
+
+	for (i = 0; i < height; i++) {
+		for (j = 0; j + 1 < width; j += 2) {
+			/* Same math as yuv420_to_rgb24 */
+			int u = uvsrc[j] - 128, v = uvsrc[j + 1] - 128;
+			int u1 = ((u << 7) + u) >> 6;
+			int rg = ((u << 1) + u + (v << 2) + (v << 1)) >> 3;
+			int v1 = ((v << 1) + v) >> 1;
+
+			*dest++ = CLIP(ysrc[j] + (bgr ? u1 : v1));
+			*dest++ = CLIP(ysrc[j] - rg);
+			*dest++ = CLIP(ysrc[j] + (bgr ? v1 : u1));
+
+			*dest++ = CLIP(ysrc[j + 1] + (bgr ? u1 : v1));
+			*dest++ = CLIP(ysrc[j + 1] - rg);
+			*dest++ = CLIP(ysrc[j + 1] + (bgr ? v1 : u1));
+		}
+		ysrc += stride;
+		if (i & 1)
+			uvsrc += stride;
+	}
+}
+
 void v4lconvert_swap_rgb(const unsigned char *src, unsigned char *dst,
 		int width, int height)
 {
@@ -586,41 +1708,46 @@ void v4lconvert_rgb565_to_yuv420(const unsigned char *src, unsigned char *dest,
 	}
 }
 
-void v4lconvert_y16_to_rgb24(const unsigned char *src, unsigned char *dest,
-		int width, int height, int little_endian)
+/* Writes the 8 msb of n pixels of 16 bit grey to 1 (grey) or 3 (rgb24)
+   bytes of dest each */
+static void y16_to_grey(const unsigned char *src, unsigned char *dest,
+		int n, int bpp, int little_endian)
 {
-	int j;
+	int i, k;
+
+	i = 0;
+	if (rgbyuv_simd.y16_to_grey) {
+		i = rgbyuv_simd.y16_to_grey(src, dest, n, bpp, little_endian);
+		src += 2 * i;
+		dest += bpp * i;
+	}
 
 	if (little_endian)
 		src++;
 
-	while (--height >= 0) {
-		for (j = 0; j < width; j++) {
-			*dest++ = *src;
+	for (; i < n; i++) {
+		for (k = 0; k < bpp; k++)
 			*dest++ = *src;
-			*dest++ = *src;
-			src+=2;
-		}
+		src += 2;
 	}
 }
 
+void v4lconvert_y16_to_rgb24(const unsigned char *src, unsigned char *dest,
+		int width, int height, int little_endian)
+{
+	y16_to_grey(src, dest, width * height, 3, little_endian);
+}
+
 void v4lconvert_y16_to_yuv420(const unsigned char *src, unsigned char *dest,
 		const struct v4l2_format *src_fmt, int little_endian)
 {
-	unsigned int x, y;
-
-	if (little_endian)
-		src++;
+	int pixels = src_fmt->fmt.pix.width * src_fmt->fmt.pix.height;
 
 	/* Y */
-	for (y = 0; y < src_fmt->fmt.pix.height; y++)
-		for (x = 0; x < src_fmt->fmt.pix.width; x++){
-			*dest++ = *src;
-			src+=2;
-		}
+	y16_to_grey(src, dest, pixels, 1, little_endian);
 
 	/* Clear U/V */
-	memset(dest, 0x80, src_fmt->fmt.pix.width * src_fmt->fmt.pix.height / 2);
+	memset(dest + pixels, 0x80, pixels / 2);
 }
 
 void v4lconvert_grey_to_rgb24(const unsigned char *src, unsigned char *dest,
@@ -651,86 +1778,58 @@ void v4lconvert_grey_to_yuv420(const unsigned char *src, unsigned char *dest,
 	memset(dest, 0x80, src_fmt->fmt.pix.width * src_fmt->fmt.pix.height / 2);
 }
 
-/* Unpack buffer of (vw bit) data into padded 16bit buffer. */
-static inline void convert_packed_to_16bit(const uint8_t *raw, uint16_t *unpacked,
-					   int vw, int unpacked_len)
+/* Y10B packs 4 pixels in 5 bytes, msb first, without padding at the end of
+   a line. We only keep the 8 msb of each pixel, for pixel j of a group
+   these are the high byte of the big endian 16 bit word starting at byte j
+   of the group, shifted left by 2 * j. This writes them straight to 1 (grey)
+   or 3 (rgb24) bytes of dest each, without unpacking to 16 bit first. */
+static void y10b_to_grey(const unsigned char *src, unsigned char *dest,
+		int n, int bpp)
 {
-	int mask = (1 << vw) - 1;
-	uint32_t buffer = 0;
-	int bitsIn = 0;
-	while (unpacked_len--) {
-		while (bitsIn < vw) {
-			buffer = (buffer << 8) | *(raw++);
-			bitsIn += 8;
-		}
-		bitsIn -= vw;
-		*(unpacked++) = (buffer >> bitsIn) & mask;
+	unsigned char msb[4];
+	int i, j, k;
+
+	i = 0;
+	if (rgbyuv_simd.y10b_to_grey) {
+		i = rgbyuv_simd.y10b_to_grey(src, dest, n, bpp);
+		src += i / 4 * 5;
+		dest += bpp * i;
 	}
-}
-
-int v4lconvert_y10b_to_rgb24(struct v4lconvert_data *data,
-	const unsigned char *src, unsigned char *dest, int width, int height)
-{
-	unsigned char *unpacked_buffer;
-
-	unpacked_buffer = v4lconvert_alloc_buffer(width * height * 2,
-					&data->convert_pixfmt_buf,
-					&data->convert_pixfmt_buf_size);
-	if (!unpacked_buffer)
-		return v4lconvert_oom_error(data);
-
-	convert_packed_to_16bit((uint8_t *)src, (uint16_t *)unpacked_buffer,
-				10, width * height);
 
-	int j;
-	unsigned short *tmp = (unsigned short *)unpacked_buffer;
-	while (--height >= 0) {
-		for (j = 0; j < width; j++) {
-
-			/* Only 10 useful bits, so we discard the LSBs */
-			*dest++ = (*tmp & 0x3ff) >> 2;
-			*dest++ = (*tmp & 0x3ff) >> 2;
-			*dest++ = (*tmp & 0x3ff) >> 2;
+	for (; i + 4 <= n; i += 4) {
+		msb[0] = src[0];
+		msb[1] = (src[1] << 2) | (src[2] >> 6);
+		msb[2] = (src[2] << 4) | (src[3] >> 4);
+		msb[3] = (src[3] << 6) | (src[4] >> 2);
+		for (j = 0; j < 4; j++)
+			for (k = 0; k < bpp; k++)
+				*dest++ = msb[j];
+		src += 5;
+	}
 
-			/* +1 means two bytes as we are dealing with (unsigned short) */
-			tmp += 1;
-		}
+	/* A last incomplete group, pixel j ends in byte j + 1 */
+	for (j = 0; i < n; i++, j++) {
+		msb[0] = j ? (src[j] << (2 * j)) | (src[j + 1] >> (8 - 2 * j)) :
+			     src[0];
+		for (k = 0; k < bpp; k++)
+			*dest++ = msb[0];
 	}
-	return 0;
 }
 
-int v4lconvert_y10b_to_yuv420(struct v4lconvert_data *data,
-	const unsigned char *src, unsigned char *dest, int width, int height)
+void v4lconvert_y10b_to_rgb24(const unsigned char *src, unsigned char *dest,
+		int width, int height)
 {
-	unsigned char *unpacked_buffer;
-
-	unpacked_buffer = v4lconvert_alloc_buffer(width * height * 2,
-					&data->convert_pixfmt_buf,
-					&data->convert_pixfmt_buf_size);
-	if (!unpacked_buffer)
-		return v4lconvert_oom_error(data);
-
-	convert_packed_to_16bit((uint8_t *)src, (uint16_t *)unpacked_buffer,
-				10, width * height);
-
-	int x, y;
-	unsigned short *tmp = (unsigned short *)unpacked_buffer;
+	y10b_to_grey(src, dest, width * height, 3);
+}
 
+void v4lconvert_y10b_to_yuv420(const unsigned char *src, unsigned char *dest,
+		int width, int height)
+{
 	/* Y */
-	for (y = 0; y < height; y++)
-		for (x = 0; x < width; x++) {
-
-			/* Only 10 useful bits, so we discard the LSBs */
-			*dest++ = (*tmp & 0x3ff) >> 2;
-
-			/* +1 means two bytes as we are dealing with (unsigned short) */
-			tmp += 1;
-		}
+	y10b_to_grey(src, dest, width * height, 1);
 
 	/* Clear U/V */
-	memset(dest, 0x80, width * height / 2);
-
-	return 0;
+	memset(dest + width * height, 0x80, width * height / 2);
 }
 
 void v4lconvert_rgb32_to_rgb24(const unsigned char *src, unsigned char *dest,
@@ -20,42 +20,35 @@
 # mail at the end of this file.
  */
 
+#include <pthread.h>
 #include "libv4lconvert-priv.h"
+#include "libv4lbits-priv.h"
 
 #define CLAMP(x)	((x) < 0 ? 0 : ((x) > 255) ? 255 : (x))
 
-struct code_table {
-	int is_abs;
-	int len;
-	int val;
-	int unk;
-};
-
-
-/* local storage */
-/* FIXME not thread safe !! */
-static struct code_table table[256];
-static int init_done;
+static struct v4lconvert_vlc table[256];
+static struct v4lconvert_vlc_multi multi_table[1 << V4LCONVERT_VLC_MULTI_BITS];
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
 
 /*
    sonix_decompress_init
    =====================
-   pre-calculates a locally stored table for efficient huffman-decoding.
+   pre-calculates locally stored tables for efficient huffman-decoding.
 
-   Each entry at index x in the table represents the codeword
-   present at the MSB of byte x.
+   Each entry at index x in table represents the codeword present at the
+   MSB of byte x, multi_table holds runs of up to 4 codewords. The absolute
+   value and unknown codes are escapes, handled by the decoding loop.
 
  */
 static void sonix_decompress_init(void)
 {
 	int i;
-	int is_abs, val, len, unk;
+	int escape, val, len;
 
 	for (i = 0; i < 256; i++) {
-		is_abs = 0;
+		escape = 0;
 		val = 0;
 		len = 0;
-		unk = 0;
 		if ((i & 0x80) == 0) {
 			/* code 0 */
 			val = 0;
@@ -88,22 +81,34 @@ static void sonix_decompress_init(void)
 			/* code 110001xx: unknown */
 			val = 0;
 			len = 8;
-			unk = 1;
+			escape = 1;
 		} else if ((i & 0xF0) == 0xE0) {
-			/* code 1110xxxx */
-			is_abs = 1;
-			val = (i & 0x0F) << 4;
+			/* code 1110xxxx: absolute value (i & 0x0F) << 4 */
 			len = 8;
+			escape = 1;
 		}
-		table[i].is_abs = is_abs;
+		table[i].escape = escape;
 		table[i].val = val;
 		table[i].len = len;
-		table[i].unk = unk;
 	}
 
-	init_done = 1;
+	v4lconvert_vlc_multi_init(multi_table, table);
 }
 
+/* value the codes are relative to */
+static inline int sonix_predict(const unsigned char *outp, int row, int col,
+		int width)
+{
+	if (col < 2) {
+		/* left column: relative to top pixel */
+		return outp[-2 * width];
+	} else if (row < 2) {
+		/* top row: relative to left pixel */
+		return outp[-2];
+	}
+	/* main area: average of left pixel and top pixel */
+	return (outp[-2] + outp[-2 * width]) / 2;
+}
 
 /*
    sonix_decompress
@@ -113,74 +118,62 @@ static void sonix_decompress_init(void)
    IN	width
    height
    inp		pointer to compressed frame (with header already stripped)
+   src_size	size of the compressed frame
    OUT	outp	pointer to decompressed frame
 
-   Returns 0 if the operation was successful.
-   Returns <0 if operation failed.
-
  */
-void v4lconvert_decode_sn9c10x(const unsigned char *inp, unsigned char *outp,
-		int width, int height)
+void v4lconvert_decode_sn9c10x(const unsigned char *inp, int src_size,
+		unsigned char *outp, int width, int height)
 {
-	int row, col;
+	struct v4lconvert_bits bits;
+	const struct v4lconvert_vlc_multi *multi;
+	int row, col, i, n;
 	int val;
-	int bitpos;
-	unsigned char code;
-	const unsigned char *addr;
+	unsigned int code;
 
-	if (!init_done)
-		sonix_decompress_init();
+	pthread_once(&init_once, sonix_decompress_init);
 
-	bitpos = 0;
+	v4lconvert_bits_init(&bits, inp, inp + src_size);
 	for (row = 0; row < height; row++) {
 		col = 0;
 
 		/* first two pixels in first two rows are stored as raw 8-bit */
 		if (row < 2) {
-			addr = inp + (bitpos >> 3);
-			code = (addr[0] << (bitpos & 7)) | (addr[1] >> (8 - (bitpos & 7)));
-			bitpos += 8;
-			*outp++ = code;
-
-			addr = inp + (bitpos >> 3);
-			code = (addr[0] << (bitpos & 7)) | (addr[1] >> (8 - (bitpos & 7)));
-			bitpos += 8;
-			*outp++ = code;
-
+			v4lconvert_bits_refill(&bits);
+			*outp++ = v4lconvert_bits_get(&bits, 8);
+			*outp++ = v4lconvert_bits_get(&bits, 8);
 			col += 2;
 		}
 
 		while (col < width) {
-			/* get bitcode from bitstream */
-			addr = inp + (bitpos >> 3);
-			code = (addr[0] << (bitpos & 7)) | (addr[1] >> (8 - (bitpos & 7)));
+			v4lconvert_bits_refill(&bits);
+
+			/* decode as many codes as we can in one go */
+			multi = &multi_table[v4lconvert_bits_peek(&bits,
+					V4LCONVERT_VLC_MULTI_BITS)];
+			if (multi->n) {
+				n = multi->n;
+				if (n > width - col)
+					n = width - col;
+				for (i = 0; i < n; i++, col++) {
+					val = multi->val[i] +
+						sonix_predict(outp, row, col, width);
+					*outp++ = CLAMP(val);
+				}
+				v4lconvert_bits_skip(&bits, multi->end[n - 1]);
+				continue;
+			}
 
-			/* update bit position */
-			bitpos += table[code].len;
+			code = v4lconvert_bits_peek(&bits, 8);
+			v4lconvert_bits_skip(&bits, table[code].len);
 
 			/* Skip unknown codes (most likely they indicate
 			   a change of the delta's the various codes encode) */
-			if (table[code].unk)
+			if ((code & 0xFC) == 0xC4)
 				continue;
 
-			/* calculate pixel value */
-			val = table[code].val;
-			if (!table[code].is_abs) {
-				/* value is relative to top and left pixel */
-				if (col < 2) {
-					/* left column: relative to top pixel */
-					val += outp[-2 * width];
-				} else if (row < 2) {
-					/* top row: relative to left pixel */
-					val += outp[-2];
-				} else {
-					/* main area: average of left pixel and top pixel */
-					val += (outp[-2] + outp[-2 * width]) / 2;
-				}
-			}
-
-			/* store pixel */
-			*outp++ = CLAMP(val);
+			/* absolute value */
+			*outp++ = (code & 0x0F) << 4;
 			col++;
 		}
 	}
@@ -29,32 +29,36 @@
 #include <string.h>
 #include "libv4lconvert-priv.h"
 
-/*fixme: not reentrant */
-static unsigned int bit_bucket;
-static const unsigned char *input_ptr;
+#define CLIP(x) ((x) < 0 ? 0 : ((x) > 0xff) ? 0xff : (x))
 
-static inline void refill(int *bitfill)
+struct spca561_bits {
+	unsigned int bucket;
+	int fill;
+	const unsigned char *input;
+};
+
+static inline void refill(struct spca561_bits *bits)
 {
-	if (*bitfill < 8) {
-		bit_bucket = (bit_bucket << 8) | *(input_ptr++);
-		*bitfill += 8;
+	if (bits->fill < 8) {
+		bits->bucket = (bits->bucket << 8) | *(bits->input++);
+		bits->fill += 8;
 	}
 }
 
-static inline int nbits(int *bitfill, int n)
+static inline int nbits(struct spca561_bits *bits, int n)
 {
-	bit_bucket = (bit_bucket << 8) | *(input_ptr++);
-	*bitfill -= n;
-	return (bit_bucket >> (*bitfill & 0xff)) & ((1 << n) - 1);
+	bits->bucket = (bits->bucket << 8) | *(bits->input++);
+	bits->fill -= n;
+	return (bits->bucket >> (bits->fill & 0xff)) & ((1 << n) - 1);
 }
 
-static inline int _nbits(int *bitfill, int n)
+static inline int _nbits(struct spca561_bits *bits, int n)
 {
-	*bitfill -= n;
-	return (bit_bucket >> (*bitfill & 0xff)) & ((1 << n) - 1);
+	bits->fill -= n;
+	return (bits->bucket >> (bits->fill & 0xff)) & ((1 << n) - 1);
 }
 
-static int fun_A(int *bitfill)
+static int fun_A(struct spca561_bits *bits)
 {
 	int ret;
 	static int tab[] = {
@@ -62,13 +66,13 @@ static int fun_A(int *bitfill)
 		-16, -17, -18, -19, -19
 	};
 
-	ret = tab[nbits(bitfill, 4)];
+	ret = tab[nbits(bits, 4)];
 
-	refill(bitfill);
+	refill(bits);
 	return ret;
 }
 
-static int fun_B(int *bitfill)
+static int fun_B(struct spca561_bits *bits)
 {
 	static int tab1[] = {
 		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 31, 31,
@@ -84,14 +88,14 @@ static int fun_B(int *bitfill)
 	};
 	unsigned int tmp;
 
-	tmp = nbits(bitfill, 7) - 68;
-	refill(bitfill);
+	tmp = nbits(bits, 7) - 68;
+	refill(bits);
 	if (tmp > 47)
 		return 0xff;
 	return tab[tab1[tmp]];
 }
 
-static int fun_C(int *bitfill, int gkw)
+static int fun_C(struct spca561_bits *bits, int gkw)
 {
 	static int tab1[] = {
 		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 23, 23, 23, 23, 23, 23,
@@ -107,7 +111,7 @@ static int fun_C(int *bitfill, int gkw)
 	unsigned int tmp;
 
 	if (gkw == 0xfe) {
-		if (nbits(bitfill, 1) == 0)
+		if (nbits(bits, 1) == 0)
 			return 7;
 		else
 			return -8;
@@ -116,30 +120,30 @@ static int fun_C(int *bitfill, int gkw)
 	if (gkw != 0xff)
 		return 0xff;
 
-	tmp = nbits(bitfill, 7) - 72;
+	tmp = nbits(bits, 7) - 72;
 	if (tmp > 43)
 		return 0xff;
 
-	refill(bitfill);
+	refill(bits);
 	return tab[tab1[tmp]];
 }
 
-static int fun_D(int *bitfill, int gkw)
+static int fun_D(struct spca561_bits *bits, int gkw)
 {
 	if (gkw == 0xfd) {
-		if (nbits(bitfill, 1) == 0)
+		if (nbits(bits, 1) == 0)
 			return 12;
 		return -13;
 	}
 
 	if (gkw == 0xfc) {
-		if (nbits(bitfill, 1) == 0)
+		if (nbits(bits, 1) == 0)
 			return 13;
 		return -14;
 	}
 
 	if (gkw == 0xfe) {
-		switch (nbits(bitfill, 2)) {
+		switch (nbits(bits, 2)) {
 		case 0:
 			return 14;
 		case 1:
@@ -152,7 +156,7 @@ static int fun_D(int *bitfill, int gkw)
 	}
 
 	if (gkw == 0xff) {
-		switch (nbits(bitfill, 3)) {
+		switch (nbits(bits, 3)) {
 		case 4:
 			return 16;
 		case 5:
@@ -162,9 +166,9 @@ static int fun_D(int *bitfill, int gkw)
 		case 7:
 			return -18;
 		case 2:
-			return _nbits(bitfill, 1) ? 0xed : 0x12;
+			return _nbits(bits, 1) ? 0xed : 0x12;
 		case 3:
-			(*bitfill)--;
+			bits->fill--;
 			return 18;
 		}
 		return 0xff;
@@ -172,7 +176,7 @@ static int fun_D(int *bitfill, int gkw)
 	return gkw;
 }
 
-static int fun_E(int cur_byte, int *bitfill)
+static int fun_E(int cur_byte, struct spca561_bits *bits)
 {
 	static int tab0[] = { 0, -1, 1, -2, 2, -3, 3, -4 };
 	static int tab1[] = { 4, -5, 5, -6, 6, -7, 7, -8 };
@@ -181,34 +185,34 @@ static int fun_E(int cur_byte, int *bitfill)
 	static int tab4[] = { 16, -17, 17, -18, 18, -19, 19, -19 };
 
 	if ((cur_byte & 0xf0) >= 0x80) {
-		*bitfill -= 4;
+		bits->fill -= 4;
 		return tab0[(cur_byte >> 4) & 7];
 	}
 	if ((cur_byte & 0xc0) == 0x40) {
-		*bitfill -= 5;
+		bits->fill -= 5;
 		return tab1[(cur_byte >> 3) & 7];
 
 	}
 	if ((cur_byte & 0xe0) == 0x20) {
-		*bitfill -= 6;
+		bits->fill -= 6;
 		return tab2[(cur_byte >> 2) & 7];
 
 	}
 	if ((cur_byte & 0xf0) == 0x10) {
-		*bitfill -= 7;
+		bits->fill -= 7;
 		return tab3[(cur_byte >> 1) & 7];
 
 	}
 	if ((cur_byte & 0xf8) == 8) {
-		*bitfill -= 8;
+		bits->fill -= 8;
 		return tab4[cur_byte & 7];
 	}
 	return 0xff;
 }
 
-static int fun_F(int cur_byte, int *bitfill)
+static int fun_F(int cur_byte, struct spca561_bits *bits)
 {
-	*bitfill -= 5;
+	bits->fill -= 5;
 	switch (cur_byte & 0xf8) {
 	case 0x80:
 		return 0;
@@ -244,7 +248,7 @@ static int fun_F(int cur_byte, int *bitfill)
 		return -8;
 	}
 
-	*bitfill -= 1;
+	bits->fill -= 1;
 	switch (cur_byte & 0xfc) {
 	case 0x40:
 		return 8;
@@ -280,7 +284,7 @@ static int fun_F(int cur_byte, int *bitfill)
 		return -16;
 	}
 
-	*bitfill -= 1;
+	bits->fill -= 1;
 	switch (cur_byte & 0xfe) {
 	case 0x20:
 		return 16;
@@ -298,7 +302,7 @@ static int fun_F(int cur_byte, int *bitfill)
 		return 19;
 	}
 
-	*bitfill += 7;
+	bits->fill += 7;
 	return 0xff;
 }
 
@@ -307,8 +311,8 @@ static int internal_spca561_decode(int width, int height,
 		unsigned char *outbuf)
 {
 	/* buffers */
-	static int accum[8 * 8 * 8];
-	static int i_hits[8 * 8 * 8];
+	int accum[8 * 8 * 8];
+	int i_hits[8 * 8 * 8];
 
 	static const int nbits_A[] = {
 		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
@@ -573,121 +577,12 @@ static int internal_spca561_decode(int width, int height,
 		40, 48, 56, 64,
 		72, 80, 88, 98, 112, 128, 144, 160
 	};
-	/* clamp0_255[256 + i] = min(max(i,255),0) */
-	static const unsigned char clamp0_255[] = {
-		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		1, 2,
-		3, 4, 5, 6, 7, 8, 9, 10,
-		11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25,
-		26, 27,
-		28, 29, 30, 31, 32, 33,
-		34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48,
-		49, 50,
-		51, 52, 53, 54, 55, 56,
-		57, 58, 59, 60, 61, 62, 63, 64, 65, 66, 67, 68, 69, 70, 71,
-		72, 73,
-		74, 75, 76, 77, 78, 79,
-		80, 81, 82, 83, 84, 85, 86, 87, 88, 89, 90, 91, 92, 93, 94,
-		95, 96,
-		97, 98, 99, 100, 101,
-		102, 103, 104, 105, 106, 107, 108, 109, 110, 111, 112, 113,
-		114,
-		115, 116, 117, 118, 119,
-		120, 121, 122, 123, 124, 125, 126, 127, 128, 129, 130, 131,
-		132,
-		133, 134, 135, 136, 137,
-		138, 139, 140, 141, 142, 143, 144, 145, 146, 147, 148, 149,
-		150,
-		151, 152, 153, 154, 155,
-		156, 157, 158, 159, 160, 161, 162, 163, 164, 165, 166, 167,
-		168,
-		169, 170, 171, 172, 173,
-		174, 175, 176, 177, 178, 179, 180, 181, 182, 183, 184, 185,
-		186,
-		187, 188, 189, 190, 191,
-		192, 193, 194, 195, 196, 197, 198, 199, 200, 201, 202, 203,
-		204,
-		205, 206, 207, 208, 209,
-		210, 211, 212, 213, 214, 215, 216, 217, 218, 219, 220, 221,
-		222,
-		223, 224, 225, 226, 227,
-		228, 229, 230, 231, 232, 233, 234, 235, 236, 237, 238, 239,
-		240,
-		241, 242, 243, 244, 245,
-		246, 247, 248, 249, 250, 251, 252, 253, 254, 255, 255, 255,
-		255,
-		255, 255, 255, 255, 255,
-		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
-		255,
-		255, 255, 255, 255, 255,
-		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
-		255,
-		255, 255, 255, 255, 255,
-		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
-		255,
-		255, 255, 255, 255, 255,
-		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
-		255,
-		255, 255, 255, 255, 255,
-		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
-		255,
-		255, 255, 255, 255, 255,
-		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
-		255,
-		255, 255, 255, 255, 255,
-		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
-		255,
-		255, 255, 255, 255, 255,
-		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
-		255,
-		255, 255, 255, 255, 255,
-		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
-		255,
-		255, 255, 255, 255, 255,
-		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
-		255,
-		255, 255, 255, 255, 255,
-		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
-		255,
-		255, 255, 255, 255, 255,
-		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
-		255,
-		255, 255, 255, 255, 255,
-		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
-		255,
-		255, 255, 255, 255, 255,
-		255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
-		255,
-		255
-	};
 	/* abs_clamp15[19 + i] = min(abs(i), 15) */
 	static const int abs_clamp15[] = {
 		15, 15, 15, 15, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3,
 		2, 1, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
 		15, 15,
-		15
+		15, 15
 	};
 	/* diff_encoding[256 + i] = ... */
 	static const int diff_encoding[] = {
@@ -746,7 +641,7 @@ static int internal_spca561_decode(int width, int height,
 	};
 
 	int block;
-	int bitfill = 0;
+	struct spca561_bits bits;
 	int xwidth = width + 6;
 	int off_up_right = 2 - 2 * xwidth;
 	int off_up_left = -2 - 2 * xwidth;
@@ -760,28 +655,29 @@ static int internal_spca561_decode(int width, int height,
 	memcpy(outbuf + xwidth * 2 + 3, inbuf + 0x14, width);
 	memcpy(outbuf + xwidth * 3 + 3, inbuf + 0x14 + width, width);
 
-	input_ptr = inbuf + 0x14 + width * 2;
+	bits.input = inbuf + 0x14 + width * 2;
 	output_ptr = outbuf + (xwidth) * 4 + 3;
 
-	bit_bucket = 0;
+	bits.bucket = 0;
+	bits.fill = 0;
 
 	for (block = 0; block < ((height - 2) * width) / 32; ++block) {
 		int b_it, var_7 = 0;
 		int cur_byte;
 
-		refill(&bitfill);
+		refill(&bits);
 
-		cur_byte = (bit_bucket >> (bitfill & 7)) & 0xff;
+		cur_byte = (bits.bucket >> (bits.fill & 7)) & 0xff;
 
 		if ((cur_byte & 0x80) == 0) {
 			var_7 = 0;
-			bitfill--;
+			bits.fill--;
 		} else if ((cur_byte & 0xC0) == 0x80) {
 			var_7 = 1;
-			bitfill -= 2;
+			bits.fill -= 2;
 		} else if ((cur_byte & 0xc0) == 0xc0) {
 			var_7 = 2;
-			bitfill -= 2;
+			bits.fill -= 2;
 		}
 
 		for (b_it = 0; b_it < 32; b_it++) {
@@ -791,8 +687,8 @@ static int internal_spca561_decode(int width, int height,
 			int dL, dC, dR;
 			int gkw;	/* God knows what */
 
-			refill(&bitfill);
-			cur_byte = bit_bucket >> (bitfill & 7) & 0xff;
+			refill(&bits);
+			cur_byte = bits.bucket >> (bits.fill & 7) & 0xff;
 
 			pixel_L = output_ptr[-2];
 			pixel_UR = output_ptr[off_up_right];
@@ -831,29 +727,29 @@ static int internal_spca561_decode(int width, int height,
 			}
 
 			if (i_hits[index] < 7) {
-				bitfill -= nbits_A[cur_byte];
+				bits.fill -= nbits_A[cur_byte];
 				gkw = tab_A[cur_byte];
 				if (gkw == 0xfe)
-					gkw = fun_A(&bitfill);
+					gkw = fun_A(&bits);
 			} else if (i_hits[index] >= accum[index]) {
-				bitfill -= nbits_B[cur_byte];
+				bits.fill -= nbits_B[cur_byte];
 				gkw = tab_B[cur_byte];
 				if (cur_byte == 0)
-					gkw = fun_B(&bitfill);
+					gkw = fun_B(&bits);
 			} else if (i_hits[index] * 2 >= accum[index]) {
-				bitfill -= nbits_C[cur_byte];
+				bits.fill -= nbits_C[cur_byte];
 				gkw = tab_C[cur_byte];
 				if (cur_byte < 2)
-					gkw = fun_C(&bitfill, gkw);
+					gkw = fun_C(&bits, gkw);
 			} else if (i_hits[index] * 4 >= accum[index]) {
-				bitfill -= nbits_D[cur_byte];
+				bits.fill -= nbits_D[cur_byte];
 				gkw = tab_D[cur_byte];
 				if (cur_byte < 4)
-					gkw = fun_D(&bitfill, gkw);
+					gkw = fun_D(&bits, gkw);
 			} else if (i_hits[index] * 8 >= accum[index]) {
-				gkw = fun_E(cur_byte, &bitfill);
+				gkw = fun_E(cur_byte, &bits);
 			} else {
-				gkw = fun_F(cur_byte, &bitfill);
+				gkw = fun_F(cur_byte, &bits);
 			}
 
 			if (gkw == 0xff)
@@ -869,8 +765,7 @@ static int internal_spca561_decode(int width, int height,
 				tmp2 += (tmp2 < 0) ? 1 : 0;
 
 				*(output_ptr++) =
-					clamp0_255[0x100 + (tmp1 >> 2) -
-					(tmp2 >> 1)];
+					CLIP((tmp1 >> 2) - (tmp2 >> 1));
 			}
 			pixel_U = saved_pixel_UR;
 			saved_pixel_UR = pixel_UR;
@@ -36,36 +36,41 @@
 #define __TINYJPEG_INTERNAL_H_
 
 #include <setjmp.h>
+#include "tinyjpeg.h"
 
 #define SANITY_CHECK 1
 
 struct jdec_private;
 
-#define HUFFMAN_HASH_NBITS 9
+#define HUFFMAN_HASH_NBITS 10
 #define HUFFMAN_HASH_SIZE  (1UL<<HUFFMAN_HASH_NBITS)
 #define HUFFMAN_HASH_MASK  (HUFFMAN_HASH_SIZE-1)
 
 #define HUFFMAN_TABLES	   4
 #define COMPONENTS	   3
-#define JPEG_MAX_WIDTH	   2048
-#define JPEG_MAX_HEIGHT	   2048
+/* Only to keep the buffer size calculations from overflowing, the decoder
+   state does not depend on the image size */
+#define JPEG_MAX_PIXELS	   (8192 * 8192)
 
 struct huffman_table {
-	/* Fast look up table, using HUFFMAN_HASH_NBITS bits we can have directly the symbol,
-	 * if the symbol is <0, then we need to look into the tree table */
-	short int lookup[HUFFMAN_HASH_SIZE];
-	/* code size: give the number of bits of a symbol is encoded */
-	unsigned char code_size[HUFFMAN_HASH_SIZE];
-	/* some place to store value that is not encoded in the lookup table
-	 * IMPROVEME: Calculate if 256 value is enough to store all values
-	 */
-	uint16_t slowtable[16 - HUFFMAN_HASH_NBITS][256];
+	/* Fast look up table, using HUFFMAN_HASH_NBITS bits we have directly the
+	 * symbol (low byte) and the number of bits it is encoded with (high byte),
+	 * if the entry is 0 the code is longer than HUFFMAN_HASH_NBITS */
+	uint16_t lookup[HUFFMAN_HASH_SIZE];
+	/* For the longer codes: the largest code of each size (-1 if there are
+	 * none) and the offset to add to a code of that size to get its index
+	 * in vals (canonical huffman codes of one size are consecutive) */
+	int32_t maxcode[17];
+	int32_t valoffset[17];
+	unsigned char vals[256];
 };
 
 struct component {
 	unsigned int Hfactor;
 	unsigned int Vfactor;
 	float *Q_table;		/* Pointer to the quantisation table to use */
+	int16_t *islow_Q_table;	/* Same for the integer IDCTs */
+	int16_t *ifast_Q_table;
 	struct huffman_table *AC_table;
 	struct huffman_table *DC_table;
 	short int previous_DC;	/* Previous DC coefficient */
@@ -78,6 +83,7 @@ struct component {
 
 typedef void (*decode_MCU_fct) (struct jdec_private *priv);
 typedef void (*convert_colorspace_fct) (struct jdec_private *priv);
+typedef void (*idct_fct) (struct component *compptr, uint8_t *output_buf, int stride);
 
 struct jdec_private {
 	/* Public variables */
@@ -90,10 +96,13 @@ struct jdec_private {
 	const unsigned char *stream;	/* Pointer to the current stream */
 	unsigned char *stream_filtered;
 	int stream_filtered_bufsize;
-	unsigned int reservoir, nbits_in_reservoir;
+	uint64_t reservoir;
+	unsigned int nbits_in_reservoir;
 
 	struct component component_infos[COMPONENTS];
 	float Q_tables[COMPONENTS][64];		/* quantization tables */
+	int16_t islow_Q_tables[COMPONENTS][64];
+	int16_t ifast_Q_tables[COMPONENTS][64];
 	struct huffman_table HTDC[HUFFMAN_TABLES];	/* DC huffman tables   */
 	struct huffman_table HTAC[HUFFMAN_TABLES];	/* AC huffman tables   */
 	int default_huffman_table_initialized;
@@ -109,6 +118,10 @@ struct jdec_private {
 	/* Temp space used after the IDCT to store each components */
 	uint8_t Y[64 * 4], Cr[64], Cb[64];
 
+	idct_fct idct;
+	unsigned int scale;	/* See tinyjpeg_set_scale() */
+	idct_fct mcu_idct;	/* idct or a scaled IDCT, used by decode_MCU */
+
 	jmp_buf jump_state;
 	/* Internal Pointer use for colorspace conversion, do not modify it !!! */
 	uint8_t *plane[COMPONENTS];
@@ -118,10 +131,28 @@ struct jdec_private {
 	/* Temp buffers for multipass planar JPG -> RGB decoding */
 	unsigned int tmp_buf_y_size;
 	uint8_t *tmp_buf[COMPONENTS];
+
+	/* For decoding restart intervals in parallel, NULL when not using
+	   worker threads */
+	struct v4lconvert_pool *pool;
+	unsigned char *intervals_buf;	/* start of each restart interval */
+	int intervals_buf_size;
+
+	/* See tinyjpeg_set_band_callback() */
+	tinyjpeg_band_fct band;
+	void *band_opaque;
+	unsigned char *band_buf;	/* one row of MCUs without components */
+	int band_buf_size;
 };
 
-#define IDCT tinyjpeg_idct_float
+#define IDCT(compptr, output_buf, stride) priv->mcu_idct(compptr, output_buf, stride)
 void tinyjpeg_idct_float (struct component *compptr, uint8_t *output_buf, int stride);
+void tinyjpeg_idct_islow (struct component *compptr, uint8_t *output_buf, int stride);
+void tinyjpeg_idct_ifast (struct component *compptr, uint8_t *output_buf, int stride);
+/* Scaled islow IDCTs, these output a 4x4, 2x2 or 1x1 block */
+void tinyjpeg_idct_4x4 (struct component *compptr, uint8_t *output_buf, int stride);
+void tinyjpeg_idct_2x2 (struct component *compptr, uint8_t *output_buf, int stride);
+void tinyjpeg_idct_1x1 (struct component *compptr, uint8_t *output_buf, int stride);
 
 #endif
 
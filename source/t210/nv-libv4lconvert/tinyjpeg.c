@@ -36,6 +36,7 @@
 #include <string.h>
 #include <stdint.h>
 #include <errno.h>
+#include <endian.h>
 
 #include "tinyjpeg.h"
 #include "tinyjpeg-internal.h"
@@ -243,7 +244,9 @@ const unsigned char standard_quantization[][64] = { {
  *  look_nbits: read nbits from the stream without marking as read.
  *  skip_nbits: read nbits from the stream but do not return the result.
  *
- * stream: current pointer in the jpeg data (read bytes per bytes)
+ * stream: current pointer in the jpeg data (read bytes per bytes, or when
+ *         there is no 0xff in the next 8 bytes as many bytes as fit into the
+ *         64 bit reservoir at once)
  * nbits_in_reservoir: number of bits filled into the reservoir
  * reservoir: register that contains bits information. Only nbits_in_reservoir
  *            is valid.
@@ -256,7 +259,23 @@ const unsigned char standard_quantization[][64] = { {
  *                 result = (reservoir >> 15) & 3
  *
  */
+#define FILL_NO_FF(x) \
+	(!((~(x) - 0x0101010101010101ULL) & (x) & 0x8080808080808080ULL))
+
 #define fill_nbits(reservoir, nbits_in_reservoir, stream, nbits_wanted) do { \
+	if (nbits_in_reservoir < nbits_wanted && \
+			priv->stream_end - stream >= 8) { \
+		uint64_t next; \
+		memcpy(&next, stream, 8); \
+		if (FILL_NO_FF(next)) { \
+			unsigned int bytes = (63 - nbits_in_reservoir) / 8; \
+			next = be64toh(next); \
+			reservoir = (reservoir << (bytes * 8)) | \
+				(next >> (64 - bytes * 8)); \
+			stream += bytes; \
+			nbits_in_reservoir += bytes * 8; \
+		} \
+	} \
 	while (nbits_in_reservoir < nbits_wanted) { \
 		unsigned char c; \
 		if (stream >= priv->stream_end) { \
@@ -279,7 +298,7 @@ const unsigned char standard_quantization[][64] = { {
 	fill_nbits(reservoir, nbits_in_reservoir, stream, (nbits_wanted)); \
 	result = ((reservoir) >> (nbits_in_reservoir - (nbits_wanted))); \
 	nbits_in_reservoir -= (nbits_wanted);  \
-	reservoir &= ((1U << nbits_in_reservoir) - 1); \
+	reservoir &= ((1ULL << nbits_in_reservoir) - 1); \
 	if ((unsigned int)result < (1UL << ((nbits_wanted) - 1))) \
 		result += (0xFFFFFFFFUL << (nbits_wanted)) + 1; \
 }  while (0);
@@ -294,12 +313,12 @@ const unsigned char standard_quantization[][64] = { {
  * #define skip_nbits(reservoir, nbits_in_reservoir, stream, nbits_wanted) do { \
  *   fill_nbits(reservoir, nbits_in_reservoir, stream, (nbits_wanted)); \
  *   nbits_in_reservoir -= (nbits_wanted); \
- *   reservoir &= ((1U << nbits_in_reservoir) - 1); \
+ *   reservoir &= ((1ULL << nbits_in_reservoir) - 1); \
  * }  while(0);
  */
 #define skip_nbits(reservoir, nbits_in_reservoir, stream, nbits_wanted) do { \
 	nbits_in_reservoir -= (nbits_wanted); \
-	reservoir &= ((1U << nbits_in_reservoir) - 1); \
+	reservoir &= ((1ULL << nbits_in_reservoir) - 1); \
 }  while (0);
 
 #define be16_to_cpu(x) (((x)[0] << 8) | (x)[1])
@@ -309,42 +328,32 @@ static void resync(struct jdec_private *priv);
 /**
  * Get the next (valid) huffman code in the stream.
  *
- * To speedup the procedure, we look HUFFMAN_HASH_NBITS bits and the code is
- * lower than HUFFMAN_HASH_NBITS we have automaticaly the length of the code
- * and the value by using two lookup table.
- * Else if the value is not found, just search (linear) into an array for each
- * bits is the code is present.
+ * To speedup the procedure, we look HUFFMAN_HASH_NBITS bits and if the code
+ * is not longer than HUFFMAN_HASH_NBITS a single lookup gives us both the
+ * length of the code and the value.
+ * Else, as canonical huffman codes of one length are consecutive, we only
+ * need to compare against the largest code of each length.
  *
- * If the code is not present for any reason, -1 is return.
+ * If the code is not present for any reason, we longjmp out with -EIO.
  */
 static int get_next_huffman_code(struct jdec_private *priv, struct huffman_table *huffman_table)
 {
 	int value, hcode;
-	unsigned int extra_nbits, nbits;
-	uint16_t *slowtable;
+	unsigned int nbits;
 
 	look_nbits(priv->reservoir, priv->nbits_in_reservoir, priv->stream, HUFFMAN_HASH_NBITS, hcode);
 	value = huffman_table->lookup[hcode];
-	if (value >= 0) {
-		unsigned int code_size = huffman_table->code_size[value];
-
-		skip_nbits(priv->reservoir, priv->nbits_in_reservoir, priv->stream, code_size);
-		return value;
+	if (value) {
+		skip_nbits(priv->reservoir, priv->nbits_in_reservoir, priv->stream, value >> 8);
+		return value & 0xff;
 	}
 
 	/* Decode more bits each time ... */
-	for (extra_nbits = 0; extra_nbits < 16 - HUFFMAN_HASH_NBITS; extra_nbits++) {
-		nbits = HUFFMAN_HASH_NBITS + 1 + extra_nbits;
-
+	for (nbits = HUFFMAN_HASH_NBITS + 1; nbits <= 16; nbits++) {
 		look_nbits(priv->reservoir, priv->nbits_in_reservoir, priv->stream, nbits, hcode);
-		slowtable = huffman_table->slowtable[extra_nbits];
-		/* Search if the code is in this array */
-		while (slowtable[0]) {
-			if (slowtable[0] == hcode) {
-				skip_nbits(priv->reservoir, priv->nbits_in_reservoir, priv->stream, nbits);
-				return slowtable[1];
-			}
-			slowtable += 2;
+		if (hcode <= huffman_table->maxcode[nbits]) {
+			skip_nbits(priv->reservoir, priv->nbits_in_reservoir, priv->stream, nbits);
+			return huffman_table->vals[hcode + huffman_table->valoffset[nbits]];
 		}
 	}
 	snprintf(priv->error_string, sizeof(priv->error_string),
@@ -417,16 +426,21 @@ static void process_Huffman_data_unit(struct jdec_private *priv, int component)
 /*
  * Takes two array of bits, and build the huffman table for size, and code
  *
- * lookup will return the symbol if the code is less or equal than HUFFMAN_HASH_NBITS.
- * code_size will be used to known how many bits this symbol is encoded.
- * slowtable will be used when the first lookup didn't give the result.
+ * lookup will return the symbol and its size if the code is less or equal
+ * than HUFFMAN_HASH_NBITS.
+ * maxcode and valoffset will be used when the first lookup didn't give the
+ * result.
  */
 static int build_huffman_table(struct jdec_private *priv, const unsigned char *bits, const unsigned char *vals, struct huffman_table *table)
 {
-	unsigned int i, j, code, code_size, val, nbits;
+	unsigned int i, j, code, code_size, val, nbits, count = 0;
 	unsigned char huffsize[257], *hz;
 	unsigned int huffcode[257], *hc;
-	int slowtable_used[16 - HUFFMAN_HASH_NBITS];
+
+	for (i = 1; i <= 16; i++)
+		count += bits[i];
+	if (count > 256)
+		error("Huffman table with more than 256 codes\n");
 
 	/*
 	 * Build a temp array
@@ -439,9 +453,10 @@ static int build_huffman_table(struct jdec_private *priv, const unsigned char *b
 	}
 	*hz = 0;
 
-	memset(table->lookup, 0xff, sizeof(table->lookup));
-	for (i = 0; i < (16 - HUFFMAN_HASH_NBITS); i++)
-		slowtable_used[i] = 0;
+	memset(table->lookup, 0, sizeof(table->lookup));
+	for (i = 0; i <= 16; i++)
+		table->maxcode[i] = -1;
+	memcpy(table->vals, vals, count);
 
 	/* Build a temp array
 	 *   huffcode[X] => code used to write vals[X]
@@ -460,7 +475,7 @@ static int build_huffman_table(struct jdec_private *priv, const unsigned char *b
 	}
 
 	/*
-	 * Build the lookup table, and the slowtable if needed.
+	 * Build the lookup table, and the maxcode / valoffset tables if needed.
 	 */
 	for (i = 0; huffsize[i]; i++) {
 		val = vals[i];
@@ -469,7 +484,10 @@ static int build_huffman_table(struct jdec_private *priv, const unsigned char *b
 
 		trace("val=%2.2x code=%8.8x codesize=%2.2d\n", i, code, code_size);
 
-		table->code_size[val] = code_size;
+		/* Over-subscribed tables would overflow lookup */
+		if (code >= (1U << code_size))
+			error("Invalid Huffman table\n");
+
 		if (code_size <= HUFFMAN_HASH_NBITS) {
 			/*
 			 * Good: val can be put in the lookup table, so fill all value of this
@@ -479,26 +497,15 @@ static int build_huffman_table(struct jdec_private *priv, const unsigned char *b
 
 			code <<= HUFFMAN_HASH_NBITS - code_size;
 			while (repeat--)
-				table->lookup[code++] = val;
+				table->lookup[code++] = val | (code_size << 8);
 
 		} else {
-			/* Perhaps sorting the array will be an optimization */
-			int slowtable_index = code_size - HUFFMAN_HASH_NBITS - 1;
-
-			if (slowtable_used[slowtable_index] == 254)
-				error("slow Huffman table overflow\n");
-
-			table->slowtable[slowtable_index][slowtable_used[slowtable_index]]
-				= code;
-			table->slowtable[slowtable_index][slowtable_used[slowtable_index] + 1]
-				= val;
-			slowtable_used[slowtable_index] += 2;
+			if (table->maxcode[code_size] == -1)
+				table->valoffset[code_size] = (int)i - (int)code;
+			table->maxcode[code_size] = code;
 		}
 	}
 
-	for (i = 0; i < (16 - HUFFMAN_HASH_NBITS); i++)
-		table->slowtable[i][slowtable_used[i]] = 0;
-
 	return 0;
 }
 
@@ -1319,6 +1326,144 @@ static void YCrCB_to_Grey_2x2(struct jdec_private *priv)
 	}
 }
 
+/*
+ * With a scaled decode the IDCT outputs a bs x bs block (bs = 8 / scale)
+ * for each 8x8 block, at the place in priv->Y / Cb / Cr where the 8x8 block
+ * would have gone. So an MCU of hf x vf blocks gives hf * bs x vf * bs
+ * pixels, these generic converters handle all sampling factors.
+ */
+
+/* Line y of the luma of a scaled MCU, the line continues bs pixels further
+   in the next block */
+static const unsigned char *scaled_luma_line(const struct jdec_private *priv,
+		unsigned int y, unsigned int bs)
+{
+	unsigned int hf = priv->component_infos[cY].Hfactor;
+
+	return priv->Y + (y / bs) * 64 * hf + (y % bs) * 8 * hf;
+}
+
+/**
+ *  YCrCb -> YUV420P (scaled)
+ */
+static void YCrCB_to_YUV420P_scaled(struct jdec_private *priv)
+{
+	unsigned int bs = 8 / priv->scale;
+	unsigned int hf = priv->component_infos[cY].Hfactor;
+	unsigned int vf = priv->component_infos[cY].Vfactor;
+	unsigned int width = priv->width / priv->scale;
+	const unsigned char *y, *cb, *cr;
+	unsigned char *p, *u, *v;
+	unsigned int i, j;
+
+	p = priv->plane[0];
+	for (i = 0; i < vf * bs; i++) {
+		y = scaled_luma_line(priv, i, bs);
+		for (j = 0; j < hf; j++)
+			memcpy(p + j * bs, y + j * 8, bs);
+		p += width;
+	}
+
+	/* As the unscaled converters, take every other chroma sample when
+	   the chroma is not subsampled */
+	u = priv->plane[1];
+	v = priv->plane[2];
+	for (i = 0; i < vf * bs / 2; i++) {
+		cb = priv->Cb + (i * 2 / vf) * 8;
+		cr = priv->Cr + (i * 2 / vf) * 8;
+		for (j = 0; j < hf * bs / 2; j++) {
+			u[j] = cb[j * 2 / hf];
+			v[j] = cr[j * 2 / hf];
+		}
+		u += width / 2;
+		v += width / 2;
+	}
+}
+
+static void YCrCB_to_RGB24_scaled_common(struct jdec_private *priv, int bgr)
+{
+	unsigned int bs = 8 / priv->scale;
+	unsigned int hf = priv->component_infos[cY].Hfactor;
+	unsigned int vf = priv->component_infos[cY].Vfactor;
+	unsigned int width = priv->width / priv->scale;
+	const unsigned char *Y, *Cb, *Cr;
+	unsigned char *p;
+	unsigned int i, j;
+
+#define SCALEBITS       10
+#define ONE_HALF        (1UL << (SCALEBITS - 1))
+#define FIX(x)          ((int)((x) * (1UL << SCALEBITS) + 0.5))
+
+	for (i = 0; i < vf * bs; i++) {
+		p = priv->plane[0] + i * width * 3;
+		Y = scaled_luma_line(priv, i, bs);
+		Cb = priv->Cb + (i / vf) * 8;
+		Cr = priv->Cr + (i / vf) * 8;
+
+		for (j = 0; j < hf * bs; j++) {
+			int y, cb, cr;
+			int add_r, add_g, add_b;
+			int r, g , b;
+
+			y  = Y[(j / bs) * 8 + j % bs] << SCALEBITS;
+			cb = Cb[j / hf] - 128;
+			cr = Cr[j / hf] - 128;
+			add_r = FIX(1.40200) * cr + ONE_HALF;
+			add_g = -FIX(0.34414) * cb - FIX(0.71414) * cr + ONE_HALF;
+			add_b = FIX(1.77200) * cb + ONE_HALF;
+
+			r = clamp((y + add_r) >> SCALEBITS);
+			g = clamp((y + add_g) >> SCALEBITS);
+			b = clamp((y + add_b) >> SCALEBITS);
+			*p++ = bgr ? b : r;
+			*p++ = g;
+			*p++ = bgr ? r : b;
+		}
+	}
+
+#undef SCALEBITS
+#undef ONE_HALF
+#undef FIX
+}
+
+/**
+ *  YCrCb -> RGB24 (scaled)
+ */
+static void YCrCB_to_RGB24_scaled(struct jdec_private *priv)
+{
+	YCrCB_to_RGB24_scaled_common(priv, 0);
+}
+
+/**
+ *  YCrCb -> BGR24 (scaled)
+ */
+static void YCrCB_to_BGR24_scaled(struct jdec_private *priv)
+{
+	YCrCB_to_RGB24_scaled_common(priv, 1);
+}
+
+/**
+ *  YCrCb -> Grey (scaled)
+ */
+static void YCrCB_to_Grey_scaled(struct jdec_private *priv)
+{
+	unsigned int bs = 8 / priv->scale;
+	unsigned int hf = priv->component_infos[cY].Hfactor;
+	unsigned int vf = priv->component_infos[cY].Vfactor;
+	unsigned int width = priv->width / priv->scale;
+	const unsigned char *y;
+	unsigned char *p;
+	unsigned int i, j;
+
+	p = priv->plane[0];
+	for (i = 0; i < vf * bs; i++) {
+		y = scaled_luma_line(priv, i, bs);
+		for (j = 0; j < hf; j++)
+			memcpy(p + j * bs, y + j * 8, bs);
+		p += width;
+	}
+}
+
 
 /*
  * Decode all the 3 components for 1x1
@@ -1380,7 +1525,8 @@ static void decode_MCU_2x1_3planes(struct jdec_private *priv)
 	IDCT(&priv->component_infos[cCr], priv->Cr, 8);
 }
 
-static void build_quantization_table(float *qtable, const unsigned char *ref_table);
+static void build_quantization_table(struct jdec_private *priv, int qi,
+		const unsigned char *ref_table);
 
 static void pixart_decode_MCU_2x1_3planes(struct jdec_private *priv)
 {
@@ -1465,7 +1611,7 @@ static void pixart_decode_MCU_2x1_3planes(struct jdec_private *priv)
 			j = (pixart_q[lumi][i] * comp + 50) / 100;
 			qt[i] = (j < 255) ? j : 255;
 		}
-		build_quantization_table(priv->Q_tables[0], qt);
+		build_quantization_table(priv, 0, qt);
 
 		/* If bit 7 of the marker is set chrominance uses the
 		   luminance quantization table */
@@ -1476,7 +1622,7 @@ static void pixart_decode_MCU_2x1_3planes(struct jdec_private *priv)
 				qt[i] = (j < 255) ? j : 255;
 			}
 		}
-		build_quantization_table(priv->Q_tables[1], qt);
+		build_quantization_table(priv, 1, qt);
 
 		priv->marker = marker;
 	}
@@ -1657,7 +1803,8 @@ static void print_SOF(const unsigned char *stream)
  *
  ******************************************************************************/
 
-static void build_quantization_table(float *qtable, const unsigned char *ref_table)
+static void build_quantization_table(struct jdec_private *priv, int qi,
+		const unsigned char *ref_table)
 {
 	/* Taken from libjpeg. Copyright Independent JPEG Group's LLM idct.
 	 * For float AA&N IDCT method, divisors are equal to quantization
@@ -1673,18 +1820,36 @@ static void build_quantization_table(float *qtable, const unsigned char *ref_tab
 		1.0, 1.387039845, 1.306562965, 1.175875602,
 		1.0, 0.785694958, 0.541196100, 0.275899379
 	};
+	/* For the integer AA&N IDCT the same scale factors, scaled up by 14
+	 * bits, which get descaled to leave 2 bits of extra precision */
+	static const int16_t aanscales[64] = {
+		16384, 22725, 21407, 19266, 16384, 12873,  8867,  4520,
+		22725, 31521, 29692, 26722, 22725, 17855, 12299,  6270,
+		21407, 29692, 27969, 25172, 21407, 16819, 11585,  5906,
+		19266, 26722, 25172, 22654, 19266, 15137, 10426,  5315,
+		16384, 22725, 21407, 19266, 16384, 12873,  8867,  4520,
+		12873, 17855, 16819, 15137, 12873, 10114,  6967,  3552,
+		 8867, 12299, 11585, 10426,  8867,  6967,  4799,  2446,
+		 4520,  6270,  5906,  5315,  4520,  3552,  2446,  1247
+	};
+	float *qtable = priv->Q_tables[qi];
 	const unsigned char *zz = zigzag;
 
 	for (i = 0; i < 8; i++)
 		for (j = 0; j < 8; j++)
 			*qtable++ = ref_table[*zz++] * aanscalefactor[i] * aanscalefactor[j];
 
+	/* The integer islow IDCT uses the plain quantization coefficients */
+	for (i = 0; i < 64; i++) {
+		priv->islow_Q_tables[qi][i] = ref_table[zigzag[i]];
+		priv->ifast_Q_tables[qi][i] =
+			(ref_table[zigzag[i]] * aanscales[i] + (1 << 11)) >> 12;
+	}
 }
 
 static int parse_DQT(struct jdec_private *priv, const unsigned char *stream)
 {
 	int qi;
-	float *table;
 	const unsigned char *dqt_block_end;
 
 	trace("> DQT marker\n");
@@ -1700,8 +1865,7 @@ static int parse_DQT(struct jdec_private *priv, const unsigned char *stream)
 			error("No more than %d quantization tables supported (got %d)\n",
 					COMPONENTS, qi + 1);
 #endif
-		table = priv->Q_tables[qi];
-		build_quantization_table(table, stream);
+		build_quantization_table(priv, qi, stream);
 		stream += 64;
 	}
 	trace("< DQT marker\n");
@@ -1723,7 +1887,8 @@ static int parse_SOF(struct jdec_private *priv, const unsigned char *stream)
 #if SANITY_CHECK
 	if (stream[2] != 8)
 		error("Precision other than 8 is not supported\n");
-	if (width > JPEG_MAX_WIDTH || height > JPEG_MAX_HEIGHT)
+	if (width == 0 || height == 0 ||
+			(unsigned long)width * height > JPEG_MAX_PIXELS)
 		error("Width and Height (%dx%d) seems suspicious\n", width, height);
 	if (nr_components != 3)
 		error("We only support YUV images\n");
@@ -1744,6 +1909,8 @@ static int parse_SOF(struct jdec_private *priv, const unsigned char *stream)
 		c->Vfactor = sampling_factor & 0xf;
 		c->Hfactor = sampling_factor >> 4;
 		c->Q_table = priv->Q_tables[Q_table];
+		c->islow_Q_table = priv->islow_Q_tables[Q_table];
+		c->ifast_Q_table = priv->ifast_Q_tables[Q_table];
 		trace("Component:%d  factor:%dx%d  Quantization table:%d\n",
 				cid, c->Hfactor, c->Hfactor, Q_table);
 
@@ -2081,6 +2248,12 @@ struct jdec_private *tinyjpeg_init(void)
 	priv = (struct jdec_private *)calloc(1, sizeof(struct jdec_private));
 	if (priv == NULL)
 		return NULL;
+
+	/* Make sure the SIMD IDCT has been selected */
+	v4lconvert_cpu_init();
+	priv->idct = tinyjpeg_idct_islow;
+	priv->scale = 1;
+
 	return priv;
 }
 
@@ -2101,6 +2274,8 @@ void tinyjpeg_free(struct jdec_private *priv)
 	}
 	priv->tmp_buf_y_size = 0;
 	free(priv->stream_filtered);
+	free(priv->intervals_buf);
+	free(priv->band_buf);
 	free(priv);
 }
 
@@ -2231,6 +2406,161 @@ kernel: 0xff 0xff 0x00 0xff 0x96, and we skip one unknown byte */
 	error("Short Pixart JPEG frame\n");
 }
 
+/* A frame with restart markers decoded in bands of restart intervals */
+struct restart_job {
+	struct jdec_private *priv;
+	decode_MCU_fct decode_MCU;
+	convert_colorspace_fct convert_to_pixfmt;
+	const unsigned char **interval;	/* start of each restart interval */
+	int intervals;
+	int markers;			/* of the intervals, + 1 for the end */
+	unsigned int mcus;		/* MCUs in the frame */
+	unsigned int mcus_per_row;
+	unsigned int bytes_per_blocklines[3], bytes_per_mcu[3];
+	int bands;
+	int result;
+};
+
+/* Find where each of the restart intervals starts, without decoding them,
+   the same way find_next_rst_marker() does. Returns the number of intervals
+   found, which is less then max when an EOI marker is found first, or -1
+   when find_next_rst_marker() would fail. interval[] is terminated with the
+   end of the EOI marker then */
+static int find_restart_intervals(struct jdec_private *priv,
+		const unsigned char **interval, int max)
+{
+	const unsigned char *stream = priv->stream;
+	int n = 0;
+	int marker;
+
+	interval[n++] = stream;
+	while (n < max) {
+		stream = memchr(stream, 0xff, priv->stream_end - stream);
+		if (stream == NULL)
+			return -1;
+		/* Skip any padding ff byte (this is normal) */
+		while (++stream < priv->stream_end && *stream == 0xff)
+			;
+		if (stream >= priv->stream_end)
+			return -1;
+
+		marker = *stream++;
+		if (marker == RST + ((priv->last_rst_marker_seen + n - 1) & 7))
+			interval[n++] = stream;
+		else if (marker >= RST && marker <= RST7)
+			return -1;
+		else if (marker == EOI) {
+			interval[n] = stream;
+			break;
+		}
+	}
+
+	return n;
+}
+
+static void decode_restart_intervals(void *arg, int thread, int band)
+{
+	struct restart_job *job = arg;
+	struct jdec_private *priv;
+	unsigned int mcu, end, x, y;
+	int i, first = job->intervals * band / job->bands;
+	int last = job->intervals * (band + 1) / job->bands;
+
+	/* Each thread decodes with its own copy of the decoder state, the
+	   tables it points to are only read while decoding */
+	priv = (struct jdec_private *)v4lconvert_pool_scratch(job->priv->pool,
+			thread, sizeof(*priv));
+	if (priv == NULL) {
+		job->result = -1;
+		return;
+	}
+	memcpy(priv, job->priv, sizeof(*priv));
+
+	if (setjmp(priv->jump_state)) {
+		job->result = -1;
+		return;
+	}
+
+	for (i = first; i < last; i++) {
+		priv->stream = job->interval[i];
+		resync(priv);
+
+		mcu = i * priv->restart_interval;
+		end = mcu + priv->restart_interval;
+		if (end > job->mcus)
+			end = job->mcus;
+
+		for (; mcu < end; mcu++) {
+			y = mcu / job->mcus_per_row;
+			x = mcu % job->mcus_per_row;
+			priv->plane[0] = priv->components[0] +
+				y * job->bytes_per_blocklines[0] +
+				x * job->bytes_per_mcu[0];
+			priv->plane[1] = priv->components[1] +
+				y * job->bytes_per_blocklines[1] +
+				x * job->bytes_per_mcu[1];
+			priv->plane[2] = priv->components[2] +
+				y * job->bytes_per_blocklines[2] +
+				x * job->bytes_per_mcu[2];
+			job->decode_MCU(priv);
+			job->convert_to_pixfmt(priv);
+		}
+
+		/* Where the serial decoder would not find the next marker,
+		   because the data of this interval runs into it */
+		if (i + 1 < job->markers && priv->stream -
+				priv->nbits_in_reservoir / 8 >= job->interval[i + 1] - 1) {
+			job->result = -1;
+			return;
+		}
+	}
+}
+
+/* Decode the restart intervals of the frame on the worker threads, returns
+   -1 when the frame cannot be decoded this way, in which case it must be
+   decoded serially */
+static int decode_restart_intervals_parallel(struct jdec_private *priv,
+		struct restart_job *job)
+{
+	int bands;
+
+	job->intervals = (job->mcus + priv->restart_interval - 1) /
+		priv->restart_interval;
+	if (job->intervals < 2)
+		return -1;
+
+	/* When the last interval is complete the serial decoder also checks
+	   the marker after it */
+	job->markers = job->intervals;
+	if (job->mcus % priv->restart_interval == 0)
+		job->markers++;
+
+	job->interval = (const unsigned char **)v4lconvert_alloc_buffer(
+			job->markers * sizeof(*job->interval),
+			&priv->intervals_buf, &priv->intervals_buf_size);
+	if (job->interval == NULL)
+		return -1;
+
+	/* Missing or out of sequence restart markers, leave it to the serial
+	   decoder to deal with these */
+	if (find_restart_intervals(priv, job->interval, job->markers) <
+			job->intervals)
+		return -1;
+
+	bands = v4lconvert_pool_threads(priv->pool) *
+		V4LCONVERT_POOL_BANDS_PER_THREAD;
+	job->bands = job->intervals < bands ? job->intervals : bands;
+	job->priv = priv;
+	job->result = 0;
+
+	v4lconvert_pool_run(priv->pool, decode_restart_intervals, job,
+			job->bands);
+
+	/* On errors the frame gets decoded again by the serial decoder, which
+	   reports where it went wrong */
+	return job->result;
+}
+
 /**
  * Decode and convert the jpeg image into @pixfmt@ image
  *
@@ -2238,16 +2568,31 @@ kernel: 0xff 0xff 0x00 0xff 0x96, and we skip one unknown byte */
  */
 int tinyjpeg_decode(struct jdec_private *priv, int pixfmt)
 {
-	unsigned int x, y, xstride_by_mcu, ystride_by_mcu;
-	unsigned int bytes_per_blocklines[3], bytes_per_mcu[3];
+	unsigned int i, x, y, rows, xstride_by_mcu, ystride_by_mcu;
+	unsigned int bytes_per_blocklines[3], bytes_per_mcu[3], row_step[3];
+	uint8_t *row[3], *planes[3];
 	decode_MCU_fct decode_MCU;
 	const decode_MCU_fct *decode_mcu_table;
 	const convert_colorspace_fct *colorspace_array_conv;
-	convert_colorspace_fct convert_to_pixfmt;
+	convert_colorspace_fct convert_to_pixfmt, convert_scaled;
 
 	if (setjmp(priv->jump_state))
 		return -1;
 
+	switch (priv->scale) {
+	case 2:
+		priv->mcu_idct = tinyjpeg_idct_4x4;
+		break;
+	case 4:
+		priv->mcu_idct = tinyjpeg_idct_2x2;
+		break;
+	case 8:
+		priv->mcu_idct = tinyjpeg_idct_1x1;
+		break;
+	default:
+		priv->mcu_idct = priv->idct;
+	}
+
 	if (priv->flags & TINYJPEG_FLAGS_PLANAR_JPEG)
 		return tinyjpeg_decode_planar(priv, pixfmt);
 
@@ -2282,12 +2627,7 @@ int tinyjpeg_decode(struct jdec_private *priv, int pixfmt)
 	switch (pixfmt) {
 	case TINYJPEG_FMT_YUV420P:
 		colorspace_array_conv = convert_colorspace_yuv420p;
-		if (priv->components[0] == NULL)
-			priv->components[0] = (uint8_t *)malloc(priv->width * priv->height);
-		if (priv->components[1] == NULL)
-			priv->components[1] = (uint8_t *)malloc(priv->width * priv->height/4);
-		if (priv->components[2] == NULL)
-			priv->components[2] = (uint8_t *)malloc(priv->width * priv->height/4);
+		convert_scaled = YCrCB_to_YUV420P_scaled;
 		bytes_per_blocklines[0] = priv->width;
 		bytes_per_blocklines[1] = priv->width/4;
 		bytes_per_blocklines[2] = priv->width/4;
@@ -2298,16 +2638,14 @@ int tinyjpeg_decode(struct jdec_private *priv, int pixfmt)
 
 	case TINYJPEG_FMT_RGB24:
 		colorspace_array_conv = convert_colorspace_rgb24;
-		if (priv->components[0] == NULL)
-			priv->components[0] = (uint8_t *)malloc(priv->width * priv->height * 3);
+		convert_scaled = YCrCB_to_RGB24_scaled;
 		bytes_per_blocklines[0] = priv->width * 3;
 		bytes_per_mcu[0] = 3*8;
 		break;
 
 	case TINYJPEG_FMT_BGR24:
 		colorspace_array_conv = convert_colorspace_bgr24;
-		if (priv->components[0] == NULL)
-			priv->components[0] = (uint8_t *)malloc(priv->width * priv->height * 3);
+		convert_scaled = YCrCB_to_BGR24_scaled;
 		bytes_per_blocklines[0] = priv->width * 3;
 		bytes_per_mcu[0] = 3*8;
 		break;
@@ -2317,8 +2655,7 @@ int tinyjpeg_decode(struct jdec_private *priv, int pixfmt)
 		if (priv->flags & TINYJPEG_FLAGS_PIXART_JPEG)
 			error("Greyscale output not support for PIXART JPEG's\n");
 		colorspace_array_conv = convert_colorspace_grey;
-		if (priv->components[0] == NULL)
-			priv->components[0] = (uint8_t *)malloc(priv->width * priv->height);
+		convert_scaled = YCrCB_to_Grey_scaled;
 		bytes_per_blocklines[0] = priv->width;
 		bytes_per_mcu[0] = 8;
 		break;
@@ -2353,6 +2690,21 @@ int tinyjpeg_decode(struct jdec_private *priv, int pixfmt)
 	if (decode_MCU == NULL)
 		error("no decode MCU function for this JPEG format (PIXART?)\n");
 
+	if (priv->scale > 1) {
+		unsigned int bs = 8 / priv->scale;
+
+		if (priv->component_infos[cY].Hfactor > 2 ||
+				priv->component_infos[cY].Vfactor > 2)
+			error("Scaled decoding not supported for this sampling\n");
+		/* yuv420p needs whole chroma samples for each MCU */
+		if (pixfmt == TINYJPEG_FMT_YUV420P &&
+				((xstride_by_mcu / 8 * bs) % 2 ||
+				 (ystride_by_mcu / 8 * bs) % 2))
+			error("Scaling by 1/%u not supported for YUV420P output with this sampling\n",
+					priv->scale);
+		convert_to_pixfmt = convert_scaled;
+	}
+
 	resync(priv);
 
 	/* Don't forget to that block can be either 8 or 16 lines */
@@ -2364,12 +2716,75 @@ int tinyjpeg_decode(struct jdec_private *priv, int pixfmt)
 	bytes_per_mcu[1] *= xstride_by_mcu / 8;
 	bytes_per_mcu[2] *= xstride_by_mcu / 8;
 
+	/* The checks above make these exact */
+	for (i = 0; i < COMPONENTS; i++) {
+		bytes_per_blocklines[i] /= priv->scale * priv->scale;
+		bytes_per_mcu[i] /= priv->scale;
+	}
+
+	rows = priv->height / ystride_by_mcu;
+
+	if (priv->band && priv->components[0] == NULL) {
+		/* Decode each row of MCUs into the same band buffer, with the
+		   components following each other */
+		priv->band_buf = v4lconvert_alloc_buffer(bytes_per_blocklines[0] +
+				bytes_per_blocklines[1] + bytes_per_blocklines[2],
+				&priv->band_buf, &priv->band_buf_size);
+		if (!priv->band_buf)
+			error("Out of memory!\n");
+		row[0] = priv->band_buf;
+		row[1] = row[0] + bytes_per_blocklines[0];
+		row[2] = row[1] + bytes_per_blocklines[1];
+		row_step[0] = row_step[1] = row_step[2] = 0;
+	} else {
+		for (i = 0; i < COMPONENTS; i++) {
+			if (priv->components[i] == NULL && bytes_per_blocklines[i]) {
+				priv->components[i] = (uint8_t *)malloc(
+					bytes_per_blocklines[i] *
+					((priv->height + ystride_by_mcu - 1) /
+					 ystride_by_mcu));
+				if (!priv->components[i])
+					error("Out of memory!\n");
+			}
+			row[i] = priv->components[i];
+			row_step[i] = bytes_per_blocklines[i];
+		}
+	}
+
+	/* With restart markers every restart interval can be decoded on its
+	   own, as long as the MCUs do not overlap at the right edge */
+	if (priv->pool && row_step[0] && priv->restart_interval > 0 &&
+			!(priv->flags & TINYJPEG_FLAGS_PIXART_JPEG) &&
+			priv->width % xstride_by_mcu == 0) {
+		struct restart_job job;
+
+		job.decode_MCU = decode_MCU;
+		job.convert_to_pixfmt = convert_to_pixfmt;
+		job.mcus_per_row = priv->width / xstride_by_mcu;
+		job.mcus = job.mcus_per_row * (priv->height / ystride_by_mcu);
+		memcpy(job.bytes_per_blocklines, bytes_per_blocklines,
+				sizeof(job.bytes_per_blocklines));
+		memcpy(job.bytes_per_mcu, bytes_per_mcu,
+				sizeof(job.bytes_per_mcu));
+		if (decode_restart_intervals_parallel(priv, &job) == 0) {
+			for (y = 0; y < rows && priv->band; y++) {
+				for (i = 0; i < COMPONENTS; i++)
+					planes[i] = row[i] + y * row_step[i];
+				priv->band(priv->band_opaque, planes,
+						y * ystride_by_mcu / priv->scale,
+						ystride_by_mcu / priv->scale);
+			}
+			return 0;
+		}
+	}
+
 	/* Just the decode the image by macroblock (size is 8x8, 8x16, or 16x16) */
-	for (y = 0; y < priv->height / ystride_by_mcu; y++) {
+	for (y = 0; y < rows; y++) {
 		//trace("Decoding row %d\n", y);
-		priv->plane[0] = priv->components[0] + (y * bytes_per_blocklines[0]);
-		priv->plane[1] = priv->components[1] + (y * bytes_per_blocklines[1]);
-		priv->plane[2] = priv->components[2] + (y * bytes_per_blocklines[2]);
+		for (i = 0; i < COMPONENTS; i++) {
+			planes[i] = row[i] + y * row_step[i];
+			priv->plane[i] = planes[i];
+		}
 		for (x = 0; x < priv->width; x += xstride_by_mcu) {
 			decode_MCU(priv);
 			convert_to_pixfmt(priv);
@@ -2386,6 +2801,10 @@ int tinyjpeg_decode(struct jdec_private *priv, int pixfmt)
 				}
 			}
 		}
+		if (priv->band)
+			priv->band(priv->band_opaque, planes,
+					y * ystride_by_mcu / priv->scale,
+					ystride_by_mcu / priv->scale);
 	}
 
 	if (priv->flags & TINYJPEG_FLAGS_PIXART_JPEG) {
@@ -2402,6 +2821,9 @@ int tinyjpeg_decode_planar(struct jdec_private *priv, int pixfmt)
 	unsigned int i, x, y;
 	uint8_t *y_buf, *u_buf, *v_buf, *p, *p2;
 
+	if (priv->scale > 1)
+		error("Scaled decoding not supported with planar JPEG input\n");
+
 	switch (pixfmt) {
 	case TINYJPEG_FMT_GREY:
 		error("Greyscale output not supported with planar JPEG input\n");
@@ -2626,6 +3048,9 @@ int tinyjpeg_decode_planar(struct jdec_private *priv, int pixfmt)
 #undef ONE_HALF
 #undef FIX
 
+	if (priv->band)
+		priv->band(priv->band_opaque, priv->components, 0, priv->height);
+
 	return 0;
 }
 
@@ -2668,3 +3093,61 @@ int tinyjpeg_set_flags(struct jdec_private *priv, int flags)
 	return oldflags;
 }
 
+/* Have band called for each row of MCUs as soon as it is decoded, so that
+   it can be further processed while still in the cache. When no components
+   have been set tinyjpeg_decode() does not decode into a full frame buffer,
+   but reuses a buffer for a single row of MCUs. Planar jpegs are always
+   decoded into the full frame, band then gets called once for the entire
+   frame. */
+int tinyjpeg_set_band_callback(struct jdec_private *priv, tinyjpeg_band_fct band,
+		void *opaque)
+{
+	priv->band = band;
+	priv->band_opaque = opaque;
+	return 0;
+}
+
+/* Decode frames with restart markers on the threads of pool */
+int tinyjpeg_set_pool(struct jdec_private *priv, struct v4lconvert_pool *pool)
+{
+	priv->pool = pool;
+	return 0;
+}
+
+/* Decode at 1/denom of the size of the image, by only using the low
+   frequency DCT coefficients of each block. The decoded image is width /
+   denom by height / denom pixels, denom must be 1, 2, 4 or 8. Scaling is not
+   supported for planar jpegs, and for YUV420P output only when the chroma of
+   each MCU still has a whole number of samples. When scaling the IDCT set
+   with tinyjpeg_set_idct() is not used. */
+int tinyjpeg_set_scale(struct jdec_private *priv, unsigned int denom)
+{
+	switch (denom) {
+	case 1:
+	case 2:
+	case 4:
+	case 8:
+		priv->scale = denom;
+		return 0;
+	}
+	return -1;
+}
+
+int tinyjpeg_set_idct(struct jdec_private *priv, int idct)
+{
+	switch (idct) {
+	case TINYJPEG_IDCT_ISLOW:
+		priv->idct = tinyjpeg_idct_islow;
+		break;
+	case TINYJPEG_IDCT_IFAST:
+		priv->idct = tinyjpeg_idct_ifast;
+		break;
+	case TINYJPEG_IDCT_FLOAT:
+		priv->idct = tinyjpeg_idct_float;
+		break;
+	default:
+		return -1;
+	}
+	return 0;
+}
+
@@ -40,6 +40,12 @@ extern "C" {
 #endif
 
 struct jdec_private;
+struct v4lconvert_pool;
+
+/* Called with the decoded lines first_line till first_line + lines, planes
+   points to the first of these lines in each component */
+typedef void (*tinyjpeg_band_fct)(void *opaque, unsigned char **planes,
+				unsigned int first_line, unsigned int lines);
 
 /* Flags that can be set by any applications */
 #define TINYJPEG_FLAGS_MJPEG_TABLE	(1<<1)
@@ -54,6 +60,13 @@ enum tinyjpeg_fmt {
 	TINYJPEG_FMT_YUV420P,
 };
 
+/* Inverse DCT used for decoding */
+enum tinyjpeg_idct {
+	TINYJPEG_IDCT_ISLOW,	/* accurate integer, the default */
+	TINYJPEG_IDCT_IFAST,	/* less accurate integer */
+	TINYJPEG_IDCT_FLOAT,
+};
+
 struct jdec_private *tinyjpeg_init(void);
 void tinyjpeg_free(struct jdec_private *priv);
 
@@ -65,6 +78,11 @@ int tinyjpeg_get_components(struct jdec_private *priv, unsigned char **component
 int tinyjpeg_set_components(struct jdec_private *priv, unsigned char **components,
 				unsigned int ncomponents);
 int tinyjpeg_set_flags(struct jdec_private *priv, int flags);
+int tinyjpeg_set_idct(struct jdec_private *priv, int idct);
+int tinyjpeg_set_scale(struct jdec_private *priv, unsigned int denom);
+int tinyjpeg_set_pool(struct jdec_private *priv, struct v4lconvert_pool *pool);
+int tinyjpeg_set_band_callback(struct jdec_private *priv, tinyjpeg_band_fct band,
+				void *opaque);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,1329 @@
+/*
+
+# Benchmark of the libv4lconvert conversion paths
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License, version 2.1,
+# as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+/* Drives v4lconvert_convert() through a fake device for every source format
+   we support, to each destination format, with each kind of processing, and
+   prints the speed, the memory allocated by the first conversion and a
+   checksum of its output:
+
+   v4lconvert-bench [-s WxH[,WxH...]] [-f FOURCC[,FOURCC...]] [-t seconds]
+                    [-r FOURCC:WxH:file]... [-c golden-file] [-i] [-j] [-d]
+                    [-m] [-p]
+
+   -s  frame sizes to run the synthetic frames at (640x480,1920x1080,3840x2160),
+       even and at least 16x16. Formats whose decoder does not handle a size
+       are skipped at it
+   -f  only run these source formats
+   -t  minimum time to spend on each case (0.2)
+   -r  also run a recorded frame, this is the only way to run the compressed
+       formats which have no synthetic frame
+   -c  compare the checksums against the output of an earlier run, exits
+       with 1 if any of them differ
+   -i  instead check the islow and ifast idct of tinyjpeg against the float
+       one, on synthetic jpeg frames of each size at several qualities.
+       Exits with 1 if the max or mean error of the decoded samples is over
+       the bounds in bench_idcts
+   -j  instead time the tinyjpeg decoding of synthetic jpeg frames of each
+       size, with each idct and at 1/8 scale. At 1/8 scale only the dc
+       coefficient goes through an idct, which leaves mostly the huffman
+       decoding
+   -d  instead check the sn9c10x, mr97310a, pac207, spca561 and sn9c20x
+       decoders against the checksums in bench_decoders, exits with 1 if
+       any of them differ
+   -m  instead check that synthetic jpeg frames with restart markers of each
+       size decode the same on LIBV4LCONVERT_THREADS (4) threads, which
+       decode the restart intervals in parallel, as serially. Exits with 1
+       if any of them differ
+   -p  run each case with LIBV4LCONVERT_THREADS 1, 2 and 4, and print the
+       ns/frame with each and the speedup over 1 thread instead. The
+       output must be the same with each, it counts as a mismatch if not
+
+   The checksums only match between runs with the same cpu flags, run with
+   LIBV4LCONVERT_CPU_FLAGS=0 to compare against the plain C code. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <malloc.h>
+#include <time.h>
+#include <pwd.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "libv4lconvert-priv.h"
+#include "tinyjpeg-internal.h"
+
+#define BENCH_MAX_RECORDED 32
+#define BENCH_MAX_SIZES 8
+#define BENCH_HM12_STRIDE 720
+
+enum bench_gen {
+	BENCH_GEN_BYTES,  /* Any bytes are a valid frame */
+	BENCH_GEN_YUYV,
+	BENCH_GEN_YUV420,
+	BENCH_GEN_JPEG,   /* Encoded with libjpeg */
+	BENCH_GEN_VLC,    /* Random codes of the webcam bitstream formats */
+	BENCH_GEN_NONE,   /* Needs a recorded frame */
+};
+
+static const struct bench_src_fmt {
+	unsigned int fourcc;
+	int bpp;          /* For bytesperline, 0 if not line based */
+	int frame_bits;   /* Bits per pixel for the frame size */
+	enum bench_gen gen;
+} src_fmts[] = {
+	{ V4L2_PIX_FMT_RGB24,		24,	24,	BENCH_GEN_BYTES },
+	{ V4L2_PIX_FMT_BGR24,		24,	24,	BENCH_GEN_BYTES },
+	{ V4L2_PIX_FMT_YUV420,		 8,	12,	BENCH_GEN_YUV420 },
+	{ V4L2_PIX_FMT_YVU420,		 8,	12,	BENCH_GEN_YUV420 },
+	{ V4L2_PIX_FMT_NV12,		 8,	12,	BENCH_GEN_YUV420 },
+	{ V4L2_PIX_FMT_RGB565,		16,	16,	BENCH_GEN_BYTES },
+	{ V4L2_PIX_FMT_BGR32,		32,	32,	BENCH_GEN_BYTES },
+	{ V4L2_PIX_FMT_RGB32,		32,	32,	BENCH_GEN_BYTES },
+	{ V4L2_PIX_FMT_XBGR32,		32,	32,	BENCH_GEN_BYTES },
+	{ V4L2_PIX_FMT_XRGB32,		32,	32,	BENCH_GEN_BYTES },
+	{ V4L2_PIX_FMT_ABGR32,		32,	32,	BENCH_GEN_BYTES },
+	{ V4L2_PIX_FMT_ARGB32,		32,	32,	BENCH_GEN_BYTES },
+	{ V4L2_PIX_FMT_YUYV,		16,	16,	BENCH_GEN_YUYV },
+	{ V4L2_PIX_FMT_YVYU,		16,	16,	BENCH_GEN_YUYV },
+	{ V4L2_PIX_FMT_UYVY,		16,	16,	BENCH_GEN_YUYV },
+	{ V4L2_PIX_FMT_SPCA501,		 0,	12,	BENCH_GEN_BYTES },
+	{ V4L2_PIX_FMT_SPCA505,		 0,	12,	BENCH_GEN_BYTES },
+	{ V4L2_PIX_FMT_SPCA508,		 0,	12,	BENCH_GEN_BYTES },
+	{ V4L2_PIX_FMT_CIT_YYVYUY,	 0,	12,	BENCH_GEN_BYTES },
+	{ V4L2_PIX_FMT_KONICA420,	 0,	12,	BENCH_GEN_BYTES },
+	{ V4L2_PIX_FMT_SN9C20X_I420,	 0,	12,	BENCH_GEN_BYTES },
+	{ V4L2_PIX_FMT_M420,		 0,	12,	BENCH_GEN_BYTES },
+	{ V4L2_PIX_FMT_HM12,		 0,	12,	BENCH_GEN_BYTES },
+	{ V4L2_PIX_FMT_CPIA1,		 0,	 0,	BENCH_GEN_NONE },
+	{ V4L2_PIX_FMT_MJPEG,		 0,	 0,	BENCH_GEN_JPEG },
+	{ V4L2_PIX_FMT_JPEG,		 0,	 0,	BENCH_GEN_JPEG },
+	{ V4L2_PIX_FMT_PJPG,		 0,	 0,	BENCH_GEN_NONE },
+	{ V4L2_PIX_FMT_JPGL,		 0,	 0,	BENCH_GEN_NONE },
+	{ V4L2_PIX_FMT_OV511,		 0,	 0,	BENCH_GEN_NONE },
+	{ V4L2_PIX_FMT_OV518,		 0,	 0,	BENCH_GEN_NONE },
+	{ V4L2_PIX_FMT_SBGGR8,		 8,	 8,	BENCH_GEN_BYTES },
+	{ V4L2_PIX_FMT_SGBRG8,		 8,	 8,	BENCH_GEN_BYTES },
+	{ V4L2_PIX_FMT_SGRBG8,		 8,	 8,	BENCH_GEN_BYTES },
+	{ V4L2_PIX_FMT_SRGGB8,		 8,	 8,	BENCH_GEN_BYTES },
+	{ V4L2_PIX_FMT_STV0680,		 8,	 8,	BENCH_GEN_BYTES },
+	{ V4L2_PIX_FMT_SPCA561,		 0,	 0,	BENCH_GEN_NONE },
+	{ V4L2_PIX_FMT_SN9C10X,		 0,	 8,	BENCH_GEN_VLC },
+	{ V4L2_PIX_FMT_SN9C2028,	 0,	 0,	BENCH_GEN_NONE },
+	{ V4L2_PIX_FMT_PAC207,		 0,	12,	BENCH_GEN_VLC },
+	{ V4L2_PIX_FMT_MR97310A,	 0,	 8,	BENCH_GEN_VLC },
+	{ V4L2_PIX_FMT_JL2005BCD,	 0,	 0,	BENCH_GEN_NONE },
+	{ V4L2_PIX_FMT_SQ905C,		 0,	 0,	BENCH_GEN_NONE },
+	{ V4L2_PIX_FMT_SE401,		 0,	 0,	BENCH_GEN_NONE },
+	{ V4L2_PIX_FMT_GREY,		 8,	 8,	BENCH_GEN_BYTES },
+	{ V4L2_PIX_FMT_Y4,		 8,	 8,	BENCH_GEN_BYTES },
+	{ V4L2_PIX_FMT_Y6,		 8,	 8,	BENCH_GEN_BYTES },
+	{ V4L2_PIX_FMT_Y10BPACK,	10,	10,	BENCH_GEN_BYTES },
+	{ V4L2_PIX_FMT_Y16,		16,	16,	BENCH_GEN_BYTES },
+	{ V4L2_PIX_FMT_Y16_BE,		16,	16,	BENCH_GEN_BYTES },
+};
+
+static const unsigned int dest_fmts[] = {
+	V4L2_PIX_FMT_RGB24,
+	V4L2_PIX_FMT_BGR24,
+	V4L2_PIX_FMT_YUV420,
+	V4L2_PIX_FMT_YVU420,
+	V4L2_PIX_FMT_NV12,
+};
+
+enum bench_variant {
+	BENCH_PLAIN,
+	BENCH_PROCESSING, /* Whitebalance + gamma */
+	BENCH_FLIP,       /* hflip + vflip */
+	BENCH_ROTATE90,
+	BENCH_CROP,
+	BENCH_VARIANT_COUNT
+};
+
+static const char *variant_names[BENCH_VARIANT_COUNT] = {
+	"plain", "processing", "flip", "rotate90", "crop"
+};
+
+/* LIBV4LCONVERT_THREADS of the -p runs */
+static const int bench_sweep_threads[] = { 1, 2, 4 };
+
+struct bench_frame {
+	const struct bench_src_fmt *fmt;
+	int width;
+	int height;
+	unsigned char *data;
+	int size;
+};
+
+struct bench_golden {
+	char name[128];
+	unsigned int checksum;
+};
+
+static struct bench_golden *golden;
+static int golden_count;
+static double min_time = 0.2;
+static int threads = 4;
+static int thread_sweep;
+static int mismatches;
+
+#ifdef HAVE_JPEG
+/* Bounds for the error of the decoded samples against the float idct. Like
+   the one of libjpeg, ifast overflows its 8 bit fixed point multipliers with
+   the large coefficients of quality 100, so it only gets checked up to
+   max_quality. */
+static const struct bench_idct {
+	const char *name;
+	int idct;
+	int max_error;
+	double mean_error;
+	int max_quality;
+} bench_idcts[] = {
+	{ "islow", TINYJPEG_IDCT_ISLOW, 2, 0.10, 100 },
+	{ "ifast", TINYJPEG_IDCT_IFAST, 3, 0.25, 95 },
+};
+
+struct bench_jpeg_params {
+	int quality;
+	int noise;
+	int restart;	/* MCUs per restart interval, 0 for no restart markers */
+};
+
+static const struct bench_jpeg_params bench_idct_corpus[] = {
+	{ 50, 0, 0 }, { 75, 0, 0 }, { 90, 0, 0 }, { 100, 0, 0 },
+	{ 75, 64, 0 }, { 90, 64, 0 }, { 100, 64, 0 }, { 100, 255, 0 },
+};
+
+/* The noisy frame has about 4 times the bits per pixel of the smooth one */
+static const struct bench_jpeg_params bench_jpeg_corpus[] = {
+	{ 85, 0, 0 }, { 90, 64, 0 },
+};
+
+/* The frames of each size have whole rows of MCUs, so 7 leaves a short last
+   interval at most sizes */
+static const struct bench_jpeg_params bench_restart_corpus[] = {
+	{ 85, 0, 1 }, { 85, 0, 7 }, { 90, 64, 40 },
+};
+
+static const struct bench_jpeg_decode {
+	const char *name;
+	int idct;
+	unsigned int scale;
+} bench_jpeg_decodes[] = {
+	{ "huffman", TINYJPEG_IDCT_ISLOW, 8 },
+	{ "islow", TINYJPEG_IDCT_ISLOW, 1 },
+	{ "ifast", TINYJPEG_IDCT_IFAST, 1 },
+	{ "float", TINYJPEG_IDCT_FLOAT, 1 },
+};
+#endif
+
+/* Checksums of the output of the webcam bitstream decoders on synthetic
+   streams, as these formats have no other reference to check against */
+static const struct bench_decoder {
+	unsigned int fourcc;
+	int width;
+	int height;
+	unsigned int seed;
+	unsigned int checksum;
+} bench_decoders[] = {
+	{ V4L2_PIX_FMT_SN9C10X,		640, 480,  1, 0xcf2d42d1 },
+	{ V4L2_PIX_FMT_SN9C10X,		352, 288,  2, 0xbbecf97b },
+	{ V4L2_PIX_FMT_SN9C10X,		176, 144,  3, 0xb877c276 },
+	{ V4L2_PIX_FMT_MR97310A,	640, 480,  1, 0xca1824d7 },
+	{ V4L2_PIX_FMT_MR97310A,	352, 288,  2, 0xacc975bb },
+	{ V4L2_PIX_FMT_MR97310A,	176, 144,  3, 0xd7b869f7 },
+	{ V4L2_PIX_FMT_PAC207,		640, 480,  1, 0x1edd760f },
+	{ V4L2_PIX_FMT_PAC207,		352, 288,  2, 0x0ec4f839 },
+	{ V4L2_PIX_FMT_PAC207,		176, 144,  3, 0x32346fad },
+	{ V4L2_PIX_FMT_SPCA561,		640, 480,  1, 0x6331bfd9 },
+	{ V4L2_PIX_FMT_SPCA561,		352, 288,  2, 0x0cdd957e },
+	{ V4L2_PIX_FMT_SPCA561,		176, 144,  3, 0x98797f0d },
+	{ V4L2_PIX_FMT_SN9C20X_I420,	640, 480,  1, 0x9c18139b },
+	{ V4L2_PIX_FMT_SN9C20X_I420,	352, 288,  2, 0x8258afd6 },
+	{ V4L2_PIX_FMT_SN9C20X_I420,	176, 144,  3, 0xd591a2d5 },
+};
+
+static int bench_ioctl(void *dev_ops_priv, int fd, unsigned long int request,
+		void *arg)
+{
+	struct v4l2_capability *cap = arg;
+
+	/* There is no device behind the bench, just a fake QUERYCAP */
+	(void)dev_ops_priv;
+	(void)fd;
+
+	if (request != VIDIOC_QUERYCAP) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	memset(cap, 0, sizeof(*cap));
+	strcpy((char *)cap->driver, "v4lconvert-bench");
+	strcpy((char *)cap->card, "v4lconvert-bench");
+	snprintf((char *)cap->bus_info, sizeof(cap->bus_info), "bench-%d",
+			(int)getpid());
+	cap->capabilities = V4L2_CAP_VIDEO_CAPTURE;
+	return 0;
+}
+
+static const struct libv4l_dev_ops bench_dev_ops = {
+	.ioctl = bench_ioctl,
+};
+
+static double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static size_t bench_allocated(void)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+	struct mallinfo2 mi = mallinfo2();
+#else
+	struct mallinfo mi = mallinfo();
+#endif
+
+	return (size_t)mi.uordblks + (size_t)mi.hblkhd;
+}
+
+static unsigned int bench_checksum(const unsigned char *buf, int size)
+{
+	unsigned int h = 2166136261u; /* FNV-1a */
+	int i;
+
+	for (i = 0; i < size; i++)
+		h = (h ^ buf[i]) * 16777619u;
+
+	return h;
+}
+
+static const char *bench_fourcc(unsigned int fourcc, char *s)
+{
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		s[i] = (fourcc >> (8 * i)) & 0x7f;
+		/* No spaces, the names are the first field of the output */
+		if (s[i] <= ' ' || s[i] > '~')
+			s[i] = '_';
+	}
+	strcpy(s + 4, (fourcc & (1U << 31)) ? "-BE" : "");
+
+	return s;
+}
+
+static unsigned int bench_parse_fourcc(const char *s)
+{
+	char c[4] = { ' ', ' ', ' ', ' ' };
+	int i;
+
+	for (i = 0; i < 4 && s[i] && s[i] != ':' && s[i] != ','; i++)
+		c[i] = s[i];
+
+	return v4l2_fourcc(c[0], c[1], c[2], c[3]);
+}
+
+/* Is fourcc in the comma separated list of fourccs */
+static int bench_fourcc_listed(const char *list, unsigned int fourcc)
+{
+	while (list) {
+		if (bench_parse_fourcc(list) == fourcc)
+			return 1;
+		list = strchr(list, ',');
+		if (list)
+			list++;
+	}
+
+	return 0;
+}
+
+static const struct bench_src_fmt *bench_find_fmt(unsigned int fourcc)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(src_fmts); i++)
+		if (src_fmts[i].fourcc == fourcc)
+			return &src_fmts[i];
+
+	return NULL;
+}
+
+static unsigned int bench_rand(unsigned int *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 16;
+}
+
+#ifdef HAVE_JPEG
+/* noise adds random values of up to +/- noise / 2 to the samples, for more
+   high frequency coefficients. restart puts a restart marker after every
+   restart MCUs */
+static int bench_gen_jpeg(struct bench_frame *frame, int quality, int noise,
+		int restart)
+{
+	struct jpeg_compress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	unsigned char *line, *buf = NULL;
+	unsigned int seed = 1;
+	size_t size = 0;
+	FILE *f;
+	int x, c;
+
+	f = open_memstream((char **)&buf, &size);
+	if (!f)
+		return -1;
+
+	line = malloc(frame->width * 3);
+	if (!line) {
+		fclose(f);
+		free(buf);
+		return -1;
+	}
+
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&cinfo);
+	jpeg_stdio_dest(&cinfo, f);
+	cinfo.image_width = frame->width;
+	cinfo.image_height = frame->height;
+	cinfo.input_components = 3;
+	cinfo.in_color_space = JCS_RGB;
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_quality(&cinfo, quality, TRUE);
+	cinfo.restart_interval = restart;
+	jpeg_start_compress(&cinfo, TRUE);
+	while (cinfo.next_scanline < cinfo.image_height) {
+		int y = cinfo.next_scanline;
+
+		for (x = 0; x < frame->width; x++) {
+			line[x * 3] = x * 255 / frame->width;
+			line[x * 3 + 1] = y * 255 / frame->height;
+			line[x * 3 + 2] = ((x / 16) ^ (y / 16)) & 1 ? 200 : 50;
+		}
+		for (x = 0; noise && x < frame->width * 3; x++) {
+			c = line[x] + (int)(bench_rand(&seed) % (noise + 1)) - noise / 2;
+			line[x] = c < 0 ? 0 : (c > 255 ? 255 : c);
+		}
+		jpeg_write_scanlines(&cinfo, &line, 1);
+	}
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+	free(line);
+	fclose(f);
+
+	/* Padded like the other frames */
+	frame->data = calloc(1, size * 2 + 4096);
+	if (frame->data)
+		memcpy(frame->data, buf, size);
+	frame->size = size;
+	free(buf);
+
+	return frame->data ? 0 : -1;
+}
+#endif
+
+static void bench_put_bits(unsigned char *p, int *bit, unsigned int v, int n)
+{
+	while (n--) {
+		if ((v >> n) & 1)
+			p[*bit >> 3] |= 0x80 >> (*bit & 7);
+		(*bit)++;
+	}
+}
+
+/* Random bits are a valid sn9c10x or mr97310a stream, with each code as
+   likely as its length implies. pac207 rows have a header and are padded
+   to 16 bits, so these get encoded code by code. spca561 switches between
+   adaptive code tables, some of which have invalid codes on which the
+   decoder gives up on the frame. Setting a bit in every nibble of its codes
+   keeps clear of these for the seeds we use. */
+static void bench_gen_vlc(struct bench_frame *frame, unsigned int seed)
+{
+	unsigned char *p = frame->data;
+	unsigned int v;
+	int i, row, col, bit, len;
+
+	if (frame->fmt->fourcc == V4L2_PIX_FMT_SPCA561) {
+		/* header and 2 raw lines */
+		for (i = 0; i < 0x14 + 2 * frame->width; i++)
+			p[i] = bench_rand(&seed);
+		for (; i < frame->size; i++)
+			p[i] = bench_rand(&seed) | 0x88;
+		return;
+	}
+
+	if (frame->fmt->fourcc != V4L2_PIX_FMT_PAC207) {
+		for (i = 0; i < frame->size; i++)
+			p[i] = bench_rand(&seed);
+		return;
+	}
+
+	for (row = 0; row < frame->height; row++) {
+		/* step size 5, 6 bit absolute values */
+		p[0] = 0x1e;
+		p[1] = 0xe1;
+		p[2] = bench_rand(&seed);
+		p[3] = bench_rand(&seed);
+		bit = 32;
+		for (col = 2; col < frame->width; col++) {
+			v = bench_rand(&seed) & 0x3f;
+			if (v < 0x30)
+				len = 2;
+			else if (v < 0x38)
+				len = 4;
+			else if (v < 0x3c)
+				len = 5;
+			else if (v < 0x3e)
+				len = 6;
+			else
+				len = 5;
+			bench_put_bits(p, &bit, v >> (6 - len), len);
+			if (v >= 0x3e)
+				bench_put_bits(p, &bit, bench_rand(&seed), 6);
+		}
+		p += 2 * ((bit + 15) / 16);
+	}
+	frame->size = p - frame->data;
+}
+
+/* The decoders of some formats only handle the geometry of the cameras
+   which produce them, and overrun their buffers at other sizes */
+static int bench_size_supported(const struct bench_src_fmt *fmt, int width,
+		int height)
+{
+	switch (fmt->fourcc) {
+	case V4L2_PIX_FMT_SPCA501:
+	case V4L2_PIX_FMT_SPCA505:
+	case V4L2_PIX_FMT_SPCA508:
+		/* Copied a long at a time, a chroma line is width / 2 */
+		return width % 16 == 0 && height % 2 == 0;
+	case V4L2_PIX_FMT_HM12:
+		/* Macroblocks in lines of 720 bytes, with a row of chroma
+		   macroblocks for each 32 lines */
+		return width <= BENCH_HM12_STRIDE && height % 32 == 0;
+	}
+
+	return 1;
+}
+
+/* Smooth gradients with some detail, so that the processing has something
+   to work on and the decoders do not take shortcuts */
+static int bench_gen_frame(struct bench_frame *frame)
+{
+	const struct bench_src_fmt *fmt = frame->fmt;
+	int w = frame->width, h = frame->height;
+	unsigned char *p;
+	int i, x, y;
+
+	if (fmt->gen == BENCH_GEN_NONE)
+		return -1;
+
+	if (fmt->gen == BENCH_GEN_JPEG) {
+#ifdef HAVE_JPEG
+		return bench_gen_jpeg(frame, 85, 0, 0);
+#else
+		return -1;
+#endif
+	}
+
+	frame->size = w * h * fmt->frame_bits / 8;
+	if (fmt->fourcc == V4L2_PIX_FMT_HM12)
+		frame->size = BENCH_HM12_STRIDE * h * fmt->frame_bits / 8;
+	/* Some decoders read a bit beyond the nominal frame size */
+	frame->data = calloc(1, frame->size * 2 + 4096);
+	if (!frame->data)
+		return -1;
+	p = frame->data;
+
+	switch (fmt->gen) {
+	case BENCH_GEN_YUYV:
+		for (y = 0; y < h; y++)
+			for (x = 0; x < w; x++, p += 2) {
+				p[0] = 16 + (x * 200 / w + y * 20 / h);
+				p[1] = (x & 1) ? 128 + (y * 64 / h) : 128 - (x * 64 / w);
+			}
+		break;
+	case BENCH_GEN_YUV420:
+		for (y = 0; y < h; y++)
+			for (x = 0; x < w; x++)
+				*p++ = 16 + (x * 200 / w + y * 20 / h);
+		for (i = 0; i < w * h / 2; i++)
+			*p++ = 128 + ((i % w) * 64 / w) - (i * 32 / (w * h / 2));
+		break;
+	case BENCH_GEN_VLC:
+		bench_gen_vlc(frame, 1);
+		break;
+	default:
+		for (i = 0; i < frame->size; i++)
+			p[i] = (i * 7 + (i / (w + 1)) * 3) & 0xff;
+	}
+
+	return 0;
+}
+
+static int bench_load_frame(struct bench_frame *frame, const char *arg)
+{
+	unsigned int fourcc = bench_parse_fourcc(arg);
+	const char *s = strchr(arg, ':');
+	FILE *f;
+	long size;
+
+	frame->fmt = bench_find_fmt(fourcc);
+	if (!frame->fmt || !s ||
+			sscanf(s + 1, "%dx%d", &frame->width, &frame->height) != 2 ||
+			!(s = strchr(s + 1, ':'))) {
+		fprintf(stderr, "invalid recorded frame: %s\n", arg);
+		return -1;
+	}
+	if (!bench_size_supported(frame->fmt, frame->width, frame->height)) {
+		fprintf(stderr, "unsupported size for the format: %s\n", arg);
+		return -1;
+	}
+
+	f = fopen(s + 1, "rb");
+	if (!f) {
+		fprintf(stderr, "opening %s: %s\n", s + 1, strerror(errno));
+		return -1;
+	}
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	frame->data = calloc(1, size * 2 + 4096);
+	if (!frame->data || fread(frame->data, 1, size, f) != (size_t)size) {
+		fprintf(stderr, "reading %s failed\n", s + 1);
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+	frame->size = size;
+
+	return 0;
+}
+
+static void bench_set_ctrl(struct v4lconvert_data *data, int id, int value)
+{
+	struct v4l2_control ctrl = { .id = id, .value = value };
+
+	v4lconvert_vidioc_s_ctrl(data, &ctrl);
+}
+
+static void bench_check_golden(const char *name, unsigned int checksum)
+{
+	int i;
+
+	for (i = 0; i < golden_count; i++)
+		if (!strcmp(golden[i].name, name)) {
+			if (golden[i].checksum != checksum) {
+				printf("  MISMATCH, golden %08x\n", golden[i].checksum);
+				mismatches++;
+			}
+			return;
+		}
+}
+
+static void bench_run(const struct bench_frame *frame, unsigned int dest_pixfmt,
+		enum bench_variant variant)
+{
+	struct v4l2_format src_fmt, dest_fmt;
+	struct v4lconvert_data *data;
+	unsigned char *src, *dest;
+	char name[128], s1[8], s2[8];
+	double start, elapsed, ns[ARRAY_SIZE(bench_sweep_threads)];
+	unsigned int checksum[ARRAY_SIZE(bench_sweep_threads)];
+	size_t allocated = 0;
+	int i, t, r, dest_size, frames;
+	int sweeps = thread_sweep ? ARRAY_SIZE(bench_sweep_threads) : 1;
+
+	memset(&src_fmt, 0, sizeof(src_fmt));
+	src_fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	src_fmt.fmt.pix.width = frame->width;
+	src_fmt.fmt.pix.height = frame->height;
+	src_fmt.fmt.pix.pixelformat = frame->fmt->fourcc;
+	src_fmt.fmt.pix.field = V4L2_FIELD_NONE;
+	src_fmt.fmt.pix.bytesperline = frame->width * frame->fmt->bpp / 8;
+	src_fmt.fmt.pix.sizeimage = frame->size;
+
+	dest_fmt = src_fmt;
+	dest_fmt.fmt.pix.pixelformat = dest_pixfmt;
+	if (variant == BENCH_ROTATE90) {
+		dest_fmt.fmt.pix.width = frame->height;
+		dest_fmt.fmt.pix.height = frame->width;
+	} else if (variant == BENCH_CROP) {
+		dest_fmt.fmt.pix.width = frame->width - 6;
+	}
+	v4lconvert_fixup_fmt(&dest_fmt);
+	dest_size = dest_fmt.fmt.pix.sizeimage;
+
+	snprintf(name, sizeof(name), "%s-%dx%d-%s-%s",
+			bench_fourcc(frame->fmt->fourcc, s1), frame->width,
+			frame->height, bench_fourcc(dest_pixfmt, s2),
+			variant_names[variant]);
+
+	src = malloc(frame->size * 2 + 4096);
+	dest = malloc(dest_size);
+	if (!src || !dest) {
+		printf("%-40s out of memory\n", name);
+		goto leave;
+	}
+
+	for (t = 0; t < sweeps; t++) {
+		/* Read by v4lconvert_create_with_dev_ops() */
+		if (thread_sweep) {
+			snprintf(s1, sizeof(s1), "%d", bench_sweep_threads[t]);
+			setenv("LIBV4LCONVERT_THREADS", s1, 1);
+		}
+
+		allocated = bench_allocated();
+		data = v4lconvert_create_with_dev_ops(-1, NULL, &bench_dev_ops);
+		if (!data) {
+			printf("%-40s creating v4lconvert data failed\n", name);
+			goto leave;
+		}
+
+		bench_set_ctrl(data, V4L2_CID_AUTO_WHITE_BALANCE,
+				variant == BENCH_PROCESSING);
+		bench_set_ctrl(data, V4L2_CID_GAMMA,
+				variant == BENCH_PROCESSING ? 1500 : 1000);
+		bench_set_ctrl(data, V4L2_CID_HFLIP, variant == BENCH_FLIP);
+		bench_set_ctrl(data, V4L2_CID_VFLIP, variant == BENCH_FLIP);
+		bench_set_ctrl(data, V4L2_CID_ROTATE,
+				variant == BENCH_ROTATE90 ? 90 : 0);
+
+		/* Some conversions work in place on the source, so every
+		   conversion gets a fresh copy */
+		memcpy(src, frame->data, frame->size * 2 + 4096);
+		memset(dest, 0, dest_size);
+		r = v4lconvert_convert(data, &src_fmt, &dest_fmt, src, frame->size,
+				dest, dest_size);
+		allocated = bench_allocated() - allocated;
+		if (r < 0) {
+			printf("%-40s failed: %s\n", name,
+					v4lconvert_get_error_message(data));
+			v4lconvert_destroy(data);
+			goto leave;
+		}
+		/* Of the first frame, as the processing adapts over the frames */
+		checksum[t] = bench_checksum(dest, r);
+
+		elapsed = 0;
+		frames = 0;
+		do {
+			memcpy(src, frame->data, frame->size);
+			start = bench_now();
+			for (i = 0; i < 4; i++)
+				v4lconvert_convert(data, &src_fmt, &dest_fmt, src,
+						frame->size, dest, dest_size);
+			elapsed += bench_now() - start;
+			frames += 4;
+		} while (elapsed < min_time);
+		ns[t] = elapsed * 1e9 / frames;
+
+		v4lconvert_destroy(data);
+	}
+
+	if (thread_sweep) {
+		printf("%-40s", name);
+		for (t = 0; t < sweeps; t++)
+			printf(" %2d: %10.0f ns/frame %4.2fx", bench_sweep_threads[t],
+					ns[t], ns[0] / ns[t]);
+		printf("  %08x\n", checksum[0]);
+	} else {
+		printf("%-40s %9.1f MPix/s %12.0f ns/frame %10zu bytes  %08x\n",
+				name, (double)frame->width * frame->height / ns[0] * 1e3,
+				ns[0], allocated, checksum[0]);
+	}
+	/* The bands must come out exactly like the whole frame */
+	for (t = 1; t < sweeps; t++)
+		if (checksum[t] != checksum[0]) {
+			printf("  MISMATCH, %08x with %d threads\n", checksum[t],
+					bench_sweep_threads[t]);
+			mismatches++;
+		}
+	if (golden)
+		bench_check_golden(name, checksum[0]);
+
+leave:
+	free(src);
+	free(dest);
+}
+
+static void bench_frame(const struct bench_frame *frame)
+{
+	int i, j;
+
+	for (i = 0; i < ARRAY_SIZE(dest_fmts); i++)
+		for (j = 0; j < BENCH_VARIANT_COUNT; j++)
+			bench_run(frame, dest_fmts[i], j);
+}
+
+/* Call the decoder directly, as going through v4lconvert_convert() would
+   also check the bayer to rgb conversion of most of them */
+static void bench_decoder_check(struct v4lconvert_data *data,
+		const struct bench_decoder *decoder)
+{
+	struct bench_frame frame = {
+		.fmt = bench_find_fmt(decoder->fourcc),
+		.width = decoder->width,
+		.height = decoder->height,
+		.size = decoder->width * decoder->height * 2,
+	};
+	int r = 0, dest_size = frame.width * frame.height;
+	unsigned int checksum;
+	unsigned char *dest;
+	char name[64], s[8];
+
+	snprintf(name, sizeof(name), "%s-%dx%d-seed%u",
+			bench_fourcc(decoder->fourcc, s), frame.width, frame.height,
+			decoder->seed);
+
+	/* Some decoders read a bit beyond the end of the stream */
+	frame.data = calloc(1, frame.size + 4096);
+	dest = malloc(dest_size * 3 / 2);
+	if (!frame.data || !dest) {
+		printf("%-40s out of memory\n", name);
+		mismatches++;
+		goto leave;
+	}
+	bench_gen_vlc(&frame, decoder->seed);
+	/* Left as is by a decoder which gives up */
+	memset(dest, 0x5a, dest_size * 3 / 2);
+
+	switch (decoder->fourcc) {
+	case V4L2_PIX_FMT_SN9C10X:
+		v4lconvert_decode_sn9c10x(frame.data, frame.size, dest,
+				frame.width, frame.height);
+		break;
+	case V4L2_PIX_FMT_MR97310A:
+		r = v4lconvert_decode_mr97310a(data, frame.data, frame.size, dest,
+				frame.width, frame.height);
+		break;
+	case V4L2_PIX_FMT_PAC207:
+		r = v4lconvert_decode_pac207(data, frame.data, frame.size, dest,
+				frame.width, frame.height);
+		break;
+	case V4L2_PIX_FMT_SPCA561:
+		v4lconvert_decode_spca561(frame.data, dest, frame.width,
+				frame.height);
+		break;
+	case V4L2_PIX_FMT_SN9C20X_I420:
+		v4lconvert_sn9c20x_to_yuv420(frame.data, dest, frame.width,
+				frame.height, 0);
+		dest_size = dest_size * 3 / 2;
+		break;
+	}
+	if (r < 0) {
+		printf("%-40s failed: %s\n", name, v4lconvert_get_error_message(data));
+		mismatches++;
+		goto leave;
+	}
+
+	checksum = bench_checksum(dest, dest_size);
+	printf("%-40s %08x\n", name, checksum);
+	if (checksum != decoder->checksum) {
+		printf("  MISMATCH, golden %08x\n", decoder->checksum);
+		mismatches++;
+	}
+
+leave:
+	free(frame.data);
+	free(dest);
+}
+
+#ifdef HAVE_JPEG
+/* Decode frame into dest as yuv420p with tinyjpeg itself, so that the idct
+   can be chosen per decoder rather than through the environment */
+static int bench_tinyjpeg_decode(struct jdec_private *priv,
+		const struct bench_frame *frame, unsigned char *dest)
+{
+	unsigned char *components[3];
+	unsigned int width, height;
+
+	if (tinyjpeg_parse_header(priv, frame->data, frame->size))
+		return -1;
+
+	tinyjpeg_get_size(priv, &width, &height);
+	components[0] = dest;
+	components[1] = components[0] + width * height;
+	components[2] = components[1] + width * height / 4;
+	tinyjpeg_set_components(priv, components, 3);
+
+	return tinyjpeg_decode(priv, TINYJPEG_FMT_YUV420P);
+}
+
+static void bench_idct_accuracy(const struct bench_frame *frame,
+		const struct bench_jpeg_params *params)
+{
+	int i, j, size = frame->width * frame->height * 3 / 2;
+	unsigned char *ref = malloc(size), *dest = malloc(size);
+	struct jdec_private *priv;
+	char name[128], s[8];
+
+	snprintf(name, sizeof(name), "%s-%dx%d-q%d-n%d",
+			bench_fourcc(frame->fmt->fourcc, s), frame->width,
+			frame->height, params->quality, params->noise);
+
+	priv = tinyjpeg_init();
+	if (!ref || !dest || !priv) {
+		printf("%-40s out of memory\n", name);
+		mismatches++;
+		goto leave;
+	}
+
+	tinyjpeg_set_idct(priv, TINYJPEG_IDCT_FLOAT);
+	if (bench_tinyjpeg_decode(priv, frame, ref)) {
+		printf("%-40s float failed: %s\n", name,
+				tinyjpeg_get_errorstring(priv));
+		mismatches++;
+		goto leave;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(bench_idcts); i++) {
+		const struct bench_idct *idct = &bench_idcts[i];
+		long long sum = 0;
+		int error, max = 0;
+		double mean;
+
+		tinyjpeg_set_idct(priv, idct->idct);
+		if (bench_tinyjpeg_decode(priv, frame, dest)) {
+			printf("%-40s %s failed: %s\n", name, idct->name,
+					tinyjpeg_get_errorstring(priv));
+			mismatches++;
+			continue;
+		}
+
+		for (j = 0; j < size; j++) {
+			error = abs(dest[j] - ref[j]);
+			sum += error;
+			if (error > max)
+				max = error;
+		}
+		mean = (double)sum / size;
+
+		if (params->quality > idct->max_quality) {
+			printf("%-40s %s  max %d  mean %.3f  not checked\n", name,
+					idct->name, max, mean);
+			continue;
+		}
+
+		printf("%-40s %s  max %d (%d)  mean %.3f (%.3f)\n", name,
+				idct->name, max, idct->max_error, mean, idct->mean_error);
+		if (max > idct->max_error || mean > idct->mean_error) {
+			printf("  OUT OF BOUNDS\n");
+			mismatches++;
+		}
+	}
+
+leave:
+	if (priv) {
+		unsigned char *comps[3] = { NULL, NULL, NULL };
+
+		tinyjpeg_set_components(priv, comps, 3);
+		tinyjpeg_free(priv);
+	}
+	free(ref);
+	free(dest);
+}
+
+static void bench_jpeg_speed(const struct bench_frame *frame,
+		const struct bench_jpeg_params *params)
+{
+	int i, j, frames, size = frame->width * frame->height * 3 / 2;
+	unsigned char *dest = malloc(size);
+	struct jdec_private *priv;
+	unsigned char *comps[3] = { NULL, NULL, NULL };
+	double start, elapsed;
+	char name[128], s[8];
+
+	priv = tinyjpeg_init();
+	if (!dest || !priv) {
+		printf("out of memory\n");
+		goto leave;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(bench_jpeg_decodes); i++) {
+		const struct bench_jpeg_decode *decode = &bench_jpeg_decodes[i];
+
+		snprintf(name, sizeof(name), "%s-%dx%d-q%d-n%d-%s",
+				bench_fourcc(frame->fmt->fourcc, s), frame->width,
+				frame->height, params->quality, params->noise,
+				decode->name);
+
+		tinyjpeg_set_idct(priv, decode->idct);
+		tinyjpeg_set_scale(priv, decode->scale);
+		if (bench_tinyjpeg_decode(priv, frame, dest)) {
+			printf("%-40s failed: %s\n", name,
+					tinyjpeg_get_errorstring(priv));
+			continue;
+		}
+
+		elapsed = 0;
+		frames = 0;
+		do {
+			start = bench_now();
+			for (j = 0; j < 4; j++)
+				bench_tinyjpeg_decode(priv, frame, dest);
+			elapsed += bench_now() - start;
+			frames += 4;
+		} while (elapsed < min_time);
+
+		/* MB/s of jpeg data, for the huffman decoding */
+		printf("%-40s %9.1f MPix/s %12.0f ns/frame %9.1f MB/s\n", name,
+				(double)frame->width * frame->height * frames / elapsed / 1e6,
+				elapsed * 1e9 / frames,
+				(double)frame->size * frames / elapsed / 1e6);
+	}
+
+leave:
+	if (priv) {
+		tinyjpeg_set_components(priv, comps, 3);
+		tinyjpeg_free(priv);
+	}
+	free(dest);
+}
+
+/* Decode a frame with restart markers on the worker threads of a pool, which
+   decode the restart intervals in parallel, and check that it comes out the
+   same as when decoded serially */
+static void bench_restart_check(const struct bench_frame *frame,
+		const struct bench_jpeg_params *params)
+{
+	int size = frame->width * frame->height * 3 / 2;
+	unsigned char *ref = malloc(size), *dest = malloc(size);
+	unsigned char *comps[3] = { NULL, NULL, NULL };
+	struct jdec_private *serial, *parallel;
+	struct v4lconvert_pool *pool;
+	char name[128], s[8];
+
+	snprintf(name, sizeof(name), "%s-%dx%d-q%d-n%d-dri%d",
+			bench_fourcc(frame->fmt->fourcc, s), frame->width,
+			frame->height, params->quality, params->noise, params->restart);
+
+	serial = tinyjpeg_init();
+	parallel = tinyjpeg_init();
+	pool = v4lconvert_pool_create(threads);
+	if (!ref || !dest || !serial || !parallel || !pool) {
+		printf("%-40s out of memory\n", name);
+		mismatches++;
+		goto leave;
+	}
+	tinyjpeg_set_pool(parallel, pool);
+
+	if (bench_tinyjpeg_decode(serial, frame, ref)) {
+		printf("%-40s serial failed: %s\n", name,
+				tinyjpeg_get_errorstring(serial));
+		mismatches++;
+		goto leave;
+	}
+	/* Poison it, as a decoder falling behind would leave the samples of
+	   the previous frame otherwise */
+	memset(dest, 0x5a, size);
+	if (bench_tinyjpeg_decode(parallel, frame, dest)) {
+		printf("%-40s %d threads failed: %s\n", name, threads,
+				tinyjpeg_get_errorstring(parallel));
+		mismatches++;
+		goto leave;
+	}
+
+	printf("%-40s %d threads  %08x\n", name, threads,
+			bench_checksum(dest, size));
+	/* Only the parallel decoding allocates intervals_buf, without it the
+	   frame went to the serial decoder */
+	if (!parallel->intervals_buf) {
+		printf("  NOT DECODED IN PARALLEL\n");
+		mismatches++;
+	} else if (memcmp(dest, ref, size)) {
+		printf("  MISMATCH, serial %08x\n", bench_checksum(ref, size));
+		mismatches++;
+	}
+
+leave:
+	if (serial) {
+		tinyjpeg_set_components(serial, comps, 3);
+		tinyjpeg_free(serial);
+	}
+	if (parallel) {
+		tinyjpeg_set_components(parallel, comps, 3);
+		tinyjpeg_free(parallel);
+	}
+	if (pool)
+		v4lconvert_pool_destroy(pool);
+	free(ref);
+	free(dest);
+}
+
+/* Run test on jpeg frames of each size with each of params */
+static void bench_jpeg_frames(int sizes[][2], int size_count,
+		const struct bench_jpeg_params *params, int param_count,
+		void (*test)(const struct bench_frame *frame,
+			const struct bench_jpeg_params *params))
+{
+	int i, j;
+
+	v4lconvert_cpu_init();
+
+	for (i = 0; i < size_count; i++)
+		for (j = 0; j < param_count; j++) {
+			/* yuv420p output needs whole MCUs */
+			struct bench_frame frame = {
+				.fmt = bench_find_fmt(V4L2_PIX_FMT_MJPEG),
+				.width = sizes[i][0] & ~15,
+				.height = sizes[i][1] & ~15,
+			};
+
+			if (!frame.width || !frame.height)
+				continue;
+			if (bench_gen_jpeg(&frame, params[j].quality, params[j].noise,
+					params[j].restart)) {
+				printf("generating a %dx%d jpeg failed\n", frame.width,
+						frame.height);
+				mismatches++;
+				continue;
+			}
+			test(&frame, &params[j]);
+			free(frame.data);
+		}
+}
+#endif
+
+static int bench_load_golden(const char *filename)
+{
+	char line[512], name[128];
+	unsigned int checksum;
+	FILE *f;
+
+	f = fopen(filename, "r");
+	if (!f) {
+		fprintf(stderr, "opening %s: %s\n", filename, strerror(errno));
+		return -1;
+	}
+
+	/* The checksum is the last field of the bench output lines */
+	while (fgets(line, sizeof(line), f)) {
+		char *s = strrchr(line, ' ');
+
+		if (!s || sscanf(line, "%127s", name) != 1 ||
+				sscanf(s, "%x", &checksum) != 1 || !strchr(line, '/'))
+			continue;
+
+		golden = realloc(golden, (golden_count + 1) * sizeof(*golden));
+		if (!golden) {
+			fclose(f);
+			return -1;
+		}
+		strcpy(golden[golden_count].name, name);
+		golden[golden_count].checksum = checksum;
+		golden_count++;
+	}
+	fclose(f);
+
+	return 0;
+}
+
+/* libv4lcontrol keeps the controls in a shm segment named after the device */
+static void bench_unlink_controls(void)
+{
+	struct passwd *pwd = getpwuid(geteuid());
+	char name[256];
+
+	snprintf(name, sizeof(name), "/libv4l-%s:bench-%d:v4lconvert-bench",
+			pwd ? pwd->pw_name : "", (int)getpid());
+	shm_unlink(name);
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench_frame recorded[BENCH_MAX_RECORDED];
+	int sizes[BENCH_MAX_SIZES][2] = {
+		{ 640, 480 }, { 1920, 1080 }, { 3840, 2160 }
+	};
+	int size_count = 3, recorded_count = 0;
+	const char *formats = NULL;
+	int i, j, opt, idct_check = 0, jpeg_speed = 0, decoder_check = 0;
+	int restart_check = 0;
+	const char *env;
+
+	while ((opt = getopt(argc, argv, "s:f:t:r:c:ijdmp")) != -1) {
+		switch (opt) {
+		case 's': {
+			char *s = optarg;
+
+			for (size_count = 0; size_count < BENCH_MAX_SIZES && s;
+					size_count++) {
+				if (sscanf(s, "%dx%d", &sizes[size_count][0],
+						&sizes[size_count][1]) != 2)
+					break;
+				/* The yuv 4:2:0 frames need whole chroma samples, and
+				   BENCH_CROP takes 6 columns off */
+				if (sizes[size_count][0] < 16 || sizes[size_count][1] < 16 ||
+						sizes[size_count][0] % 2 ||
+						sizes[size_count][1] % 2) {
+					fprintf(stderr, "frame sizes must be even and at "
+							"least 16x16: %s\n", s);
+					return 2;
+				}
+				s = strchr(s, ',');
+				if (s)
+					s++;
+			}
+			break;
+		}
+		case 'f':
+			formats = optarg;
+			break;
+		case 't':
+			min_time = atof(optarg);
+			break;
+		case 'r':
+			if (recorded_count == BENCH_MAX_RECORDED ||
+					bench_load_frame(&recorded[recorded_count], optarg))
+				return 2;
+			recorded_count++;
+			break;
+		case 'c':
+			if (bench_load_golden(optarg))
+				return 2;
+			break;
+		case 'i':
+			idct_check = 1;
+			break;
+		case 'j':
+			jpeg_speed = 1;
+			break;
+		case 'd':
+			decoder_check = 1;
+			break;
+		case 'm':
+			restart_check = 1;
+			break;
+		case 'p':
+			thread_sweep = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-s WxH[,WxH...]] [-f FOURCC[,...]] "
+					"[-t seconds] [-r FOURCC:WxH:file]... [-c golden] "
+					"[-i] [-j] [-d] [-m] [-p]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if (decoder_check) {
+		struct v4lconvert_data *data;
+
+		data = v4lconvert_create_with_dev_ops(-1, NULL, &bench_dev_ops);
+		if (!data) {
+			fprintf(stderr, "creating v4lconvert data failed\n");
+			return 2;
+		}
+		for (i = 0; i < ARRAY_SIZE(bench_decoders); i++)
+			bench_decoder_check(data, &bench_decoders[i]);
+		v4lconvert_destroy(data);
+		bench_unlink_controls();
+
+		if (mismatches) {
+			printf("%d decoder checks failed\n", mismatches);
+			return 1;
+		}
+		return 0;
+	}
+
+	env = getenv("LIBV4LCONVERT_THREADS");
+	if (restart_check && env) {
+		threads = atoi(env);
+		if (threads < 2 || threads > V4LCONVERT_MAX_THREADS) {
+			fprintf(stderr, "LIBV4LCONVERT_THREADS must be 2 - %d\n",
+					V4LCONVERT_MAX_THREADS);
+			return 2;
+		}
+	}
+
+	if (idct_check || jpeg_speed || restart_check) {
+#ifdef HAVE_JPEG
+		if (jpeg_speed)
+			bench_jpeg_frames(sizes, size_count, bench_jpeg_corpus,
+					ARRAY_SIZE(bench_jpeg_corpus), bench_jpeg_speed);
+		if (idct_check)
+			bench_jpeg_frames(sizes, size_count, bench_idct_corpus,
+					ARRAY_SIZE(bench_idct_corpus), bench_idct_accuracy);
+		if (restart_check)
+			bench_jpeg_frames(sizes, size_count, bench_restart_corpus,
+					ARRAY_SIZE(bench_restart_corpus), bench_restart_check);
+		if (mismatches) {
+			printf("%d jpeg checks failed\n", mismatches);
+			return 1;
+		}
+		return 0;
+#else
+		fprintf(stderr, "-i, -j and -m need libjpeg to encode their "
+				"frames\n");
+		return 2;
+#endif
+	}
+
+	/* Enable the whitebalance, flip, gamma and rotate fake controls, as our
+	   fake device has no controls of its own */
+	setenv("LIBV4LCONTROL_CONTROLS", "0x8f", 0);
+
+	for (i = 0; i < ARRAY_SIZE(src_fmts); i++) {
+		char s[8];
+
+		if (formats && !bench_fourcc_listed(formats, src_fmts[i].fourcc))
+			continue;
+
+		for (j = 0; j < size_count; j++) {
+			struct bench_frame frame = {
+				.fmt = &src_fmts[i],
+				.width = sizes[j][0],
+				.height = sizes[j][1],
+			};
+
+			if (!bench_size_supported(frame.fmt, frame.width,
+						frame.height)) {
+				printf("%-40s skipped, %dx%d is not supported\n",
+						bench_fourcc(src_fmts[i].fourcc, s), frame.width,
+						frame.height);
+				continue;
+			}
+			if (bench_gen_frame(&frame)) {
+				if (j == 0)
+					printf("%-40s skipped, needs a recorded frame (-r)\n",
+							bench_fourcc(src_fmts[i].fourcc, s));
+				continue;
+			}
+			bench_frame(&frame);
+			free(frame.data);
+		}
+	}
+
+	for (i = 0; i < recorded_count; i++) {
+		bench_frame(&recorded[i]);
+		free(recorded[i].data);
+	}
+
+	bench_unlink_controls();
+	free(golden);
+
+	if (mismatches) {
+		printf("%d checksum mismatches\n", mismatches);
+		return 1;
+	}
+
+	return 0;
+}